@@ -503,7 +503,11 @@ void MainWindow::RefreshFiles() {
     SendMessage(hListFiles, LB_RESETCONTENT, 0, 0);
     files.clear();
     
-    auto fileList = metadataClient->ListFiles();
+    std::vector<std::pair<std::string, uint64_t>> fileList;
+    if (!metadataClient->ListFiles("", fileList)) {
+        UpdateStatus("Failed to refresh file list");
+        return;
+    }
     
     for (const auto& file : fileList) {
         FileInfo info;
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Локальный кэш чанков на диске.
+// Идентификатор чанка - SHA-256 его содержимого, поэтому инвалидация не
+// нужна: чанк с тем же id всегда содержит те же байты. Файлы раскладываются
+// по подкаталогам <dir>/ab/cd/<chunkId>, вытеснение - LRU по объёму.
+class ChunkCache {
+private:
+  struct Entry {
+    uint64_t size;
+    std::list<std::string>::iterator lruPosition;
+  };
+
+  std::string cacheDir;
+  uint64_t capacityBytes;
+  uint64_t usedBytes;
+
+  // LRU: в начале списка - последние использованные чанки
+  std::list<std::string> lru;
+  std::unordered_map<std::string, Entry> entries;
+  mutable std::mutex cacheMutex;
+
+  // Статистика
+  size_t hits;
+  size_t misses;
+  size_t stores;
+  size_t evictions;
+
+public:
+  struct Stats {
+    size_t hits;
+    size_t misses;
+    size_t stores;
+    size_t evictions;
+    size_t entryCount;
+    uint64_t usedBytes;
+    uint64_t capacityBytes;
+  };
+
+  ChunkCache(const std::string &cacheDir, uint64_t capacityBytes);
+
+  // Создание каталога и загрузка индекса уже закэшированных чанков
+  bool Initialize();
+
+  // Получение чанка (с проверкой хеша); false - промах
+  bool Get(const std::string &chunkId, std::vector<uint8_t> &data);
+
+  // Сохранение проверенного чанка
+  bool Put(const std::string &chunkId, const std::vector<uint8_t> &data);
+
+  Stats GetStats() const;
+
+private:
+  // Внутренние методы
+  static bool IsValidChunkId(const std::string &chunkId);
+  std::string GetChunkPath(const std::string &chunkId) const;
+  void Touch(const std::string &chunkId);
+  void Remove(const std::string &chunkId);
+  void EvictLocked(std::vector<std::string> &evicted);
+};
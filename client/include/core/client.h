@@ -1,5 +1,6 @@
 #pragma once
 
+#include "core/chunk_cache.h"
 #include "core/download_manager.h"
 #include "core/metadata_client.h"
 #include "core/upload_manager.h"
@@ -12,16 +13,26 @@ private:
   std::unique_ptr<MetadataClient> metadataClient;
   std::unique_ptr<UploadManager> uploadManager;
   std::unique_ptr<DownloadManager> downloadManager;
+  std::unique_ptr<ChunkCache> chunkCache;
 
-  std::string serverIp;
-  int serverPort;
+  std::vector<MetadataEndpoint> endpoints; // Основной и резервные серверы
+
+  // Настройки
+  bool verbose;
+  std::string cacheDir; // Пусто - кэш чанков отключён
+  uint64_t cacheSizeBytes;
 
 public:
   Client();
   ~Client();
 
+  // Настройка (до Initialize)
+  void SetVerbose(bool verbose) { this->verbose = verbose; }
+  void SetChunkCache(const std::string &dir, uint64_t sizeBytes);
+
   // Инициализация
   bool Initialize(const std::string &serverIp, int serverPort);
+  bool Initialize(const std::vector<MetadataEndpoint> &endpoints);
   void Shutdown();
 
   // Обработка команд
@@ -29,6 +40,7 @@ public:
   bool HandleUpload(const std::vector<std::string> &args);
   bool HandleDownload(const std::vector<std::string> &args);
   bool HandleList(const std::vector<std::string> &args);
+  bool HandleDelete(const std::vector<std::string> &args);
   bool HandleHelp(const std::vector<std::string> &args);
 
   // Утилиты
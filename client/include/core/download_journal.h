@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Журнал возобновляемого скачивания.
+// Данные пишутся в предвыделенный <path>.part по смещениям чанков, рядом
+// хранится <path>.part.journal с битовой картой проверенных чанков,
+// отпечатком манифеста и контрольной суммой. Повторный запуск download
+// докачивает только недостающие чанки.
+class DownloadJournal {
+private:
+  std::string localPath;
+  std::string partPath;
+  std::string journalPath;
+
+  std::string manifestDigest; // Идентичность версии файла на сервере
+  uint64_t totalSize;
+  std::vector<bool> completed; // Битовая карта проверенных чанков
+  size_t completedCount;
+
+  // .part остался без валидного журнала - чанки проверяются по хешу
+  bool verifyExisting;
+
+  std::fstream partFile;
+
+  static constexpr const char *JOURNAL_MAGIC = "COURSESTORE_DOWNLOAD_JOURNAL";
+  static constexpr int JOURNAL_VERSION = 1;
+
+public:
+  explicit DownloadJournal(const std::string &localPath);
+  ~DownloadJournal();
+
+  // Открытие (или продолжение) скачивания файла с данным манифестом
+  bool Open(const std::string &manifestDigest, uint64_t totalSize,
+            size_t chunkCount);
+
+  bool IsCompleted(size_t chunkIndex) const;
+  size_t GetCompletedCount() const { return completedCount; }
+
+  // Ленивая проверка чанка, уже лежащего в .part (без валидного журнала)
+  bool VerifyExistingChunk(size_t chunkIndex, uint64_t offset, size_t size,
+                           const std::string &chunkId);
+
+  // Запись проверенного чанка и отметка в журнале
+  bool WriteChunk(size_t chunkIndex, uint64_t offset,
+                  const std::vector<uint8_t> &data);
+
+  // Переименование .part в итоговый файл и удаление журнала
+  bool Finish();
+
+private:
+  bool LoadJournal();
+  bool SaveJournal();
+  void MarkCompleted(size_t chunkIndex);
+};
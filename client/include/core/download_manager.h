@@ -1,10 +1,13 @@
 #pragma once
 
+#include "core/chunk_cache.h"
 #include "core/chunk_processor.h"
 #include "core/metadata_client.h"
 #include "core/node_client.h"
+#include "core/node_stats.h"
 #include <cstdint>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -16,6 +19,14 @@ private:
   NodeClient nodeClient;
   ChunkProcessor chunkProcessor;
 
+  // Статистика узлов: выбор реплик и пороги hedged-чтения (разделяется с
+  // фоновыми запросами, которые могут пережить TryDownloadFromNodes)
+  std::shared_ptr<NodeStats> nodeStats;
+
+  // Локальный кэш чанков (может отсутствовать)
+  ChunkCache *chunkCache;
+  bool verbose;
+
   // Callback для прогресса
   std::function<void(size_t, size_t)> progressCallback;
 
@@ -27,14 +38,15 @@ private:
 public:
   DownloadManager(MetadataClient *metadataClient);
 
-  // Главный метод скачивания
+  // Главный метод скачивания (возобновляемый: см. DownloadJournal)
   bool DownloadFile(const std::string &remoteFilename,
                    const std::string &localPath);
 
   // Скачивание одного чанка
   bool DownloadChunk(const FileMetadata::ChunkInfo &chunkInfo, Chunk &chunk);
 
-  // Попытка скачать с узлов
+  // Попытка скачать с узлов: реплики упорядочены power-of-two-choices,
+  // если реплика не ответила за p95, запрос дублируется на следующую
   bool TryDownloadFromNodes(const std::string &chunkId,
                            const std::vector<std::string> &nodeIds,
                            Chunk &chunk);
@@ -42,9 +54,18 @@ public:
   // Настройка прогресса
   void SetProgressCallback(std::function<void(size_t, size_t)> callback);
 
+  // Настройка кэша и подробного вывода
+  void SetChunkCache(ChunkCache *cache) { chunkCache = cache; }
+  void SetVerbose(bool verbose) { this->verbose = verbose; }
+
 private:
   // Внутренние методы
   void ReportProgress(size_t current, size_t total);
+  bool FetchChunk(const FileMetadata::ChunkInfo &chunkInfo, Chunk &chunk);
+  void PrintCacheStats();
+  std::string
+  GetManifestDigest(const FileMetadata &metadata,
+                    const std::vector<FileMetadata::ChunkInfo> &chunkInfos);
   StorageNodeInfo GetNodeInfo(const std::string &nodeId,
                              const FileMetadata &metadata);
 };
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "chunk_processor.h"
+#include "node_stats.h"
+#include "shard_map.h"
 
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -23,6 +26,7 @@ struct StorageNodeInfo {
   std::string ipAddress;
   int port;
   uint64_t freeSpace;
+  std::string failureDomain; // "zone/rack/host"; пусто - неизвестен
 };
 
 struct FileMetadata {
@@ -39,6 +43,20 @@ struct FileMetadata {
   std::vector<ChunkInfo> chunks;
 };
 
+// План загрузки, выданный Metadata Server
+struct UploadPlan {
+  std::string sessionId;
+  std::vector<StorageNodeInfo> nodes; // Узлы плана, затем запасные
+  // Чанк -> индексы в nodes (пусто, если сервер не прислал план)
+  std::vector<std::vector<size_t>> chunkPlacement;
+};
+
+// Адрес сервера метаданных (основного или резервного)
+struct MetadataEndpoint {
+  std::string ip;
+  int port;
+};
+
 // Структура для хранения полной информации об узле (для кэша)
 struct NodeInfoCache {
   std::string nodeId;
@@ -49,13 +67,34 @@ struct NodeInfoCache {
 
 class MetadataClient {
 private:
-  std::string serverIp;
-  int serverPort;
+  // Серверы метаданных; при нескольких основной находится запросом ROLE и
+  // ищется заново, когда перестаёт отвечать или отвечает NOT_PRIMARY
+  std::vector<MetadataEndpoint> endpoints;
+  size_t activeEndpoint; // NO_ENDPOINT - основной ещё не найден
   // Кэш информации об узлах (nodeId -> NodeInfoCache)
   std::unordered_map<std::string, NodeInfoCache> nodeCache;
+  // Статистика узлов, общая для всех менеджеров этого клиента
+  std::shared_ptr<NodeStats> nodeStats;
+
+  // Шардирование пространства имён: карта запрашивается у сервера
+  // (GET_SHARD_MAP), запросы по имени файла идут клиенту его шарда. Пусто -
+  // сервер не шардирован, запросы выполняет этот клиент
+  ShardMap shardMap;
+  std::vector<std::unique_ptr<MetadataClient>> shardClients;
+  bool shardMapLoaded;
+  bool shardMapStale; // Ответ WRONG_SHARD: карта устарела
+  bool isShardClient; // Клиент одного шарда, сам карту не запрашивает
+
+  static constexpr size_t NO_ENDPOINT = static_cast<size_t>(-1);
+  // Сколько ждать повышения резервного при недоступном основном
+  static constexpr int FAILOVER_WAIT_SEC = 30;
+  static constexpr int FAILOVER_RETRY_MS = 250;
+  static constexpr int ROLE_TIMEOUT_SEC = 2;
+  static constexpr size_t LIST_FILES_PAGE = 1000; // Файлов в ответе LIST_FILES
 
 public:
   MetadataClient(const std::string &ip, int port);
+  explicit MetadataClient(const std::vector<MetadataEndpoint> &endpoints);
   ~MetadataClient();
 
   // Базовые методы
@@ -64,26 +103,57 @@ public:
   bool ReceiveResponse(SOCKET socket, std::string &response);
 
   // Загрузка
-  std::vector<StorageNodeInfo> RequestUploadNodes(const std::string &filename,
-                                                   uint64_t fileSize);
+  bool RequestUpload(const std::string &filename, uint64_t fileSize,
+                     UploadPlan &plan);
+  bool ResumeUpload(const std::string &filename, const std::string &sessionId,
+                    UploadPlan &plan);
+  std::vector<StorageNodeInfo>
+  RequestUploadNodes(const std::string &filename, uint64_t fileSize,
+                     std::string *sessionId = nullptr);
   bool NotifyUploadComplete(
       const std::string &filename,
       const std::vector<Chunk> &chunks,
-      const std::vector<std::vector<std::string>> &chunkNodeIds);
+      const std::vector<std::vector<std::string>> &chunkNodeIds,
+      const std::string &sessionId = "");
 
-  // Скачивание и список
+  // Скачивание, удаление и список
   FileMetadata RequestDownload(const std::string &filename);
-  std::vector<std::pair<std::string, uint64_t>> ListFiles();
+  bool DeleteFile(const std::string &filename);
+  // Все файлы с именем на prefix (по страницам), по возрастанию имён;
+  // false - страница или шард не получены, список неполон
+  bool ListFiles(const std::string &prefix,
+                 std::vector<std::pair<std::string, uint64_t>> &files);
   std::vector<StorageNodeInfo> ListNodes();
   bool TestConnection();
 
   // Получение информации об узле из кэша
   bool GetNodeInfo(const std::string &nodeId, StorageNodeInfo &nodeInfo);
 
+  // Статистика задержек, скорости и ошибок узлов
+  std::shared_ptr<NodeStats> GetNodeStats() const { return nodeStats; }
+
 private:
   // Внутренние методы
+  bool SendUploadRequest(const std::string &request, UploadPlan &plan);
+  // Чтение ответа целиком: сервер закрывает соединение после ответа
+  bool ReceiveAll(SOCKET socket, std::string &data);
+  // Страница LIST_FILES после имени after; nextCursor пуст на последней
+  bool ListFilesPage(const std::string &prefix, const std::string &after,
+                     std::vector<std::pair<std::string, uint64_t>> &files,
+                     std::string &nextCursor);
+  bool ConnectToEndpoint(const MetadataEndpoint &endpoint, SOCKET &socket);
+  bool IsPrimaryEndpoint(const MetadataEndpoint &endpoint);
+  bool FindPrimary();
+  // Ответ NOT_PRIMARY: основной сменился, при следующем запросе ищем заново.
+  // Ответ WRONG_SHARD: карта шардов сменилась, запрашиваем заново
+  void CheckNotPrimary(const std::string &responseLine);
+  bool LoadShardMap();
+  // Клиент шарда имени файла (this без шардирования)
+  MetadataClient *ShardFor(const std::string &filename);
   std::vector<std::string> ParseCommand(const std::string &command);
   std::vector<std::string> SplitLines(const std::string &text);
   StorageNodeInfo ParseNodeInfo(const std::vector<std::string> &args);
+  void CacheNodeAddress(const std::string &nodeId, const std::string &ip,
+                        int port);
 };
 
@@ -1,5 +1,10 @@
 #pragma once
 
+#include "core/node_stats.h"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -18,21 +23,48 @@ typedef int SOCKET;
 // Forward declaration
 struct StorageNodeInfo;
 
+// Отмена выполняющегося запроса к узлу (для hedged-чтения)
+// Cancel() может вызываться из другого потока: сокет закрывается на
+// чтение/запись, и заблокированный recv сразу возвращает ошибку
+class CancelToken {
+private:
+  std::mutex mutex;
+  SOCKET socket = INVALID_SOCKET;
+  bool cancelled = false;
+
+  friend class NodeClient;
+  bool Attach(SOCKET socket); // false, если запрос уже отменён
+  void Detach();
+
+public:
+  void Cancel();
+  bool IsCancelled();
+};
+
 class NodeClient {
+private:
+  // Статистика узлов (EWMA задержки, скорости и ошибок)
+  std::shared_ptr<NodeStats> stats;
+
 public:
-  NodeClient();
+  NodeClient(std::shared_ptr<NodeStats> stats = NodeStats::Shared());
   ~NodeClient();
 
   // Работа с чанками
   bool StoreChunk(const StorageNodeInfo &node, const std::string &chunkId,
                   const std::vector<uint8_t> &data);
   bool GetChunk(const StorageNodeInfo &node, const std::string &chunkId,
-                std::vector<uint8_t> &data);
+                std::vector<uint8_t> &data, CancelToken *cancel = nullptr);
   bool CheckChunk(const StorageNodeInfo &node, const std::string &chunkId);
 
 private:
   // Внутренние методы
   bool ConnectToNode(const StorageNodeInfo &node, SOCKET &socket);
+  bool SendChunk(const StorageNodeInfo &node, const std::string &chunkId,
+                 const std::vector<uint8_t> &data);
+  bool RequestChunk(const StorageNodeInfo &node, const std::string &chunkId,
+                    std::vector<uint8_t> &data, CancelToken *cancel,
+                    std::chrono::steady_clock::time_point &firstByteAt);
   bool SendBinaryData(SOCKET socket, const std::vector<uint8_t> &data);
   bool ReceiveBinaryData(SOCKET socket, std::vector<uint8_t> &data,
                         size_t size);
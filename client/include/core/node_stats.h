@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Статистика узлов хранения, накопленная клиентом: EWMA задержки,
+// пропускной способности и доли ошибок, плюс окно задержек чтения для p95.
+// Записи учитываются отдельно и не влияют на порог hedged-чтений.
+// Таблица общая для процесса (Shared()) и переживает отдельные скачивания.
+class NodeStats {
+private:
+  struct NodeEntry {
+    double latencyMs = 0; // EWMA времени до первого байта ответа
+    double throughputBps = 0; // EWMA скорости передачи данных
+    double writeBps = 0; // EWMA скорости записи (STORE_CHUNK целиком)
+    double errorRate = 0; // EWMA доли неудачных запросов
+    size_t samples = 0; // Количество учтённых запросов
+    size_t inFlight = 0; // Выполняющиеся сейчас запросы
+    std::chrono::steady_clock::time_point lastError;
+
+    // Окно полных задержек чтений для перцентилей, мс
+    std::vector<double> window;
+    size_t windowNext = 0;
+  };
+
+  std::unordered_map<std::string, NodeEntry> nodes;
+  mutable std::mutex statsMutex;
+
+  // Конфигурация
+  static constexpr double EWMA_ALPHA = 0.2;
+  static constexpr double ERROR_HALF_LIFE_SEC = 30.0; // Затухание ошибок
+  static constexpr double ERROR_PENALTY = 10.0; // Штраф стоимости за ошибки
+  static constexpr size_t WINDOW_SIZE = 64; // Последние N замеров на узел
+  static constexpr size_t MIN_SAMPLES = 8; // Минимум замеров для перцентиля
+  static constexpr double HEDGE_PERCENTILE = 0.95;
+  static constexpr int DEFAULT_HEDGE_DELAY_MS = 500;
+  static constexpr int MIN_HEDGE_DELAY_MS = 20;
+  static constexpr int MAX_HEDGE_DELAY_MS = 10000;
+
+public:
+  // Общая таблица процесса
+  static std::shared_ptr<NodeStats> Shared();
+
+  // Учёт запросов
+  void BeginRequest(const std::string &nodeId);
+  void EndRequest(const std::string &nodeId);
+  void RecordSuccess(const std::string &nodeId,
+                     std::chrono::microseconds firstByteLatency,
+                     std::chrono::microseconds totalLatency, size_t bytes);
+  // Запись чанка: время до первого байта у неё - лишь время соединения,
+  // поэтому учитывается только полное время
+  void RecordWrite(const std::string &nodeId,
+                   std::chrono::microseconds totalLatency, size_t bytes);
+  void RecordFailure(const std::string &nodeId);
+
+  // Перцентиль задержки в мс (-1, если замеров недостаточно)
+  double GetLatencyPercentile(const std::string &nodeId,
+                              double percentile) const;
+
+  // Сколько ждать ответа узла, прежде чем дублировать запрос на реплику
+  std::chrono::milliseconds GetHedgeDelay(const std::string &nodeId) const;
+
+  // Ожидаемая стоимость записи bytes байт на узел (меньше - лучше)
+  double GetExpectedWriteCost(const std::string &nodeId, size_t bytes) const;
+
+  // Порядок опроса реплик по принципу power-of-two-choices
+  std::vector<std::string>
+  OrderReplicas(const std::vector<std::string> &nodeIds, size_t bytes) const;
+
+private:
+  double CostLocked(const NodeEntry &entry, size_t bytes, bool write,
+                    std::chrono::steady_clock::time_point now) const;
+};
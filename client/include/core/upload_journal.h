@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Журнал возобновляемой загрузки (<local_path>.upload.journal).
+// Хранит сессию загрузки, выданную сервером, и для каждого чанка - его
+// хеш и узлы, подтвердившие запись. Строки только дописываются, поэтому
+// оборвана может быть лишь последняя строка (без перевода строки): при
+// чтении она отбрасывается, и журнал переписывается без неё, чтобы новые
+// строки не продолжили оборванную.
+class UploadJournal {
+public:
+  struct ChunkRecord {
+    std::string chunkId;
+    size_t size;
+    std::vector<std::string> nodeIds; // Узлы, подтвердившие запись
+  };
+
+private:
+  std::string journalPath;
+  std::string remoteFilename;
+  uint64_t fileSize;
+  std::string sessionId;
+  std::map<size_t, ChunkRecord> chunks; // index -> запись
+  // Запись не удалась: конец файла может быть оборван, следующая запись
+  // переписывает журнал целиком
+  bool damaged;
+
+  static constexpr const char *JOURNAL_MAGIC = "COURSESTORE_UPLOAD_JOURNAL";
+  static constexpr int JOURNAL_VERSION = 1;
+
+public:
+  explicit UploadJournal(const std::string &localPath);
+
+  // Открытие журнала для загрузки файла; журнал другой загрузки
+  // (другое имя или размер) отбрасывается
+  bool Open(const std::string &remoteFilename, uint64_t fileSize);
+
+  const std::string &GetSessionId() const { return sessionId; }
+  bool SetSessionId(const std::string &sessionId);
+
+  // Подтверждённая запись чанка с тем же содержимым, если есть
+  const ChunkRecord *FindChunk(size_t index,
+                               const std::string &chunkId) const;
+  size_t GetChunkCount() const { return chunks.size(); }
+
+  bool RecordChunk(size_t index, const std::string &chunkId, size_t size,
+                   const std::vector<std::string> &nodeIds);
+
+  // Удаление журнала после UPLOAD_COMPLETE
+  void Remove();
+
+private:
+  bool Load();
+  // Журнал целиком по текущему состоянию
+  bool Rewrite();
+  bool Append(const std::string &line);
+  static std::string FormatChunk(size_t index, const ChunkRecord &record);
+};
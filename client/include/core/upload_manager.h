@@ -6,6 +6,7 @@
 #include <cstdint>
 #include <functional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 class UploadManager {
@@ -16,6 +17,11 @@ private:
 
   // Конфигурация
   static const size_t REPLICATION_FACTOR = 2; // 2 копии каждого чанка
+  // После стольких ошибок подряд узел пропускается до конца загрузки
+  static const size_t CIRCUIT_BREAKER_THRESHOLD = 2;
+
+  // Ошибки подряд по узлам в текущей загрузке (circuit breaker)
+  std::unordered_map<std::string, size_t> nodeFailures;
 
   // Callback для прогресса
   std::function<void(size_t, size_t)> progressCallback;
@@ -23,19 +29,18 @@ private:
 public:
   UploadManager(MetadataClient *metadataClient);
 
-  // Главный метод загрузки
+  // Главный метод загрузки (возобновляемый: см. UploadJournal)
   bool UploadFile(const std::string &localPath,
                  const std::string &remoteFilename);
 
-  // Загрузка чанка с репликацией
-  bool UploadChunk(const Chunk &chunk,
-                  const std::vector<StorageNodeInfo> &nodes,
+  // Загрузка чанка с репликацией; неудачная запись реплики повторяется
+  // на следующем по качеству узле из списка кандидатов
+  bool UploadChunk(const Chunk &chunk, const UploadPlan &plan,
                   std::vector<std::string> &uploadedNodeIds);
 
-  // Выбор узлов для чанка
-  std::vector<StorageNodeInfo>
-  SelectNodesForChunk(const std::vector<StorageNodeInfo> &nodes,
-                     size_t chunkIndex);
+  // Выбор узлов для чанка: по плану сервера, иначе round-robin
+  std::vector<StorageNodeInfo> SelectNodesForChunk(const UploadPlan &plan,
+                                                   size_t chunkIndex);
 
   // Настройка прогресса
   void SetProgressCallback(std::function<void(size_t, size_t)> callback);
@@ -43,5 +48,7 @@ public:
 private:
   // Внутренние методы
   void ReportProgress(size_t current, size_t total);
+  bool IsCircuitOpen(const std::string &nodeId) const;
+  void RecordNodeResult(const std::string &nodeId, bool success);
 };
 
@@ -0,0 +1,253 @@
+#include "core/chunk_cache.h"
+
+#include "hash_utils.h"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+namespace fs = std::filesystem;
+
+ChunkCache::ChunkCache(const std::string &cacheDir, uint64_t capacityBytes)
+    : cacheDir(cacheDir), capacityBytes(capacityBytes), usedBytes(0),
+      hits(0), misses(0), stores(0), evictions(0) {}
+
+// Идентификатор чанка - 64 hex-символа (защищает и от выхода за каталог)
+bool ChunkCache::IsValidChunkId(const std::string &chunkId) {
+  return chunkId.length() == 64 &&
+         std::all_of(chunkId.begin(), chunkId.end(), [](char c) {
+           return std::isxdigit(static_cast<unsigned char>(c)) != 0;
+         });
+}
+
+// Путь к файлу чанка: <dir>/ab/cd/<chunkId>
+std::string ChunkCache::GetChunkPath(const std::string &chunkId) const {
+  return (fs::path(cacheDir) / chunkId.substr(0, 2) / chunkId.substr(2, 2) /
+          chunkId)
+      .string();
+}
+
+// Создание каталога и загрузка индекса
+bool ChunkCache::Initialize() {
+  std::error_code ec;
+  fs::create_directories(cacheDir, ec);
+  if (ec) {
+    std::cerr << "Error: Failed to create chunk cache directory: " << cacheDir
+              << std::endl;
+    return false;
+  }
+
+  struct FoundChunk {
+    std::string chunkId;
+    uint64_t size;
+    fs::file_time_type lastUsed;
+  };
+  std::vector<FoundChunk> found;
+
+  for (auto it = fs::recursive_directory_iterator(cacheDir, ec);
+       !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+    if (!it->is_regular_file(ec)) {
+      continue;
+    }
+
+    std::string name = it->path().filename().string();
+    if (!IsValidChunkId(name)) {
+      // Остатки прерванной записи
+      if (it->path().extension() == ".tmp") {
+        fs::remove(it->path(), ec);
+      }
+      continue;
+    }
+
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    FoundChunk chunk;
+    chunk.chunkId = name;
+    chunk.size = it->file_size(ec);
+    chunk.lastUsed = it->last_write_time(ec);
+    found.push_back(chunk);
+  }
+
+  // Время изменения файла служит отметкой последнего использования
+  std::sort(found.begin(), found.end(),
+            [](const FoundChunk &a, const FoundChunk &b) {
+              return a.lastUsed > b.lastUsed;
+            });
+
+  std::vector<std::string> evicted;
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    for (const auto &chunk : found) {
+      lru.push_back(chunk.chunkId);
+      entries[chunk.chunkId] = Entry{chunk.size, std::prev(lru.end())};
+      usedBytes += chunk.size;
+    }
+    EvictLocked(evicted);
+  }
+
+  for (const auto &chunkId : evicted) {
+    fs::remove(GetChunkPath(chunkId), ec);
+  }
+
+  return true;
+}
+
+// Получение чанка из кэша
+bool ChunkCache::Get(const std::string &chunkId, std::vector<uint8_t> &data) {
+  std::string key = chunkId;
+  std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (entries.find(key) == entries.end()) {
+      misses++;
+      return false;
+    }
+  }
+
+  std::ifstream file(GetChunkPath(key), std::ios::binary);
+  bool valid = file.is_open();
+  if (valid) {
+    data.assign(std::istreambuf_iterator<char>(file),
+                std::istreambuf_iterator<char>());
+    file.close();
+    valid = HashUtils::VerifyHash(data, key);
+  }
+
+  if (!valid) {
+    // Файл пропал или повреждён - забываем о нём
+    Remove(key);
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    misses++;
+    return false;
+  }
+
+  Touch(key);
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  hits++;
+  return true;
+}
+
+// Сохранение чанка в кэш
+bool ChunkCache::Put(const std::string &chunkId,
+                     const std::vector<uint8_t> &data) {
+  if (!IsValidChunkId(chunkId) || data.size() > capacityBytes) {
+    return false;
+  }
+
+  std::string key = chunkId;
+  std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (entries.find(key) != entries.end()) {
+      return true;
+    }
+  }
+
+  // Запись через временный файл, чтобы прерванная запись не оставила
+  // обрезанный чанк под настоящим именем
+  std::string path = GetChunkPath(key);
+  std::string tmpPath = path + ".tmp";
+  std::error_code ec;
+  fs::create_directories(fs::path(path).parent_path(), ec);
+
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      return false;
+    }
+    file.write(reinterpret_cast<const char *>(data.data()),
+               static_cast<std::streamsize>(data.size()));
+    if (!file.good()) {
+      file.close();
+      fs::remove(tmpPath, ec);
+      return false;
+    }
+  }
+
+  fs::rename(tmpPath, path, ec);
+  if (ec) {
+    fs::remove(tmpPath, ec);
+    return false;
+  }
+
+  std::vector<std::string> evicted;
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    if (entries.find(key) == entries.end()) {
+      lru.push_front(key);
+      entries[key] = Entry{data.size(), lru.begin()};
+      usedBytes += data.size();
+      stores++;
+    }
+    EvictLocked(evicted);
+  }
+
+  for (const auto &evictedId : evicted) {
+    fs::remove(GetChunkPath(evictedId), ec);
+  }
+
+  return true;
+}
+
+// Отметка использования (и в памяти, и во времени изменения файла)
+void ChunkCache::Touch(const std::string &chunkId) {
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto it = entries.find(chunkId);
+    if (it == entries.end()) {
+      return;
+    }
+    lru.splice(lru.begin(), lru, it->second.lruPosition);
+  }
+
+  std::error_code ec;
+  fs::last_write_time(GetChunkPath(chunkId), fs::file_time_type::clock::now(),
+                      ec);
+}
+
+// Удаление чанка из кэша
+void ChunkCache::Remove(const std::string &chunkId) {
+  {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    auto it = entries.find(chunkId);
+    if (it != entries.end()) {
+      usedBytes -= it->second.size;
+      lru.erase(it->second.lruPosition);
+      entries.erase(it);
+    }
+  }
+
+  std::error_code ec;
+  fs::remove(GetChunkPath(chunkId), ec);
+}
+
+// Вытеснение давно не использованных чанков (файлы удаляет вызывающий)
+void ChunkCache::EvictLocked(std::vector<std::string> &evicted) {
+  while (usedBytes > capacityBytes && !lru.empty()) {
+    std::string chunkId = lru.back();
+    auto it = entries.find(chunkId);
+    if (it != entries.end()) {
+      usedBytes -= it->second.size;
+      entries.erase(it);
+    }
+    lru.pop_back();
+    evicted.push_back(chunkId);
+    evictions++;
+  }
+}
+
+// Статистика
+ChunkCache::Stats ChunkCache::GetStats() const {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  Stats stats;
+  stats.hits = hits;
+  stats.misses = misses;
+  stats.stores = stores;
+  stats.evictions = evictions;
+  stats.entryCount = entries.size();
+  stats.usedBytes = usedBytes;
+  stats.capacityBytes = capacityBytes;
+  return stats;
+}
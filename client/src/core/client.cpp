@@ -2,31 +2,64 @@
 
 #include <iostream>
 
-Client::Client() : serverPort(0) {}
+Client::Client()
+    : verbose(false), cacheSizeBytes(0) {}
 
 Client::~Client() { Shutdown(); }
 
+// Настройка локального кэша чанков
+void Client::SetChunkCache(const std::string &dir, uint64_t sizeBytes) {
+  cacheDir = dir;
+  cacheSizeBytes = sizeBytes;
+}
+
 // Инициализация клиента
 bool Client::Initialize(const std::string &serverIp, int serverPort) {
-  this->serverIp = serverIp;
-  this->serverPort = serverPort;
+  return Initialize(std::vector<MetadataEndpoint>{{serverIp, serverPort}});
+}
+
+// Инициализация клиента со списком серверов метаданных
+bool Client::Initialize(const std::vector<MetadataEndpoint> &endpoints) {
+  this->endpoints = endpoints;
+
+  std::string addresses;
+  for (const auto &endpoint : endpoints) {
+    if (!addresses.empty()) {
+      addresses += ", ";
+    }
+    addresses += endpoint.ip + ":" + std::to_string(endpoint.port);
+  }
 
   // Создание MetadataClient
-  metadataClient = std::make_unique<MetadataClient>(serverIp, serverPort);
+  metadataClient = std::make_unique<MetadataClient>(endpoints);
 
   // Проверка подключения к Metadata Server
   if (!metadataClient->TestConnection()) {
-    PrintError("Failed to connect to metadata server at " + serverIp + ":" +
-               std::to_string(serverPort));
+    PrintError("Failed to connect to metadata server at " + addresses);
     return false;
   }
 
-  PrintInfo("Connected to metadata server at " + serverIp + ":" +
-            std::to_string(serverPort));
+  PrintInfo("Connected to metadata server at " + addresses);
 
   // Создание UploadManager и DownloadManager
   uploadManager = std::make_unique<UploadManager>(metadataClient.get());
   downloadManager = std::make_unique<DownloadManager>(metadataClient.get());
+  downloadManager->SetVerbose(verbose);
+
+  // Локальный кэш чанков
+  if (!cacheDir.empty()) {
+    chunkCache = std::make_unique<ChunkCache>(cacheDir, cacheSizeBytes);
+    if (chunkCache->Initialize()) {
+      downloadManager->SetChunkCache(chunkCache.get());
+      if (verbose) {
+        PrintInfo("Chunk cache: " + cacheDir + " (" +
+                  std::to_string(cacheSizeBytes / (1024 * 1024)) + " MB)");
+      }
+    } else {
+      PrintError("Chunk cache disabled: cannot use " + cacheDir);
+      chunkCache.reset();
+    }
+  }
 
   return true;
 }
@@ -35,6 +68,7 @@ bool Client::Initialize(const std::string &serverIp, int serverPort) {
 void Client::Shutdown() {
   downloadManager.reset();
   uploadManager.reset();
+  chunkCache.reset();
   metadataClient.reset();
 }
 
@@ -53,6 +87,8 @@ bool Client::ExecuteCommand(const std::vector<std::string> &args) {
     return HandleDownload(args);
   } else if (command == "list") {
     return HandleList(args);
+  } else if (command == "delete") {
+    return HandleDelete(args);
   } else if (command == "help" || command == "--help" || command == "-h") {
     return HandleHelp(args);
   } else {
@@ -108,7 +144,13 @@ bool Client::HandleDownload(const std::vector<std::string> &args) {
 bool Client::HandleList(const std::vector<std::string> &args) {
   PrintInfo("Requesting file list from server...");
 
-  auto files = metadataClient->ListFiles();
+  // list [prefix] - только файлы с именем на prefix
+  std::string prefix = args.size() >= 2 ? args[1] : "";
+  std::vector<std::pair<std::string, uint64_t>> files;
+  if (!metadataClient->ListFiles(prefix, files)) {
+    PrintError("Failed to get file list");
+    return false;
+  }
 
   if (files.empty()) {
     PrintInfo("No files found");
@@ -126,6 +168,25 @@ bool Client::HandleList(const std::vector<std::string> &args) {
   return true;
 }
 
+// Обработка команды delete
+bool Client::HandleDelete(const std::vector<std::string> &args) {
+  if (args.size() < 2) {
+    PrintError("Usage: delete <remote_filename>");
+    return false;
+  }
+
+  std::string remoteFilename = args[1];
+  PrintInfo("Deleting file: " + remoteFilename);
+
+  if (!metadataClient->DeleteFile(remoteFilename)) {
+    PrintError("Failed to delete file");
+    return false;
+  }
+
+  PrintInfo("File deleted successfully");
+  return true;
+}
+
 // Обработка команды help
 bool Client::HandleHelp(const std::vector<std::string> &args) {
   PrintUsage();
@@ -140,11 +201,17 @@ void Client::PrintUsage() {
             << std::endl;
   std::cout << "  download <remote_filename> <local_path>  - Download a file"
             << std::endl;
-  std::cout << "  list  - List all files in storage" << std::endl;
+  std::cout << "  delete <remote_filename>  - Delete a file" << std::endl;
+  std::cout << "  list [prefix]  - List files in storage (optionally by name "
+               "prefix)"
+            << std::endl;
   std::cout << "  help  - Show this help message" << std::endl;
   std::cout << "\nOptions:" << std::endl;
   std::cout << "  --server <ip>  - Metadata server IP address" << std::endl;
   std::cout << "  --port <port>  - Metadata server port" << std::endl;
+  std::cout << "  --cache-dir <dir>  - Local chunk cache directory" << std::endl;
+  std::cout << "  --cache-size <mb>  - Chunk cache size in MB (default 1024)"
+            << std::endl;
   std::cout << "  --verbose      - Verbose output" << std::endl;
   std::cout << "  --quiet        - Quiet output" << std::endl;
   std::cout << std::endl;
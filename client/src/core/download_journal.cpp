@@ -0,0 +1,250 @@
+#include "core/download_journal.h"
+
+#include "hash_utils.h"
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Битовая карта в hex (4 чанка на символ)
+std::string EncodeBitmap(const std::vector<bool> &bits) {
+  static const char *digits = "0123456789abcdef";
+  std::string hex((bits.size() + 3) / 4, '0');
+  for (size_t i = 0; i < bits.size(); ++i) {
+    if (bits[i]) {
+      size_t pos = i / 4;
+      int value = (hex[pos] >= 'a') ? hex[pos] - 'a' + 10 : hex[pos] - '0';
+      value |= 1 << (i % 4);
+      hex[pos] = digits[value];
+    }
+  }
+  return hex;
+}
+
+bool DecodeBitmap(const std::string &hex, std::vector<bool> &bits) {
+  if (hex.length() != (bits.size() + 3) / 4) {
+    return false;
+  }
+  for (size_t i = 0; i < bits.size(); ++i) {
+    char c = hex[i / 4];
+    int value;
+    if (c >= '0' && c <= '9') {
+      value = c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      value = c - 'a' + 10;
+    } else {
+      return false;
+    }
+    bits[i] = (value >> (i % 4)) & 1;
+  }
+  return true;
+}
+
+std::string Checksum(const std::string &text) {
+  return HashUtils::CalculateSHA256(
+      std::vector<uint8_t>(text.begin(), text.end()));
+}
+
+} // namespace
+
+DownloadJournal::DownloadJournal(const std::string &localPath)
+    : localPath(localPath), partPath(localPath + ".part"),
+      journalPath(localPath + ".part.journal"), totalSize(0),
+      completedCount(0), verifyExisting(false) {}
+
+DownloadJournal::~DownloadJournal() {
+  if (partFile.is_open()) {
+    partFile.close();
+  }
+}
+
+// Открытие скачивания
+bool DownloadJournal::Open(const std::string &manifestDigest,
+                           uint64_t totalSize, size_t chunkCount) {
+  this->manifestDigest = manifestDigest;
+  this->totalSize = totalSize;
+  completed.assign(chunkCount, false);
+  completedCount = 0;
+  verifyExisting = false;
+
+  std::error_code ec;
+  bool partExists = fs::exists(partPath, ec);
+  bool resumed = partExists && LoadJournal();
+
+  if (!resumed) {
+    completed.assign(chunkCount, false);
+    completedCount = 0;
+    // .part подходящего размера без журнала - проверим его чанки по хешу
+    verifyExisting = partExists && fs::file_size(partPath, ec) == totalSize;
+  }
+
+  if (!partExists) {
+    std::ofstream create(partPath, std::ios::binary | std::ios::trunc);
+    if (!create.is_open()) {
+      std::cerr << "Error: Failed to create file: " << partPath << std::endl;
+      return false;
+    }
+  }
+
+  // Предвыделение (на большинстве ФС файл остаётся разреженным)
+  fs::resize_file(partPath, totalSize, ec);
+  if (ec) {
+    std::cerr << "Error: Failed to preallocate file: " << partPath
+              << std::endl;
+    return false;
+  }
+
+  partFile.open(partPath, std::ios::in | std::ios::out | std::ios::binary);
+  if (!partFile.is_open()) {
+    std::cerr << "Error: Failed to open file: " << partPath << std::endl;
+    return false;
+  }
+
+  return SaveJournal();
+}
+
+bool DownloadJournal::IsCompleted(size_t chunkIndex) const {
+  return chunkIndex < completed.size() && completed[chunkIndex];
+}
+
+void DownloadJournal::MarkCompleted(size_t chunkIndex) {
+  if (chunkIndex < completed.size() && !completed[chunkIndex]) {
+    completed[chunkIndex] = true;
+    completedCount++;
+  }
+}
+
+// Ленивая проверка уже записанного чанка
+bool DownloadJournal::VerifyExistingChunk(size_t chunkIndex, uint64_t offset,
+                                          size_t size,
+                                          const std::string &chunkId) {
+  if (!verifyExisting || chunkIndex >= completed.size()) {
+    return false;
+  }
+
+  std::vector<uint8_t> data(size);
+  partFile.clear();
+  partFile.seekg(static_cast<std::streamoff>(offset));
+  partFile.read(reinterpret_cast<char *>(data.data()),
+                static_cast<std::streamsize>(size));
+  if (partFile.gcount() != static_cast<std::streamsize>(size) ||
+      !HashUtils::VerifyHash(data, chunkId)) {
+    partFile.clear();
+    return false;
+  }
+
+  MarkCompleted(chunkIndex);
+  return SaveJournal();
+}
+
+// Запись чанка и отметка в журнале
+bool DownloadJournal::WriteChunk(size_t chunkIndex, uint64_t offset,
+                                 const std::vector<uint8_t> &data) {
+  partFile.clear();
+  partFile.seekp(static_cast<std::streamoff>(offset));
+  partFile.write(reinterpret_cast<const char *>(data.data()),
+                 static_cast<std::streamsize>(data.size()));
+  partFile.flush();
+  if (!partFile.good()) {
+    std::cerr << "Error: Failed to write chunk at index " << chunkIndex
+              << std::endl;
+    return false;
+  }
+
+  // Журнал обновляется только после записи данных
+  MarkCompleted(chunkIndex);
+  return SaveJournal();
+}
+
+// Завершение: .part становится итоговым файлом
+bool DownloadJournal::Finish() {
+  partFile.close();
+
+  std::error_code ec;
+  fs::remove(localPath, ec);
+  fs::rename(partPath, localPath, ec);
+  if (ec) {
+    std::cerr << "Error: Failed to rename " << partPath << " to " << localPath
+              << std::endl;
+    return false;
+  }
+
+  fs::remove(journalPath, ec);
+  return true;
+}
+
+// Формат журнала (текстовый):
+//   COURSESTORE_DOWNLOAD_JOURNAL <version>
+//   <manifest digest> <total size> <chunk count>
+//   <битовая карта в hex>
+//   <SHA-256 трёх строк выше>
+bool DownloadJournal::LoadJournal() {
+  std::ifstream file(journalPath);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  std::string header, manifestLine, bitmapLine, checksumLine;
+  if (!std::getline(file, header) || !std::getline(file, manifestLine) ||
+      !std::getline(file, bitmapLine) || !std::getline(file, checksumLine)) {
+    return false;
+  }
+
+  std::string body = header + "\n" + manifestLine + "\n" + bitmapLine + "\n";
+  if (Checksum(body) != checksumLine) {
+    std::cerr << "Warning: Download journal is corrupted, ignoring it"
+              << std::endl;
+    return false;
+  }
+
+  std::stringstream expectedHeader;
+  expectedHeader << JOURNAL_MAGIC << " " << JOURNAL_VERSION;
+  std::stringstream expectedManifest;
+  expectedManifest << manifestDigest << " " << totalSize << " "
+                   << completed.size();
+  if (header != expectedHeader.str() ||
+      manifestLine != expectedManifest.str()) {
+    // Журнал от другой версии файла
+    return false;
+  }
+
+  if (!DecodeBitmap(bitmapLine, completed)) {
+    return false;
+  }
+
+  completedCount = 0;
+  for (bool done : completed) {
+    completedCount += done ? 1 : 0;
+  }
+  return true;
+}
+
+// Сохранение журнала через временный файл (атомарная замена)
+bool DownloadJournal::SaveJournal() {
+  std::stringstream body;
+  body << JOURNAL_MAGIC << " " << JOURNAL_VERSION << "\n"
+       << manifestDigest << " " << totalSize << " " << completed.size()
+       << "\n"
+       << EncodeBitmap(completed) << "\n";
+  std::string text = body.str();
+
+  std::string tmpPath = journalPath + ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::trunc);
+    if (!file.is_open()) {
+      return false;
+    }
+    file << text << Checksum(text) << "\n";
+    if (!file.good()) {
+      return false;
+    }
+  }
+
+  std::error_code ec;
+  fs::rename(tmpPath, journalPath, ec);
+  return !ec;
+}
@@ -1,14 +1,35 @@
 #include "core/download_manager.h"
 
+#include "core/download_journal.h"
 #include "core/metadata_client.h"
 #include "hash_utils.h"
 #include <algorithm>
 #include <cctype>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <sstream>
 #include <thread>
 
+namespace {
+
+// Общее состояние hedged-запросов одного чанка
+struct HedgeState {
+  std::mutex mutex;
+  std::condition_variable cv;
+  size_t pending = 0; // Запущенные и ещё не завершившиеся запросы
+  bool done = false;
+  std::vector<uint8_t> data;
+  std::string winnerNodeId;
+};
+
+} // namespace
+
 DownloadManager::DownloadManager(MetadataClient *metadataClient)
-    : metadataClient(metadataClient), completedChunks(0) {}
+    : metadataClient(metadataClient),
+      nodeClient(metadataClient->GetNodeStats()),
+      nodeStats(metadataClient->GetNodeStats()), chunkCache(nullptr),
+      verbose(false), completedChunks(0) {}
 
 // Настройка прогресса
 void DownloadManager::SetProgressCallback(
@@ -39,44 +60,143 @@ StorageNodeInfo DownloadManager::GetNodeInfo(const std::string &nodeId,
 bool DownloadManager::TryDownloadFromNodes(
     const std::string &chunkId, const std::vector<std::string> &nodeIds,
     Chunk &chunk) {
-  // Перебор узлов по списку
-  for (const std::string &nodeId : nodeIds) {
-    // Получение информации об узле из кэша MetadataClient
+  // Порядок реплик: power-of-two-choices по статистике узлов
+  size_t expectedBytes = chunk.size;
+  std::vector<std::string> orderedIds =
+      nodeStats->OrderReplicas(nodeIds, expectedBytes);
+
+  // Получение информации об узлах из кэша MetadataClient
+  std::vector<StorageNodeInfo> candidates;
+  for (const std::string &nodeId : orderedIds) {
     StorageNodeInfo node;
-    if (!metadataClient->GetNodeInfo(nodeId, node)) {
-      // Узел не найден в кэше, пропускаем
-      continue;
+    if (metadataClient->GetNodeInfo(nodeId, node)) {
+      candidates.push_back(node);
     }
+  }
+
+  if (candidates.empty()) {
+    return false;
+  }
+
+  auto state = std::make_shared<HedgeState>();
+  std::vector<std::shared_ptr<CancelToken>> tokens;
+  size_t nextCandidate = 0;
+
+  // Запуск запроса к очередной реплике (вызывается под state->mutex)
+  auto launch = [&]() {
+    const StorageNodeInfo node = candidates[nextCandidate++];
+    auto token = std::make_shared<CancelToken>();
+    tokens.push_back(token);
+    state->pending++;
+
+    std::shared_ptr<NodeStats> stats = nodeStats;
+    std::thread([state, token, stats, node, chunkId]() {
+      NodeClient client(stats);
+      std::vector<uint8_t> data;
+      bool success = client.GetChunk(node, chunkId, data, token.get());
 
-    // Попытка скачать с узла
-    std::vector<uint8_t> data;
-    if (nodeClient.GetChunk(node, chunkId, data)) {
       // Валидация скачанного чанка
-      std::string calculatedHash = HashUtils::CalculateSHA256(data);
-      std::string lowerCalculated = calculatedHash;
-      std::string lowerExpected = chunkId;
-      std::transform(lowerCalculated.begin(), lowerCalculated.end(),
-                     lowerCalculated.begin(), ::tolower);
-      std::transform(lowerExpected.begin(), lowerExpected.end(),
-                     lowerExpected.begin(), ::tolower);
-
-      if (lowerCalculated == lowerExpected) {
-        chunk.data = data;
-        chunk.size = data.size();
-        chunk.chunkId = chunkId;
-        return true; // Успешно скачали
+      if (success && !HashUtils::VerifyHash(data, chunkId)) {
+        stats->RecordFailure(node.nodeId);
+        success = false;
+      }
+
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->pending--;
+      if (success && !state->done) {
+        state->done = true;
+        state->data = std::move(data);
+        state->winnerNodeId = node.nodeId;
+      }
+      state->cv.notify_all();
+    }).detach();
+  };
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  launch();
+
+  while (!state->done) {
+    auto finishedOrFailed = [&]() {
+      return state->done || state->pending == 0;
+    };
+
+    if (nextCandidate < candidates.size()) {
+      // Ждём не дольше p95 последней опрошенной реплики, затем дублируем
+      // запрос на следующую (или сразу переходим к ней, если все упали)
+      std::chrono::milliseconds delay =
+          nodeStats->GetHedgeDelay(candidates[nextCandidate - 1].nodeId);
+      state->cv.wait_for(lock, delay, finishedOrFailed);
+      if (!state->done) {
+        launch();
+      }
+    } else {
+      state->cv.wait(lock, finishedOrFailed);
+      if (!state->done) {
+        break; // Не удалось скачать ни с одного узла
       }
     }
   }
 
-  return false; // Не удалось скачать ни с одного узла
+  bool success = state->done;
+  if (success) {
+    chunk.data = std::move(state->data);
+    chunk.size = chunk.data.size();
+    chunk.chunkId = chunkId;
+  }
+  lock.unlock();
+
+  // Отмена проигравших запросов
+  for (auto &token : tokens) {
+    token->Cancel();
+  }
+
+  return success;
 }
 
 // Скачивание одного чанка
 bool DownloadManager::DownloadChunk(const FileMetadata::ChunkInfo &chunkInfo,
                                     Chunk &chunk) {
-  // Используем TryDownloadFromNodes для скачивания
-  return TryDownloadFromNodes(chunkInfo.chunkId, chunkInfo.nodeIds, chunk);
+  return FetchChunk(chunkInfo, chunk);
+}
+
+// Получение чанка: сначала локальный кэш, затем узлы хранения
+bool DownloadManager::FetchChunk(const FileMetadata::ChunkInfo &chunkInfo,
+                                 Chunk &chunk) {
+  chunk.size = chunkInfo.size;
+
+  if (chunkCache != nullptr && chunkCache->Get(chunkInfo.chunkId, chunk.data)) {
+    chunk.chunkId = chunkInfo.chunkId;
+    chunk.size = chunk.data.size();
+    return true;
+  }
+
+  if (!TryDownloadFromNodes(chunkInfo.chunkId, chunkInfo.nodeIds, chunk)) {
+    return false;
+  }
+
+  if (chunkCache != nullptr) {
+    chunkCache->Put(chunk.chunkId, chunk.data);
+  }
+  return true;
+}
+
+// Вывод статистики кэша (в режиме --verbose)
+void DownloadManager::PrintCacheStats() {
+  if (!verbose || chunkCache == nullptr) {
+    return;
+  }
+
+  ChunkCache::Stats stats = chunkCache->GetStats();
+  size_t lookups = stats.hits + stats.misses;
+  std::cout << "Chunk cache: " << stats.hits << " hits, " << stats.misses
+            << " misses";
+  if (lookups > 0) {
+    std::cout << " (" << (stats.hits * 100 / lookups) << "% hit rate)";
+  }
+  std::cout << ", " << stats.stores << " stored, " << stats.evictions
+            << " evicted, " << stats.entryCount << " chunks / "
+            << stats.usedBytes << " of " << stats.capacityBytes << " bytes"
+            << std::endl;
 }
 
 // Главный метод скачивания
@@ -94,38 +214,106 @@ bool DownloadManager::DownloadFile(const std::string &remoteFilename,
   std::cout << "File metadata received: " << metadata.chunks.size()
             << " chunks, " << metadata.totalSize << " bytes" << std::endl;
 
+  // Чанки по порядку и их смещения в файле
+  std::vector<FileMetadata::ChunkInfo> chunkInfos = metadata.chunks;
+  std::sort(chunkInfos.begin(), chunkInfos.end(),
+            [](const FileMetadata::ChunkInfo &a,
+               const FileMetadata::ChunkInfo &b) { return a.index < b.index; });
+
+  std::vector<uint64_t> offsets(chunkInfos.size());
+  uint64_t offset = 0;
+  for (size_t i = 0; i < chunkInfos.size(); ++i) {
+    if (chunkInfos[i].index != i) {
+      std::cerr << "Error: Invalid chunk sequence" << std::endl;
+      return false;
+    }
+    offsets[i] = offset;
+    offset += chunkInfos[i].size;
+  }
+  if (offset != metadata.totalSize) {
+    std::cerr << "Error: Chunk sizes do not match file size" << std::endl;
+    return false;
+  }
+
+  // Журнал скачивания: продолжаем с места предыдущей попытки
+  DownloadJournal journal(localPath);
+  if (!journal.Open(GetManifestDigest(metadata, chunkInfos),
+                    metadata.totalSize, chunkInfos.size())) {
+    return false;
+  }
+
+  completedChunks = journal.GetCompletedCount();
+  if (completedChunks > 0) {
+    std::cout << "Resuming download: " << completedChunks << " of "
+              << chunkInfos.size() << " chunks already downloaded"
+              << std::endl;
+    ReportProgress(completedChunks, chunkInfos.size());
+  }
+
   // Скачивание чанков
   std::cout << "Downloading chunks..." << std::endl;
-  std::vector<Chunk> chunks;
-  completedChunks = 0;
 
   // Последовательное скачивание (можно сделать параллельным позже)
-  for (size_t i = 0; i < metadata.chunks.size(); ++i) {
-    const auto &chunkInfo = metadata.chunks[i];
+  for (size_t i = 0; i < chunkInfos.size(); ++i) {
+    const auto &chunkInfo = chunkInfos[i];
+    if (journal.IsCompleted(i)) {
+      continue;
+    }
+
+    // Чанк уже лежит в .part от прерванной попытки без журнала
+    if (journal.VerifyExistingChunk(i, offsets[i], chunkInfo.size,
+                                    chunkInfo.chunkId)) {
+      completedChunks++;
+      ReportProgress(completedChunks, chunkInfos.size());
+      continue;
+    }
+
     Chunk chunk;
     chunk.index = chunkInfo.index;
     chunk.chunkId = chunkInfo.chunkId;
     chunk.size = chunkInfo.size;
 
-    // Попытка скачать с узлов
-    if (!TryDownloadFromNodes(chunkInfo.chunkId, chunkInfo.nodeIds, chunk)) {
-      std::cerr << "Error: Failed to download chunk " << i << std::endl;
+    // Попытка получить из кэша или скачать с узлов
+    if (!FetchChunk(chunkInfo, chunk)) {
+      std::cerr << "Error: Failed to download chunk " << i
+                << " (rerun download to resume)" << std::endl;
+      PrintCacheStats();
+      return false;
+    }
+
+    if (chunk.data.size() != chunkInfo.size ||
+        !journal.WriteChunk(i, offsets[i], chunk.data)) {
+      std::cerr << "Error: Failed to write chunk " << i << std::endl;
       return false;
     }
 
-    chunks.push_back(chunk);
     completedChunks++;
-    ReportProgress(completedChunks, metadata.chunks.size());
+    ReportProgress(completedChunks, chunkInfos.size());
   }
 
-  // Сборка файла
-  std::cout << "Assembling file..." << std::endl;
-  if (!chunkProcessor.AssembleFile(chunks, localPath)) {
-    std::cerr << "Error: Failed to assemble file" << std::endl;
+  // Все чанки проверены по хешу при получении - остаётся переименовать файл
+  if (!journal.Finish()) {
+    std::cerr << "Error: Failed to finalize file" << std::endl;
     return false;
   }
 
+  PrintCacheStats();
   std::cout << "File downloaded successfully!" << std::endl;
   return true;
 }
 
+// Отпечаток манифеста: журнал от другой версии файла не используется
+std::string DownloadManager::GetManifestDigest(
+    const FileMetadata &metadata,
+    const std::vector<FileMetadata::ChunkInfo> &chunkInfos) {
+  std::stringstream manifest;
+  manifest << metadata.filename << "\n" << metadata.totalSize << "\n";
+  for (const auto &chunkInfo : chunkInfos) {
+    manifest << chunkInfo.index << " " << chunkInfo.chunkId << " "
+             << chunkInfo.size << "\n";
+  }
+
+  std::string text = manifest.str();
+  return HashUtils::CalculateSHA256(
+      std::vector<uint8_t>(text.begin(), text.end()));
+}
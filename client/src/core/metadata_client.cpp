@@ -2,8 +2,11 @@
 
 #include "core/chunk_processor.h"
 #include "network_utils.h"
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <sstream>
+#include <thread>
 
 #ifdef _WIN32
 #include <winsock2.h>
@@ -19,12 +22,32 @@
 #endif
 
 MetadataClient::MetadataClient(const std::string &ip, int port)
-    : serverIp(ip), serverPort(port) {}
+    : MetadataClient(std::vector<MetadataEndpoint>{{ip, port}}) {}
+
+MetadataClient::MetadataClient(const std::vector<MetadataEndpoint> &endpoints)
+    : endpoints(endpoints),
+      activeEndpoint(endpoints.size() == 1 ? 0 : NO_ENDPOINT),
+      nodeStats(NodeStats::Shared()), shardMapLoaded(false),
+      shardMapStale(false), isShardClient(false) {}
 
 MetadataClient::~MetadataClient() = default;
 
 // Подключение к серверу
 bool MetadataClient::ConnectToServer(SOCKET &socket) {
+  if (activeEndpoint != NO_ENDPOINT &&
+      ConnectToEndpoint(endpoints[activeEndpoint], socket)) {
+    return true;
+  }
+  if (endpoints.size() < 2) {
+    return false;
+  }
+
+  // Основной недоступен: ждём, пока один из серверов станет основным
+  return FindPrimary() && ConnectToEndpoint(endpoints[activeEndpoint], socket);
+}
+
+bool MetadataClient::ConnectToEndpoint(const MetadataEndpoint &endpoint,
+                                       SOCKET &socket) {
   // Winsock должен быть инициализирован до вызова этого метода
   socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
   if (socket == INVALID_SOCKET) {
@@ -33,9 +56,9 @@ bool MetadataClient::ConnectToServer(SOCKET &socket) {
 
   sockaddr_in serverAddr{};
   serverAddr.sin_family = AF_INET;
-  serverAddr.sin_port = htons(serverPort);
+  serverAddr.sin_port = htons(endpoint.port);
 
-  if (inet_pton(AF_INET, serverIp.c_str(), &serverAddr.sin_addr) != 1) {
+  if (inet_pton(AF_INET, endpoint.ip.c_str(), &serverAddr.sin_addr) != 1) {
     closesocket(socket);
     return false;
   }
@@ -49,6 +72,149 @@ bool MetadataClient::ConnectToServer(SOCKET &socket) {
   return true;
 }
 
+// Запрос роли: ROLE_RESPONSE OK PRIMARY|STANDBY <seq>
+bool MetadataClient::IsPrimaryEndpoint(const MetadataEndpoint &endpoint) {
+  SOCKET socket =
+      NetworkUtils::ConnectToHost(endpoint.ip, endpoint.port, ROLE_TIMEOUT_SEC);
+  if (socket == INVALID_SOCKET) {
+    return false;
+  }
+
+  std::string response;
+  bool isPrimary = NetworkUtils::SendMessage(socket, "ROLE") &&
+                   NetworkUtils::ReceiveMessage(socket, response, 4096,
+                                                ROLE_TIMEOUT_SEC);
+  NetworkUtils::CloseSocket(socket);
+
+  std::vector<std::string> args = ParseCommand(response);
+  return isPrimary && args.size() >= 3 && args[0] == "ROLE_RESPONSE" &&
+         args[1] == "OK" && args[2] == "PRIMARY";
+}
+
+// Поиск основного среди серверов (до FAILOVER_WAIT_SEC)
+bool MetadataClient::FindPrimary() {
+  size_t previous = activeEndpoint;
+  activeEndpoint = NO_ENDPOINT;
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::seconds(FAILOVER_WAIT_SEC);
+
+  while (true) {
+    for (size_t i = 0; i < endpoints.size(); ++i) {
+      if (IsPrimaryEndpoint(endpoints[i])) {
+        activeEndpoint = i;
+        if (previous != NO_ENDPOINT && previous != i) {
+          std::cerr << "Warning: Metadata server failover to "
+                    << endpoints[i].ip << ":" << endpoints[i].port
+                    << std::endl;
+        }
+        return true;
+      }
+    }
+
+    if (std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(FAILOVER_RETRY_MS));
+  }
+}
+
+void MetadataClient::CheckNotPrimary(const std::string &responseLine) {
+  if (endpoints.size() > 1 && responseLine.find("ERROR NOT_PRIMARY") == 0) {
+    activeEndpoint = NO_ENDPOINT;
+  }
+  if (responseLine.find(" ERROR WRONG_SHARD") != std::string::npos) {
+    std::cerr << "Error: File belongs to another metadata shard, "
+              << "reloading shard map" << std::endl;
+    shardMapStale = true;
+  }
+}
+
+// Загрузка карты шардов: SHARD_MAP_RESPONSE OK <shard_count> <local_shard>,
+// строки "<shard> <адреса>", END_SHARD_MAP. Сервер без GET_SHARD_MAP
+// отвечает ошибкой - он не шардирован
+bool MetadataClient::LoadShardMap() {
+  SOCKET socket = INVALID_SOCKET;
+  if (!ConnectToServer(socket)) {
+    return false;
+  }
+  if (!SendRequest(socket, "GET_SHARD_MAP")) {
+    closesocket(socket);
+    return false;
+  }
+
+  std::string line;
+  if (!ReceiveResponse(socket, line)) {
+    closesocket(socket);
+    return false;
+  }
+
+  std::vector<std::string> lines;
+  std::vector<std::string> firstLine = ParseCommand(line);
+  bool supported = firstLine.size() >= 3 &&
+                   firstLine[0] == "SHARD_MAP_RESPONSE" && firstLine[1] == "OK";
+  while (supported && ReceiveResponse(socket, line) &&
+         line != "END_SHARD_MAP") {
+    lines.push_back(line);
+  }
+  closesocket(socket);
+
+  // Адреса шардов по номерам
+  std::vector<std::string> addresses;
+  for (const auto &shardLine : lines) {
+    std::vector<std::string> args = ParseCommand(shardLine);
+    if (args.size() != 2 || args[0] != std::to_string(addresses.size())) {
+      std::cerr << "Error: Invalid shard map line: " << shardLine
+                << std::endl;
+      return false;
+    }
+    addresses.push_back(args[1]);
+  }
+
+  ShardMap map;
+  std::vector<std::unique_ptr<MetadataClient>> clients;
+  if (!addresses.empty()) {
+    if (!map.SetShards(addresses)) {
+      return false;
+    }
+    for (const auto &shardAddresses : addresses) {
+      std::vector<std::pair<std::string, int>> parsed;
+      ShardMap::ParseAddresses(shardAddresses, parsed);
+      std::vector<MetadataEndpoint> shardEndpoints;
+      for (const auto &address : parsed) {
+        shardEndpoints.push_back({address.first, address.second});
+      }
+      clients.push_back(std::make_unique<MetadataClient>(shardEndpoints));
+      clients.back()->isShardClient = true;
+    }
+  }
+
+  shardMap = map;
+  shardClients = std::move(clients);
+  shardMapLoaded = true;
+  shardMapStale = false;
+  return true;
+}
+
+MetadataClient *MetadataClient::ShardFor(const std::string &filename) {
+  if (isShardClient) {
+    return this;
+  }
+
+  // Ответ WRONG_SHARD мог получить клиент шарда
+  for (const auto &client : shardClients) {
+    if (client->shardMapStale) {
+      shardMapStale = true;
+    }
+  }
+  if (!shardMapLoaded || shardMapStale) {
+    LoadShardMap();
+  }
+  if (shardClients.empty()) {
+    return this;
+  }
+  return shardClients[shardMap.Locate(filename)].get();
+}
+
 // Отправка запроса
 bool MetadataClient::SendRequest(SOCKET socket, const std::string &request) {
   return NetworkUtils::SendMessage(socket, request);
@@ -56,7 +222,27 @@ bool MetadataClient::SendRequest(SOCKET socket, const std::string &request) {
 
 // Получение ответа
 bool MetadataClient::ReceiveResponse(SOCKET socket, std::string &response) {
-  return NetworkUtils::ReceiveMessage(socket, response);
+  if (!NetworkUtils::ReceiveMessage(socket, response)) {
+    return false;
+  }
+  CheckNotPrimary(response);
+  return true;
+}
+
+// Чтение до закрытия соединения блоками
+bool MetadataClient::ReceiveAll(SOCKET socket, std::string &data) {
+  char buffer[4096];
+
+  while (true) {
+    int bytesReceived = recv(socket, buffer, sizeof(buffer), 0);
+    if (bytesReceived == 0) {
+      return true; // Соединение закрыто: ответ получен целиком
+    }
+    if (bytesReceived == SOCKET_ERROR) {
+      return false; // Ошибка или таймаут
+    }
+    data.append(buffer, bytesReceived);
+  }
 }
 
 // Парсинг команды
@@ -105,106 +291,153 @@ StorageNodeInfo MetadataClient::ParseNodeInfo(
     } catch (const std::exception &) {
       // Ошибка парсинга
     }
+    if (args.size() >= 5) {
+      node.failureDomain = args[4];
+    }
   }
   return node;
 }
 
-// Запрос узлов для загрузки
-std::vector<StorageNodeInfo> MetadataClient::RequestUploadNodes(
-    const std::string &filename, uint64_t fileSize) {
-  std::vector<StorageNodeInfo> nodes;
+// Запрос плана загрузки
+bool MetadataClient::RequestUpload(const std::string &filename,
+                                   uint64_t fileSize, UploadPlan &plan) {
+  MetadataClient *shard = ShardFor(filename);
+  if (shard != this) {
+    return shard->RequestUpload(filename, fileSize, plan);
+  }
+
+  std::stringstream request;
+  request << "REQUEST_UPLOAD " << filename << " " << fileSize;
+  return SendUploadRequest(request.str(), plan);
+}
+
+// Продолжение прерванной сессии загрузки
+bool MetadataClient::ResumeUpload(const std::string &filename,
+                                  const std::string &sessionId,
+                                  UploadPlan &plan) {
+  MetadataClient *shard = ShardFor(filename);
+  if (shard != this) {
+    return shard->ResumeUpload(filename, sessionId, plan);
+  }
+
+  return SendUploadRequest("RESUME_UPLOAD " + sessionId, plan) &&
+         plan.sessionId == sessionId;
+}
+
+// Запрос только списка узлов (без плана размещения)
+std::vector<StorageNodeInfo>
+MetadataClient::RequestUploadNodes(const std::string &filename,
+                                   uint64_t fileSize, std::string *sessionId) {
+  UploadPlan plan;
+  RequestUpload(filename, fileSize, plan);
+  if (sessionId != nullptr) {
+    *sessionId = plan.sessionId;
+  }
+  return plan.nodes;
+}
+
+// Отправка REQUEST_UPLOAD / RESUME_UPLOAD и разбор плана
+bool MetadataClient::SendUploadRequest(const std::string &request,
+                                       UploadPlan &plan) {
+  plan = UploadPlan();
   SOCKET socket = INVALID_SOCKET;
 
   if (!ConnectToServer(socket)) {
-    return nodes;
+    return false;
   }
 
-  // Формирование запроса
-  std::string request = "REQUEST_UPLOAD " + filename + " " +
-                       std::to_string(fileSize);
-
   // Отправка запроса
   if (!SendRequest(socket, request)) {
     closesocket(socket);
-    return nodes;
+    return false;
   }
 
-  // Получение многострочного ответа
-  // Читаем весь ответ сразу через recv, так как metadata server отправляет его одним пакетом
+  // Получение многострочного ответа (план большого файла может занимать
+  // сотни килобайт)
   std::string fullResponse;
-  char buffer[4096];
-  
-  // Читаем данные из сокета до закрытия соединения
-  while (true) {
-    int bytesReceived = recv(socket, buffer, sizeof(buffer) - 1, 0);
-    
-    if (bytesReceived == SOCKET_ERROR) {
-#ifdef _WIN32
-      int error = WSAGetLastError();
-      if (error == WSAETIMEDOUT || error == WSAECONNRESET) {
-        break; // Таймаут или соединение закрыто
-      }
-#endif
-      break; // Ошибка
-    }
-    
-    if (bytesReceived == 0) {
-      break; // Соединение закрыто
-    }
-    
-    buffer[bytesReceived] = '\0';
-    fullResponse += std::string(buffer, bytesReceived);
-    
-    // Если получили достаточно данных (предполагаем, что ответ не очень большой)
-    if (fullResponse.length() > 4096) {
-      break;
-    }
-  }
+  ReceiveAll(socket, fullResponse);
 
   closesocket(socket);
 
-  std::cout << "Received full response (" << fullResponse.length() << " bytes): " << fullResponse.substr(0, 100) << std::endl;
-
   // Парсинг ответа
   std::vector<std::string> lines = SplitLines(fullResponse);
-  std::cout << "Total lines received: " << lines.size() << std::endl;
   if (lines.empty()) {
     std::cerr << "Error: No lines in response" << std::endl;
-    return nodes;
+    return false;
   }
 
-  // Первая строка: UPLOAD_RESPONSE OK <node_count>
+  // Первая строка: UPLOAD_RESPONSE OK <node_count> [session_id]
+  CheckNotPrimary(lines[0]);
   std::vector<std::string> firstLineArgs = ParseCommand(lines[0]);
   if (firstLineArgs.size() < 3 || firstLineArgs[0] != "UPLOAD_RESPONSE" ||
       firstLineArgs[1] != "OK") {
-    std::cerr << "Error: Invalid UPLOAD_RESPONSE format. First line: " << lines[0] << std::endl;
-    return nodes;
+    std::cerr << "Error: Invalid UPLOAD_RESPONSE format. First line: "
+              << lines[0] << std::endl;
+    return false;
   }
 
-  // Парсинг узлов
-  for (size_t i = 1; i < lines.size(); ++i) {
-    std::vector<std::string> nodeArgs = ParseCommand(lines[i]);
-    std::cout << "Parsing node line " << i << ": " << lines[i] << " -> " << nodeArgs.size() << " args" << std::endl;
+  size_t nodeCount = 0;
+  try {
+    nodeCount = std::stoull(firstLineArgs[2]);
+  } catch (...) {
+    std::cerr << "Error: Invalid node count in UPLOAD_RESPONSE" << std::endl;
+    return false;
+  }
+  plan.sessionId = firstLineArgs.size() >= 4 ? firstLineArgs[3] : "";
+
+  // Узлы
+  size_t lineIndex = 1;
+  for (; lineIndex < lines.size() && plan.nodes.size() < nodeCount;
+       ++lineIndex) {
+    std::vector<std::string> nodeArgs = ParseCommand(lines[lineIndex]);
     if (nodeArgs.size() >= 4) {
       StorageNodeInfo node = ParseNodeInfo(nodeArgs);
       if (!node.nodeId.empty()) {
-        std::cout << "Added node: " << node.nodeId << " at " << node.ipAddress << ":" << node.port << std::endl;
-        nodes.push_back(node);
+        plan.nodes.push_back(node);
       }
     } else {
-      std::cerr << "Warning: Node line has insufficient arguments: " << nodeArgs.size() << std::endl;
+      std::cerr << "Warning: Node line has insufficient arguments: "
+                << nodeArgs.size() << std::endl;
     }
   }
 
-  std::cout << "Total nodes parsed: " << nodes.size() << std::endl;
+  // План размещения: PLACEMENT <chunk_count> <rf>, строки индексов узлов
+  if (lineIndex < lines.size()) {
+    std::vector<std::string> placementArgs = ParseCommand(lines[lineIndex]);
+    if (placementArgs.size() >= 2 && placementArgs[0] == "PLACEMENT") {
+      for (++lineIndex;
+           lineIndex < lines.size() && lines[lineIndex] != "END_PLACEMENT";
+           ++lineIndex) {
+        std::vector<size_t> replicas;
+        for (const auto &arg : ParseCommand(lines[lineIndex])) {
+          try {
+            size_t index = std::stoull(arg);
+            if (index < plan.nodes.size()) {
+              replicas.push_back(index);
+            }
+          } catch (...) {
+            // Некорректный индекс пропускается
+          }
+        }
+        plan.chunkPlacement.push_back(replicas);
+      }
+    }
+  }
 
-  return nodes;
+  return true;
 }
 
 // Уведомление о завершении загрузки
 bool MetadataClient::NotifyUploadComplete(
     const std::string &filename, const std::vector<Chunk> &chunks,
-    const std::vector<std::vector<std::string>> &chunkNodeIds) {
+    const std::vector<std::vector<std::string>> &chunkNodeIds,
+    const std::string &sessionId) {
+  MetadataClient *shard = ShardFor(filename);
+  if (shard != this) {
+    return shard->NotifyUploadComplete(filename, chunks, chunkNodeIds,
+                                       sessionId);
+  }
+
   SOCKET socket = INVALID_SOCKET;
 
   if (!ConnectToServer(socket)) {
@@ -214,6 +447,9 @@ bool MetadataClient::NotifyUploadComplete(
   // Формирование многострочного запроса
   std::stringstream request;
   request << "UPLOAD_COMPLETE " << filename << "\r\n";
+  if (!sessionId.empty()) {
+    request << "SESSION " << sessionId << "\r\n";
+  }
 
   for (size_t i = 0; i < chunks.size(); ++i) {
     const auto &chunk = chunks[i];
@@ -254,6 +490,11 @@ bool MetadataClient::NotifyUploadComplete(
 
 // Запрос метаданных для скачивания
 FileMetadata MetadataClient::RequestDownload(const std::string &filename) {
+  MetadataClient *shard = ShardFor(filename);
+  if (shard != this) {
+    return shard->RequestDownload(filename);
+  }
+
   FileMetadata metadata;
   SOCKET socket = INVALID_SOCKET;
 
@@ -301,28 +542,54 @@ FileMetadata MetadataClient::RequestDownload(const std::string &filename) {
   }
 
   // Первая строка: DOWNLOAD_RESPONSE OK <file_size> <chunk_count>
+  // [<node_count>]. С node_count за ней идёт таблица узлов "nodeId ip port",
+  // а реплики в строках чанков - индексы в таблице
   std::vector<std::string> firstLine = ParseCommand(lines[0]);
   if (firstLine.size() < 4 || firstLine[0] != "DOWNLOAD_RESPONSE" ||
       firstLine[1] != "OK") {
     return metadata;
   }
 
+  size_t nodeCount = 0;
+  bool hasNodeTable = firstLine.size() >= 5;
   try {
     metadata.totalSize = std::stoull(firstLine[2]);
     metadata.chunkCount = std::stoull(firstLine[3]);
+    if (hasNodeTable) {
+      nodeCount = std::stoull(firstLine[4]);
+    }
   } catch (const std::exception &) {
     return metadata;
   }
 
   metadata.filename = filename;
 
+  // Таблица узлов
+  std::vector<std::string> nodeTable;
+  size_t lineIndex = 1;
+  for (; lineIndex < lines.size() && nodeTable.size() < nodeCount;
+       ++lineIndex) {
+    std::vector<std::string> nodeArgs = ParseCommand(lines[lineIndex]);
+    if (nodeArgs.empty()) {
+      return FileMetadata();
+    }
+    nodeTable.push_back(nodeArgs[0]);
+    if (nodeArgs.size() >= 3) {
+      try {
+        CacheNodeAddress(nodeArgs[0], nodeArgs[1], std::stoi(nodeArgs[2]));
+      } catch (const std::exception &) {
+        // Узел без адреса: реплика будет пропущена при скачивании
+      }
+    }
+  }
+
   // Парсинг чанков
-  for (size_t i = 1; i < lines.size(); ++i) {
-    if (lines[i] == "END_CHUNKS") {
+  for (; lineIndex < lines.size(); ++lineIndex) {
+    if (lines[lineIndex] == "END_CHUNKS") {
       break;
     }
 
-    std::vector<std::string> chunkArgs = ParseCommand(lines[i]);
+    std::vector<std::string> chunkArgs = ParseCommand(lines[lineIndex]);
     if (chunkArgs.size() >= 4) {
       FileMetadata::ChunkInfo chunk;
       chunk.chunkId = chunkArgs[0];
@@ -333,7 +600,23 @@ FileMetadata MetadataClient::RequestDownload(const std::string &filename) {
         continue;
       }
 
-      // Парсинг узлов: формат nodeId ip port (расширенный формат)
+      if (hasNodeTable) {
+        // Реплики - индексы в таблице узлов
+        for (size_t j = 3; j < chunkArgs.size(); ++j) {
+          try {
+            size_t index = std::stoull(chunkArgs[j]);
+            if (index < nodeTable.size()) {
+              chunk.nodeIds.push_back(nodeTable[index]);
+            }
+          } catch (const std::exception &) {
+            // Некорректный индекс пропускается
+          }
+        }
+        metadata.chunks.push_back(chunk);
+        continue;
+      }
+
+      // Сервер без таблицы узлов: формат nodeId ip port (расширенный)
       size_t j = 3;
       while (j < chunkArgs.size()) {
         if (j + 2 < chunkArgs.size()) {
@@ -350,14 +633,7 @@ FileMetadata MetadataClient::RequestDownload(const std::string &filename) {
           }
 
           chunk.nodeIds.push_back(nodeId);
-
-          // Сохранение в кэш
-          NodeInfoCache nodeInfo;
-          nodeInfo.nodeId = nodeId;
-          nodeInfo.ipAddress = ip;
-          nodeInfo.port = port;
-          nodeInfo.freeSpace = 0; // FreeSpace не передается в REQUEST_DOWNLOAD
-          nodeCache[nodeId] = nodeInfo;
+          CacheNodeAddress(nodeId, ip, port);
 
           j += 3; // Переходим к следующему узлу
         } else {
@@ -374,79 +650,161 @@ FileMetadata MetadataClient::RequestDownload(const std::string &filename) {
   return metadata;
 }
 
-// Список файлов
-std::vector<std::pair<std::string, uint64_t>> MetadataClient::ListFiles() {
-  std::vector<std::pair<std::string, uint64_t>> files;
+// Удаление файла
+bool MetadataClient::DeleteFile(const std::string &filename) {
+  MetadataClient *shard = ShardFor(filename);
+  if (shard != this) {
+    return shard->DeleteFile(filename);
+  }
+
   SOCKET socket = INVALID_SOCKET;
 
   if (!ConnectToServer(socket)) {
-    return files;
+    return false;
   }
 
-  // Формирование запроса
-  std::string request = "LIST_FILES";
-
-  // Отправка запроса
-  if (!SendRequest(socket, request)) {
+  // Формирование и отправка запроса
+  if (!SendRequest(socket, "DELETE_FILE " + filename)) {
     closesocket(socket);
-    return files;
+    return false;
   }
 
-  // Получение многострочного ответа
+  // Ответ: DELETE_RESPONSE OK | DELETE_RESPONSE ERROR <code>
   std::string response;
-  std::string line;
+  bool received = ReceiveResponse(socket, response);
+  closesocket(socket);
 
-  // Чтение первой строки
-  if (!ReceiveResponse(socket, line)) {
-    closesocket(socket);
-    return files;
+  if (!received || response.rfind("DELETE_RESPONSE OK", 0) != 0) {
+    std::cerr << "Error: Failed to delete " << filename
+              << (received ? ": " + response : "") << std::endl;
+    return false;
   }
-  response += line + "\r\n";
+  return true;
+}
 
-  // Чтение остальных строк до END_FILES
+// Сохранение адреса узла в кэш (свободное место в ответах на скачивание не
+// передаётся)
+void MetadataClient::CacheNodeAddress(const std::string &nodeId,
+                                      const std::string &ip, int port) {
+  NodeInfoCache nodeInfo;
+  nodeInfo.nodeId = nodeId;
+  nodeInfo.ipAddress = ip;
+  nodeInfo.port = port;
+  nodeInfo.freeSpace = 0;
+  nodeCache[nodeId] = nodeInfo;
+}
+
+// Список файлов
+bool MetadataClient::ListFiles(
+    const std::string &prefix,
+    std::vector<std::pair<std::string, uint64_t>> &files) {
+  files.clear();
+
+  // Шардированный сервер: объединение списков всех шардов
+  if (!isShardClient && (!shardMapLoaded || shardMapStale)) {
+    LoadShardMap();
+  }
+  if (!shardClients.empty()) {
+    std::vector<std::pair<std::string, uint64_t>> shardFiles;
+    for (const auto &client : shardClients) {
+      if (!client->ListFiles(prefix, shardFiles)) {
+        return false;
+      }
+      files.insert(files.end(), shardFiles.begin(), shardFiles.end());
+    }
+    std::sort(files.begin(), files.end());
+    return true;
+  }
+
+  // Страницы по LIST_FILES_PAGE файлов, каждая следующая - после
+  // последнего имени предыдущей
+  std::string after;
   while (true) {
-    if (!ReceiveResponse(socket, line)) {
-      break;
+    std::string nextCursor;
+    if (!ListFilesPage(prefix, after, files, nextCursor)) {
+      std::cerr << "Error: Failed to receive file list page"
+                << (after.empty() ? "" : " after " + after) << std::endl;
+      return false;
     }
-    response += line + "\r\n";
-    if (line == "END_FILES") {
-      break;
+    if (nextCursor.empty()) {
+      return true;
     }
+    after = nextCursor;
   }
+}
+
+// Одна страница LIST_FILES
+bool MetadataClient::ListFilesPage(
+    const std::string &prefix, const std::string &after,
+    std::vector<std::pair<std::string, uint64_t>> &files,
+    std::string &nextCursor) {
+  SOCKET socket = INVALID_SOCKET;
+
+  if (!ConnectToServer(socket)) {
+    return false;
+  }
+
+  // Формирование запроса
+  std::string request = "LIST_FILES limit=" + std::to_string(LIST_FILES_PAGE);
+  if (!prefix.empty()) {
+    request += " prefix=" + NetworkUtils::EscapeToken(prefix);
+  }
+  if (!after.empty()) {
+    request += " after=" + NetworkUtils::EscapeToken(after);
+  }
+
+  // Отправка запроса
+  if (!SendRequest(socket, request)) {
+    closesocket(socket);
+    return false;
+  }
+
+  // Получение многострочного ответа
+  std::string response;
+  ReceiveAll(socket, response);
 
   closesocket(socket);
 
   // Парсинг ответа
   std::vector<std::string> lines = SplitLines(response);
   if (lines.empty()) {
-    return files;
+    return false;
   }
 
-  // Первая строка: LIST_FILES_RESPONSE OK <file_count>
+  // Первая строка: LIST_FILES_RESPONSE OK <file_count> [next=<cursor>]
+  CheckNotPrimary(lines[0]);
   std::vector<std::string> firstLine = ParseCommand(lines[0]);
   if (firstLine.size() < 3 || firstLine[0] != "LIST_FILES_RESPONSE" ||
       firstLine[1] != "OK") {
-    return files;
+    return false;
+  }
+  if (firstLine.size() >= 4 && firstLine[3].compare(0, 5, "next=") == 0 &&
+      !NetworkUtils::UnescapeToken(firstLine[3].substr(5), nextCursor)) {
+    return false;
   }
 
   // Парсинг файлов
+  bool complete = false;
   for (size_t i = 1; i < lines.size(); ++i) {
     if (lines[i] == "END_FILES") {
+      complete = true;
       break;
     }
 
-    std::vector<std::string> fileArgs = ParseCommand(lines[i]);
-    if (fileArgs.size() >= 2) {
+    // Имя может содержать пробелы: размер - после последнего пробела
+    size_t separator = lines[i].rfind(' ');
+    if (separator != std::string::npos && separator > 0) {
       try {
-        uint64_t size = std::stoull(fileArgs[1]);
-        files.push_back({fileArgs[0], size});
+        uint64_t size = std::stoull(lines[i].substr(separator + 1));
+        files.push_back({lines[i].substr(0, separator), size});
       } catch (const std::exception &) {
         continue;
       }
     }
   }
 
-  return files;
+  // Оборванный ответ: следующую страницу не запрашиваем
+  return complete;
 }
 
 // Список узлов
@@ -504,7 +862,7 @@ std::vector<StorageNodeInfo> MetadataClient::ListNodes() {
     return nodes;
   }
 
-  // Парсинг узлов: формат nodeId ip port freeSpace isActive
+  // Парсинг узлов: формат nodeId ip port freeSpace isActive [domain]
   for (size_t i = 1; i < lines.size(); ++i) {
     if (lines[i] == "END_NODES") {
       break;
@@ -521,6 +879,9 @@ std::vector<StorageNodeInfo> MetadataClient::ListNodes() {
       } catch (const std::exception &) {
         continue;
       }
+      if (nodeArgs.size() >= 6) {
+        node.failureDomain = nodeArgs[5];
+      }
       
       if (!node.nodeId.empty()) {
         nodes.push_back(node);
@@ -560,6 +921,13 @@ bool MetadataClient::GetNodeInfo(const std::string &nodeId,
     nodeInfo.freeSpace = it->second.freeSpace;
     return true;
   }
+
+  // Узлы из ответов шардов кэшируются их клиентами
+  for (const auto &client : shardClients) {
+    if (client->GetNodeInfo(nodeId, nodeInfo)) {
+      return true;
+    }
+  }
   return false;
 }
 
@@ -12,7 +12,42 @@
 #include <netdb.h>
 #endif
 
-NodeClient::NodeClient() = default;
+// Привязка сокета к токену отмены
+bool CancelToken::Attach(SOCKET socket) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (cancelled) {
+    return false;
+  }
+  this->socket = socket;
+  return true;
+}
+
+// Отвязка сокета (до его закрытия, чтобы Cancel не тронул чужой дескриптор)
+void CancelToken::Detach() {
+  std::lock_guard<std::mutex> lock(mutex);
+  socket = INVALID_SOCKET;
+}
+
+// Отмена запроса
+void CancelToken::Cancel() {
+  std::lock_guard<std::mutex> lock(mutex);
+  cancelled = true;
+  if (socket != INVALID_SOCKET) {
+#ifdef _WIN32
+    shutdown(socket, SD_BOTH);
+#else
+    shutdown(socket, SHUT_RDWR);
+#endif
+  }
+}
+
+bool CancelToken::IsCancelled() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return cancelled;
+}
+
+NodeClient::NodeClient(std::shared_ptr<NodeStats> stats)
+    : stats(std::move(stats)) {}
 
 NodeClient::~NodeClient() = default;
 
@@ -59,6 +94,29 @@ bool NodeClient::ReceiveBinaryData(SOCKET socket, std::vector<uint8_t> &data,
 bool NodeClient::StoreChunk(const StorageNodeInfo &node,
                             const std::string &chunkId,
                             const std::vector<uint8_t> &data) {
+  stats->BeginRequest(node.nodeId);
+  auto start = std::chrono::steady_clock::now();
+
+  bool success = SendChunk(node, chunkId, data);
+
+  stats->EndRequest(node.nodeId);
+  if (success) {
+    auto end = std::chrono::steady_clock::now();
+    stats->RecordWrite(
+        node.nodeId,
+        std::chrono::duration_cast<std::chrono::microseconds>(end - start),
+        data.size());
+  } else {
+    stats->RecordFailure(node.nodeId);
+  }
+
+  return success;
+}
+
+// Отправка чанка на узел
+bool NodeClient::SendChunk(const StorageNodeInfo &node,
+                           const std::string &chunkId,
+                           const std::vector<uint8_t> &data) {
   SOCKET socket = INVALID_SOCKET;
 
   std::cout << "Connecting to storage node " << node.nodeId 
@@ -116,29 +174,71 @@ bool NodeClient::StoreChunk(const StorageNodeInfo &node,
 // Получение чанка
 bool NodeClient::GetChunk(const StorageNodeInfo &node,
                          const std::string &chunkId,
-                         std::vector<uint8_t> &data) {
+                         std::vector<uint8_t> &data, CancelToken *cancel) {
+  stats->BeginRequest(node.nodeId);
+  auto start = std::chrono::steady_clock::now();
+  auto firstByteAt = start;
+
+  bool success = RequestChunk(node, chunkId, data, cancel, firstByteAt);
+
+  stats->EndRequest(node.nodeId);
+  if (success) {
+    auto end = std::chrono::steady_clock::now();
+    stats->RecordSuccess(
+        node.nodeId,
+        std::chrono::duration_cast<std::chrono::microseconds>(firstByteAt -
+                                                              start),
+        std::chrono::duration_cast<std::chrono::microseconds>(end - start),
+        data.size());
+  } else if (cancel == nullptr || !cancel->IsCancelled()) {
+    // Отменённый hedged-запрос не считается ошибкой узла
+    stats->RecordFailure(node.nodeId);
+  }
+
+  return success;
+}
+
+// Запрос чанка у узла
+bool NodeClient::RequestChunk(const StorageNodeInfo &node,
+                             const std::string &chunkId,
+                             std::vector<uint8_t> &data, CancelToken *cancel,
+                             std::chrono::steady_clock::time_point &firstByteAt) {
   SOCKET socket = INVALID_SOCKET;
 
   if (!ConnectToNode(node, socket)) {
     return false;
   }
 
+  if (cancel != nullptr && !cancel->Attach(socket)) {
+    closesocket(socket);
+    return false;
+  }
+
+  auto closeSocket = [&]() {
+    if (cancel != nullptr) {
+      cancel->Detach();
+    }
+    closesocket(socket);
+  };
+
   // Формирование команды
   std::string command = "GET_CHUNK " + chunkId;
 
   // Отправка команды
   if (!NetworkUtils::SendMessage(socket, command)) {
-    closesocket(socket);
+    closeSocket();
     return false;
   }
 
   // Получение ответа с размером
   std::string response;
   if (!NetworkUtils::ReceiveMessage(socket, response)) {
-    closesocket(socket);
+    closeSocket();
     return false;
   }
 
+  firstByteAt = std::chrono::steady_clock::now();
+
   // Парсинг ответа: GET_RESPONSE OK <size>
   std::vector<std::string> args;
   std::stringstream ss(response);
@@ -148,7 +248,7 @@ bool NodeClient::GetChunk(const StorageNodeInfo &node,
   }
 
   if (args.size() < 3 || args[0] != "GET_RESPONSE" || args[1] != "OK") {
-    closesocket(socket);
+    closeSocket();
     return false;
   }
 
@@ -156,14 +256,14 @@ bool NodeClient::GetChunk(const StorageNodeInfo &node,
   try {
     size = std::stoull(args[2]);
   } catch (const std::exception &) {
-    closesocket(socket);
+    closeSocket();
     return false;
   }
 
   // Получение бинарных данных
   bool success = ReceiveBinaryData(socket, data, size);
 
-  closesocket(socket);
+  closeSocket();
 
   return success;
 }
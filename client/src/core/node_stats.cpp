@@ -0,0 +1,212 @@
+#include "core/node_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+double Ewma(double current, double sample, double alpha, bool first) {
+  return first ? sample : current + alpha * (sample - current);
+}
+
+} // namespace
+
+// Общая таблица процесса
+std::shared_ptr<NodeStats> NodeStats::Shared() {
+  static std::shared_ptr<NodeStats> instance = std::make_shared<NodeStats>();
+  return instance;
+}
+
+void NodeStats::BeginRequest(const std::string &nodeId) {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  nodes[nodeId].inFlight++;
+}
+
+void NodeStats::EndRequest(const std::string &nodeId) {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  NodeEntry &entry = nodes[nodeId];
+  if (entry.inFlight > 0) {
+    entry.inFlight--;
+  }
+}
+
+// Учёт успешного запроса к узлу
+void NodeStats::RecordSuccess(const std::string &nodeId,
+                              std::chrono::microseconds firstByteLatency,
+                              std::chrono::microseconds totalLatency,
+                              size_t bytes) {
+  double firstByteMs = static_cast<double>(firstByteLatency.count()) / 1000.0;
+  double totalMs = static_cast<double>(totalLatency.count()) / 1000.0;
+  double transferSec = std::max(totalMs - firstByteMs, 0.001) / 1000.0;
+
+  std::lock_guard<std::mutex> lock(statsMutex);
+  NodeEntry &entry = nodes[nodeId];
+  bool first = entry.samples == 0;
+
+  entry.latencyMs = Ewma(entry.latencyMs, firstByteMs, EWMA_ALPHA, first);
+  if (bytes > 0) {
+    double bps = static_cast<double>(bytes) / transferSec;
+    entry.throughputBps =
+        Ewma(entry.throughputBps, bps, EWMA_ALPHA, entry.throughputBps == 0);
+  }
+  entry.errorRate = Ewma(entry.errorRate, 0.0, EWMA_ALPHA, first);
+  entry.samples++;
+
+  if (entry.window.size() < WINDOW_SIZE) {
+    entry.window.push_back(totalMs);
+  } else {
+    entry.window[entry.windowNext] = totalMs;
+  }
+  entry.windowNext = (entry.windowNext + 1) % WINDOW_SIZE;
+}
+
+// Учёт успешной записи: окно перцентилей (порог hedged-чтений) не
+// меняется
+void NodeStats::RecordWrite(const std::string &nodeId,
+                            std::chrono::microseconds totalLatency,
+                            size_t bytes) {
+  double totalSec =
+      std::max(static_cast<double>(totalLatency.count()) / 1e6, 0.000001);
+
+  std::lock_guard<std::mutex> lock(statsMutex);
+  NodeEntry &entry = nodes[nodeId];
+  entry.errorRate = Ewma(entry.errorRate, 0.0, EWMA_ALPHA, entry.samples == 0);
+  entry.samples++;
+  if (bytes > 0) {
+    double bps = static_cast<double>(bytes) / totalSec;
+    entry.writeBps = Ewma(entry.writeBps, bps, EWMA_ALPHA, entry.writeBps == 0);
+  }
+}
+
+// Учёт неудачного запроса к узлу
+void NodeStats::RecordFailure(const std::string &nodeId) {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  NodeEntry &entry = nodes[nodeId];
+  entry.errorRate =
+      Ewma(entry.errorRate, 1.0, EWMA_ALPHA, entry.samples == 0);
+  entry.samples++;
+  entry.lastError = std::chrono::steady_clock::now();
+}
+
+// Перцентиль задержки по последним замерам
+double NodeStats::GetLatencyPercentile(const std::string &nodeId,
+                                       double percentile) const {
+  std::vector<double> samples;
+  {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    auto it = nodes.find(nodeId);
+    if (it == nodes.end() || it->second.window.size() < MIN_SAMPLES) {
+      return -1.0;
+    }
+    samples = it->second.window;
+  }
+
+  size_t rank = static_cast<size_t>(
+      std::ceil(percentile * static_cast<double>(samples.size())));
+  rank = std::min(std::max<size_t>(rank, 1), samples.size()) - 1;
+  std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+  return samples[rank];
+}
+
+// Порог для hedged-запроса: p95 узла, пока нет данных - значение по умолчанию
+std::chrono::milliseconds
+NodeStats::GetHedgeDelay(const std::string &nodeId) const {
+  double p95 = GetLatencyPercentile(nodeId, HEDGE_PERCENTILE);
+  if (p95 < 0) {
+    return std::chrono::milliseconds(DEFAULT_HEDGE_DELAY_MS);
+  }
+
+  long long delay = static_cast<long long>(std::ceil(p95));
+  delay = std::min<long long>(std::max<long long>(delay, MIN_HEDGE_DELAY_MS),
+                              MAX_HEDGE_DELAY_MS);
+  return std::chrono::milliseconds(delay);
+}
+
+// Стоимость: задержка + время передачи (для записи - по скорости записи,
+// пока её нет - по чтениям), с поправкой на ошибки и очередь. Ошибки
+// затухают со временем, чтобы восстановившийся узел снова выбирался
+double NodeStats::CostLocked(const NodeEntry &entry, size_t bytes, bool write,
+                             std::chrono::steady_clock::time_point now) const {
+  if (entry.samples == 0) {
+    // Неизвестный узел считаем быстрым, чтобы он получил первые запросы
+    return static_cast<double>(entry.inFlight);
+  }
+
+  double cost;
+  if (write && entry.writeBps > 0) {
+    cost = static_cast<double>(bytes) / entry.writeBps * 1000.0;
+  } else {
+    cost = entry.latencyMs;
+    if (entry.throughputBps > 0) {
+      cost += static_cast<double>(bytes) / entry.throughputBps * 1000.0;
+    }
+  }
+
+  double sinceError =
+      std::chrono::duration<double>(now - entry.lastError).count();
+  double errorRate =
+      entry.errorRate * std::pow(0.5, sinceError / ERROR_HALF_LIFE_SEC);
+
+  return cost * (1.0 + ERROR_PENALTY * errorRate) *
+         (1.0 + static_cast<double>(entry.inFlight));
+}
+
+double NodeStats::GetExpectedWriteCost(const std::string &nodeId,
+                                       size_t bytes) const {
+  std::lock_guard<std::mutex> lock(statsMutex);
+  auto it = nodes.find(nodeId);
+  if (it == nodes.end()) {
+    return 0.0;
+  }
+  return CostLocked(it->second, bytes, true,
+                    std::chrono::steady_clock::now());
+}
+
+// Power-of-two-choices: из двух случайных оставшихся реплик первой идёт
+// более дешёвая. Нагрузка распределяется, медленные узлы обходятся
+std::vector<std::string>
+NodeStats::OrderReplicas(const std::vector<std::string> &nodeIds,
+                         size_t bytes) const {
+  static thread_local std::mt19937 gen(std::random_device{}());
+
+  std::vector<std::pair<std::string, double>> remaining;
+  remaining.reserve(nodeIds.size());
+  {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    auto now = std::chrono::steady_clock::now();
+    for (const auto &nodeId : nodeIds) {
+      auto it = nodes.find(nodeId);
+      double cost =
+          it == nodes.end() ? 0.0 : CostLocked(it->second, bytes, false, now);
+      remaining.push_back({nodeId, cost});
+    }
+  }
+
+  std::vector<std::string> ordered;
+  ordered.reserve(remaining.size());
+  while (remaining.size() > 1) {
+    std::uniform_int_distribution<size_t> dis(0, remaining.size() - 1);
+    size_t a = dis(gen);
+    size_t b = dis(gen);
+    while (b == a) {
+      b = dis(gen);
+    }
+
+    // При равной стоимости (узлы ещё без замеров) - порядок сервера,
+    // который ставит менее нагруженные реплики первыми
+    size_t chosen;
+    if (remaining[a].second != remaining[b].second) {
+      chosen = remaining[b].second < remaining[a].second ? b : a;
+    } else {
+      chosen = std::min(a, b);
+    }
+    ordered.push_back(remaining[chosen].first);
+    remaining.erase(remaining.begin() + static_cast<long>(chosen));
+  }
+  if (!remaining.empty()) {
+    ordered.push_back(remaining.front().first);
+  }
+
+  return ordered;
+}
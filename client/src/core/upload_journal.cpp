@@ -0,0 +1,171 @@
+#include "core/upload_journal.h"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+UploadJournal::UploadJournal(const std::string &localPath)
+    : journalPath(localPath + ".upload.journal"), fileSize(0),
+      damaged(false) {}
+
+// Открытие журнала
+bool UploadJournal::Open(const std::string &remoteFilename,
+                         uint64_t fileSize) {
+  this->remoteFilename = remoteFilename;
+  this->fileSize = fileSize;
+  sessionId.clear();
+  chunks.clear();
+  damaged = false;
+
+  if (Load()) {
+    return true;
+  }
+
+  // Новой загрузке - новый журнал
+  sessionId.clear();
+  chunks.clear();
+  return Rewrite();
+}
+
+bool UploadJournal::SetSessionId(const std::string &sessionId) {
+  this->sessionId = sessionId;
+  return Append("SESSION " + sessionId);
+}
+
+const UploadJournal::ChunkRecord *
+UploadJournal::FindChunk(size_t index, const std::string &chunkId) const {
+  auto it = chunks.find(index);
+  if (it == chunks.end() || it->second.chunkId != chunkId) {
+    return nullptr;
+  }
+  return &it->second;
+}
+
+bool UploadJournal::RecordChunk(size_t index, const std::string &chunkId,
+                                size_t size,
+                                const std::vector<std::string> &nodeIds) {
+  ChunkRecord record;
+  record.chunkId = chunkId;
+  record.size = size;
+  record.nodeIds = nodeIds;
+  chunks[index] = record;
+  return Append(FormatChunk(index, record));
+}
+
+void UploadJournal::Remove() {
+  std::error_code ec;
+  fs::remove(journalPath, ec);
+}
+
+// Формат:
+//   COURSESTORE_UPLOAD_JOURNAL <version>
+//   FILE <file_size> <remote_filename>
+//   SESSION <session_id>                      (последняя строка побеждает)
+//   CHUNK <index> <chunk_id> <size> <node_id>...
+bool UploadJournal::Load() {
+  std::ifstream file(journalPath);
+  if (!file.is_open()) {
+    return false;
+  }
+
+  std::string line;
+  std::stringstream expectedHeader;
+  expectedHeader << JOURNAL_MAGIC << " " << JOURNAL_VERSION;
+  if (!std::getline(file, line) || file.eof() ||
+      line != expectedHeader.str()) {
+    return false;
+  }
+
+  std::stringstream expectedFile;
+  expectedFile << "FILE " << fileSize << " " << remoteFilename;
+  if (!std::getline(file, line) || file.eof() ||
+      line != expectedFile.str()) {
+    return false; // Журнал другой загрузки
+  }
+
+  bool torn = false;
+  while (std::getline(file, line)) {
+    // Строка без перевода строки - запись, прерванная на середине
+    if (file.eof()) {
+      torn = true;
+      break;
+    }
+
+    std::stringstream ss(line);
+    std::string type;
+    ss >> type;
+
+    if (type == "SESSION") {
+      std::string id;
+      if (ss >> id) {
+        sessionId = id;
+      }
+    } else if (type == "CHUNK") {
+      size_t index;
+      ChunkRecord record;
+      if (!(ss >> index >> record.chunkId >> record.size) ||
+          record.chunkId.length() != 64) {
+        continue; // Оборванная строка
+      }
+      std::string nodeId;
+      while (ss >> nodeId) {
+        record.nodeIds.push_back(nodeId);
+      }
+      chunks[index] = record;
+    }
+  }
+  file.close();
+
+  // Дописывать можно только после целой строки
+  return !torn || Rewrite();
+}
+
+bool UploadJournal::Rewrite() {
+  std::ofstream file(journalPath, std::ios::trunc);
+  if (!file.is_open()) {
+    return false;
+  }
+  file << JOURNAL_MAGIC << " " << JOURNAL_VERSION << "\n";
+  file << "FILE " << fileSize << " " << remoteFilename << "\n";
+  if (!sessionId.empty()) {
+    file << "SESSION " << sessionId << "\n";
+  }
+  for (const auto &pair : chunks) {
+    file << FormatChunk(pair.first, pair.second) << "\n";
+  }
+  file.flush();
+  return file.good();
+}
+
+// Строка дописывается к журналу; после неудачной записи журнал
+// переписывается целиком (состояние в памяти уже включает line)
+bool UploadJournal::Append(const std::string &line) {
+  if (damaged) {
+    damaged = !Rewrite();
+    return !damaged;
+  }
+
+  std::ofstream file(journalPath, std::ios::app);
+  if (!file.is_open()) {
+    return false;
+  }
+  file << line << "\n";
+  file.flush();
+  if (!file.good()) {
+    damaged = true;
+    return false;
+  }
+  return true;
+}
+
+std::string UploadJournal::FormatChunk(size_t index,
+                                       const ChunkRecord &record) {
+  std::stringstream line;
+  line << "CHUNK " << index << " " << record.chunkId << " " << record.size;
+  for (const auto &nodeId : record.nodeIds) {
+    line << " " << nodeId;
+  }
+  return line.str();
+}
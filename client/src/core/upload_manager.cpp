@@ -1,11 +1,13 @@
 #include "core/upload_manager.h"
 
+#include "core/upload_journal.h"
 #include <algorithm>
 #include <fstream>
 #include <iostream>
 
 UploadManager::UploadManager(MetadataClient *metadataClient)
-    : metadataClient(metadataClient) {}
+    : metadataClient(metadataClient),
+      nodeClient(metadataClient->GetNodeStats()) {}
 
 // Настройка прогресса
 void UploadManager::SetProgressCallback(
@@ -21,10 +23,20 @@ void UploadManager::ReportProgress(size_t current, size_t total) {
 }
 
 // Выбор узлов для чанка
-std::vector<StorageNodeInfo> UploadManager::SelectNodesForChunk(
-    const std::vector<StorageNodeInfo> &nodes, size_t chunkIndex) {
+std::vector<StorageNodeInfo>
+UploadManager::SelectNodesForChunk(const UploadPlan &plan, size_t chunkIndex) {
+  const std::vector<StorageNodeInfo> &nodes = plan.nodes;
   std::vector<StorageNodeInfo> selectedNodes;
 
+  // Размещение, рассчитанное сервером
+  if (chunkIndex < plan.chunkPlacement.size() &&
+      plan.chunkPlacement[chunkIndex].size() >= REPLICATION_FACTOR) {
+    for (size_t nodeIndex : plan.chunkPlacement[chunkIndex]) {
+      selectedNodes.push_back(nodes[nodeIndex]);
+    }
+    return selectedNodes;
+  }
+
   if (nodes.size() < REPLICATION_FACTOR) {
     return selectedNodes; // Недостаточно узлов
   }
@@ -39,15 +51,31 @@ std::vector<StorageNodeInfo> UploadManager::SelectNodesForChunk(
   return selectedNodes;
 }
 
+// Circuit breaker: узел с серией ошибок больше не используется
+bool UploadManager::IsCircuitOpen(const std::string &nodeId) const {
+  auto it = nodeFailures.find(nodeId);
+  return it != nodeFailures.end() && it->second >= CIRCUIT_BREAKER_THRESHOLD;
+}
+
+void UploadManager::RecordNodeResult(const std::string &nodeId,
+                                     bool success) {
+  if (success) {
+    nodeFailures.erase(nodeId);
+  } else if (++nodeFailures[nodeId] == CIRCUIT_BREAKER_THRESHOLD) {
+    std::cerr << "Warning: Node " << nodeId
+              << " keeps failing, skipping it for the rest of the upload"
+              << std::endl;
+  }
+}
+
 // Загрузка чанка с репликацией
-bool UploadManager::UploadChunk(const Chunk &chunk,
-                                const std::vector<StorageNodeInfo> &nodes,
+bool UploadManager::UploadChunk(const Chunk &chunk, const UploadPlan &plan,
                                 std::vector<std::string> &uploadedNodeIds) {
   uploadedNodeIds.clear();
 
   // Выбор узлов для этого чанка
   std::vector<StorageNodeInfo> selectedNodes =
-      SelectNodesForChunk(nodes, chunk.index);
+      SelectNodesForChunk(plan, chunk.index);
 
   if (selectedNodes.size() < REPLICATION_FACTOR) {
     std::cerr << "Error: Not enough nodes for chunk " << chunk.index
@@ -55,16 +83,80 @@ bool UploadManager::UploadChunk(const Chunk &chunk,
     return false;
   }
 
-  // Загрузка на все узлы (репликация)
-  bool allSuccess = true;
-  for (const auto &node : selectedNodes) {
-    if (nodeClient.StoreChunk(node, chunk.chunkId, chunk.data)) {
+  // Запасные узлы: остальные кандидаты, лучшие по статистике первыми
+  std::vector<StorageNodeInfo> alternates;
+  for (const auto &node : plan.nodes) {
+    bool selected = std::any_of(
+        selectedNodes.begin(), selectedNodes.end(),
+        [&](const StorageNodeInfo &s) { return s.nodeId == node.nodeId; });
+    if (!selected) {
+      alternates.push_back(node);
+    }
+  }
+
+  // Стоимость считается один раз: она меняется со временем, и сравнение
+  // по свежим значениям нарушило бы строгий порядок сортировки
+  std::shared_ptr<NodeStats> stats = metadataClient->GetNodeStats();
+  std::vector<std::pair<double, size_t>> costs;
+  costs.reserve(alternates.size());
+  for (size_t i = 0; i < alternates.size(); ++i) {
+    costs.push_back(
+        {stats->GetExpectedWriteCost(alternates[i].nodeId, chunk.size), i});
+  }
+  std::sort(costs.begin(), costs.end());
+
+  std::vector<StorageNodeInfo> orderedAlternates;
+  orderedAlternates.reserve(alternates.size());
+  for (const auto &cost : costs) {
+    orderedAlternates.push_back(alternates[cost.second]);
+  }
+  alternates.swap(orderedAlternates);
+
+  std::vector<StorageNodeInfo> candidates = selectedNodes;
+  candidates.insert(candidates.end(), alternates.begin(), alternates.end());
+
+  // Домены отказа узлов, уже сохранивших чанк
+  std::vector<std::string> storedDomains;
+
+  // Загрузка на узлы (репликация) до REPLICATION_FACTOR успешных копий
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    if (uploadedNodeIds.size() >= REPLICATION_FACTOR) {
+      break;
+    }
+
+    // Запасной узел берём из другого домена отказа, если такой есть
+    if (i >= selectedNodes.size()) {
+      auto other = std::find_if(
+          candidates.begin() + i, candidates.end(),
+          [&](const StorageNodeInfo &n) {
+            return !IsCircuitOpen(n.nodeId) &&
+                   std::find(storedDomains.begin(), storedDomains.end(),
+                             n.failureDomain) == storedDomains.end();
+          });
+      if (other != candidates.end()) {
+        std::rotate(candidates.begin() + i, other, other + 1);
+      }
+    }
+
+    const auto &node = candidates[i];
+    if (IsCircuitOpen(node.nodeId)) {
+      continue;
+    }
+
+    if (i >= selectedNodes.size()) {
+      std::cout << "Retrying chunk " << chunk.index << " on alternate node "
+                << node.nodeId << std::endl;
+    }
+
+    bool stored = nodeClient.StoreChunk(node, chunk.chunkId, chunk.data);
+    RecordNodeResult(node.nodeId, stored);
+
+    if (stored) {
       uploadedNodeIds.push_back(node.nodeId);
+      storedDomains.push_back(node.failureDomain);
     } else {
       std::cerr << "Warning: Failed to store chunk " << chunk.index
                 << " on node " << node.nodeId << std::endl;
-      allSuccess = false;
-      // Продолжаем попытки с другими узлами
     }
   }
 
@@ -99,62 +191,89 @@ bool UploadManager::UploadFile(const std::string &localPath,
     totalSize += chunk.size;
   }
 
-  // Запрос узлов у Metadata Server
+  nodeFailures.clear();
+
+  // Журнал загрузки: чанки, уже подтверждённые узлами, не отправляются
+  // повторно после перезапуска
+  UploadJournal journal(localPath);
+  if (!journal.Open(remoteFilename, totalSize)) {
+    std::cerr << "Warning: Failed to open upload journal" << std::endl;
+  }
+
+  // Запрос плана у Metadata Server (или продолжение прерванной сессии)
   std::cout << "Requesting nodes from metadata server..." << std::endl;
-  std::vector<StorageNodeInfo> nodes =
-      metadataClient->RequestUploadNodes(remoteFilename, totalSize);
+  UploadPlan plan;
+  std::string sessionId = journal.GetSessionId();
 
-  if (nodes.size() < REPLICATION_FACTOR) {
+  if (sessionId.empty() ||
+      !metadataClient->ResumeUpload(remoteFilename, sessionId, plan)) {
+    metadataClient->RequestUpload(remoteFilename, totalSize, plan);
+    sessionId = plan.sessionId;
+    if (!sessionId.empty()) {
+      journal.SetSessionId(sessionId);
+    }
+  } else if (journal.GetChunkCount() > 0) {
+    std::cout << "Resuming upload session " << sessionId << std::endl;
+  }
+
+  if (plan.nodes.size() < REPLICATION_FACTOR) {
     std::cerr << "Error: Not enough storage nodes available" << std::endl;
     return false;
   }
 
-  std::cout << "Received " << nodes.size() << " storage nodes" << std::endl;
+  std::cout << "Received " << plan.nodes.size() << " storage nodes"
+            << std::endl;
 
   // Загрузка чанков и сохранение информации о узлах
   std::cout << "Uploading chunks..." << std::endl;
   size_t uploadedCount = 0;
-
-  // Структура для хранения информации о загруженных чанках с nodeIds
-  struct ChunkWithNodes {
-    Chunk chunk;
-    std::vector<std::string> nodeIds;
-  };
-  std::vector<ChunkWithNodes> chunksWithNodes;
+  size_t skippedCount = 0;
+  std::vector<std::vector<std::string>> chunkNodeIds(chunks.size());
 
   for (size_t i = 0; i < chunks.size(); ++i) {
+    // Чанк уже подтверждён достаточным числом реплик в прошлой попытке
+    const UploadJournal::ChunkRecord *record =
+        journal.FindChunk(chunks[i].index, chunks[i].chunkId);
+    if (record != nullptr && record->nodeIds.size() >= REPLICATION_FACTOR) {
+      chunkNodeIds[i] = record->nodeIds;
+      skippedCount++;
+      uploadedCount++;
+      ReportProgress(uploadedCount, chunks.size());
+      continue;
+    }
+
     std::vector<std::string> uploadedNodeIds;
-    if (!UploadChunk(chunks[i], nodes, uploadedNodeIds)) {
-      std::cerr << "Error: Failed to upload chunk " << i << std::endl;
+    if (!UploadChunk(chunks[i], plan, uploadedNodeIds)) {
+      std::cerr << "Error: Failed to upload chunk " << i
+                << " (rerun upload to resume)" << std::endl;
       return false;
     }
 
-    ChunkWithNodes chunkWithNodes;
-    chunkWithNodes.chunk = chunks[i];
-    chunkWithNodes.nodeIds = uploadedNodeIds;
-    chunksWithNodes.push_back(chunkWithNodes);
+    journal.RecordChunk(chunks[i].index, chunks[i].chunkId, chunks[i].size,
+                        uploadedNodeIds);
+    chunkNodeIds[i] = uploadedNodeIds;
 
     uploadedCount++;
     ReportProgress(uploadedCount, chunks.size());
   }
 
+  if (skippedCount > 0) {
+    std::cout << "Skipped " << skippedCount
+              << " chunks already stored by a previous attempt" << std::endl;
+  }
+
   // Уведомление о завершении
   std::cout << "Notifying metadata server about upload completion..."
             << std::endl;
 
-  // Подготовка nodeIds для каждого чанка
-  std::vector<std::vector<std::string>> chunkNodeIds;
-  for (const auto &chunkWithNodes : chunksWithNodes) {
-    chunkNodeIds.push_back(chunkWithNodes.nodeIds);
-  }
-
   if (!metadataClient->NotifyUploadComplete(remoteFilename, chunks,
-                                            chunkNodeIds)) {
+                                            chunkNodeIds, sessionId)) {
     std::cerr << "Error: Failed to notify upload completion" << std::endl;
     return false;
   }
 
+  journal.Remove();
+
   std::cout << "File uploaded successfully!" << std::endl;
   return true;
 }
-
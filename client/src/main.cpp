@@ -6,16 +6,25 @@
 #endif
 
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
 
 void PrintUsage(const char *programName) {
   std::cout << "Usage: " << programName
-            << " --server <ip> --port <port> <command> [args...]" << std::endl;
+            << " --server <ip>[:port][,<ip>[:port]...] --port <port> <command>"
+            << " [args...]" << std::endl;
   std::cout << std::endl;
   std::cout << "Options:" << std::endl;
-  std::cout << "  --server <ip>     Metadata server IP address" << std::endl;
-  std::cout << "  --port <port>     Metadata server port" << std::endl;
+  std::cout << "  --server <ip>     Metadata server IP address; a comma-separated"
+            << std::endl;
+  std::cout << "                    list adds standby servers for failover"
+            << std::endl;
+  std::cout << "  --port <port>     Metadata server port (for addresses"
+            << " without one)" << std::endl;
+  std::cout << "  --cache-dir <dir>  Local chunk cache directory" << std::endl;
+  std::cout << "  --cache-size <mb>  Chunk cache size in MB (default 1024)"
+            << std::endl;
   std::cout << "  --verbose         Verbose output" << std::endl;
   std::cout << "  --quiet           Quiet output" << std::endl;
   std::cout << std::endl;
@@ -47,17 +56,19 @@ int main(int argc, char *argv[]) {
   }
 
   // Парсинг аргументов
-  std::string serverIp;
+  std::string serverList;
   int serverPort = 0;
   bool verbose = false;
   bool quiet = false;
+  std::string cacheDir;
+  uint64_t cacheSizeMb = 1024;
   std::vector<std::string> commandArgs;
 
   for (int i = 1; i < argc; i++) {
     std::string arg = argv[i];
 
     if (arg == "--server" && i + 1 < argc) {
-      serverIp = argv[++i];
+      serverList = argv[++i];
     } else if (arg == "--port" && i + 1 < argc) {
       try {
         serverPort = std::stoi(argv[++i]);
@@ -65,6 +76,15 @@ int main(int argc, char *argv[]) {
         std::cerr << "Error: Invalid port number" << std::endl;
         return 1;
       }
+    } else if (arg == "--cache-dir" && i + 1 < argc) {
+      cacheDir = argv[++i];
+    } else if (arg == "--cache-size" && i + 1 < argc) {
+      try {
+        cacheSizeMb = std::stoull(argv[++i]);
+      } catch (const std::exception &) {
+        std::cerr << "Error: Invalid cache size" << std::endl;
+        return 1;
+      }
     } else if (arg == "--verbose") {
       verbose = true;
     } else if (arg == "--quiet") {
@@ -79,12 +99,38 @@ int main(int argc, char *argv[]) {
   }
 
   // Проверка обязательных параметров
-  if (serverIp.empty() || serverPort == 0) {
+  if (serverList.empty()) {
     std::cerr << "Error: --server and --port are required" << std::endl;
     PrintUsage(argv[0]);
     return 1;
   }
 
+  // Список серверов: ip[:port] через запятую, без порта - --port
+  std::vector<MetadataEndpoint> endpoints;
+  std::stringstream servers(serverList);
+  std::string server;
+  while (std::getline(servers, server, ',')) {
+    if (server.empty()) {
+      continue;
+    }
+    MetadataEndpoint endpoint{server, serverPort};
+    size_t colon = server.rfind(':');
+    if (colon != std::string::npos) {
+      endpoint.ip = server.substr(0, colon);
+      try {
+        endpoint.port = std::stoi(server.substr(colon + 1));
+      } catch (const std::exception &) {
+        endpoint.port = 0;
+      }
+    }
+    if (endpoint.port == 0) {
+      std::cerr << "Error: --server and --port are required" << std::endl;
+      PrintUsage(argv[0]);
+      return 1;
+    }
+    endpoints.push_back(endpoint);
+  }
+
   // Проверка наличия команды
   if (commandArgs.empty()) {
     std::cerr << "Error: No command specified" << std::endl;
@@ -94,9 +140,13 @@ int main(int argc, char *argv[]) {
 
   // Создание экземпляра Client
   Client client;
+  client.SetVerbose(verbose);
+  if (!cacheDir.empty()) {
+    client.SetChunkCache(cacheDir, cacheSizeMb * 1024 * 1024);
+  }
 
   // Инициализация клиента
-  if (!client.Initialize(serverIp, serverPort)) {
+  if (!client.Initialize(endpoints)) {
     std::cerr << "Error: Failed to initialize client" << std::endl;
     return 1;
   }
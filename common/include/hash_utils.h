@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -13,6 +15,21 @@ namespace HashUtils {
   // Проверка хеша
   bool VerifyHash(const std::vector<uint8_t> &data,
                   const std::string &expectedHash);
+
+  // Отпечаток набора чанков: XOR первых 64 бит их SHA-256 идентификаторов.
+  // Не зависит от порядка и пересчитывается по одному чанку, поэтому узел и
+  // Metadata Server могут сверить наборы, не пересылая их
+  uint64_t ChunkFingerprint(const std::string &chunkId);
+  uint64_t InventoryFingerprint(const std::vector<std::string> &chunkIds);
+
+  // CRC-32 (IEEE) для проверки целостности файлов; crc - результат для
+  // предыдущей части данных (счёт по частям)
+  uint32_t Crc32(const void *data, size_t size, uint32_t crc = 0);
+
+  // 64-битный хеш строки (FNV-1a с финальным перемешиванием splitmix64);
+  // одинаков на всех платформах - для размещения и разбиения на шарды
+  uint64_t Hash64(const std::string &data);
+  uint64_t Mix64(uint64_t x);
 }
 
 
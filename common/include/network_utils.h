@@ -29,6 +29,15 @@ namespace NetworkUtils {
   bool ReceiveBinaryData(SOCKET socket, void *buffer, size_t size,
                         int timeoutSec = 60);
 
+  // Подключение к host:port (IPv4); INVALID_SOCKET при ошибке
+  SOCKET ConnectToHost(const std::string &ip, int port, int timeoutSec = 30);
+
+  // Экранирование значения аргумента (%XX для пробелов, '%' и переводов
+  // строк): значение с пробелами остаётся одним токеном строки протокола
+  std::string EscapeToken(const std::string &value);
+  // Обратное преобразование; false - неверная последовательность %XX
+  bool UnescapeToken(const std::string &token, std::string &value);
+
   // Утилиты
   std::string GetClientIP(SOCKET socket);
   bool SetSocketTimeout(SOCKET socket, int seconds);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Разбиение пространства имён файлов между серверами метаданных
+// согласованным хешированием. У каждого шарда VIRTUAL_NODES точек на
+// кольце 64-битных хешей; файл принадлежит шарду первой точки не меньше
+// хеша имени. Точки зависят только от номера шарда, а не от адресов:
+// адреса можно менять, а при добавлении шарда к нему переходит около
+// 1/(N+1) имён, остальные остаются на месте.
+//
+// Текстовый вид карты: адреса шардов через запятую, адреса одного шарда
+// (основной и резервные) через '|': "10.0.0.1:8080|10.0.0.2:8080,...".
+class ShardMap {
+private:
+  std::vector<std::string> shards; // Адреса шарда в текстовом виде
+  std::vector<std::pair<uint64_t, uint32_t>> ring; // Точка -> шард
+
+  static constexpr int VIRTUAL_NODES = 128;
+
+public:
+  ShardMap();
+
+  // Разбор текстового вида; пустая строка - без шардирования
+  bool Parse(const std::string &spec);
+  bool SetShards(const std::vector<std::string> &shardAddresses);
+
+  bool IsSharded() const { return !shards.empty(); }
+  size_t GetShardCount() const { return shards.size(); }
+  const std::string &GetShardAddresses(size_t shard) const {
+    return shards[shard];
+  }
+
+  // Шард, которому принадлежит имя файла (0 без шардирования)
+  size_t Locate(const std::string &filename) const;
+
+  // Адреса шарда: "ip:port|ip:port" -> пары (ip, port)
+  static bool ParseAddresses(const std::string &addresses,
+                             std::vector<std::pair<std::string, int>> &out);
+
+private:
+  void BuildRing();
+};
@@ -155,5 +155,90 @@ bool VerifyHash(const std::vector<uint8_t> &data,
   return lowerCalculated == lowerExpected;
 }
 
+uint64_t ChunkFingerprint(const std::string &chunkId) {
+  // Идентификатор чанка уже равномерный хеш: достаточно его начала
+  uint64_t value = 0;
+  for (size_t i = 0; i < chunkId.length() && i < 16; ++i) {
+    char c = static_cast<char>(
+        std::tolower(static_cast<unsigned char>(chunkId[i])));
+    uint64_t digit;
+    if (c >= '0' && c <= '9') {
+      digit = static_cast<uint64_t>(c - '0');
+    } else if (c >= 'a' && c <= 'f') {
+      digit = static_cast<uint64_t>(c - 'a' + 10);
+    } else {
+      digit = static_cast<unsigned char>(c) & 0x0f;
+    }
+    value = (value << 4) | digit;
+  }
+  return value;
+}
+
+uint64_t InventoryFingerprint(const std::vector<std::string> &chunkIds) {
+  uint64_t fingerprint = 0;
+  for (const auto &chunkId : chunkIds) {
+    fingerprint ^= ChunkFingerprint(chunkId);
+  }
+  return fingerprint;
+}
+
+uint32_t Crc32(const void *data, size_t size, uint32_t crc) {
+  // Восемь таблиц: по 8 байт за шаг (slicing-by-8). table[0] - обычная
+  // побайтовая таблица, table[k] - её сдвиг ещё на k байт
+  static const std::vector<std::vector<uint32_t>> table = [] {
+    std::vector<std::vector<uint32_t>> result(8, std::vector<uint32_t>(256));
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; ++k) {
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      result[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; ++i) {
+      for (size_t k = 1; k < 8; ++k) {
+        uint32_t c = result[k - 1][i];
+        result[k][i] = (c >> 8) ^ result[0][c & 0xFF];
+      }
+    }
+    return result;
+  }();
+  const uint32_t *t0 = table[0].data(), *t1 = table[1].data(),
+                 *t2 = table[2].data(), *t3 = table[3].data(),
+                 *t4 = table[4].data(), *t5 = table[5].data(),
+                 *t6 = table[6].data(), *t7 = table[7].data();
+
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  crc = ~crc;
+  for (; size >= 8; bytes += 8, size -= 8) {
+    uint32_t low = crc ^ (static_cast<uint32_t>(bytes[0]) |
+                          static_cast<uint32_t>(bytes[1]) << 8 |
+                          static_cast<uint32_t>(bytes[2]) << 16 |
+                          static_cast<uint32_t>(bytes[3]) << 24);
+    crc = t7[low & 0xFF] ^ t6[(low >> 8) & 0xFF] ^ t5[(low >> 16) & 0xFF] ^
+          t4[low >> 24] ^ t3[bytes[4]] ^ t2[bytes[5]] ^ t1[bytes[6]] ^
+          t0[bytes[7]];
+  }
+  for (; size > 0; ++bytes, --size) {
+    crc = t0[(crc ^ *bytes) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+uint64_t Mix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+uint64_t Hash64(const std::string &data) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (unsigned char c : data) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  return Mix64(hash);
+}
+
 } // namespace HashUtils
 
@@ -1,5 +1,6 @@
 #include "network_utils.h"
 
+#include <cctype>
 #include <cstring>
 
 #ifdef _WIN32
@@ -152,6 +153,31 @@ bool ReceiveBinaryData(SOCKET socket, void *buffer, size_t size,
   return true;
 }
 
+SOCKET ConnectToHost(const std::string &ip, int port, int timeoutSec) {
+  SOCKET sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (sock == INVALID_SOCKET) {
+    return INVALID_SOCKET;
+  }
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(static_cast<unsigned short>(port));
+  if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1) {
+    closesocket(sock);
+    return INVALID_SOCKET;
+  }
+
+  // Таймаут до connect: на Linux SO_SNDTIMEO ограничивает и его
+  SetSocketTimeout(sock, timeoutSec);
+
+  if (connect(sock, (sockaddr *)&addr, sizeof(addr)) == SOCKET_ERROR) {
+    closesocket(sock);
+    return INVALID_SOCKET;
+  }
+
+  return sock;
+}
+
 std::string GetClientIP(SOCKET socket) {
   sockaddr_in clientAddr{};
   socklen_t addrLen = sizeof(clientAddr);
@@ -187,6 +213,42 @@ bool SetSocketTimeout(SOCKET socket, int seconds) {
 #endif
 }
 
+std::string EscapeToken(const std::string &value) {
+  static const char *hex = "0123456789ABCDEF";
+  std::string token;
+  token.reserve(value.size());
+  for (char c : value) {
+    if (c == ' ' || c == '%' || c == '\r' || c == '\n' || c == '\t') {
+      unsigned char byte = static_cast<unsigned char>(c);
+      token += '%';
+      token += hex[byte >> 4];
+      token += hex[byte & 0x0F];
+    } else {
+      token += c;
+    }
+  }
+  return token;
+}
+
+bool UnescapeToken(const std::string &token, std::string &value) {
+  value.clear();
+  value.reserve(token.size());
+  for (size_t i = 0; i < token.size(); ++i) {
+    if (token[i] != '%') {
+      value += token[i];
+      continue;
+    }
+    if (i + 2 >= token.size() ||
+        !std::isxdigit(static_cast<unsigned char>(token[i + 1])) ||
+        !std::isxdigit(static_cast<unsigned char>(token[i + 2]))) {
+      return false;
+    }
+    value += static_cast<char>(std::stoi(token.substr(i + 1, 2), nullptr, 16));
+    i += 2;
+  }
+  return true;
+}
+
 void CloseSocket(SOCKET socket) {
   if (socket != INVALID_SOCKET) {
     closesocket(socket);
@@ -0,0 +1,84 @@
+#include "shard_map.h"
+
+#include "hash_utils.h"
+#include <algorithm>
+#include <sstream>
+
+ShardMap::ShardMap() = default;
+
+bool ShardMap::Parse(const std::string &spec) {
+  std::vector<std::string> shardAddresses;
+  std::stringstream ss(spec);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    shardAddresses.push_back(item);
+  }
+  return SetShards(shardAddresses);
+}
+
+bool ShardMap::SetShards(const std::vector<std::string> &shardAddresses) {
+  for (const auto &addresses : shardAddresses) {
+    std::vector<std::pair<std::string, int>> parsed;
+    if (!ParseAddresses(addresses, parsed)) {
+      return false;
+    }
+  }
+
+  shards = shardAddresses;
+  BuildRing();
+  return true;
+}
+
+void ShardMap::BuildRing() {
+  ring.clear();
+  ring.reserve(shards.size() * VIRTUAL_NODES);
+  for (size_t shard = 0; shard < shards.size(); ++shard) {
+    for (int point = 0; point < VIRTUAL_NODES; ++point) {
+      ring.push_back({HashUtils::Hash64("shard-" + std::to_string(shard) +
+                                        "#" + std::to_string(point)),
+                      static_cast<uint32_t>(shard)});
+    }
+  }
+  std::sort(ring.begin(), ring.end());
+}
+
+size_t ShardMap::Locate(const std::string &filename) const {
+  if (ring.empty()) {
+    return 0;
+  }
+
+  uint64_t hash = HashUtils::Hash64(filename);
+  auto it = std::lower_bound(
+      ring.begin(), ring.end(), hash,
+      [](const std::pair<uint64_t, uint32_t> &point, uint64_t value) {
+        return point.first < value;
+      });
+  if (it == ring.end()) {
+    it = ring.begin(); // Кольцо замыкается
+  }
+  return it->second;
+}
+
+bool ShardMap::ParseAddresses(const std::string &addresses,
+                              std::vector<std::pair<std::string, int>> &out) {
+  out.clear();
+  std::stringstream ss(addresses);
+  std::string address;
+  while (std::getline(ss, address, '|')) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon == 0) {
+      return false;
+    }
+    int port = 0;
+    try {
+      port = std::stoi(address.substr(colon + 1));
+    } catch (const std::exception &) {
+      return false;
+    }
+    if (port <= 0 || port > 65535) {
+      return false;
+    }
+    out.push_back({address.substr(0, colon), port});
+  }
+  return !out.empty();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// Token bucket для ограничения фоновых передач (ремонт, ребалансировка).
+// Токены - байты: пополняются со скоростью bytesPerSecond (0 - без
+// ограничения), копятся не больше burstBytes. Acquire блокирует до
+// появления нужного числа токенов; запрос больше burstBytes разрешается,
+// когда корзина полна, и уводит баланс в минус - следующие запросы
+// подождут дольше.
+class BandwidthLimiter {
+private:
+  using Clock = std::chrono::steady_clock;
+
+  std::mutex mutex;
+  std::condition_variable stopped;
+  uint64_t bytesPerSecond;
+  double burstBytes;
+  double tokens;
+  Clock::time_point lastRefill;
+  std::atomic<bool> cancelled;
+
+public:
+  BandwidthLimiter(uint64_t bytesPerSecond, uint64_t burstBytes);
+
+  void SetRate(uint64_t bytesPerSecond);
+  uint64_t GetRate();
+
+  // false, если ожидание прервано Cancel
+  bool Acquire(uint64_t bytes);
+  void Cancel();
+
+private:
+  void Refill(Clock::time_point now);
+};
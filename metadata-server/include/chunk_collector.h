@@ -0,0 +1,51 @@
+#pragma once
+
+#include "metadata_manager.h"
+#include "node_manager.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Сборка мусора: удаление с узлов копий чанков, на которые не ссылается ни
+// один файл (удалённые и перезаписанные файлы, брошенные загрузки). Раз в
+// проход MetadataManager отдаёт копии с истёкшим сроком ожидания, они
+// удаляются пачками по узлам (DELETE_CHUNKS). Копии на неактивном узле и
+// не удалённые из-за ошибки откладываются; копии узла, снятого с учёта,
+// забываются. Работает только на основном нешардированном сервере.
+class ChunkCollector {
+private:
+  NodeManager *nodeManager;
+  MetadataManager *metadataManager;
+
+  std::thread collectThread;
+  std::atomic<bool> running;
+  std::mutex stopMutex;
+  std::condition_variable stopCondition;
+
+  std::atomic<uint64_t> collectedChunks;
+
+  static constexpr int COLLECT_INTERVAL_SEC = 60;
+  static constexpr size_t DELETE_BATCH_CHUNKS = 1000;
+  static constexpr int RETRY_DELAY_SEC = 10 * 60;
+
+public:
+  ChunkCollector(NodeManager *nodeManager, MetadataManager *metadataManager);
+  ~ChunkCollector();
+
+  void Start();
+  void Stop();
+
+  uint64_t GetCollectedChunks() const { return collectedChunks; }
+
+private:
+  void CollectLoop();
+  void RunPass();
+  // Удаление копий с одного узла; возвращает число удалённых
+  size_t CollectFromNode(const std::string &nodeId,
+                         const std::vector<OrphanReplica> &replicas);
+};
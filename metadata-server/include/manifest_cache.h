@@ -0,0 +1,96 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Ответ DOWNLOAD_RESPONSE без порядка реплик: строки узлов и чанков с
+// индексами реплик в порядке метаданных. Порядок реплик по нагрузке
+// узлов применяется при выдаче (Render), поэтому смена нагрузки не
+// требует заново читать метаданные файла
+struct DownloadManifest {
+  std::string head;                  // Первая строка и строки узлов
+  std::vector<std::string> nodeIds;  // Таблица узлов ответа
+  std::vector<std::string> chunks;   // "chunkId index size" по чанкам
+  std::vector<size_t> replicaOffsets; // Начало реплик чанка (+ конец)
+  std::vector<size_t> replicaIndexes; // Индексы узлов реплик подряд
+
+  // Ответ с репликами, упорядоченными по рангам узлов таблицы (меньше -
+  // раньше, при равных - порядок метаданных). Последний ответ
+  // запоминается: пока ранги узлов файла не меняются, он выдаётся готовым
+  std::shared_ptr<const std::string>
+  Render(const std::vector<int> &ranks) const;
+  // Оценка занимаемой памяти (с запомненным ответом)
+  size_t GetSize() const;
+
+private:
+  mutable std::mutex renderMutex;
+  mutable std::vector<int> renderedRanks;
+  mutable std::shared_ptr<const std::string> rendered;
+};
+
+// Кэш ответов DOWNLOAD_RESPONSE. Ключ - имя файла, версия его метаданных
+// и эпоха таблицы узлов: новая загрузка, изменение реплик, адресов или
+// набора активных узлов дают новый ключ, и старый ответ больше не
+// выдаётся (он вытесняется по LRU). Смена нагрузки узлов ключ не
+// меняет. Одновременные промахи по одному ключу строят ответ один раз,
+// остальные запросы ждут его (singleflight) - сотни клиентов,
+// скачивающих один файл, не строят сотни одинаковых ответов.
+class ManifestCache {
+public:
+  using Builder = std::function<std::shared_ptr<const DownloadManifest>()>;
+
+private:
+  struct Entry {
+    uint64_t version;
+    uint64_t epoch;
+    std::shared_ptr<const DownloadManifest> manifest;
+    size_t bytes;
+    std::list<std::string>::iterator lruPosition;
+  };
+
+  // Построение ответа, которого ждут остальные запросы; исключение
+  // построителя передаётся ожидающим
+  struct Flight {
+    bool finished = false;
+    std::shared_ptr<const DownloadManifest> manifest;
+    std::exception_ptr error;
+  };
+
+  std::unordered_map<std::string, Entry> entries; // Имя файла -> ответ
+  std::list<std::string> lru; // Имена файлов, недавние в начале
+  std::unordered_map<std::string, std::shared_ptr<Flight>> flights;
+  size_t cachedBytes;
+  size_t maxBytes;
+  std::mutex mutex;
+  std::condition_variable flightCondition;
+
+public:
+  explicit ManifestCache(size_t maxBytes);
+
+  // Ответ из кэша или построенный builder (вне блокировки кэша)
+  std::shared_ptr<const DownloadManifest> Get(const std::string &filename,
+                                              uint64_t version, uint64_t epoch,
+                                              const Builder &builder);
+  // Удаление ответа файла (файл удалён)
+  void Invalidate(const std::string &filename);
+
+private:
+  void StoreLocked(const std::string &filename, uint64_t version,
+                   uint64_t epoch,
+                   const std::shared_ptr<const DownloadManifest> &manifest);
+  void FinishFlight(const std::string &flightKey,
+                    const std::shared_ptr<Flight> &flight,
+                    std::exception_ptr error);
+  void EraseLocked(std::unordered_map<std::string, Entry>::iterator it);
+  static std::string FlightKey(const std::string &filename, uint64_t version,
+                               uint64_t epoch);
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Журнал изменений метаданных (write-ahead log).
+// Запись - строка "<crc32> <поле> <поле> ...": поля экранируются (%XX для
+// пробела, '%' и переводов строк), так что имена файлов с пробелами
+// безопасны, а CRC отсекает недописанный хвост после сбоя. Журнал разбит
+// на сегменты wal-<seq>.log, где seq - номер первой записи сегмента.
+//
+// Групповая фиксация: Append только добавляет запись в буфер и вызывается
+// под мьютексом владельца данных, поэтому порядок записей совпадает с
+// порядком изменений. Поток записи сбрасывает весь накопленный буфер одним
+// write + fsync; пока идёт fsync, новые записи копятся для следующей
+// группы. Вызывающий ждёт WaitDurable уже без своих блокировок.
+class MetadataLog {
+public:
+  using Record = std::vector<std::string>;
+  // false - прервать обход
+  using RecordVisitor = std::function<bool(const Record &record)>;
+
+  // Последовательное чтение строк журнала по сегментам (передача журнала
+  // резервному серверу). Читать можно только записи до GetDurableSeq():
+  // они целиком на диске
+  class Reader {
+  private:
+    const MetadataLog &log;
+    std::ifstream in;
+    uint64_t seq; // Номер следующей читаемой записи
+
+  public:
+    explicit Reader(const MetadataLog &log);
+
+    // Переход к записи fromSeq; false, если сегмент с ней уже удалён
+    bool Seek(uint64_t fromSeq);
+    // Следующая закодированная строка (без перевода строки)
+    bool Next(std::string &line);
+    uint64_t GetSeq() const { return seq; }
+  };
+
+private:
+  std::string directory;
+  std::FILE *segment;
+  uint64_t segmentStartSeq;
+  uint64_t nextSeq; // Номер следующей записи
+  uint64_t durableSeq; // Записи с меньшими номерами уже на диске
+  std::string pending; // Ещё не записанные строки
+  bool writing; // Поток записи работает с segment вне мьютекса
+  // Ошибка записи: сегмент больше не пишется, durableSeq не растёт,
+  // дальнейшие изменения не подтверждаются
+  bool failed;
+
+  std::mutex mutex;
+  std::condition_variable pendingCondition; // Для потока записи
+  std::condition_variable durableCondition; // Для ожидающих фиксации
+  std::thread writerThread;
+  std::atomic<bool> running;
+
+  std::atomic<uint64_t> groupCommits;
+
+public:
+  explicit MetadataLog(const std::string &directory);
+  ~MetadataLog();
+
+  // Новый сегмент с номера startSeq (после восстановления) и запуск записи
+  bool Open(uint64_t startSeq);
+  void Close();
+
+  // Добавление записи; возвращает её номер
+  uint64_t Append(const Record &record);
+  // Ожидание, пока запись seq не окажется на диске; false после ошибки
+  // записи журнала
+  bool WaitDurable(uint64_t seq);
+  // То же с таймаутом; false по таймауту и при закрытии журнала
+  bool WaitDurableFor(uint64_t seq, std::chrono::milliseconds timeout);
+  uint64_t GetDurableSeq();
+
+  // Закрытие текущего сегмента и начало нового; seq - номер первой
+  // записи нового сегмента (граница для снимка). false после ошибки
+  // записи журнала
+  bool Rotate(uint64_t &seq);
+  // Удаление сегментов, целиком лежащих до seq
+  void RemoveSegmentsBefore(uint64_t seq);
+  // Удаление всех сегментов и начало журнала с startSeq (резервный сервер
+  // после установки снимка основного)
+  bool Reset(uint64_t startSeq);
+
+  // Повтор записей с номера fromSeq; nextSeq - номер за последней целой
+  // записью. Недописанный хвост последнего сегмента отрезается
+  bool Replay(uint64_t fromSeq, const RecordVisitor &visitor,
+              uint64_t &nextSeq);
+
+  uint64_t GetNextSeq();
+  uint64_t GetGroupCommits() const { return groupCommits; }
+
+  // Кодирование записи в строку журнала (без перевода строки) и обратно;
+  // используются и для файлов снимков
+  static std::string EncodeRecord(const Record &record);
+  static bool DecodeRecord(const std::string &line, Record &record);
+
+  // fsync файла и каталога (для переименований)
+  static bool SyncFile(std::FILE *file);
+  static void SyncDirectory(const std::string &directory);
+
+private:
+  void WriterLoop();
+  std::string SegmentPath(uint64_t startSeq) const;
+  std::vector<std::pair<uint64_t, std::string>> ListSegments() const;
+};
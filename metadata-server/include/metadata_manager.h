@@ -1,10 +1,20 @@
 #pragma once
 
+#include "metadata_log.h"
+#include "snapshot_image.h"
+#include "timing_wheel.h"
+
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 struct ChunkInfo {
@@ -22,7 +32,11 @@ struct FileMetadata {
   uint64_t totalSize; // Общий размер файла
   std::vector<ChunkInfo> chunks; // Список чанков
   std::chrono::time_point<std::chrono::steady_clock> uploadTime;
+  // Хранится в записи сегмента; заполняется в копиях (GetAllFiles)
   std::chrono::time_point<std::chrono::steady_clock> lastAccessed;
+  // Номер изменения (в пределах процесса): новый при каждом изменении
+  // файла или его реплик; задаётся менеджером
+  uint64_t version;
 
   // Валидация
   bool IsValid() const;
@@ -32,14 +46,166 @@ struct FileMetadata {
   bool HasChunk(const std::string &chunkId) const;
 };
 
+// Расположение чанка: один чанк (по содержимому) может входить в
+// несколько файлов, реплики у всех вхождений общие
+struct ChunkLocation {
+  uint64_t size;
+  std::vector<std::string> nodeIds; // Узлы с репликами
+  std::unordered_set<std::string> files; // Файлы, содержащие чанк
+};
+
+// Данные, размещённые на узле (по индексу реплик)
+struct NodeUsage {
+  size_t chunks;
+  uint64_t bytes;
+  uint64_t fingerprint; // HashUtils::InventoryFingerprint набора чанков
+};
+
+// Итог сверки инвентаря узла с индексом реплик
+struct InventoryReconciliation {
+  size_t restored; // Реплики узла снова учтены в метаданных
+  size_t surplus;  // Чанк уже имеет достаточно реплик без узла
+  size_t unknown;  // Чанк не входит ни в один файл
+  std::vector<std::string> missing; // Узел должен хранить, но не хранит
+};
+
+// Изменение реплик чанка: removeNodeIds убираются, addNodeId (если не
+// пуст) добавляется. Перенос (move) выполняется, только если реплики ещё
+// на всех removeNodeIds и ещё нет на addNodeId
+struct ReplicaChange {
+  std::string chunkId;
+  std::vector<std::string> removeNodeIds;
+  std::string addNodeId;
+  bool move;
+};
+
+// Позиция обхода всех чанков порциями (ScanChunks): сначала чанки
+// снимка по порядку, затем корзины chunkLocations
+struct ChunkScanCursor {
+  size_t imageChunk = 0;
+  size_t bucket = 0;
+  size_t bucketCount = 0; // Число корзин, когда начался их обход
+};
+
+// Реплики чанка из порции обхода
+struct ChunkReplicas {
+  std::string chunkId;
+  std::vector<std::string> nodeIds;
+};
+
+// Копия чанка без ссылок, срок ожидания которой истёк
+struct OrphanReplica {
+  std::string chunkId;
+  // Сколько секунд чанк без ссылок: копию, записанную на узел позже
+  // (повторная загрузка того же содержимого), узел не удаляет
+  int64_t ageSec;
+};
+
+// Сессия загрузки: выдаётся на REQUEST_UPLOAD, закрывается UPLOAD_COMPLETE.
+// Позволяет клиенту продолжить прерванную загрузку (RESUME_UPLOAD)
+struct UploadSession {
+  std::string sessionId;
+  std::string filename;
+  uint64_t fileSize;
+  std::chrono::time_point<std::chrono::steady_clock> createdAt;
+  std::chrono::time_point<std::chrono::steady_clock> lastActivity;
+};
+
 class MetadataManager {
 private:
-  std::unordered_map<std::string, FileMetadata> files;
-  mutable std::mutex filesMutex;
+  // Файл в сегменте. Метаданные - неизменяемый снимок: читатель берёт
+  // ссылку под разделяемой блокировкой и дальше читает без блокировок,
+  // изменение копирует снимок, если его кто-то держит (copy-on-write).
+  // Файл, загруженный из снимка на диске и с тех пор не менявшийся,
+  // читается прямо из отображения (metadata == nullptr), метаданные в
+  // памяти появляются при первом изменении. Время доступа обновляется
+  // атомарно, не чаще раза в ACCESS_TIME_RESOLUTION_MS
+  struct FileEntry {
+    std::shared_ptr<FileMetadata> metadata;
+    size_t imageFile = 0; // Запись в image, если metadata == nullptr
+    uint64_t imageVersion = 0;
+    std::atomic<int64_t> lastAccessedMs{0}; // steady_clock, мс
+  };
 
-  // Статистика
-  size_t totalFiles;
-  uint64_t totalBytes;
+  // Сегмент таблицы файлов: чтения разных файлов не конкурируют за одну
+  // блокировку, а чтения одного сегмента идут параллельно
+  struct FileShard {
+    std::unordered_map<std::string, FileEntry> files;
+    mutable std::shared_mutex mutex;
+  };
+
+  static constexpr size_t FILE_SHARD_COUNT = 64;
+  static constexpr int64_t ACCESS_TIME_RESOLUTION_MS = 1000;
+
+  std::array<FileShard, FILE_SHARD_COUNT> fileShards;
+
+  // Упорядоченный индекс имён (имя -> размер) для постраничного списка:
+  // страница - проход от курсора без обхода сегментов. Меняется вместе с
+  // сегментами под indexMutex; fileIndexMutex берётся последним
+  std::map<std::string, uint64_t> fileIndex;
+  mutable std::shared_mutex fileIndexMutex;
+
+  // Индексы реплик (защищены indexMutex): chunkId -> расположение,
+  // nodeId -> чанки на узле
+  std::unordered_map<std::string, ChunkLocation> chunkLocations;
+  std::unordered_map<std::string, std::unordered_set<std::string>>
+      nodeChunks;
+  // По nodeChunks и чанкам image (загружается из снимка)
+  std::unordered_map<std::string, NodeUsage> nodeUsage;
+  // Все изменения (файлов и реплик) выполняются под indexMutex, файлы -
+  // ещё и под исключительной блокировкой своего сегмента. Порядок
+  // блокировок: indexMutex, затем сегмент. Под indexMutex файлы можно
+  // читать без блокировок сегментов
+  mutable std::mutex indexMutex;
+  uint64_t lastVersion; // Последний выданный FileMetadata::version
+
+  // Снимок, из которого загружено состояние. Он остаётся отображённым в
+  // память, и неизменённые чанки читаются из него: в chunkLocations и
+  // nodeChunks чанк снимка попадает при первом изменении (своём или
+  // содержащего файла) и помечается в imageChunkMoved. Защищены
+  // indexMutex; image задаётся раньше, чем в сегментах появляются файлы
+  // из него, и сбрасывается после их удаления, поэтому читатель файла
+  // из снимка берёт image под блокировкой сегмента
+  std::shared_ptr<const SnapshotImage> image;
+  std::vector<bool> imageChunkMoved;
+  std::unordered_map<std::string, uint32_t> imageNodeHandles;
+
+  // Журнал изменений файлов и реплик (nullptr - только в памяти). Записи
+  // добавляются под indexMutex, ожидание фиксации - после его снятия
+  MetadataLog *log;
+
+  // Незавершённые загрузки
+  std::unordered_map<std::string, UploadSession> uploadSessions;
+  mutable std::mutex sessionsMutex;
+
+  // Сессия живёт сутки с последней активности (загрузки бывают долгими)
+  static const int UPLOAD_SESSION_TTL_SEC = 24 * 60 * 60;
+
+  // Копии чанков, на которые не ссылается ни один файл: реплики чанка,
+  // из которого удалён последний файл, и неизвестные индексу чанки из
+  // инвентаря узлов (брошенные загрузки). Удаляются с узлов сборщиком
+  // (ChunkCollector) по истечении срока ожидания. Защищены indexMutex
+  struct OrphanChunk {
+    std::vector<std::string> nodeIds; // Узлы с копиями
+    TimingWheel::Clock::time_point orphanedAt; // Последняя потеря ссылок
+    TimingWheel::Clock::time_point collectAt;  // Раньше не удалять
+  };
+  std::unordered_map<std::string, OrphanChunk> orphanChunks;
+  TimingWheel orphanTimers; // chunkId -> collectAt
+  bool trackOrphans;
+
+  // Чанки удалённых файлов ждут час: клиенты, получившие список чанков до
+  // удаления, успевают дочитать
+  static constexpr int ORPHAN_GRACE_SEC = 60 * 60;
+  // Неизвестный чанк из инвентаря может быть частью незавершённой
+  // загрузки: ждём дольше жизни её сессии
+  static constexpr int UNKNOWN_CHUNK_GRACE_SEC =
+      UPLOAD_SESSION_TTL_SEC + ORPHAN_GRACE_SEC;
+  static constexpr int ORPHAN_TICK_MS = 1000; // Шаг колеса сроков
+
+  // Статистика (меняется под indexMutex, читается без блокировок)
+  std::atomic<size_t> totalFiles;
+  std::atomic<uint64_t> totalBytes;
 
 public:
   MetadataManager();
@@ -49,17 +215,93 @@ public:
   bool RegisterFile(const std::string &filename, uint64_t size,
                     const std::vector<ChunkInfo> &chunks);
   bool DeleteFile(const std::string &filename);
-  FileMetadata *GetFileMetadata(const std::string &filename);
+  // Снимок метаданных (nullptr - файла нет); не меняется после выдачи
+  std::shared_ptr<const FileMetadata>
+  GetFileMetadata(const std::string &filename);
 
-  // Поиск и список
-  std::vector<std::string> ListFiles();
+  // Поиск и список. Страница: до limit файлов с именем на prefix после
+  // имени after (по возрастанию); nextCursor - after следующей страницы,
+  // пусто - страница последняя
+  std::vector<std::pair<std::string, uint64_t>>
+  ListFiles(const std::string &prefix, const std::string &after, size_t limit,
+            std::string &nextCursor);
   std::vector<FileMetadata> GetAllFiles();
   bool FileExists(const std::string &filename);
 
   // Работа с чанками
   std::vector<ChunkInfo> GetFileChunks(const std::string &filename);
-  ChunkInfo *GetChunkInfo(const std::string &filename,
-                         const std::string &chunkId);
+  bool GetChunkInfo(const std::string &filename, const std::string &chunkId,
+                    ChunkInfo &chunkInfo);
+
+  // Реплики чанков
+  std::vector<std::string> GetNodeChunks(const std::string &nodeId);
+  std::vector<std::string> GetAllChunkIds();
+  // Следующая порция обхода всех чанков (около limit чанков) с их
+  // репликами; cursor сдвигается, false - обход завершён. Перестроение
+  // таблицы начинает обход корзин заново; чанк может встретиться дважды,
+  // а добавленный во время обхода - не встретиться
+  bool ScanChunks(ChunkScanCursor &cursor, size_t limit,
+                  std::vector<ChunkReplicas> &chunks);
+  bool GetChunkLocation(const std::string &chunkId, uint64_t &size,
+                        std::vector<std::string> &nodeIds);
+  // Замена реплик чанка во всех файлах: removeNodeIds убираются,
+  // addNodeId (если не пуст) добавляется
+  bool ReplaceChunkReplicas(const std::string &chunkId,
+                            const std::vector<std::string> &removeNodeIds,
+                            const std::string &addNodeId);
+  // Перенос реплики fromNodeId -> toNodeId; false, если реплика уже
+  // не на fromNodeId (её успел заменить ремонт) или уже есть на toNodeId
+  bool MoveChunkReplica(const std::string &chunkId,
+                        const std::string &fromNodeId,
+                        const std::string &toNodeId);
+  // Пакет изменений реплик: файл, содержащий несколько изменённых чанков,
+  // копируется один раз на пакет. applied[i] - выполнено ли изменение i;
+  // false - пакет не сохранён в журнале
+  bool ApplyReplicaChanges(const std::vector<ReplicaChange> &changes,
+                           std::vector<bool> &applied);
+  std::unordered_map<std::string, NodeUsage> GetNodeUsage();
+  // Ожидаемое содержимое узла: число чанков и отпечаток
+  void GetNodeInventory(const std::string &nodeId, size_t &chunkCount,
+                        uint64_t &fingerprint);
+  // Сверка фактического инвентаря узла с индексом: отсутствующие на узле
+  // реплики снимаются, найденные возвращаются чанкам, у которых меньше
+  // maxReplicas реплик
+  InventoryReconciliation ReconcileNodeInventory(
+      const std::string &nodeId, const std::vector<std::string> &chunkIds,
+      size_t maxReplicas);
+
+  // Сборка мусора: копии чанков без ссылок с истёкшим сроком ожидания,
+  // по узлам. Узлы, снова ставшие репликами чанка, пропускаются
+  std::unordered_map<std::string, std::vector<OrphanReplica>>
+  TakeOrphanReplicas();
+  // Повторное удаление копий с узла через delaySec (узел недоступен)
+  void DeferOrphanReplicas(const std::string &nodeId,
+                           const std::vector<OrphanReplica> &replicas,
+                           int delaySec);
+  // Шард не знает файлов других шардов, а чанк (по содержимому) может
+  // входить и в них: шардированный сервер копии без ссылок не отслеживает
+  void SetOrphanTracking(bool enabled);
+
+  // Сохранение на диск: журнал подключается после восстановления
+  void SetLog(MetadataLog *metadataLog);
+  // Повтор записи журнала или снимка (FILE_PUT, FILE_DEL, REPLICAS).
+  // Записи идемпотентны: повтор уже учтённой записи ничего не меняет
+  bool ApplyLogRecord(const MetadataLog::Record &record);
+  // Снимок: текущие чанки и файлы в writer (без indexMutex, изменения во
+  // время обхода повторяются из журнала); загрузка - в пустой менеджер,
+  // который дальше читает неизменённые данные из отображения snapshot
+  void ExportSnapshot(SnapshotImageWriter &writer);
+  void LoadSnapshotImage(std::shared_ptr<const SnapshotImage> snapshot);
+  // Удаление всех файлов и реплик (перед загрузкой снимка основного сервера)
+  void Clear();
+
+  // Сессии загрузки
+  std::string CreateUploadSession(const std::string &filename,
+                                  uint64_t fileSize);
+  bool ResumeUploadSession(const std::string &sessionId,
+                           UploadSession &session);
+  bool CompleteUploadSession(const std::string &sessionId);
+  size_t ExpireUploadSessions();
 
   // Статистика
   size_t GetFileCount() const;
@@ -68,9 +310,55 @@ public:
 private:
   // Внутренние методы
   bool ValidateFileMetadata(const FileMetadata &metadata);
-  void UpdateStatistics();
   std::string SanitizeFilename(const std::string &filename);
   bool ValidateChunkSequence(const std::vector<ChunkInfo> &chunks);
+  std::string GenerateSessionId();
+  FileShard &GetShard(const std::string &filename);
+  static int64_t NowMs();
+  static void TouchFile(FileEntry &entry);
+  FileMetadata &MutableFileLocked(FileEntry &entry);
+  // Метаданные записи (под блокировкой сегмента или indexMutex)
+  std::shared_ptr<const FileMetadata>
+  GetEntryMetadata(const FileEntry &entry) const;
+  static std::shared_ptr<FileMetadata>
+  DecodeImageFile(const SnapshotImage &source, size_t index);
+  void PutFileLocked(const FileMetadata &metadata);
+  bool EraseFileLocked(const std::string &filename);
+  void IndexFileLocked(const FileMetadata &metadata);
+  void UnindexFileLocked(const FileMetadata &metadata);
+  // Расположение чанка для изменения: чанк из снимка переносится в
+  // chunkLocations. nullptr - чанк не входит ни в один файл
+  ChunkLocation *FindChunkLocked(const std::string &chunkId);
+  bool FindImageChunkLocked(const std::string &chunkId, size_t &index) const;
+  // Размер и реплики без переноса из снимка
+  bool GetChunkReplicasLocked(const std::string &chunkId, uint64_t &size,
+                              std::vector<std::string> &nodeIds) const;
+  std::vector<std::string> GetNodeChunksLocked(const std::string &nodeId);
+  void AddNodeChunkLocked(const std::string &nodeId,
+                          const std::string &chunkId, uint64_t size);
+  void RemoveNodeChunkLocked(const std::string &nodeId,
+                             const std::string &chunkId, uint64_t size);
+  void AddOrphanLocked(const std::string &chunkId,
+                       const std::vector<std::string> &nodeIds,
+                       TimingWheel::Clock::time_point orphanedAt,
+                       TimingWheel::Clock::time_point collectAt);
+  // Пакет изменений реплик: расположения, индекс узлов и журнал
+  // меняются сразу, файлы - один раз на пакет (UpdateBatchFilesLocked)
+  struct ReplicaBatch {
+    std::vector<ReplicaChange> changes;
+    // Имя файла -> номера изменений его чанков
+    std::unordered_map<std::string, std::vector<size_t>> files;
+  };
+  // Возвращает номер записи журнала об изменении
+  uint64_t ReplaceChunkReplicasLocked(ChunkLocation &location,
+                                      const ReplicaChange &change,
+                                      ReplicaBatch &batch);
+  void UpdateBatchFilesLocked(const ReplicaBatch &batch);
+  static void UpdateReplicas(std::vector<std::string> &nodeIds,
+                             const ReplicaChange &change);
+  uint64_t AppendLogLocked(const MetadataLog::Record &record);
+  bool WaitLogDurable(uint64_t seq);
+  static MetadataLog::Record MakeFileRecord(const FileMetadata &metadata);
 };
 
 
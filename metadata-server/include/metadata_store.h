@@ -0,0 +1,91 @@
+#pragma once
+
+#include "metadata_log.h"
+#include "metadata_manager.h"
+#include "network_utils.h"
+#include "node_manager.h"
+#include "snapshot_image.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Сохранение метаданных на диск: журнал изменений и периодические снимки.
+// Снимок snapshot-<seq>.dat - двоичный образ файлов, чанков и узлов
+// (SnapshotImage), при запуске он отображается в память, и неизменённые
+// после загрузки данные читаются прямо из него. Снимки первого формата
+// (текстовые записи журнала между строками "SNAPSHOT 1 <seq>" и
+// "END <число>") по-прежнему читаются.
+// Снимок нечёткий: сначала журнал
+// переключается на новый сегмент с номера seq, затем состояние копируется
+// под обычными блокировками менеджеров и уже может содержать изменения
+// после seq. Восстановление - снимок плюс повтор журнала с seq; записи
+// идемпотентны, поэтому повтор уже учтённых изменений безопасен. После
+// записи снимка старые сегменты и снимки удаляются.
+//
+// Тот же журнал передаётся резервному серверу (SUBSCRIBE_LOG): строки
+// "R <запись>" по мере фиксации, "H <seq>" раз в секунду в простое. Если
+// нужные резервному сегменты уже удалены, сначала идёт "SNAPSHOT <seq>
+// <размер>" и байты последнего снимка.
+class MetadataStore {
+private:
+  std::string directory;
+  MetadataManager *metadataManager;
+  NodeManager *nodeManager;
+  MetadataLog log;
+  uint64_t lastSnapshotSeq;
+
+  std::thread snapshotThread;
+  std::atomic<bool> running;
+  std::mutex stopMutex;
+  std::condition_variable stopCondition;
+  // Снимки не пишутся, не устанавливаются и не удаляются одновременно
+  std::mutex snapshotMutex;
+
+  static constexpr int TEXT_SNAPSHOT_VERSION = 1;
+  static constexpr int SNAPSHOT_CHECK_SEC = 10;
+  // Снимок после стольких записей журнала с предыдущего
+  static constexpr uint64_t SNAPSHOT_EVERY_RECORDS = 100000;
+  static constexpr int STANDBY_HEARTBEAT_MS = 1000;
+  static constexpr size_t STANDBY_BATCH_BYTES = 64 * 1024;
+
+public:
+  MetadataStore(const std::string &directory,
+                MetadataManager *metadataManager, NodeManager *nodeManager);
+  ~MetadataStore();
+
+  // Загрузка снимка, повтор журнала и открытие нового сегмента.
+  // Вызывается до запуска фоновых потоков сервера
+  bool Recover();
+  // Подключение журнала к менеджерам: с этого момента сервер основной.
+  // Резервный сервер пишет в журнал только записи основного
+  void AttachLog();
+  void Start();
+  void Stop();
+
+  bool TakeSnapshot();
+
+  // Передача журнала резервному серверу с записи fromSeq; возвращается
+  // при обрыве соединения или остановке
+  void ServeStandby(SOCKET socket, uint64_t fromSeq);
+  // Резервный сервер: запись из потока основного (строка журнала)
+  bool ApplyReplicated(const std::string &line);
+  // Резервный сервер: снимок основного вместо текущего состояния и журнала
+  bool InstallSnapshot(uint64_t snapshotSeq, const std::string &data);
+
+  uint64_t GetNextSeq() { return log.GetNextSeq(); }
+
+  const std::string &GetDirectory() const { return directory; }
+
+private:
+  void SnapshotLoop();
+  bool ApplyRecord(const MetadataLog::Record &record);
+  bool LoadSnapshot(const std::string &path, uint64_t snapshotSeq);
+  bool LoadTextSnapshot(const std::string &path, uint64_t snapshotSeq);
+  std::string FindLatestSnapshot(uint64_t &snapshotSeq);
+  std::string SnapshotPath(uint64_t seq) const;
+  void RemoveSnapshotsBefore(uint64_t seq);
+};
@@ -1,20 +1,40 @@
 #pragma once
 
+#include "metadata_log.h"
+#include "snapshot_image.h"
+#include "timing_wheel.h"
+
 #include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
 #include <unordered_map>
 #include <vector>
 
+// Телеметрия узла из KEEP_ALIVE
+struct NodeTelemetry {
+  uint32_t inflightTransfers = 0; // Выполняющиеся передачи чанков
+  uint64_t readBytesPerSec = 0; // Недавняя скорость чтения
+  uint64_t writeBytesPerSec = 0; // Недавняя скорость записи
+  uint32_t diskQueueDepth = 0; // Очередь запросов к диску
+  uint64_t errorCount = 0; // Накопительный счётчик ошибок узла
+};
+
 struct StorageNode {
   std::string nodeId; // Уникальный идентификатор
   std::string ipAddress; // IPv4 адрес
   int port; // Порт узла
-  uint64_t freeSpace; // Свободное место в байтах
+  uint64_t freeSpace; // Свободное место в байтах (по отчёту узла)
+  uint64_t reservedSpace; // Зарезервировано незавершёнными загрузками
   uint64_t totalSpace; // Общее место в байтах
+  // Домен отказа: иерархическая метка "zone/rack/host" (по умолчанию IP)
+  std::string failureDomain;
   std::chrono::time_point<std::chrono::steady_clock> lastSeen;
   std::chrono::time_point<std::chrono::steady_clock> registeredAt;
   bool isActive; // Флаг активности
@@ -23,42 +43,205 @@ struct StorageNode {
   size_t chunksStored; // Количество хранимых чанков
   uint64_t bytesStored; // Объём хранимых данных
 
+  // Нагрузка: последняя телеметрия и сглаженная оценка в [0, 1)
+  NodeTelemetry telemetry;
+  double loadScore;
+
   // Методы валидации
   bool IsValid() const;
   bool IsActive() const;
+
+  // Свободное место за вычетом резервов
+  uint64_t GetEffectiveFreeSpace() const;
+};
+
+// Резерв места под незавершённую загрузку (по сессии)
+struct SpaceReservation {
+  std::unordered_map<std::string, uint64_t> bytesPerNode; // nodeId -> байты
+  std::chrono::time_point<std::chrono::steady_clock> expiresAt;
+};
+
+// Адрес узла и его место в порядке чтения реплик
+struct NodeAddress {
+  std::string ipAddress;
+  int port;
+  int readRank; // Меньше - раньше; неактивный узел - в конце
+};
+
+// Неизменяемый снимок адресов всех известных узлов: ответы с адресами
+// многих узлов формируются по нему без nodesMutex. Снимок пересобирается
+// при каждом изменении адреса, активности или порядка чтения узла, а epoch
+// меняется только при изменении адресов или набора активных узлов
+struct NodeDirectory {
+  uint64_t epoch;
+  std::unordered_map<std::string, NodeAddress> nodes;
+};
+
+// План размещения чанков загрузки
+struct PlacementPlan {
+  std::vector<StorageNode> nodes; // Таблица узлов (сначала узлы плана)
+  std::vector<std::vector<size_t>> chunkReplicas; // Чанк -> индексы в nodes
 };
 
 class NodeManager {
+public:
+  // Уведомление о смене активности узла (вызывается вне nodesMutex)
+  using NodeStateCallback =
+      std::function<void(const std::string &nodeId, bool active)>;
+
 private:
+  // Узел в индексе записи. Хеш и вес узла для размещения считаются при
+  // изменении узла, а не в каждом запросе
+  struct EligibleEntry {
+    const StorageNode *node; // Запись в nodes
+    uint64_t nodeHash; // Placement::Hash64(nodeId)
+    double weight; // GetPlacementWeight
+    uint32_t domain; // Номер failureDomain в domainNames
+  };
+
+  // Индекс узлов, доступных для записи: эффективное свободное место ->
+  // узел, по убыванию; обновляется при каждом изменении узла
+  using EligibleIndex =
+      std::multimap<uint64_t, EligibleEntry, std::greater<uint64_t>>;
+
+  // Кандидат размещения: копия записи индекса без строк
+  struct PlacementCandidate {
+    uint64_t nodeHash;
+    double weight;
+    uint64_t freeSpace; // Эффективное свободное место
+    uint32_t domain;
+    const std::string *domainName; // Элемент domainNames
+    const StorageNode *node;
+  };
+
   std::unordered_map<std::string, StorageNode> nodes;
+  EligibleIndex eligibleIndex;
+  // nodeId -> позиция в eligibleIndex (только для узлов в индексе)
+  std::unordered_map<std::string, EligibleIndex::iterator> eligiblePositions;
+  // sessionId -> резерв (защищён nodesMutex)
+  std::unordered_map<std::string, SpaceReservation> reservations;
   mutable std::mutex nodesMutex; // mutable для использования в const методах
+  // Метки доменов отказа по номерам. Только добавляются, и элементы deque
+  // не переезжают: строку по указателю можно читать без nodesMutex
+  std::deque<std::string> domainNames;
+  std::unordered_map<std::string, uint32_t> domainIds;
+  // Число удалений из nodes: указатель на запись узла, взятый под
+  // nodesMutex, действителен после повторного захвата, если оно то же
+  uint64_t nodesRemoved;
   std::thread keepAliveThread;
   std::atomic<bool> running;
 
+  // Сроки истечения узлов (nodeId) и резервов (sessionId), под nodesMutex
+  TimingWheel nodeExpiry;
+  TimingWheel reservationExpiry;
+
+  // Журнал изменений состава узлов (nullptr - только в памяти)
+  MetadataLog *log;
+
+  NodeStateCallback nodeStateCallback;
+  std::mutex callbackMutex; // Защищает nodeStateCallback и его вызов
+
+  // Агрегаты по активным узлам, поддерживаются при каждом изменении
+  std::atomic<size_t> activeNodeCount;
+  std::atomic<uint64_t> totalFreeSpace;
+
+  // Снимок адресов (std::atomic_load/atomic_store). Изменения узлов только
+  // помечают его устаревшим, пересобирается он при следующем запросе
+  std::shared_ptr<const NodeDirectory> directory;
+  std::atomic<bool> directoryStale;
+  uint64_t directoryEpoch; // Под nodesMutex
+
   // Конфигурация
-  static const int KEEP_ALIVE_INTERVAL_SEC = 30;
-  static const int NODE_TIMEOUT_SEC = 60;
-  static const int MAX_NODES = 1000;
+  static constexpr int NODE_TIMEOUT_SEC = 60; // Два пропущенных keep-alive
+  static constexpr int MAX_NODES = 1000;
+  static constexpr int RESERVATION_TTL_SEC = 15 * 60;
+  static constexpr int EXPIRY_TICK_MS = 100; // Шаг колеса таймеров
+
+  // Оценка нагрузки: каждая составляющая нормируется на уровень
+  // насыщения, сумма r переводится в r / (1 + r) и сглаживается EWMA
+  static constexpr double LOAD_EWMA_ALPHA = 0.5;
+  static constexpr double INFLIGHT_SATURATION = 16;
+  static constexpr double BANDWIDTH_SATURATION = 100.0 * 1024 * 1024; // B/s
+  static constexpr double QUEUE_SATURATION = 8;
+  static constexpr double ERRORS_SATURATION = 5; // Новых ошибок за heartbeat
 
 public:
   NodeManager();
   ~NodeManager();
 
-  // Регистрация узлов
+  // Регистрация узлов; requestedNodeId - сохранённый узлом идентификатор
+  // (пусто - выдать новый)
   bool RegisterNode(const std::string &ip, int port, uint64_t freeSpace,
-                   std::string &nodeId);
+                    const std::string &failureDomain,
+                    const std::string &requestedNodeId, std::string &nodeId);
   bool UnregisterNode(const std::string &nodeId);
   bool UpdateNodeSpace(const std::string &nodeId, uint64_t freeSpace);
+  // Оценка места после переноса чанка между узлами (до следующего
+  // UPDATE_SPACE от узла); delta > 0 - место освободилось
+  void AdjustNodeSpace(const std::string &nodeId, int64_t delta);
+  // Объём данных на узле по индексу реплик
+  void UpdateNodeUsage(const std::string &nodeId, size_t chunksStored,
+                       uint64_t bytesStored);
   void UpdateNodeLastSeen(const std::string &nodeId);
+  // Телеметрия из KEEP_ALIVE: пересчёт оценки нагрузки
+  bool UpdateNodeTelemetry(const std::string &nodeId,
+                           const NodeTelemetry &telemetry);
 
-  // Получение информации
-  StorageNode *GetNode(const std::string &nodeId);
+  // Получение информации: копия узла (запись таблицы меняется под
+  // nodesMutex после возврата)
+  bool GetNode(const std::string &nodeId, StorageNode &node) const;
+  // Копия узла, если он активен
+  bool GetActiveNode(const std::string &nodeId, StorageNode &node) const;
+  // Снимок адресов узлов (без nodesMutex, если узлы не менялись)
+  std::shared_ptr<const NodeDirectory> GetNodeDirectory();
   std::vector<StorageNode> GetAvailableNodes(size_t count,
                                              uint64_t requiredSpace);
   std::vector<StorageNode> GetAllActiveNodes();
+
+  // Обход узлов, доступных для записи, с не менее чем requiredSpace
+  // эффективного свободного места, по убыванию места. Узлы не копируются;
+  // visitor вызывается под nodesMutex и возвращает false для остановки
+  void ForEachEligibleNode(
+      uint64_t requiredSpace,
+      const std::function<bool(const StorageNode &)> &visitor) const;
+
+  // Размещение реплик каждого чанка взвешенным рандеву-хешированием
+  // (вес - свободное место); реплики чанка разносятся по разным доменам
+  // отказа, если их достаточно; spareNodes запасных узлов для перезаписи
+  bool PlanPlacement(const std::string &placementKey, size_t chunkCount,
+                     size_t replicationFactor, uint64_t chunkSize,
+                     size_t spareNodes, PlacementPlan &plan);
   size_t GetActiveNodeCount();
 
+  // Узел для новой реплики чанка (HRW по chunkId) среди узлов не из
+  // excludeNodeIds; предпочитается домен отказа без живых реплик
+  bool SelectReplicaTarget(const std::string &chunkId, uint64_t chunkSize,
+                           const std::vector<std::string> &excludeNodeIds,
+                           StorageNode &target);
+
+  // Резервирование места под загрузку; повторный вызов для той же сессии
+  // (возобновление) заменяет прежний резерв и продлевает его. При нехватке
+  // места прежний резерв сохраняется
+  bool ReserveSpace(const std::string &sessionId,
+                    const std::unordered_map<std::string, uint64_t> &bytes);
+  // Завершение загрузки: резерв снимается, записанные байты вычитаются
+  // из свободного места до следующего отчёта узла
+  void CommitReservation(
+      const std::string &sessionId,
+      const std::unordered_map<std::string, uint64_t> &storedBytes);
+  void ReleaseReservation(const std::string &sessionId);
+
+  // Сохранение на диск: журнал подключается после восстановления.
+  // Восстановленные узлы неактивны до повторной регистрации с node_id
+  void SetLog(MetadataLog *metadataLog);
+  bool ApplyLogRecord(const MetadataLog::Record &record);
+  // Снимок: все известные узлы в writer; загрузка - неактивными
+  void ExportSnapshot(SnapshotImageWriter &writer);
+  void LoadSnapshotImage(const SnapshotImage &image);
+  void Clear();
+
   // Мониторинг
+  void SetNodeStateCallback(NodeStateCallback callback);
   void StartKeepAliveChecker();
   void StopKeepAliveChecker();
   void CheckNodeHealth();
@@ -72,7 +255,38 @@ private:
   // Внутренние методы
   std::string GenerateNodeId();
   bool ValidateNodeInfo(const std::string &ip, int port, uint64_t freeSpace);
+  bool ValidateNodeId(const std::string &nodeId);
   void RemoveInactiveNodes();
-  std::vector<StorageNode> FilterAndSortNodes(uint64_t requiredSpace);
+  void ReleaseReservationLocked(const std::string &sessionId);
+  void SetNodeActiveLocked(StorageNode &node, bool active);
+  void NotifyNodeState(const std::string &nodeId, bool active);
+  void SetNodeFreeSpaceLocked(StorageNode &node, uint64_t freeSpace);
+  void ForEachEligibleNodeLocked(
+      uint64_t requiredSpace,
+      const std::function<bool(const StorageNode &)> &visitor) const;
+  void ForEachEligibleEntryLocked(
+      uint64_t requiredSpace,
+      const std::function<bool(const EligibleIndex::value_type &)> &visitor)
+      const;
+  // Выбор узлов плана среди кандидатов (без nodesMutex): chosen -
+  // кандидаты в порядке таблицы plan.nodes
+  bool ChoosePlacement(const std::vector<PlacementCandidate> &candidates,
+                       const std::string &placementKey, size_t chunkCount,
+                       size_t replicationFactor, uint64_t chunkSize,
+                       size_t spareNodes, std::vector<size_t> &chosen,
+                       std::vector<std::vector<size_t>> &chunkReplicas);
+  uint32_t GetDomainIdLocked(const std::string &failureDomain);
+  static int GetReadRank(const StorageNode &node);
+  static bool IsSameAddresses(const NodeDirectory &a, const NodeDirectory &b);
+  void ReindexNodeLocked(const StorageNode &node);
+  void UnindexNodeLocked(const std::string &nodeId);
+  uint64_t AppendLogLocked(const MetadataLog::Record &record);
+  bool WaitLogDurable(uint64_t seq);
+  static MetadataLog::Record MakeNodeRecord(const StorageNode &node);
+  static double GetPlacementWeight(const StorageNode &node);
+  static double ComputeLoad(const NodeTelemetry &telemetry,
+                            uint64_t newErrors);
+  static size_t GetSharedDomainDepth(const std::string &a,
+                                     const std::string &b);
 };
 
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Взвешенное рандеву-хеширование (HRW) для размещения реплик.
+// Каждый узел получает для ключа чанка оценку -weight / ln(u), где u -
+// равномерное число из (0, 1), полученное из хеша пары (ключ, узел).
+// Реплики чанка - узлы с наибольшими оценками: нагрузка распределяется
+// пропорционально весам, а добавление или удаление узла перемещает только
+// чанки, для которых этот узел входит в топ.
+namespace Placement {
+  // 64-битный хеш строки (FNV-1a с финальным перемешиванием)
+  uint64_t Hash64(const std::string &data);
+
+  // Перемешивание пары хешей (ключ чанка, узел)
+  uint64_t Combine(uint64_t keyHash, uint64_t nodeHash);
+
+  // Оценка узла для ключа (больше - лучше); weight <= 0 даёт минимум
+  double Score(uint64_t keyHash, uint64_t nodeHash, double weight);
+}
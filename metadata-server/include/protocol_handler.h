@@ -1,7 +1,11 @@
 #pragma once
 
+#include "manifest_cache.h"
 #include "metadata_manager.h"
 #include "node_manager.h"
+#include "repair_scheduler.h"
+#include "shard_map.h"
+#include "shard_relay.h"
 #include <string>
 #include <vector>
 
@@ -18,40 +22,94 @@ class ProtocolHandler {
 private:
   NodeManager *nodeManager;
   MetadataManager *metadataManager;
+  RepairScheduler *repairScheduler;
+
+  // Шардирование пространства имён (nullptr - один сервер на все файлы)
+  const ShardMap *shardMap;
+  size_t localShard;
+  ShardRelay *shardRelay; // Запросы узлов хранения остальным шардам
+
+  // Готовые ответы REQUEST_DOWNLOAD
+  ManifestCache manifestCache;
+  static constexpr size_t MANIFEST_CACHE_BYTES = 64 * 1024 * 1024;
 
   // Константы протокола (используем строковые литералы напрямую)
 
+  static constexpr size_t SPARE_NODES = 2; // Запасные узлы для перезаписи
+  // Попытки план+резерв: параллельная загрузка может занять место
+  // между планированием и резервированием
+  static constexpr size_t PLACEMENT_ATTEMPTS = 3;
+
+  // Ограничения многострочных запросов
+  static constexpr size_t MAX_UPLOAD_LINES = 10000;
+  static constexpr size_t MAX_INVENTORY_CHUNKS = 1000000;
+  // Размер страницы LIST_FILES: по умолчанию и наибольший
+  static constexpr size_t LIST_FILES_DEFAULT_LIMIT = 1000;
+  static constexpr size_t LIST_FILES_MAX_LIMIT = 10000;
+
+public:
   // Константы для репликации
   static constexpr size_t REPLICATION_FACTOR = 2; // 2 копии каждого чанка
 
-public:
-  ProtocolHandler(NodeManager *nodeManager, MetadataManager *metadataManager);
+  ProtocolHandler(NodeManager *nodeManager, MetadataManager *metadataManager,
+                  RepairScheduler *repairScheduler);
 
-  // Основной метод обработки
-  std::string ProcessRequest(const std::string &request, SOCKET socket);
+  // Шард этого сервера; вызывается до обработки запросов
+  void SetSharding(const ShardMap *shardMap, size_t localShard,
+                   ShardRelay *shardRelay);
+
+  // Основной метод обработки; relayed - запрос переслан другим шардом
+  // (RELAY) и дальше не пересылается
+  std::string ProcessRequest(const std::string &request, SOCKET socket,
+                             bool relayed = false);
   
-  // Обработка многострочного запроса (для UPLOAD_COMPLETE)
-  std::string ProcessMultilineRequest(const std::string &firstLine, SOCKET socket);
+  // Обработка многострочного запроса (UPLOAD_COMPLETE, CHUNK_INVENTORY)
+  static bool IsMultilineRequest(const std::string &firstLine);
+  std::string ProcessMultilineRequest(const std::string &firstLine,
+                                      SOCKET socket, bool relayed = false);
 
 private:
   // Обработчики команд от Storage Node
   std::string HandleRegisterNode(const std::vector<std::string> &args);
   std::string HandleKeepAlive(const std::vector<std::string> &args);
   std::string HandleUpdateSpace(const std::vector<std::string> &args);
+  std::string HandleChunkInventory(const std::string &firstLine, SOCKET socket,
+                                   bool relayed);
 
   // Обработчики команд от Client
   std::string HandleRequestUpload(const std::vector<std::string> &args);
+  std::string HandleResumeUpload(const std::vector<std::string> &args);
   std::string HandleUploadComplete(const std::string &firstLine, SOCKET socket);
   std::string HandleRequestDownload(const std::vector<std::string> &args);
-  std::string HandleListFiles();
+  std::string HandleDeleteFile(const std::vector<std::string> &args);
+  std::shared_ptr<const DownloadManifest>
+  BuildDownloadManifest(const FileMetadata &metadata,
+                        const NodeDirectory &directory);
+  std::string HandleListFiles(const std::vector<std::string> &args);
   std::string HandleListNodes();
+  std::string HandleGetShardMap();
+
+  // Шардирование: принадлежит ли имя этому шарду; иначе в wrongShard
+  // ответ "<prefix> ERROR WRONG_SHARD <шард>"
+  bool IsLocalFilename(const std::string &filename,
+                       const std::string &responsePrefix,
+                       std::string &wrongShard);
+  // Пересылка успешного запроса узла хранения остальным шардам
+  void RelayNodeRequest(const std::vector<std::string> &args,
+                        const std::string &request,
+                        const std::string &response);
 
   // Утилиты
+  std::string BuildUploadResponse(const std::string &filename,
+                                  uint64_t fileSize,
+                                  const std::string &sessionId);
   std::vector<std::string> ParseCommand(const std::string &command);
   std::string CreateErrorResponse(const std::string &errorCode,
                                   const std::string &message);
   std::string CreateSuccessResponse(const std::string &data);
-  bool ReadMultilineRequest(SOCKET socket, std::string &request, const std::string &firstLine);
+  bool ReadMultilineRequest(SOCKET socket, std::string &request,
+                            const std::string &firstLine,
+                            const std::string &endMarker, size_t maxLines);
   std::vector<std::string> SplitLines(const std::string &text);
 };
 
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "bandwidth_limiter.h"
+#include "metadata_manager.h"
+#include "node_manager.h"
+#include "repair_scheduler.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Фоновое выравнивание заполненности узлов.
+// Раз в проход считается доля занятого места каждого активного узла
+// (данные по индексу реплик / totalSpace) и средняя по кластеру. Пока
+// разброс между самым заполненным и самым пустым узлом больше порога,
+// планируются переносы чанков с переполненных узлов на недозаполненные,
+// не ухудшая разнесение реплик по доменам отказа. Перенос: узел-источник
+// передаёт чанк получателю (REPLICATE_CHUNK), сервер проверяет копию
+// (CHECK_CHUNK), атомарно меняет реплику в метаданных (пакетами по
+// MOVE_COMMIT_BATCH переносов) и лишь через DELETE_DELAY_SEC удаляет
+// старую копию - клиенты, получившие прежний список узлов, успевают
+// дочитать. Пока ремонт не разобрал свою очередь,
+// переносы не выполняются. При шардировании не запускается: удаляемая
+// копия может быть репликой того же содержимого из файла другого шарда.
+class Rebalancer {
+private:
+  struct ChunkMove {
+    std::string chunkId;
+    uint64_t size;
+    StorageNode source;
+    StorageNode target;
+  };
+
+  struct PendingDelete {
+    std::chrono::steady_clock::time_point dueAt;
+    StorageNode node;
+    std::string chunkId;
+    uint64_t size;
+  };
+
+  NodeManager *nodeManager;
+  MetadataManager *metadataManager;
+  RepairScheduler *repairScheduler;
+  BandwidthLimiter limiter;
+
+  std::vector<PendingDelete> pendingDeletes; // Только поток ребалансировки
+
+  std::thread rebalanceThread;
+  std::atomic<bool> running;
+  std::mutex stopMutex;
+  std::condition_variable stopCondition;
+
+  std::atomic<uint64_t> movedChunks;
+
+  static constexpr int REBALANCE_INTERVAL_SEC = 60;
+  static constexpr int DELETE_DELAY_SEC = 60;
+  static constexpr double IMBALANCE_THRESHOLD = 0.10; // Разброс долей
+  static constexpr size_t MAX_MOVES_PER_PASS = 256;
+  static constexpr size_t MOVE_COMMIT_BATCH = 32;
+  static constexpr uint64_t DEFAULT_BANDWIDTH = 20ULL * 1024 * 1024; // 20 MB/s
+  static constexpr uint64_t BURST_BYTES = 4ULL * 1024 * 1024;
+
+public:
+  Rebalancer(NodeManager *nodeManager, MetadataManager *metadataManager,
+             RepairScheduler *repairScheduler);
+  ~Rebalancer();
+
+  void Start();
+  void Stop();
+
+  // Суммарная скорость переносов (0 - без ограничения)
+  void SetBandwidthLimit(uint64_t bytesPerSecond);
+
+  uint64_t GetMovedChunks() const { return movedChunks; }
+
+private:
+  void RebalanceLoop();
+  void RunPass();
+
+  // План переносов по текущей заполненности
+  std::vector<ChunkMove> PlanMoves(
+      const std::vector<StorageNode> &activeNodes,
+      const std::unordered_map<std::string, NodeUsage> &usage);
+  // Копия чанка на получатель без изменения метаданных
+  bool CopyChunk(const ChunkMove &move);
+  // Замена реплик скопированных чанков одним пакетом; число выполненных
+  size_t CommitMoves(const std::vector<ChunkMove> &copied);
+  void ProcessPendingDeletes();
+};
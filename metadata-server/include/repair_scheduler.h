@@ -0,0 +1,159 @@
+#pragma once
+
+#include "bandwidth_limiter.h"
+#include "metadata_manager.h"
+#include "node_manager.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Восстановление реплик чанков после отказа узлов.
+// Когда узел становится неактивным, его чанки (по обратному индексу
+// MetadataManager) после отсрочки (узел может вернуться после перезапуска
+// или сетевого сбоя) попадают в очередь с приоритетом по риску: первыми
+// чинятся чанки с наименьшим числом живых реплик. Рабочий поток выбирает
+// новый узел (HRW по chunkId) и командует живому держателю реплики
+// передать чанк напрямую (REPLICATE_CHUNK); общий поток ремонта
+// ограничивается BandwidthLimiter. Скопированные реплики записываются в
+// метаданные пакетами (файл со многими чинящимися чанками копируется раз
+// на пакет). Периодический полный обход находит чанки, пропущенные
+// событиями (например, после неудачных попыток); он идёт порциями по
+// SCAN_BATCH чанков в секунду, не собирая список всех чанков.
+class RepairScheduler {
+private:
+  struct RepairTask {
+    size_t liveReplicas;  // Приоритет: меньше живых реплик - раньше
+    uint64_t sequence;    // Порядок постановки среди равных
+    std::string chunkId;
+    size_t attempts;
+  };
+
+  struct TaskOrder {
+    bool operator()(const RepairTask &a, const RepairTask &b) const {
+      if (a.liveReplicas != b.liveReplicas) {
+        return a.liveReplicas > b.liveReplicas;
+      }
+      return a.sequence > b.sequence;
+    }
+  };
+
+  // Отложенная повторная попытка
+  struct RetryTask {
+    std::chrono::steady_clock::time_point dueAt;
+    std::string chunkId;
+    size_t attempts;
+  };
+
+  // Скопированная реплика, ждущая записи в метаданные
+  struct RepairCommit {
+    ReplicaChange change;
+    uint64_t size;
+    std::string sourceNodeId;
+    size_t replicas; // Живых реплик вместе с новой
+  };
+
+  NodeManager *nodeManager;
+  MetadataManager *metadataManager;
+  size_t replicationFactor;
+  BandwidthLimiter limiter;
+
+  std::priority_queue<RepairTask, std::vector<RepairTask>, TaskOrder> queue;
+  std::unordered_set<std::string> scheduled; // В очереди, в работе или ждут
+  std::vector<RetryTask> retries;
+  // Отказавшие узлы в отсрочке: время, когда начнётся ремонт их чанков.
+  // Вернувшийся до срока узел убирается отсюда без ремонта
+  std::unordered_map<std::string, std::chrono::steady_clock::time_point>
+      downNodes;
+  int downGraceSec;
+  std::unordered_set<std::string> lostChunks; // Чанки без живых реплик
+  uint64_t nextSequence;
+  std::mutex queueMutex;
+  std::condition_variable queueCondition;    // Для рабочих потоков
+  std::condition_variable scanCondition;     // Для потока обхода
+
+  // Пакет записывается, когда набран или очередь опустела. Порядок
+  // блокировок: commitMutex, затем queueMutex
+  std::vector<RepairCommit> pendingCommits;
+  std::mutex commitMutex;
+
+  std::vector<std::thread> workers;
+  std::thread scanThread;
+  // Позиция полного обхода (только поток обхода)
+  ChunkScanCursor scanCursor;
+  bool scanning;
+  std::atomic<bool> running;
+
+  std::atomic<uint64_t> repairedChunks;
+
+  static constexpr size_t WORKER_COUNT = 4;
+  static constexpr size_t MAX_ATTEMPTS = 5;
+  static constexpr int RETRY_DELAY_SEC = 10;
+  static constexpr size_t COMMIT_BATCH = 64;
+  static constexpr int SCAN_INTERVAL_SEC = 300;
+  static constexpr size_t SCAN_BATCH = 8192;
+  static constexpr int DEFAULT_DOWN_GRACE_SEC = 300;
+  static constexpr uint64_t DEFAULT_BANDWIDTH = 50ULL * 1024 * 1024; // 50 MB/s
+  static constexpr uint64_t BURST_BYTES = 4ULL * 1024 * 1024;
+
+public:
+  RepairScheduler(NodeManager *nodeManager, MetadataManager *metadataManager,
+                  size_t replicationFactor);
+  ~RepairScheduler();
+
+  void Start();
+  void Stop();
+
+  // Суммарная скорость ремонта по кластеру (0 - без ограничения)
+  void SetBandwidthLimit(uint64_t bytesPerSecond);
+  // Отсрочка ремонта после отказа узла (0 - ремонт сразу)
+  void SetDownGrace(int seconds);
+
+  // Подписка на NodeManager: отказ узла ставит его чанки в очередь по
+  // истечении отсрочки, возвращение узла отменяет ожидающий ремонт
+  void OnNodeStateChanged(const std::string &nodeId, bool active);
+
+  // Постановка чанка в очередь, если ему не хватает реплик
+  void EnqueueChunk(const std::string &chunkId);
+
+  // Статистика
+  size_t GetQueueLength();
+  uint64_t GetRepairedChunks() const { return repairedChunks; }
+  size_t GetLostChunks();
+
+private:
+  void WorkerLoop();
+  void ScanLoop();
+  // Порция полного обхода; false - обход завершён
+  bool ScanChunkBatch();
+
+  // Живые реплики из списка узлов
+  std::vector<StorageNode> GetLiveReplicas(
+      const std::vector<std::string> &nodeIds) const;
+
+  // Одна попытка ремонта; false - стоит повторить позже, copied - реплика
+  // скопирована и ждёт записи в метаданные (CommitRepairs)
+  bool RepairChunk(const std::string &chunkId, size_t attempts,
+                   bool &copied);
+  // Запись скопированных реплик пакетом; force - не дожидаясь пакета
+  void CommitRepairs(bool force);
+  void ScheduleRetry(const std::string &chunkId, size_t attempts);
+  void FinishChunk(const std::string &chunkId);
+  void PushLocked(const std::string &chunkId, size_t liveReplicas,
+                  size_t attempts);
+  // Постановка чанка по его репликам (queueMutex уже захвачен)
+  void EnqueueLocked(const std::string &chunkId,
+                     const std::vector<std::string> &nodeIds,
+                     size_t liveReplicas);
+  void ReportLost(const std::string &chunkId, bool lost);
+  // Реплики на узлах в отсрочке (queueMutex уже захвачен)
+  size_t CountDownGraceLocked(const std::vector<std::string> &nodeIds) const;
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <atomic>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -18,9 +19,16 @@ typedef int SOCKET;
 #define closesocket close
 #endif
 
+#include "chunk_collector.h"
 #include "node_manager.h"
 #include "metadata_manager.h"
+#include "metadata_store.h"
 #include "protocol_handler.h"
+#include "rebalancer.h"
+#include "repair_scheduler.h"
+#include "shard_map.h"
+#include "shard_relay.h"
+#include "standby_replicator.h"
 
 class MetadataServer {
 private:
@@ -32,7 +40,22 @@ private:
   // Менеджеры
   NodeManager nodeManager;
   MetadataManager metadataManager;
+  MetadataStore metadataStore; // Журнал и снимки метаданных на диске
+  RepairScheduler repairScheduler; // Восстановление реплик после отказов
   ProtocolHandler protocolHandler; // Инициализируется в конструкторе
+  Rebalancer rebalancer; // Выравнивание заполненности узлов
+  ChunkCollector chunkCollector; // Удаление чанков без ссылок с узлов
+
+  // Резервный режим: состояние приходит из журнала основного сервера,
+  // клиентам отвечается NOT_PRIMARY до повышения
+  std::atomic<bool> standby;
+  std::unique_ptr<StandbyReplicator> replicator;
+  std::mutex roleMutex; // Повышение выполняется один раз
+
+  // Шард пространства имён и пересылка запросов узлов остальным шардам
+  ShardMap shardMap;
+  size_t shardIndex;
+  ShardRelay shardRelay;
 
   // Потоки
   std::thread acceptThread;
@@ -44,9 +67,20 @@ private:
   static const int SOCKET_TIMEOUT_SEC = 30;
 
 public:
-  MetadataServer(int port = 8080);
+  MetadataServer(int port = 8080,
+                 const std::string &dataDir = "./metadata-data");
   ~MetadataServer();
 
+  // Резервный режим (до Initialize): следовать за основным primaryIp:port;
+  // leaseSec > 0 - повышение после стольких секунд без связи с ним
+  void SetStandby(const std::string &primaryIp, int primaryPort,
+                  int leaseSec);
+  // Шардирование (до Initialize): этот сервер - шард shardIndex карты
+  bool SetSharding(const ShardMap &shardMap, size_t shardIndex);
+  // Повышение резервного до основного (PROMOTE или истечение аренды)
+  bool Promote();
+  bool IsStandby() const { return standby; }
+
   // Инициализация и запуск
   bool Initialize();
   void Run();
@@ -60,6 +94,9 @@ public:
   // Геттеры
   NodeManager &GetNodeManager() { return nodeManager; }
   MetadataManager &GetMetadataManager() { return metadataManager; }
+  RepairScheduler &GetRepairScheduler() { return repairScheduler; }
+  Rebalancer &GetRebalancer() { return rebalancer; }
+  ChunkCollector &GetChunkCollector() { return chunkCollector; }
 
 private:
   // Внутренние методы
@@ -67,5 +104,8 @@ private:
   bool CreateListenSocket();
   void AcceptLoop();
   void Cleanup();
+  void StartPrimaryServices();
+  // Команды роли: ROLE, PROMOTE
+  std::string HandleRoleCommand(const std::string &command);
 };
 
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "shard_map.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Пересылка запросов узлов хранения остальным шардам. Узел хранения
+// работает с одним сервером метаданных, а размещать реплики и следить за
+// отказами должен каждый шард, поэтому REGISTER_NODE, KEEP_ALIVE,
+// UPDATE_SPACE и CHUNK_INVENTORY повторяются на всех шардах с префиксом
+// RELAY (получатель их дальше не пересылает). У каждого шарда своя очередь
+// и поток: недоступный шард не задерживает остальные, запросы к нему
+// доставляются по порядку после восстановления связи.
+class ShardRelay {
+private:
+  struct Peer {
+    size_t shard;
+    std::vector<std::pair<std::string, int>> endpoints;
+    size_t activeEndpoint; // Последний ответивший основной
+    std::deque<std::string> queue;
+    std::thread thread;
+  };
+
+  std::vector<std::unique_ptr<Peer>> peers;
+  std::mutex mutex; // Защищает очереди
+  std::condition_variable queueCondition;
+  std::atomic<bool> running;
+  size_t droppedRequests;
+
+  // Очередь к недоступному шарду ограничена: старые запросы отбрасываются
+  // (KEEP_ALIVE и UPDATE_SPACE повторяются узлами сами)
+  static constexpr size_t MAX_QUEUE = 10000;
+  static constexpr int SEND_TIMEOUT_SEC = 5;
+  static constexpr int RETRY_DELAY_MS = 1000;
+
+public:
+  ShardRelay();
+  ~ShardRelay();
+
+  // Получатели - все шарды карты, кроме localShard
+  bool Configure(const ShardMap &shardMap, size_t localShard);
+  void Start();
+  void Stop();
+
+  // request - полный текст запроса с завершающими \r\n
+  void Forward(const std::string &request);
+
+private:
+  void PeerLoop(Peer *peer);
+  bool Deliver(Peer &peer, const std::string &request);
+};
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Двоичный снимок метаданных (формат 2).
+// После заголовка идут секции, каждая с границы 8 байт:
+//   stringOffsets    - uint64 смещения строк (строк + 1) в stringData
+//   stringData       - байты строк подряд
+//   nodeNames        - uint64 строка идентификатора на каждый дескриптор узла
+//   nodes            - SnapshotNodeRecord зарегистрированных узлов
+//   chunks           - SnapshotChunkRecord фиксированной ширины, по
+//                      возрастанию идентификатора
+//   replicas         - uint32 дескрипторы узлов (реплики чанков подряд)
+//   files            - SnapshotFileRecord
+//   fileChunks       - uint32 индексы чанков файлов по порядку
+//   chunkFiles       - uint32 индексы файлов, содержащих чанк
+//   nodeChunkOffsets - uint64 начала списков nodeChunks (дескрипторов + 1)
+//   nodeChunks       - uint32 индексы чанков на узле, по дескрипторам
+//   nodeUsage        - SnapshotNodeUsage на каждый дескриптор узла
+// Реплики ссылаются на узлы дескрипторами, а не строками, идентификатор
+// чанка из 64 hex-символов хранится 32 байтами. Упорядоченные чанки и
+// обратные индексы (чанк -> файлы, узел -> чанки) позволяют отвечать на
+// запросы прямо из отображения, не разбирая снимок в память. Тело
+// защищено CRC-32 в заголовке. Числа записываются в порядке байт машины;
+// чужой порядок распознаётся по byteOrder и такой снимок не читается.
+struct SnapshotSection {
+  uint64_t offset;
+  uint64_t count;
+};
+
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint64_t logSeq; // Граница снимка в журнале
+  uint64_t fileSize;
+  SnapshotSection stringOffsets;
+  SnapshotSection stringData;
+  SnapshotSection nodeNames;
+  SnapshotSection nodes;
+  SnapshotSection chunks;
+  SnapshotSection replicas;
+  SnapshotSection files;
+  SnapshotSection fileChunks;
+  SnapshotSection chunkFiles;
+  SnapshotSection nodeChunkOffsets;
+  SnapshotSection nodeChunks;
+  SnapshotSection nodeUsage;
+  uint32_t bodyCrc;
+  uint32_t headerCrc; // По байтам заголовка до этого поля
+};
+
+struct SnapshotNodeRecord {
+  uint32_t handle; // Индекс в nodeNames
+  uint32_t port;
+  uint64_t ipString;
+  uint64_t domainString;
+  uint64_t totalSpace;
+};
+
+struct SnapshotChunkRecord {
+  // SHA-256 в двоичном виде; при CHUNK_ID_IN_STRING_TABLE первые 8 байт -
+  // индекс строки (идентификатор не из 64 строчных hex-символов). Такие
+  // чанки идут после всех остальных
+  uint8_t id[32];
+  uint64_t size;
+  uint64_t firstReplica;
+  uint32_t replicaCount;
+  uint32_t flags;
+  uint64_t firstFile; // Индекс в chunkFiles
+  uint32_t fileCount;
+  uint32_t reserved;
+};
+
+struct SnapshotFileRecord {
+  uint64_t nameString;
+  uint64_t totalSize;
+  uint64_t firstChunk; // Индекс в fileChunks
+  uint64_t chunkCount;
+};
+
+// Данные на узле: как NodeUsage менеджера метаданных
+struct SnapshotNodeUsage {
+  uint64_t chunks;
+  uint64_t bytes;
+  uint64_t fingerprint;
+};
+
+// Снимок, отображённый в память только для чтения. Open проверяет
+// заголовок, CRC и все ссылки между секциями, после чего записи читаются
+// напрямую из отображения без разбора
+class SnapshotImage {
+private:
+  const unsigned char *data;
+  size_t size;
+#ifdef _WIN32
+  void *fileHandle;
+  void *mappingHandle;
+#endif
+
+  const SnapshotHeader *header;
+  const uint64_t *stringOffsets;
+  const char *stringData;
+  const uint64_t *nodeNames;
+  const SnapshotNodeRecord *nodes;
+  const SnapshotChunkRecord *chunks;
+  const uint32_t *replicas;
+  const SnapshotFileRecord *files;
+  const uint32_t *fileChunks;
+  const uint32_t *chunkFiles;
+  const uint64_t *nodeChunkOffsets;
+  const uint32_t *nodeChunks;
+  const SnapshotNodeUsage *nodeUsage;
+  size_t hexChunkCount; // Чанки без CHUNK_ID_IN_STRING_TABLE
+
+public:
+  static constexpr uint32_t FORMAT_VERSION = 2;
+  static constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+  static constexpr uint32_t CHUNK_ID_IN_STRING_TABLE = 1;
+
+  SnapshotImage();
+  ~SnapshotImage();
+  SnapshotImage(const SnapshotImage &) = delete;
+  SnapshotImage &operator=(const SnapshotImage &) = delete;
+
+  bool Open(const std::string &path);
+  void Close();
+
+  // Начинается ли файл с сигнатуры двоичного снимка
+  static bool HasImageMagic(const std::string &path);
+
+  uint64_t GetLogSeq() const { return header->logSeq; }
+
+  size_t GetNodeNameCount() const { return header->nodeNames.count; }
+  std::string GetNodeName(uint32_t handle) const;
+
+  size_t GetNodeCount() const { return header->nodes.count; }
+  const SnapshotNodeRecord &GetNode(size_t index) const {
+    return nodes[index];
+  }
+
+  size_t GetChunkCount() const { return header->chunks.count; }
+  const SnapshotChunkRecord &GetChunk(size_t index) const {
+    return chunks[index];
+  }
+  std::string GetChunkId(const SnapshotChunkRecord &chunk) const;
+  const uint32_t *GetReplicas(const SnapshotChunkRecord &chunk) const {
+    return replicas + chunk.firstReplica;
+  }
+  const uint32_t *GetChunkFiles(const SnapshotChunkRecord &chunk) const {
+    return chunkFiles + chunk.firstFile;
+  }
+  // Индекс чанка: двоичный поиск по идентификатору
+  bool FindChunk(const std::string &chunkId, size_t &index) const;
+
+  size_t GetFileCount() const { return header->files.count; }
+  const SnapshotFileRecord &GetFile(size_t index) const {
+    return files[index];
+  }
+  const uint32_t *GetFileChunks(const SnapshotFileRecord &file) const {
+    return fileChunks + file.firstChunk;
+  }
+
+  // Чанки с репликой на узле (по возрастанию индекса)
+  size_t GetNodeChunkCount(uint32_t handle) const {
+    return nodeChunkOffsets[handle + 1] - nodeChunkOffsets[handle];
+  }
+  const uint32_t *GetNodeChunks(uint32_t handle) const {
+    return nodeChunks + nodeChunkOffsets[handle];
+  }
+  const SnapshotNodeUsage &GetNodeUsage(uint32_t handle) const {
+    return nodeUsage[handle];
+  }
+
+  std::string GetString(uint64_t index) const;
+
+private:
+  bool Validate();
+};
+
+// Сборка снимка в памяти и запись в файл
+class SnapshotImageWriter {
+private:
+  std::vector<uint64_t> stringOffsets;
+  std::string stringData;
+  // Повторяющиеся строки (узлы, адреса, домены) хранятся один раз
+  std::unordered_map<std::string, uint64_t> sharedStrings;
+
+  std::unordered_map<std::string, uint32_t> nodeHandles;
+  std::vector<uint64_t> nodeNames;
+  std::vector<SnapshotNodeRecord> nodes;
+  std::vector<SnapshotNodeUsage> nodeUsage;
+
+  std::unordered_map<std::string, uint32_t> chunkIndexes;
+  std::vector<SnapshotChunkRecord> chunks;
+  std::vector<uint32_t> replicas;
+
+  std::vector<SnapshotFileRecord> files;
+  std::vector<uint32_t> fileChunks;
+
+  // Строятся в Write
+  std::vector<uint32_t> chunkFiles;
+  std::vector<uint64_t> nodeChunkOffsets;
+  std::vector<uint32_t> nodeChunks;
+
+public:
+  SnapshotImageWriter();
+
+  void AddNode(const std::string &nodeId, const std::string &ip, int port,
+               const std::string &failureDomain, uint64_t totalSpace);
+  // Повторно добавленный чанк пропускается
+  void AddChunk(const std::string &chunkId, uint64_t size,
+                const std::vector<std::string> &nodeIds);
+  // Чанки файла должны быть добавлены раньше
+  bool AddFile(const std::string &filename, uint64_t totalSize,
+               const std::vector<std::string> &chunkIds);
+
+  size_t GetRecordCount() const { return nodes.size() + files.size(); }
+
+  // Запись во временный файл, fsync и переименование в path. Чанки при
+  // этом упорядочиваются: после Write добавлять записи нельзя
+  bool Write(const std::string &path, uint64_t logSeq);
+
+private:
+  // Упорядочивание чанков и обратные индексы
+  void BuildIndexes();
+  uint64_t AddString(const std::string &value);
+  uint64_t AddSharedString(const std::string &value);
+  uint32_t GetNodeHandle(const std::string &nodeId);
+};
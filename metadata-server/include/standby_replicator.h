@@ -0,0 +1,74 @@
+#pragma once
+
+#include "metadata_store.h"
+#include "network_utils.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Резервный сервер метаданных: подписывается на журнал основного
+// (SUBSCRIBE_LOG) и применяет его записи к своим менеджерам, сохраняя их
+// и в свой журнал. При обрыве переподключается с последней записи. Если
+// основной молчит дольше аренды (после хотя бы одного успешного
+// подключения), вызывается обработчик истечения аренды - повышение до
+// основного. Репликация асинхронная: записи, не дошедшие до резервного,
+// теряются при переключении.
+class StandbyReplicator {
+public:
+  using LeaseExpiredCallback = std::function<void()>;
+
+private:
+  MetadataStore *store;
+  std::string primaryIp;
+  int primaryPort;
+  int leaseSec; // 0 - только ручное повышение (PROMOTE)
+
+  std::thread replicationThread;
+  std::atomic<bool> running;
+  std::mutex mutex; // Защищает streamSocket
+  std::condition_variable stopCondition;
+  SOCKET streamSocket;
+
+  // Буфер потока журнала (только поток репликации)
+  std::string streamBuffer;
+  size_t streamOffset;
+
+  std::chrono::steady_clock::time_point lastContact;
+  bool everConnected;
+  std::atomic<uint64_t> appliedRecords;
+
+  LeaseExpiredCallback leaseExpiredCallback;
+
+  static constexpr int RECONNECT_DELAY_MS = 500;
+  static constexpr int CONNECT_TIMEOUT_SEC = 2;
+  // Heartbeat основного - раз в секунду; таймаут чтения короче аренды
+  static constexpr int STREAM_TIMEOUT_SEC = 2;
+
+public:
+  StandbyReplicator(MetadataStore *store, const std::string &primaryIp,
+                    int primaryPort, int leaseSec);
+  ~StandbyReplicator();
+
+  void SetLeaseExpiredCallback(LeaseExpiredCallback callback);
+  void Start();
+  // Можно вызывать и из обработчика истечения аренды
+  void Stop();
+
+  uint64_t GetAppliedRecords() const { return appliedRecords; }
+
+private:
+  void ReplicationLoop();
+  // Один сеанс подписки; возвращается при обрыве
+  void FollowPrimary(SOCKET socket);
+  bool IsLeaseExpired() const;
+  // Чтение строки и байтов из потока через буфер
+  bool ReadLine(SOCKET socket, std::string &line);
+  bool ReadBytes(SOCKET socket, size_t size, std::string &data);
+  bool FillBuffer(SOCKET socket);
+};
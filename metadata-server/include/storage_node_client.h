@@ -0,0 +1,28 @@
+#pragma once
+
+#include "metadata_manager.h"
+#include "node_manager.h"
+
+#include <string>
+#include <vector>
+
+// Команды, которые Metadata Server отправляет узлам хранения.
+// Каждая команда - отдельное соединение, как у клиентов.
+namespace StorageNodeClient {
+  // REPLICATE_CHUNK <chunk_id> <target_ip> <target_port>: узел-источник
+  // сам передаёт чанк узлу-получателю (данные не идут через сервер)
+  bool ReplicateChunk(const StorageNode &source, const std::string &chunkId,
+                      const StorageNode &target);
+
+  // CHECK_CHUNK <chunk_id>: true, если чанк есть на узле
+  bool CheckChunk(const StorageNode &node, const std::string &chunkId);
+
+  // DELETE_CHUNK <chunk_id>: удаление реплики с узла
+  bool DeleteChunk(const StorageNode &node, const std::string &chunkId);
+
+  // DELETE_CHUNKS <count>, строки "<chunk_id> <age_sec>", END_CHUNKS:
+  // удаление пачки копий без ссылок. Узел удаляет копию, только если она
+  // записана не позже age_sec секунд назад
+  bool DeleteChunks(const StorageNode &node,
+                    const std::vector<OrphanReplica> &replicas);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Иерархическое колесо таймеров для событий истечения (таймауты узлов).
+// Четыре уровня по 64 слота: при шаге 100 мс нижний уровень покрывает
+// 6.4 с, следующие - 6.8 мин, 7.3 ч и 19 сут. Постановка, перенос и отмена
+// таймера - O(1); продвижение колеса - O(1) на шаг плюс число сработавших
+// и перенесённых с верхних уровней таймеров.
+//
+// Перенос таймера (heartbeat) не ищет старую запись в слоте: у ключа
+// меняется поколение, а устаревшие записи отбрасываются, когда до их слота
+// доходит колесо.
+//
+// Класс не потокобезопасен: вызывающий защищает его своим мьютексом.
+class TimingWheel {
+public:
+  using Clock = std::chrono::steady_clock;
+
+private:
+  struct Entry {
+    std::string key;
+    uint64_t generation;
+    uint64_t deadlineTick;
+  };
+
+  struct Timer {
+    uint64_t generation;
+    uint64_t deadlineTick;
+  };
+
+  static constexpr size_t LEVELS = 4;
+  static constexpr size_t SLOT_BITS = 6;
+  static constexpr size_t SLOTS = 1 << SLOT_BITS;
+
+  std::chrono::milliseconds tick;
+  Clock::time_point start;
+  uint64_t currentTick;
+  uint64_t nextGeneration;
+
+  std::array<std::array<std::vector<Entry>, SLOTS>, LEVELS> wheel;
+  std::unordered_map<std::string, Timer> timers; // Активные таймеры
+
+public:
+  explicit TimingWheel(std::chrono::milliseconds tick);
+
+  // Постановка (или перенос) таймера ключа на момент deadline
+  void Schedule(const std::string &key, Clock::time_point deadline);
+  void Cancel(const std::string &key);
+  bool IsScheduled(const std::string &key) const;
+  size_t Size() const { return timers.size(); }
+
+  // Продвижение колеса до now; сработавшие ключи дописываются в expired
+  void Advance(Clock::time_point now, std::vector<std::string> &expired);
+
+private:
+  uint64_t ToTick(Clock::time_point time) const;
+  void Insert(Entry entry);
+  void Cascade(size_t level);
+};
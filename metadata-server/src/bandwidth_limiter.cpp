@@ -0,0 +1,62 @@
+#include "bandwidth_limiter.h"
+
+#include <algorithm>
+
+BandwidthLimiter::BandwidthLimiter(uint64_t bytesPerSecond,
+                                   uint64_t burstBytes)
+    : bytesPerSecond(bytesPerSecond),
+      burstBytes(static_cast<double>(burstBytes)),
+      tokens(static_cast<double>(burstBytes)), lastRefill(Clock::now()),
+      cancelled(false) {}
+
+void BandwidthLimiter::SetRate(uint64_t bytesPerSecond) {
+  std::lock_guard<std::mutex> lock(mutex);
+  Refill(Clock::now());
+  this->bytesPerSecond = bytesPerSecond;
+}
+
+uint64_t BandwidthLimiter::GetRate() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return bytesPerSecond;
+}
+
+// Пополнение корзины за прошедшее время (mutex уже захвачен)
+void BandwidthLimiter::Refill(Clock::time_point now) {
+  double elapsed = std::chrono::duration<double>(now - lastRefill).count();
+  tokens = std::min(burstBytes, tokens + elapsed * bytesPerSecond);
+  lastRefill = now;
+}
+
+// Получение токенов на передачу bytes байт
+bool BandwidthLimiter::Acquire(uint64_t bytes) {
+  std::unique_lock<std::mutex> lock(mutex);
+
+  // Больше ёмкости корзины не накопить - ждём полной корзины
+  double needed = std::min(static_cast<double>(bytes), burstBytes);
+
+  while (!cancelled) {
+    Refill(Clock::now());
+    if (bytesPerSecond == 0) {
+      return true;
+    }
+    if (tokens >= needed) {
+      tokens -= static_cast<double>(bytes);
+      return true;
+    }
+
+    auto wait = std::chrono::duration<double>((needed - tokens) /
+                                              bytesPerSecond);
+    stopped.wait_for(lock, wait);
+  }
+
+  return false;
+}
+
+// Прерывание ожидающих (при остановке сервера)
+void BandwidthLimiter::Cancel() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    cancelled = true;
+  }
+  stopped.notify_all();
+}
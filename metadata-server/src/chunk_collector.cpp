@@ -0,0 +1,101 @@
+#include "chunk_collector.h"
+
+#include "storage_node_client.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+ChunkCollector::ChunkCollector(NodeManager *nodeManager,
+                               MetadataManager *metadataManager)
+    : nodeManager(nodeManager), metadataManager(metadataManager),
+      running(false), collectedChunks(0) {}
+
+ChunkCollector::~ChunkCollector() { Stop(); }
+
+void ChunkCollector::Start() {
+  if (running) {
+    return;
+  }
+
+  running = true;
+  collectThread = std::thread(&ChunkCollector::CollectLoop, this);
+}
+
+void ChunkCollector::Stop() {
+  if (!running) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(stopMutex);
+    running = false;
+  }
+  stopCondition.notify_all();
+
+  if (collectThread.joinable()) {
+    collectThread.join();
+  }
+}
+
+void ChunkCollector::CollectLoop() {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(stopMutex);
+      stopCondition.wait_for(lock, std::chrono::seconds(COLLECT_INTERVAL_SEC),
+                             [this] { return !running; });
+      if (!running) {
+        return;
+      }
+    }
+
+    RunPass();
+  }
+}
+
+// Один проход: копии с истёкшим сроком, по узлам
+void ChunkCollector::RunPass() {
+  auto replicas = metadataManager->TakeOrphanReplicas();
+  if (replicas.empty()) {
+    return;
+  }
+
+  size_t total = 0;
+  size_t collected = 0;
+  for (const auto &pair : replicas) {
+    total += pair.second.size();
+    collected += CollectFromNode(pair.first, pair.second);
+  }
+
+  collectedChunks += collected;
+  std::cout << "ChunkCollector: deleted " << collected << " of " << total
+            << " orphan chunk replicas" << std::endl;
+}
+
+size_t ChunkCollector::CollectFromNode(
+    const std::string &nodeId, const std::vector<OrphanReplica> &replicas) {
+  StorageNode node;
+  if (!nodeManager->GetActiveNode(nodeId, node)) {
+    // Неактивный узел - позже; снятый с учёта - вместе с его данными
+    if (nodeManager->GetNode(nodeId, node)) {
+      metadataManager->DeferOrphanReplicas(nodeId, replicas, RETRY_DELAY_SEC);
+    }
+    return 0;
+  }
+
+  size_t collected = 0;
+  for (size_t offset = 0; offset < replicas.size();
+       offset += DELETE_BATCH_CHUNKS) {
+    size_t end = std::min(offset + DELETE_BATCH_CHUNKS, replicas.size());
+    std::vector<OrphanReplica> batch(replicas.begin() + offset,
+                                     replicas.begin() + end);
+
+    // При остановке оставшиеся копии сохраняются до следующего запуска
+    if (!running || !StorageNodeClient::DeleteChunks(node, batch)) {
+      metadataManager->DeferOrphanReplicas(nodeId, batch, RETRY_DELAY_SEC);
+      continue;
+    }
+    collected += batch.size();
+  }
+
+  return collected;
+}
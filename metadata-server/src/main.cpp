@@ -3,6 +3,7 @@
 #include <csignal>
 #include <cstdlib>
 #include <iostream>
+#include <string>
 
 static MetadataServer *g_server = nullptr;
 
@@ -17,21 +18,144 @@ void SignalHandler(int signal) {
 }
 
 int main(int argc, char *argv[]) {
-  // Парсинг аргументов (пока простой)
+  // Парсинг аргументов:
+  // [port] [--repair-bandwidth <MB/s>] [--rebalance-bandwidth <MB/s>]
+  // [--repair-grace <sec>]
+  // [--data-dir <path>] [--standby-of <ip:port>] [--standby-lease <sec>]
+  // [--shards <ip:port[|ip:port]>,... --shard-index <n>]
   int port = 8080;
-  if (argc > 1) {
+  int argIndex = 1;
+  if (argc > argIndex && argv[argIndex][0] != '-') {
     try {
-      port = std::stoi(argv[1]);
+      port = std::stoi(argv[argIndex]);
     } catch (const std::exception &) {
       std::cerr << "Error: Invalid port number" << std::endl;
       return 1;
     }
+    argIndex++;
+  }
+
+  // Ограничения суммарной скорости восстановления реплик и ребалансировки
+  // (0 - без ограничения)
+  long long repairBandwidthMB = -1;
+  long long rebalanceBandwidthMB = -1;
+  // Отсрочка ремонта после отказа узла
+  int repairGraceSec = -1;
+  // Каталог журнала и снимков метаданных
+  std::string dataDir = "./metadata-data";
+  // Резервный режим: адрес основного и аренда (0 - только PROMOTE)
+  std::string primaryIp;
+  int primaryPort = 0;
+  int standbyLeaseSec = 0;
+  // Шардирование: адреса всех шардов (одинаковые на всех серверах) и
+  // номер своего
+  ShardMap shardMap;
+  long long shardIndex = -1;
+  for (; argIndex < argc; ++argIndex) {
+    std::string arg = argv[argIndex];
+    if (arg == "--data-dir" && argIndex + 1 < argc) {
+      dataDir = argv[++argIndex];
+    } else if (arg == "--standby-of" && argIndex + 1 < argc) {
+      std::string primary = argv[++argIndex];
+      size_t colon = primary.rfind(':');
+      try {
+        primaryPort = colon == std::string::npos
+                          ? 0
+                          : std::stoi(primary.substr(colon + 1));
+      } catch (const std::exception &) {
+        primaryPort = 0;
+      }
+      if (primaryPort <= 0) {
+        std::cerr << "Error: --standby-of expects <ip:port>" << std::endl;
+        return 1;
+      }
+      primaryIp = primary.substr(0, colon);
+    } else if (arg == "--shards" && argIndex + 1 < argc) {
+      if (!shardMap.Parse(argv[++argIndex]) || !shardMap.IsSharded()) {
+        std::cerr << "Error: --shards expects <ip:port[|ip:port]>,..."
+                  << std::endl;
+        return 1;
+      }
+    } else if (arg == "--shard-index" && argIndex + 1 < argc) {
+      try {
+        shardIndex = std::stoll(argv[++argIndex]);
+      } catch (const std::exception &) {
+        shardIndex = -1;
+      }
+      if (shardIndex < 0) {
+        std::cerr << "Error: Invalid value for " << arg << std::endl;
+        return 1;
+      }
+    } else if (arg == "--repair-grace" && argIndex + 1 < argc) {
+      try {
+        repairGraceSec = std::stoi(argv[++argIndex]);
+      } catch (const std::exception &) {
+        repairGraceSec = -1;
+      }
+      if (repairGraceSec < 0) {
+        std::cerr << "Error: Invalid value for " << arg << std::endl;
+        return 1;
+      }
+    } else if (arg == "--standby-lease" && argIndex + 1 < argc) {
+      try {
+        standbyLeaseSec = std::stoi(argv[++argIndex]);
+      } catch (const std::exception &) {
+        standbyLeaseSec = -1;
+      }
+      if (standbyLeaseSec < 0) {
+        std::cerr << "Error: Invalid value for " << arg << std::endl;
+        return 1;
+      }
+    } else if ((arg == "--repair-bandwidth" || arg == "--rebalance-bandwidth") &&
+        argIndex + 1 < argc) {
+      long long value = -1;
+      try {
+        value = std::stoll(argv[++argIndex]);
+      } catch (const std::exception &) {
+        value = -1;
+      }
+      if (value < 0) {
+        std::cerr << "Error: Invalid value for " << arg << std::endl;
+        return 1;
+      }
+      if (arg == "--repair-bandwidth") {
+        repairBandwidthMB = value;
+      } else {
+        rebalanceBandwidthMB = value;
+      }
+    } else {
+      std::cerr << "Error: Unknown argument " << arg << std::endl;
+      return 1;
+    }
   }
 
   // Создание экземпляра сервера
-  MetadataServer server(port);
+  MetadataServer server(port, dataDir);
   g_server = &server;
 
+  if (shardMap.IsSharded() &&
+      !server.SetSharding(shardMap, static_cast<size_t>(shardIndex))) {
+    std::cerr << "Error: --shard-index must select one of --shards"
+              << std::endl;
+    return 1;
+  }
+
+  if (!primaryIp.empty()) {
+    server.SetStandby(primaryIp, primaryPort, standbyLeaseSec);
+  }
+
+  if (repairBandwidthMB >= 0) {
+    server.GetRepairScheduler().SetBandwidthLimit(
+        static_cast<uint64_t>(repairBandwidthMB) * 1024 * 1024);
+  }
+  if (repairGraceSec >= 0) {
+    server.GetRepairScheduler().SetDownGrace(repairGraceSec);
+  }
+  if (rebalanceBandwidthMB >= 0) {
+    server.GetRebalancer().SetBandwidthLimit(
+        static_cast<uint64_t>(rebalanceBandwidthMB) * 1024 * 1024);
+  }
+
   // Регистрация обработчиков сигналов
 #ifdef _WIN32
   signal(SIGINT, SignalHandler);
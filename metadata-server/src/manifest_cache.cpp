@@ -0,0 +1,170 @@
+#include "manifest_cache.h"
+
+#include <algorithm>
+#include <utility>
+
+// Ответ с репликами, упорядоченными по рангам узлов таблицы
+std::shared_ptr<const std::string>
+DownloadManifest::Render(const std::vector<int> &ranks) const {
+  std::lock_guard<std::mutex> lock(renderMutex);
+  if (rendered != nullptr && renderedRanks == ranks) {
+    return rendered;
+  }
+
+  std::string response;
+  response.reserve(head.size() + chunks.size() * 96);
+  response += head;
+
+  // Клиент опрашивает реплики в порядке ответа (если не знает узлы сам):
+  // менее нагруженные первыми, при равной нагрузке - исходный порядок
+  std::vector<std::pair<int, size_t>> replicas;
+  for (size_t chunk = 0; chunk < chunks.size(); ++chunk) {
+    response += chunks[chunk];
+
+    replicas.clear();
+    for (size_t r = replicaOffsets[chunk]; r < replicaOffsets[chunk + 1];
+         ++r) {
+      size_t index = replicaIndexes[r];
+      replicas.push_back({ranks[index], index});
+    }
+    std::stable_sort(replicas.begin(), replicas.end(),
+                     [](const std::pair<int, size_t> &a,
+                        const std::pair<int, size_t> &b) {
+                       return a.first < b.first;
+                     });
+    for (const auto &replica : replicas) {
+      response += " " + std::to_string(replica.second);
+    }
+    response += "\r\n";
+  }
+
+  response += "END_CHUNKS\r\n";
+
+  renderedRanks = ranks;
+  rendered = std::make_shared<const std::string>(std::move(response));
+  return rendered;
+}
+
+// Оценка памяти: части ответа и запомненный ответ примерно того же размера
+size_t DownloadManifest::GetSize() const {
+  size_t bytes = head.size() + replicaIndexes.size() * sizeof(size_t) +
+                 replicaOffsets.size() * sizeof(size_t);
+  for (const auto &nodeId : nodeIds) {
+    bytes += nodeId.size();
+  }
+  for (const auto &chunk : chunks) {
+    bytes += chunk.size();
+  }
+  return bytes * 2;
+}
+
+ManifestCache::ManifestCache(size_t maxBytes)
+    : cachedBytes(0), maxBytes(maxBytes) {}
+
+std::string ManifestCache::FlightKey(const std::string &filename,
+                                     uint64_t version, uint64_t epoch) {
+  return std::to_string(version) + ":" + std::to_string(epoch) + ":" +
+         filename;
+}
+
+// Ответ по ключу: попадание, ожидание чужого построения или построение
+std::shared_ptr<const DownloadManifest>
+ManifestCache::Get(const std::string &filename, uint64_t version,
+                   uint64_t epoch, const Builder &builder) {
+  std::string flightKey = FlightKey(filename, version, epoch);
+  std::shared_ptr<Flight> flight;
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = entries.find(filename);
+    if (it != entries.end() && it->second.version == version &&
+        it->second.epoch == epoch) {
+      lru.splice(lru.begin(), lru, it->second.lruPosition);
+      return it->second.manifest;
+    }
+
+    // Ответ уже строится другим запросом
+    auto flightIt = flights.find(flightKey);
+    if (flightIt != flights.end()) {
+      std::shared_ptr<Flight> pending = flightIt->second;
+      flightCondition.wait(lock, [&] { return pending->finished; });
+      if (pending->error) {
+        std::rethrow_exception(pending->error);
+      }
+      return pending->manifest;
+    }
+
+    flight = std::make_shared<Flight>();
+    flights[flightKey] = flight;
+  }
+
+  // Построение завершает ожидание в любом случае: иначе запросы того же
+  // ключа ждали бы вечно
+  try {
+    flight->manifest = builder();
+  } catch (...) {
+    FinishFlight(flightKey, flight, std::current_exception());
+    throw;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    StoreLocked(filename, version, epoch, flight->manifest);
+  }
+  FinishFlight(flightKey, flight, nullptr);
+  return flight->manifest;
+}
+
+// Завершение построения и пробуждение ожидающих
+void ManifestCache::FinishFlight(const std::string &flightKey,
+                                 const std::shared_ptr<Flight> &flight,
+                                 std::exception_ptr error) {
+  std::lock_guard<std::mutex> lock(mutex);
+  flight->error = error;
+  flight->finished = true;
+  flights.erase(flightKey);
+  flightCondition.notify_all();
+}
+
+void ManifestCache::Invalidate(const std::string &filename) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = entries.find(filename);
+  if (it != entries.end()) {
+    EraseLocked(it);
+  }
+}
+
+// Сохранение ответа с вытеснением давно не запрошенных (mutex захвачен)
+void ManifestCache::StoreLocked(
+    const std::string &filename, uint64_t version, uint64_t epoch,
+    const std::shared_ptr<const DownloadManifest> &manifest) {
+  // Запрос со старым снимком не заменяет более новый ответ
+  auto existing = entries.find(filename);
+  if (existing != entries.end()) {
+    if (existing->second.version > version ||
+        (existing->second.version == version &&
+         existing->second.epoch > epoch)) {
+      return;
+    }
+    EraseLocked(existing);
+  }
+  size_t bytes = manifest->GetSize();
+  if (bytes > maxBytes) {
+    return; // Ответ больше всего кэша
+  }
+
+  while (cachedBytes + bytes > maxBytes && !lru.empty()) {
+    EraseLocked(entries.find(lru.back()));
+  }
+
+  lru.push_front(filename);
+  entries[filename] = {version, epoch, manifest, bytes, lru.begin()};
+  cachedBytes += bytes;
+}
+
+void ManifestCache::EraseLocked(
+    std::unordered_map<std::string, Entry>::iterator it) {
+  cachedBytes -= it->second.bytes;
+  lru.erase(it->second.lruPosition);
+  entries.erase(it);
+}
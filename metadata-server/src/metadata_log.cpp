@@ -0,0 +1,443 @@
+#include "metadata_log.h"
+
+#include "hash_utils.h"
+#include "network_utils.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char *SEGMENT_PREFIX = "wal-";
+const char *SEGMENT_SUFFIX = ".log";
+
+} // namespace
+
+MetadataLog::MetadataLog(const std::string &directory)
+    : directory(directory), segment(nullptr), segmentStartSeq(0), nextSeq(0),
+      durableSeq(0), writing(false), failed(false), running(false),
+      groupCommits(0) {}
+
+MetadataLog::~MetadataLog() { Close(); }
+
+std::string MetadataLog::SegmentPath(uint64_t startSeq) const {
+  std::stringstream name;
+  name << SEGMENT_PREFIX << std::setw(20) << std::setfill('0') << startSeq
+       << SEGMENT_SUFFIX;
+  return (fs::path(directory) / name.str()).string();
+}
+
+// Сегменты каталога по возрастанию номера первой записи
+std::vector<std::pair<uint64_t, std::string>>
+MetadataLog::ListSegments() const {
+  std::vector<std::pair<uint64_t, std::string>> segments;
+  std::error_code ec;
+  for (const auto &entry : fs::directory_iterator(directory, ec)) {
+    std::string name = entry.path().filename().string();
+    std::string prefix = SEGMENT_PREFIX;
+    std::string suffix = SEGMENT_SUFFIX;
+    if (name.size() <= prefix.size() + suffix.size() ||
+        name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) !=
+            0) {
+      continue;
+    }
+    try {
+      uint64_t startSeq = std::stoull(
+          name.substr(prefix.size(), name.size() - prefix.size() -
+                                         suffix.size()));
+      segments.push_back({startSeq, entry.path().string()});
+    } catch (const std::exception &) {
+      continue;
+    }
+  }
+  std::sort(segments.begin(), segments.end());
+  return segments;
+}
+
+// Открытие нового сегмента и запуск потока записи
+bool MetadataLog::Open(uint64_t startSeq) {
+  std::error_code ec;
+  fs::create_directories(directory, ec);
+
+  std::string path = SegmentPath(startSeq);
+  segment = std::fopen(path.c_str(), "ab");
+  if (segment == nullptr) {
+    std::cerr << "Error: Cannot open metadata log " << path << std::endl;
+    return false;
+  }
+  SyncDirectory(directory);
+
+  segmentStartSeq = startSeq;
+  nextSeq = startSeq;
+  durableSeq = startSeq;
+  failed = false;
+
+  running = true;
+  writerThread = std::thread(&MetadataLog::WriterLoop, this);
+  return true;
+}
+
+// Остановка: оставшийся буфер дописывается
+void MetadataLog::Close() {
+  if (running) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      running = false;
+    }
+    pendingCondition.notify_all();
+    durableCondition.notify_all(); // Ожидающие с таймаутом выходят
+    if (writerThread.joinable()) {
+      writerThread.join();
+    }
+  }
+
+  if (segment != nullptr) {
+    std::fclose(segment);
+    segment = nullptr;
+  }
+}
+
+uint64_t MetadataLog::Append(const Record &record) {
+  std::string line = EncodeRecord(record);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  pending += line;
+  pending += '\n';
+  uint64_t seq = nextSeq++;
+  pendingCondition.notify_one();
+  return seq;
+}
+
+bool MetadataLog::WaitDurable(uint64_t seq) {
+  std::unique_lock<std::mutex> lock(mutex);
+  durableCondition.wait(lock, [&] { return durableSeq > seq || failed; });
+  return durableSeq > seq && !failed;
+}
+
+bool MetadataLog::WaitDurableFor(uint64_t seq,
+                                 std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(mutex);
+  durableCondition.wait_for(lock, timeout, [&] {
+    return durableSeq > seq || !running;
+  });
+  return durableSeq > seq;
+}
+
+uint64_t MetadataLog::GetDurableSeq() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return durableSeq;
+}
+
+uint64_t MetadataLog::GetNextSeq() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return nextSeq;
+}
+
+// Поток записи: одна группа - один write и один fsync
+void MetadataLog::WriterLoop() {
+  std::unique_lock<std::mutex> lock(mutex);
+
+  while (true) {
+    pendingCondition.wait(
+        lock, [this] { return !running || (!pending.empty() && !writing); });
+    if (pending.empty()) {
+      if (!running) {
+        return;
+      }
+      continue;
+    }
+
+    std::string batch;
+    batch.swap(pending);
+    if (failed) {
+      // После ошибки сегмент может оканчиваться оборванной строкой:
+      // дописывать за ней нельзя, записи не подтверждаются
+      continue;
+    }
+    uint64_t batchEndSeq = nextSeq;
+    std::FILE *file = segment;
+    writing = true;
+    lock.unlock();
+
+    bool success =
+        std::fwrite(batch.data(), 1, batch.size(), file) == batch.size() &&
+        SyncFile(file);
+
+    lock.lock();
+    writing = false;
+    if (success) {
+      durableSeq = batchEndSeq;
+      groupCommits++;
+    } else if (!failed) {
+      failed = true;
+      std::cerr << "Error: Failed to write metadata log, further changes "
+                   "will not be acknowledged"
+                << std::endl;
+    }
+    durableCondition.notify_all();
+    pendingCondition.notify_all(); // Rotate ждёт окончания записи
+  }
+}
+
+// Новый сегмент; вызывается потоком снимков
+bool MetadataLog::Rotate(uint64_t &seq) {
+  std::unique_lock<std::mutex> lock(mutex);
+  pendingCondition.wait(lock, [this] { return !writing; });
+
+  // Недописанное уходит в старый сегмент синхронно
+  if (!pending.empty() && !failed) {
+    if (std::fwrite(pending.data(), 1, pending.size(), segment) ==
+            pending.size() &&
+        SyncFile(segment)) {
+      durableSeq = nextSeq;
+    } else {
+      failed = true;
+      std::cerr << "Error: Failed to write metadata log, further changes "
+                   "will not be acknowledged"
+                << std::endl;
+    }
+  }
+  pending.clear();
+  durableCondition.notify_all();
+  if (failed) {
+    return false; // Состояние в памяти содержит неподтверждённые изменения
+  }
+
+  std::string path = SegmentPath(nextSeq);
+  std::FILE *next = std::fopen(path.c_str(), "ab");
+  if (next == nullptr) {
+    std::cerr << "Error: Cannot open metadata log " << path << std::endl;
+    seq = segmentStartSeq; // Продолжаем писать в старый сегмент
+    return true;
+  }
+  SyncDirectory(directory);
+
+  std::fclose(segment);
+  segment = next;
+  segmentStartSeq = nextSeq;
+  seq = segmentStartSeq;
+  return true;
+}
+
+void MetadataLog::RemoveSegmentsBefore(uint64_t seq) {
+  std::vector<std::pair<uint64_t, std::string>> segments = ListSegments();
+  for (size_t i = 0; i < segments.size(); ++i) {
+    // Сегмент целиком до seq, если следующий начинается не позже seq
+    if (i + 1 < segments.size() && segments[i + 1].first <= seq) {
+      std::error_code ec;
+      fs::remove(segments[i].second, ec);
+    }
+  }
+}
+
+// Журнал с чистого листа; менеджеры в это время не пишут в журнал
+bool MetadataLog::Reset(uint64_t startSeq) {
+  Close();
+  for (const auto &segmentEntry : ListSegments()) {
+    std::error_code ec;
+    fs::remove(segmentEntry.second, ec);
+  }
+  return Open(startSeq);
+}
+
+MetadataLog::Reader::Reader(const MetadataLog &log) : log(log), seq(0) {}
+
+bool MetadataLog::Reader::Seek(uint64_t fromSeq) {
+  std::vector<std::pair<uint64_t, std::string>> segments = log.ListSegments();
+  if (segments.empty() || segments.front().first > fromSeq) {
+    return false;
+  }
+
+  // Последний сегмент, начинающийся не позже fromSeq
+  size_t index = 0;
+  while (index + 1 < segments.size() && segments[index + 1].first <= fromSeq) {
+    index++;
+  }
+
+  in.close();
+  in.clear();
+  in.open(segments[index].second, std::ios::binary);
+  if (!in.is_open()) {
+    return false;
+  }
+
+  std::string line;
+  for (seq = segments[index].first; seq < fromSeq; ++seq) {
+    if (!std::getline(in, line) || in.eof()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool MetadataLog::Reader::Next(std::string &line) {
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    if (in.is_open() && std::getline(in, line) && !in.eof()) {
+      seq++;
+      return true;
+    }
+
+    // Конец сегмента: следующий начинается с seq
+    std::string path = log.SegmentPath(seq);
+    std::error_code ec;
+    if (!fs::exists(path, ec)) {
+      in.clear();
+      return false;
+    }
+    in.close();
+    in.clear();
+    in.open(path, std::ios::binary);
+  }
+  return false;
+}
+
+// Повтор журнала при запуске
+bool MetadataLog::Replay(uint64_t fromSeq, const RecordVisitor &visitor,
+                         uint64_t &nextSeqOut) {
+  std::vector<std::pair<uint64_t, std::string>> segments = ListSegments();
+  uint64_t seq = fromSeq;
+
+  for (size_t i = 0; i < segments.size(); ++i) {
+    uint64_t startSeq = segments[i].first;
+    const std::string &path = segments[i].second;
+
+    // Сегмент целиком до fromSeq (не успел удалиться после снимка)
+    if (i + 1 < segments.size() && segments[i + 1].first <= fromSeq) {
+      continue;
+    }
+    if (startSeq > seq) {
+      std::cerr << "Error: Metadata log gap: expected record " << seq
+                << ", segment starts at " << startSeq << std::endl;
+      return false;
+    }
+
+    std::ifstream in(path, std::ios::binary);
+    std::string line;
+    uint64_t recordSeq = startSeq;
+    std::streamoff validEnd = 0;
+    bool torn = false;
+
+    while (std::getline(in, line)) {
+      Record record;
+      if (in.eof() || !DecodeRecord(line, record)) {
+        torn = true; // Нет перевода строки или не сошлась CRC
+        break;
+      }
+      validEnd = in.tellg();
+
+      if (recordSeq >= seq) {
+        if (!visitor(record)) {
+          return false;
+        }
+        seq = recordSeq + 1;
+      }
+      recordSeq++;
+    }
+    in.close();
+
+    if (torn) {
+      if (i + 1 != segments.size()) {
+        std::cerr << "Error: Corrupted metadata log segment " << path
+                  << std::endl;
+        return false;
+      }
+      std::cerr << "Warning: Truncating torn tail of metadata log " << path
+                << std::endl;
+      std::error_code ec;
+      fs::resize_file(path, static_cast<uintmax_t>(validEnd), ec);
+    }
+  }
+
+  nextSeqOut = seq;
+  return true;
+}
+
+std::string MetadataLog::EncodeRecord(const Record &record) {
+  std::string payload;
+  for (size_t i = 0; i < record.size(); ++i) {
+    if (i > 0) {
+      payload += ' ';
+    }
+    if (record[i].empty()) {
+      payload += "%-"; // Пустое поле
+      continue;
+    }
+    payload += NetworkUtils::EscapeToken(record[i]);
+  }
+
+  uint32_t crc = HashUtils::Crc32(payload.data(), payload.size());
+  std::stringstream line;
+  line << std::hex << std::setw(8) << std::setfill('0') << crc << ' '
+       << payload;
+  return line.str();
+}
+
+bool MetadataLog::DecodeRecord(const std::string &line, Record &record) {
+  if (line.size() < 9 || line[8] != ' ') {
+    return false;
+  }
+
+  std::string payload = line.substr(9);
+  uint32_t crc;
+  try {
+    crc = static_cast<uint32_t>(std::stoul(line.substr(0, 8), nullptr, 16));
+  } catch (const std::exception &) {
+    return false;
+  }
+  if (crc != HashUtils::Crc32(payload.data(), payload.size())) {
+    return false;
+  }
+
+  record.clear();
+  std::stringstream ss(payload);
+  std::string token;
+  while (std::getline(ss, token, ' ')) {
+    if (token == "%-") {
+      record.push_back(std::string());
+      continue;
+    }
+
+    std::string field;
+    if (!NetworkUtils::UnescapeToken(token, field)) {
+      return false;
+    }
+    record.push_back(field);
+  }
+  return !record.empty();
+}
+
+bool MetadataLog::SyncFile(std::FILE *file) {
+  if (std::fflush(file) != 0) {
+    return false;
+  }
+#ifdef _WIN32
+  return _commit(_fileno(file)) == 0;
+#else
+  return fsync(fileno(file)) == 0;
+#endif
+}
+
+void MetadataLog::SyncDirectory(const std::string &directory) {
+#ifndef _WIN32
+  int fd = open(directory.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+#else
+  (void)directory;
+#endif
+}
@@ -1,8 +1,12 @@
 #include "metadata_manager.h"
 
+#include "hash_utils.h"
 #include <algorithm>
 #include <cctype>
+#include <iostream>
+#include <random>
 #include <sstream>
+#include <string_view>
 
 // Валидация ChunkInfo
 bool ChunkInfo::IsValid() const {
@@ -26,7 +30,10 @@ bool FileMetadata::HasChunk(const std::string &chunkId) const {
 }
 
 // Конструктор
-MetadataManager::MetadataManager() : totalFiles(0), totalBytes(0) {}
+MetadataManager::MetadataManager()
+    : lastVersion(0), log(nullptr),
+      orphanTimers(std::chrono::milliseconds(ORPHAN_TICK_MS)),
+      trackOrphans(true), totalFiles(0), totalBytes(0) {}
 
 // Деструктор
 MetadataManager::~MetadataManager() = default;
@@ -137,15 +144,139 @@ bool MetadataManager::RegisterFile(const std::string &filename, uint64_t size,
     return false;
   }
 
-  // Сохранение в map с мьютексом
+  // Сохранение в сегмент и индексы
+  uint64_t seq = 0;
   {
-    std::lock_guard<std::mutex> lock(filesMutex);
-    files[sanitizedFilename] = metadata;
+    std::lock_guard<std::mutex> lock(indexMutex);
+    PutFileLocked(metadata);
+    seq = AppendLogLocked(MakeFileRecord(metadata));
   }
 
-  // Обновление статистики
-  UpdateStatistics();
+  // Загрузка подтверждается клиенту только после записи на диск
+  return WaitLogDurable(seq);
+}
+
+// Сегмент таблицы файлов по хешу имени
+MetadataManager::FileShard &
+MetadataManager::GetShard(const std::string &filename) {
+  return fileShards[HashUtils::Hash64(filename) % FILE_SHARD_COUNT];
+}
+
+int64_t MetadataManager::NowMs() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Отметка доступа к файлу: горячий файл читают многие потоки, поэтому
+// запись (и передача строки кэша между ядрами) - только когда значение
+// устарело больше чем на ACCESS_TIME_RESOLUTION_MS
+void MetadataManager::TouchFile(FileEntry &entry) {
+  int64_t now = NowMs();
+  if (now - entry.lastAccessedMs.load(std::memory_order_relaxed) >=
+      ACCESS_TIME_RESOLUTION_MS) {
+    entry.lastAccessedMs.store(now, std::memory_order_relaxed);
+  }
+}
+
+// Изменяемые метаданные файла (исключительная блокировка сегмента уже
+// захвачена). Изменяется всегда копия: читатели могли взять ссылку на
+// снимок под разделяемой блокировкой и дочитывают его без неё
+FileMetadata &MetadataManager::MutableFileLocked(FileEntry &entry) {
+  entry.metadata = entry.metadata != nullptr
+                       ? std::make_shared<FileMetadata>(*entry.metadata)
+                       : DecodeImageFile(*image, entry.imageFile);
+  entry.metadata->version = ++lastVersion;
+  return *entry.metadata;
+}
+
+// Метаданные записи: свои или разобранные из снимка
+std::shared_ptr<const FileMetadata>
+MetadataManager::GetEntryMetadata(const FileEntry &entry) const {
+  if (entry.metadata != nullptr) {
+    return entry.metadata;
+  }
+  std::shared_ptr<FileMetadata> metadata =
+      DecodeImageFile(*image, entry.imageFile);
+  metadata->version = entry.imageVersion;
+  return metadata;
+}
+
+// Файл из снимка. Реплики чанков берутся из записей чанков: изменение
+// реплик чанка переносит в память все содержащие его файлы, поэтому у
+// файла из снимка они те же, что при загрузке
+std::shared_ptr<FileMetadata>
+MetadataManager::DecodeImageFile(const SnapshotImage &source, size_t index) {
+  const SnapshotFileRecord &record = source.GetFile(index);
+
+  auto metadata = std::make_shared<FileMetadata>();
+  metadata->filename = source.GetString(record.nameString);
+  metadata->totalSize = record.totalSize;
+  metadata->uploadTime = std::chrono::steady_clock::now();
+  metadata->lastAccessed = metadata->uploadTime;
+  metadata->version = 0;
+  metadata->chunks.resize(static_cast<size_t>(record.chunkCount));
+
+  const uint32_t *chunkIndexes = source.GetFileChunks(record);
+  for (size_t c = 0; c < metadata->chunks.size(); ++c) {
+    const SnapshotChunkRecord &chunkRecord = source.GetChunk(chunkIndexes[c]);
+    ChunkInfo &chunk = metadata->chunks[c];
+    chunk.chunkId = source.GetChunkId(chunkRecord);
+    chunk.index = c;
+    chunk.size = static_cast<size_t>(chunkRecord.size);
+
+    const uint32_t *handles = source.GetReplicas(chunkRecord);
+    chunk.nodeIds.reserve(chunkRecord.replicaCount);
+    for (uint32_t r = 0; r < chunkRecord.replicaCount; ++r) {
+      chunk.nodeIds.push_back(source.GetNodeName(handles[r]));
+    }
+  }
+  return metadata;
+}
+
+// Добавление или перезапись файла (indexMutex уже захвачен)
+void MetadataManager::PutFileLocked(const FileMetadata &metadata) {
+  FileShard &shard = GetShard(metadata.filename);
+  std::unique_lock<std::shared_mutex> lock(shard.mutex);
+
+  auto inserted = shard.files.try_emplace(metadata.filename);
+  FileEntry &entry = inserted.first->second;
+  if (!inserted.second) {
+    // Перезапись файла
+    std::shared_ptr<const FileMetadata> previous = GetEntryMetadata(entry);
+    UnindexFileLocked(*previous);
+    totalBytes -= previous->totalSize;
+  } else {
+    totalFiles++;
+  }
+  // Новый снимок: читатели старого дочитывают его
+  entry.metadata = std::make_shared<FileMetadata>(metadata);
+  entry.metadata->version = ++lastVersion;
+  entry.lastAccessedMs.store(NowMs(), std::memory_order_relaxed);
+  totalBytes += metadata.totalSize;
+  IndexFileLocked(metadata);
+
+  std::unique_lock<std::shared_mutex> indexLock(fileIndexMutex);
+  fileIndex[metadata.filename] = metadata.totalSize;
+}
+
+// Удаление файла из сегмента и индексов (indexMutex уже захвачен)
+bool MetadataManager::EraseFileLocked(const std::string &filename) {
+  FileShard &shard = GetShard(filename);
+  std::unique_lock<std::shared_mutex> lock(shard.mutex);
+
+  auto it = shard.files.find(filename);
+  if (it == shard.files.end()) {
+    return false;
+  }
+  std::shared_ptr<const FileMetadata> metadata = GetEntryMetadata(it->second);
+  UnindexFileLocked(*metadata);
+  totalFiles--;
+  totalBytes -= metadata->totalSize;
+  shard.files.erase(it);
 
+  std::unique_lock<std::shared_mutex> indexLock(fileIndexMutex);
+  fileIndex.erase(filename);
   return true;
 }
 
@@ -153,49 +284,81 @@ bool MetadataManager::RegisterFile(const std::string &filename, uint64_t size,
 bool MetadataManager::DeleteFile(const std::string &filename) {
   std::string sanitizedFilename = SanitizeFilename(filename);
 
-  std::lock_guard<std::mutex> lock(filesMutex);
-  auto it = files.find(sanitizedFilename);
-  if (it != files.end()) {
-    files.erase(it);
-    UpdateStatistics();
-    return true;
+  uint64_t seq = 0;
+  {
+    std::lock_guard<std::mutex> lock(indexMutex);
+    if (!EraseFileLocked(sanitizedFilename)) {
+      return false;
+    }
+    seq = AppendLogLocked({"FILE_DEL", sanitizedFilename});
   }
 
-  return false;
+  return WaitLogDurable(seq);
 }
 
-// Получение метаданных файла
-FileMetadata *MetadataManager::GetFileMetadata(const std::string &filename) {
+// Получение снимка метаданных файла
+std::shared_ptr<const FileMetadata>
+MetadataManager::GetFileMetadata(const std::string &filename) {
   std::string sanitizedFilename = SanitizeFilename(filename);
 
-  std::lock_guard<std::mutex> lock(filesMutex);
-  auto it = files.find(sanitizedFilename);
-  if (it != files.end()) {
-    // Обновление времени последнего доступа
-    it->second.lastAccessed = std::chrono::steady_clock::now();
-    return &(it->second);
+  FileShard &shard = GetShard(sanitizedFilename);
+  std::shared_ptr<const SnapshotImage> source;
+  size_t imageFile;
+  uint64_t imageVersion;
+  {
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.files.find(sanitizedFilename);
+    if (it == shard.files.end()) {
+      return nullptr;
+    }
+    TouchFile(it->second);
+    if (it->second.metadata != nullptr) {
+      return it->second.metadata;
+    }
+    source = image;
+    imageFile = it->second.imageFile;
+    imageVersion = it->second.imageVersion;
   }
 
-  return nullptr;
+  // Файл из снимка разбирается из отображения без блокировки сегмента
+  std::shared_ptr<FileMetadata> metadata =
+      DecodeImageFile(*source, imageFile);
+  metadata->version = imageVersion;
+  return metadata;
 }
 
 // Проверка существования файла
 bool MetadataManager::FileExists(const std::string &filename) {
   std::string sanitizedFilename = SanitizeFilename(filename);
 
-  std::lock_guard<std::mutex> lock(filesMutex);
-  return files.find(sanitizedFilename) != files.end();
+  FileShard &shard = GetShard(sanitizedFilename);
+  std::shared_lock<std::shared_mutex> lock(shard.mutex);
+  return shard.files.find(sanitizedFilename) != shard.files.end();
 }
 
-// Список имён файлов
-std::vector<std::string> MetadataManager::ListFiles() {
-  std::vector<std::string> fileList;
-
-  std::lock_guard<std::mutex> lock(filesMutex);
-  fileList.reserve(files.size());
+// Страница списка файлов по упорядоченному индексу
+std::vector<std::pair<std::string, uint64_t>>
+MetadataManager::ListFiles(const std::string &prefix, const std::string &after,
+                           size_t limit, std::string &nextCursor) {
+  std::vector<std::pair<std::string, uint64_t>> fileList;
+  nextCursor.clear();
+  if (limit == 0) {
+    return fileList;
+  }
 
-  for (const auto &pair : files) {
-    fileList.push_back(pair.first);
+  std::shared_lock<std::shared_mutex> lock(fileIndexMutex);
+  // Имена с префиксом идут подряд, начиная с lower_bound(prefix)
+  auto it = after < prefix ? fileIndex.lower_bound(prefix)
+                           : fileIndex.upper_bound(after);
+  for (; it != fileIndex.end(); ++it) {
+    if (it->first.compare(0, prefix.size(), prefix) != 0) {
+      break;
+    }
+    if (fileList.size() == limit) {
+      nextCursor = fileList.back().first; // Есть ещё файлы
+      break;
+    }
+    fileList.emplace_back(it->first, it->second);
   }
 
   return fileList;
@@ -204,12 +367,16 @@ std::vector<std::string> MetadataManager::ListFiles() {
 // Получение всех метаданных
 std::vector<FileMetadata> MetadataManager::GetAllFiles() {
   std::vector<FileMetadata> allFiles;
+  allFiles.reserve(totalFiles);
 
-  std::lock_guard<std::mutex> lock(filesMutex);
-  allFiles.reserve(files.size());
-
-  for (const auto &pair : files) {
-    allFiles.push_back(pair.second);
+  for (const auto &shard : fileShards) {
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    for (const auto &pair : shard.files) {
+      allFiles.push_back(*GetEntryMetadata(pair.second));
+      allFiles.back().lastAccessed =
+          std::chrono::steady_clock::time_point(std::chrono::milliseconds(
+              pair.second.lastAccessedMs.load(std::memory_order_relaxed)));
+    }
   }
 
   return allFiles;
@@ -217,68 +384,931 @@ std::vector<FileMetadata> MetadataManager::GetAllFiles() {
 
 // Получение чанков файла
 std::vector<ChunkInfo> MetadataManager::GetFileChunks(const std::string &filename) {
-  std::string sanitizedFilename = SanitizeFilename(filename);
-
-  std::lock_guard<std::mutex> lock(filesMutex);
-  auto it = files.find(sanitizedFilename);
-  if (it != files.end()) {
-    return it->second.chunks;
+  std::shared_ptr<const FileMetadata> metadata = GetFileMetadata(filename);
+  if (metadata != nullptr) {
+    return metadata->chunks; // Копия снимка без блокировки
   }
 
   return std::vector<ChunkInfo>();
 }
 
 // Получение информации о чанке
-ChunkInfo *MetadataManager::GetChunkInfo(const std::string &filename,
-                                        const std::string &chunkId) {
-  std::string sanitizedFilename = SanitizeFilename(filename);
+bool MetadataManager::GetChunkInfo(const std::string &filename,
+                                   const std::string &chunkId,
+                                   ChunkInfo &chunkInfo) {
+  std::shared_ptr<const FileMetadata> metadata = GetFileMetadata(filename);
+  if (metadata == nullptr) {
+    return false;
+  }
 
-  std::lock_guard<std::mutex> lock(filesMutex);
-  auto it = files.find(sanitizedFilename);
-  if (it != files.end()) {
-    for (auto &chunk : it->second.chunks) {
-      if (chunk.chunkId == chunkId) {
-        return &chunk;
+  for (const auto &chunk : metadata->chunks) {
+    if (chunk.chunkId == chunkId) {
+      chunkInfo = chunk;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Добавление чанков файла в индексы реплик (indexMutex уже захвачен)
+void MetadataManager::IndexFileLocked(const FileMetadata &metadata) {
+  for (const auto &chunk : metadata.chunks) {
+    ChunkLocation *found = FindChunkLocked(chunk.chunkId);
+    ChunkLocation &location =
+        found != nullptr ? *found : chunkLocations[chunk.chunkId];
+    location.size = chunk.size;
+    location.files.insert(metadata.filename);
+
+    // Реплики чанка - объединение по всем файлам
+    for (const auto &nodeId : chunk.nodeIds) {
+      if (std::find(location.nodeIds.begin(), location.nodeIds.end(),
+                    nodeId) == location.nodeIds.end()) {
+        location.nodeIds.push_back(nodeId);
       }
+      AddNodeChunkLocked(nodeId, chunk.chunkId, chunk.size);
     }
   }
+}
+
+// Удаление чанков файла из индексов (indexMutex уже захвачен)
+void MetadataManager::UnindexFileLocked(const FileMetadata &metadata) {
+  for (const auto &chunk : metadata.chunks) {
+    ChunkLocation *location = FindChunkLocked(chunk.chunkId);
+    if (location == nullptr) {
+      continue;
+    }
 
-  return nullptr;
+    location->files.erase(metadata.filename);
+    if (!location->files.empty()) {
+      continue; // Чанк ещё входит в другие файлы
+    }
+
+    for (const auto &nodeId : location->nodeIds) {
+      RemoveNodeChunkLocked(nodeId, chunk.chunkId, location->size);
+    }
+    // Реплики остаются на узлах до сборки мусора
+    auto now = TimingWheel::Clock::now();
+    AddOrphanLocked(chunk.chunkId, location->nodeIds, now,
+                    now + std::chrono::seconds(ORPHAN_GRACE_SEC));
+    chunkLocations.erase(chunk.chunkId);
+  }
 }
 
-// Обновление статистики
-void MetadataManager::UpdateStatistics() {
-  size_t count = 0;
-  uint64_t bytes = 0;
+// Поиск чанка с переносом из снимка (indexMutex уже захвачен). Файлы,
+// содержащие ещё не перенесённый чанк, не менялись с загрузки: его
+// файлы и реплики - из снимка. Реплики уже учтены в nodeUsage
+ChunkLocation *MetadataManager::FindChunkLocked(const std::string &chunkId) {
+  auto it = chunkLocations.find(chunkId);
+  if (it != chunkLocations.end()) {
+    return &it->second;
+  }
+  size_t index;
+  if (!FindImageChunkLocked(chunkId, index)) {
+    return nullptr;
+  }
+
+  const SnapshotChunkRecord &record = image->GetChunk(index);
+  ChunkLocation &location = chunkLocations[chunkId];
+  location.size = record.size;
+
+  const uint32_t *handles = image->GetReplicas(record);
+  location.nodeIds.reserve(record.replicaCount);
+  for (uint32_t r = 0; r < record.replicaCount; ++r) {
+    location.nodeIds.push_back(image->GetNodeName(handles[r]));
+    nodeChunks[location.nodeIds.back()].insert(chunkId);
+  }
+
+  const uint32_t *fileIndexes = image->GetChunkFiles(record);
+  for (uint32_t f = 0; f < record.fileCount; ++f) {
+    location.files.insert(
+        image->GetString(image->GetFile(fileIndexes[f]).nameString));
+  }
+
+  imageChunkMoved[index] = true;
+  return &location;
+}
 
+// Чанк снимка, ещё не перенесённый в индекс (indexMutex уже захвачен)
+bool MetadataManager::FindImageChunkLocked(const std::string &chunkId,
+                                           size_t &index) const {
+  return image != nullptr && image->FindChunk(chunkId, index) &&
+         !imageChunkMoved[index];
+}
+
+// Размер и реплики чанка из индекса или снимка (indexMutex уже захвачен)
+bool MetadataManager::GetChunkReplicasLocked(
+    const std::string &chunkId, uint64_t &size,
+    std::vector<std::string> &nodeIds) const {
+  auto it = chunkLocations.find(chunkId);
+  if (it != chunkLocations.end()) {
+    size = it->second.size;
+    nodeIds = it->second.nodeIds;
+    return true;
+  }
+  size_t index;
+  if (!FindImageChunkLocked(chunkId, index)) {
+    return false;
+  }
+
+  const SnapshotChunkRecord &record = image->GetChunk(index);
+  const uint32_t *handles = image->GetReplicas(record);
+  size = record.size;
+  nodeIds.clear();
+  for (uint32_t r = 0; r < record.replicaCount; ++r) {
+    nodeIds.push_back(image->GetNodeName(handles[r]));
+  }
+  return true;
+}
+
+// Учёт реплики на узле (indexMutex уже захвачен)
+void MetadataManager::AddNodeChunkLocked(const std::string &nodeId,
+                                         const std::string &chunkId,
+                                         uint64_t size) {
+  if (nodeChunks[nodeId].insert(chunkId).second) {
+    NodeUsage &usage = nodeUsage[nodeId];
+    usage.chunks++;
+    usage.bytes += size;
+    usage.fingerprint ^= HashUtils::ChunkFingerprint(chunkId);
+  }
+}
+
+// Снятие реплики с узла (indexMutex уже захвачен)
+void MetadataManager::RemoveNodeChunkLocked(const std::string &nodeId,
+                                            const std::string &chunkId,
+                                            uint64_t size) {
+  auto nodeIt = nodeChunks.find(nodeId);
+  if (nodeIt == nodeChunks.end() || nodeIt->second.erase(chunkId) == 0) {
+    return;
+  }
+  if (nodeIt->second.empty()) {
+    nodeChunks.erase(nodeIt);
+  }
+
+  // Учёт включает и не перенесённые чанки снимка
+  auto usageIt = nodeUsage.find(nodeId);
+  if (usageIt == nodeUsage.end()) {
+    return;
+  }
+  NodeUsage &usage = usageIt->second;
+  if (--usage.chunks == 0) {
+    nodeUsage.erase(usageIt);
+    return;
+  }
+  usage.bytes -= size;
+  usage.fingerprint ^= HashUtils::ChunkFingerprint(chunkId);
+}
+
+// Объём данных на узлах
+std::unordered_map<std::string, NodeUsage> MetadataManager::GetNodeUsage() {
+  std::lock_guard<std::mutex> lock(indexMutex);
+  return nodeUsage;
+}
+
+// Ожидаемое содержимое узла
+void MetadataManager::GetNodeInventory(const std::string &nodeId,
+                                       size_t &chunkCount,
+                                       uint64_t &fingerprint) {
+  std::lock_guard<std::mutex> lock(indexMutex);
+  auto it = nodeUsage.find(nodeId);
+  chunkCount = it != nodeUsage.end() ? it->second.chunks : 0;
+  fingerprint = it != nodeUsage.end() ? it->second.fingerprint : 0;
+}
+
+// Сверка инвентаря узла. Все изменения реплик - один пакет: файл со
+// многими пропавшими или найденными чанками копируется один раз
+InventoryReconciliation MetadataManager::ReconcileNodeInventory(
+    const std::string &nodeId, const std::vector<std::string> &chunkIds,
+    size_t maxReplicas) {
+  InventoryReconciliation result{0, 0, 0, {}};
+  std::unordered_set<std::string> present(chunkIds.begin(), chunkIds.end());
+  uint64_t seq = 0;
+  ReplicaBatch batch;
+
+  std::unique_lock<std::mutex> lock(indexMutex);
+
+  // Реплики, которых на узле больше нет
+  for (auto &chunkId : GetNodeChunksLocked(nodeId)) {
+    if (present.find(chunkId) == present.end()) {
+      result.missing.push_back(std::move(chunkId));
+    }
+  }
+  for (const auto &chunkId : result.missing) {
+    ChunkLocation *location = FindChunkLocked(chunkId);
+    if (location != nullptr) {
+      seq = ReplaceChunkReplicasLocked(
+          *location, ReplicaChange{chunkId, {nodeId}, "", false}, batch);
+    }
+  }
+
+  // Чанки на узле, о которых индекс не знал. Чанки снимка, уже
+  // учтённые на узле, остаются в снимке
+  auto now = TimingWheel::Clock::now();
+  uint64_t size;
+  std::vector<std::string> nodeIds;
+  for (const auto &chunkId : present) {
+    if (!GetChunkReplicasLocked(chunkId, size, nodeIds)) {
+      // Уже известная копия без ссылок сохраняет свой срок
+      auto orphanIt = orphanChunks.find(chunkId);
+      if (orphanIt == orphanChunks.end() ||
+          std::find(orphanIt->second.nodeIds.begin(),
+                    orphanIt->second.nodeIds.end(),
+                    nodeId) == orphanIt->second.nodeIds.end()) {
+        AddOrphanLocked(chunkId, {nodeId}, now,
+                        now + std::chrono::seconds(UNKNOWN_CHUNK_GRACE_SEC));
+      }
+      result.unknown++;
+      continue;
+    }
+
+    if (std::find(nodeIds.begin(), nodeIds.end(), nodeId) != nodeIds.end()) {
+      continue;
+    }
+    if (nodeIds.size() >= maxReplicas) {
+      result.surplus++;
+      continue;
+    }
+
+    seq = ReplaceChunkReplicasLocked(
+        *FindChunkLocked(chunkId), ReplicaChange{chunkId, {}, nodeId, false},
+        batch);
+    result.restored++;
+  }
+
+  UpdateBatchFilesLocked(batch);
+  lock.unlock();
+  WaitLogDurable(seq);
+  return result;
+}
+
+// Чанки, хранящиеся на узле
+std::vector<std::string>
+MetadataManager::GetNodeChunks(const std::string &nodeId) {
+  std::lock_guard<std::mutex> lock(indexMutex);
+  return GetNodeChunksLocked(nodeId);
+}
+
+// Чанки узла из индекса и снимка (indexMutex уже захвачен)
+std::vector<std::string>
+MetadataManager::GetNodeChunksLocked(const std::string &nodeId) {
+  std::vector<std::string> chunkIds;
+  auto it = nodeChunks.find(nodeId);
+  if (it != nodeChunks.end()) {
+    chunkIds.assign(it->second.begin(), it->second.end());
+  }
+
+  auto handleIt = imageNodeHandles.find(nodeId);
+  if (handleIt != imageNodeHandles.end()) {
+    const uint32_t *chunkIndexes = image->GetNodeChunks(handleIt->second);
+    for (size_t i = 0; i < image->GetNodeChunkCount(handleIt->second); ++i) {
+      if (!imageChunkMoved[chunkIndexes[i]]) {
+        chunkIds.push_back(image->GetChunkId(image->GetChunk(chunkIndexes[i])));
+      }
+    }
+  }
+  return chunkIds;
+}
+
+// Все известные чанки
+std::vector<std::string> MetadataManager::GetAllChunkIds() {
+  std::vector<std::string> chunkIds;
+
+  std::lock_guard<std::mutex> lock(indexMutex);
+  chunkIds.reserve(chunkLocations.size());
+  for (const auto &pair : chunkLocations) {
+    chunkIds.push_back(pair.first);
+  }
+  for (size_t i = 0; i < imageChunkMoved.size(); ++i) {
+    if (!imageChunkMoved[i]) {
+      chunkIds.push_back(image->GetChunkId(image->GetChunk(i)));
+    }
+  }
+
+  return chunkIds;
+}
+
+// Порция обхода всех чанков. Чанки снимка идут первыми: чанк, который
+// после прохода по снимку перенесён в память, встретится в корзинах
+bool MetadataManager::ScanChunks(ChunkScanCursor &cursor, size_t limit,
+                                 std::vector<ChunkReplicas> &chunks) {
+  chunks.clear();
+
+  std::lock_guard<std::mutex> lock(indexMutex);
+  for (; cursor.imageChunk < imageChunkMoved.size() && chunks.size() < limit;
+       ++cursor.imageChunk) {
+    if (imageChunkMoved[cursor.imageChunk]) {
+      continue;
+    }
+    const SnapshotChunkRecord &record = image->GetChunk(cursor.imageChunk);
+    const uint32_t *handles = image->GetReplicas(record);
+    ChunkReplicas chunk;
+    chunk.chunkId = image->GetChunkId(record);
+    for (uint32_t r = 0; r < record.replicaCount; ++r) {
+      chunk.nodeIds.push_back(image->GetNodeName(handles[r]));
+    }
+    chunks.push_back(std::move(chunk));
+  }
+
+  if (cursor.bucketCount != chunkLocations.bucket_count()) {
+    cursor.bucket = 0;
+    cursor.bucketCount = chunkLocations.bucket_count();
+  }
+  for (; cursor.bucket < cursor.bucketCount && chunks.size() < limit;
+       ++cursor.bucket) {
+    for (auto it = chunkLocations.begin(cursor.bucket);
+         it != chunkLocations.end(cursor.bucket); ++it) {
+      chunks.push_back(ChunkReplicas{it->first, it->second.nodeIds});
+    }
+  }
+
+  return cursor.imageChunk < imageChunkMoved.size() ||
+         cursor.bucket < cursor.bucketCount;
+}
+
+// Размер и реплики чанка
+bool MetadataManager::GetChunkLocation(const std::string &chunkId,
+                                       uint64_t &size,
+                                       std::vector<std::string> &nodeIds) {
+  std::lock_guard<std::mutex> lock(indexMutex);
+  return GetChunkReplicasLocked(chunkId, size, nodeIds);
+}
+
+// Замена реплик чанка
+bool MetadataManager::ReplaceChunkReplicas(
+    const std::string &chunkId, const std::vector<std::string> &removeNodeIds,
+    const std::string &addNodeId) {
+  std::vector<bool> applied;
+  bool durable = ApplyReplicaChanges(
+      {ReplicaChange{chunkId, removeNodeIds, addNodeId, false}}, applied);
+  return applied[0] && durable;
+}
+
+// Перенос реплики между узлами
+bool MetadataManager::MoveChunkReplica(const std::string &chunkId,
+                                       const std::string &fromNodeId,
+                                       const std::string &toNodeId) {
+  std::vector<bool> applied;
+  bool durable = ApplyReplicaChanges(
+      {ReplicaChange{chunkId, {fromNodeId}, toNodeId, true}}, applied);
+  return applied[0] && durable;
+}
+
+// Пакет изменений реплик
+bool MetadataManager::ApplyReplicaChanges(
+    const std::vector<ReplicaChange> &changes, std::vector<bool> &applied) {
+  applied.assign(changes.size(), false);
+  uint64_t seq = 0;
   {
-    std::lock_guard<std::mutex> lock(filesMutex);
-    for (const auto &pair : files) {
-      count++;
-      bytes += pair.second.totalSize;
+    std::lock_guard<std::mutex> lock(indexMutex);
+    ReplicaBatch batch;
+    for (size_t i = 0; i < changes.size(); ++i) {
+      const ReplicaChange &change = changes[i];
+      ChunkLocation *location = FindChunkLocked(change.chunkId);
+      if (location == nullptr) {
+        continue; // Файл успели удалить
+      }
+
+      const std::vector<std::string> &nodeIds = location->nodeIds;
+      if (change.move &&
+          (std::find(nodeIds.begin(), nodeIds.end(), change.addNodeId) !=
+               nodeIds.end() ||
+           std::any_of(change.removeNodeIds.begin(),
+                       change.removeNodeIds.end(),
+                       [&](const std::string &nodeId) {
+                         return std::find(nodeIds.begin(), nodeIds.end(),
+                                          nodeId) == nodeIds.end();
+                       }))) {
+        continue;
+      }
+
+      seq = ReplaceChunkReplicasLocked(*location, change, batch);
+      applied[i] = true;
     }
+    UpdateBatchFilesLocked(batch);
   }
+  return WaitLogDurable(seq);
+}
 
-  totalFiles = count;
-  totalBytes = bytes;
+// Замена реплик в списке узлов
+void MetadataManager::UpdateReplicas(std::vector<std::string> &nodeIds,
+                                     const ReplicaChange &change) {
+  for (const auto &nodeId : change.removeNodeIds) {
+    nodeIds.erase(std::remove(nodeIds.begin(), nodeIds.end(), nodeId),
+                  nodeIds.end());
+  }
+  if (!change.addNodeId.empty() &&
+      std::find(nodeIds.begin(), nodeIds.end(), change.addNodeId) ==
+          nodeIds.end()) {
+    nodeIds.push_back(change.addNodeId);
+  }
 }
 
-// Количество файлов
-size_t MetadataManager::GetFileCount() const {
-  std::lock_guard<std::mutex> lock(filesMutex);
-  return files.size();
+// Замена реплик в расположении и индексе узлов (indexMutex уже
+// захвачен). Файлы чанка запоминаются в пакете
+uint64_t MetadataManager::ReplaceChunkReplicasLocked(
+    ChunkLocation &location, const ReplicaChange &change,
+    ReplicaBatch &batch) {
+  UpdateReplicas(location.nodeIds, change);
+
+  size_t changeIndex = batch.changes.size();
+  batch.changes.push_back(change);
+  for (const auto &filename : location.files) {
+    batch.files[filename].push_back(changeIndex);
+  }
+
+  for (const auto &nodeId : change.removeNodeIds) {
+    RemoveNodeChunkLocked(nodeId, change.chunkId, location.size);
+  }
+  if (!change.addNodeId.empty()) {
+    AddNodeChunkLocked(change.addNodeId, change.chunkId, location.size);
+  }
+
+  // REPLICAS <chunkId> <addNodeId> <removeNodeId>...
+  MetadataLog::Record record{"REPLICAS", change.chunkId, change.addNodeId};
+  record.insert(record.end(), change.removeNodeIds.begin(),
+                change.removeNodeIds.end());
+  return AppendLogLocked(record);
 }
 
-// Общий объём данных
-uint64_t MetadataManager::GetTotalBytes() const {
-  uint64_t total = 0;
+// Списки реплик в метаданных файлов пакета (indexMutex уже захвачен):
+// одна копия и один проход по чанкам на файл, изменения одного чанка
+// применяются по порядку
+void MetadataManager::UpdateBatchFilesLocked(const ReplicaBatch &batch) {
+  std::unordered_map<std::string, std::vector<size_t>> chunkChanges;
+  for (const auto &pair : batch.files) {
+    FileShard &shard = GetShard(pair.first);
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto fileIt = shard.files.find(pair.first);
+    if (fileIt == shard.files.end()) {
+      continue;
+    }
+
+    chunkChanges.clear();
+    for (size_t changeIndex : pair.second) {
+      chunkChanges[batch.changes[changeIndex].chunkId].push_back(changeIndex);
+    }
+    for (auto &chunk : MutableFileLocked(fileIt->second).chunks) {
+      auto it = chunkChanges.find(chunk.chunkId);
+      if (it == chunkChanges.end()) {
+        continue;
+      }
+      for (size_t changeIndex : it->second) {
+        UpdateReplicas(chunk.nodeIds, batch.changes[changeIndex]);
+      }
+    }
+  }
+}
+
+// Подключение журнала после восстановления
+void MetadataManager::SetLog(MetadataLog *metadataLog) {
+  std::lock_guard<std::mutex> lock(indexMutex);
+  log = metadataLog;
+}
+
+// Запись в журнал (indexMutex уже захвачен)
+uint64_t MetadataManager::AppendLogLocked(const MetadataLog::Record &record) {
+  return log != nullptr ? log->Append(record) : 0;
+}
+
+// Ожидание фиксации записи seq (без indexMutex)
+bool MetadataManager::WaitLogDurable(uint64_t seq) {
+  MetadataLog *metadataLog;
+  {
+    std::lock_guard<std::mutex> lock(indexMutex);
+    metadataLog = log;
+  }
+  if (metadataLog == nullptr) {
+    return true;
+  }
+  if (!metadataLog->WaitDurable(seq)) {
+    std::cerr << "Error: Metadata change was not persisted" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// FILE_PUT <filename> <totalSize> <chunkCount>
+//          (<chunkId> <size> <replicaCount> <nodeId>...)...
+// Чанки идут по порядку индексов
+MetadataLog::Record
+MetadataManager::MakeFileRecord(const FileMetadata &metadata) {
+  MetadataLog::Record record{"FILE_PUT", metadata.filename,
+                             std::to_string(metadata.totalSize),
+                             std::to_string(metadata.chunks.size())};
+  for (const auto &chunk : metadata.chunks) {
+    record.push_back(chunk.chunkId);
+    record.push_back(std::to_string(chunk.size));
+    record.push_back(std::to_string(chunk.nodeIds.size()));
+    record.insert(record.end(), chunk.nodeIds.begin(), chunk.nodeIds.end());
+  }
+  return record;
+}
+
+// Повтор записи журнала
+bool MetadataManager::ApplyLogRecord(const MetadataLog::Record &record) {
+  const std::string &type = record[0];
+
+  try {
+    if (type == "FILE_PUT" && record.size() >= 4) {
+      FileMetadata metadata;
+      metadata.filename = record[1];
+      metadata.totalSize = std::stoull(record[2]);
+      metadata.uploadTime = std::chrono::steady_clock::now();
+      metadata.lastAccessed = metadata.uploadTime;
+
+      size_t chunkCount = std::stoull(record[3]);
+      size_t pos = 4;
+      for (size_t i = 0; i < chunkCount; ++i) {
+        if (pos + 3 > record.size()) {
+          return false;
+        }
+        ChunkInfo chunk;
+        chunk.chunkId = record[pos];
+        chunk.index = i;
+        chunk.size = std::stoull(record[pos + 1]);
+        size_t replicaCount = std::stoull(record[pos + 2]);
+        pos += 3;
+        if (pos + replicaCount > record.size()) {
+          return false;
+        }
+        chunk.nodeIds.assign(record.begin() + pos,
+                             record.begin() + pos + replicaCount);
+        pos += replicaCount;
+        metadata.chunks.push_back(chunk);
+      }
+
+      std::lock_guard<std::mutex> lock(indexMutex);
+      PutFileLocked(metadata);
+      return true;
+    }
+  } catch (const std::exception &) {
+    return false;
+  }
+
+  if (type == "FILE_DEL" && record.size() == 2) {
+    std::lock_guard<std::mutex> lock(indexMutex);
+    EraseFileLocked(record[1]);
+    return true;
+  }
+
+  if (type == "REPLICAS" && record.size() >= 3) {
+    std::vector<std::string> removeNodeIds(record.begin() + 3, record.end());
+
+    std::lock_guard<std::mutex> lock(indexMutex);
+    ChunkLocation *location = FindChunkLocked(record[1]);
+    if (location != nullptr) {
+      ReplicaBatch batch;
+      ReplaceChunkReplicasLocked(
+          *location, ReplicaChange{record[1], removeNodeIds, record[2], false},
+          batch);
+      UpdateBatchFilesLocked(batch);
+    }
+    return true;
+  }
+
+  return false;
+}
+
+// Учёт копий чанка без ссылок (indexMutex уже захвачен). Повторная
+// потеря ссылок сдвигает сроки: берутся более поздние
+void MetadataManager::AddOrphanLocked(
+    const std::string &chunkId, const std::vector<std::string> &nodeIds,
+    TimingWheel::Clock::time_point orphanedAt,
+    TimingWheel::Clock::time_point collectAt) {
+  if (!trackOrphans || nodeIds.empty()) {
+    return;
+  }
+
+  auto inserted = orphanChunks.emplace(chunkId, OrphanChunk());
+  OrphanChunk &orphan = inserted.first->second;
+  if (inserted.second) {
+    orphan.orphanedAt = orphanedAt;
+    orphan.collectAt = collectAt;
+  } else {
+    orphan.orphanedAt = std::max(orphan.orphanedAt, orphanedAt);
+    orphan.collectAt = std::max(orphan.collectAt, collectAt);
+  }
+  for (const auto &nodeId : nodeIds) {
+    if (std::find(orphan.nodeIds.begin(), orphan.nodeIds.end(), nodeId) ==
+        orphan.nodeIds.end()) {
+      orphan.nodeIds.push_back(nodeId);
+    }
+  }
+  orphanTimers.Schedule(chunkId, orphan.collectAt);
+}
+
+// Копии без ссылок с истёкшим сроком, сгруппированные по узлам
+std::unordered_map<std::string, std::vector<OrphanReplica>>
+MetadataManager::TakeOrphanReplicas() {
+  std::unordered_map<std::string, std::vector<OrphanReplica>> replicas;
+  auto now = TimingWheel::Clock::now();
+  std::vector<std::string> expired;
+
+  std::lock_guard<std::mutex> lock(indexMutex);
+  orphanTimers.Advance(now, expired);
+
+  for (const auto &chunkId : expired) {
+    auto it = orphanChunks.find(chunkId);
+    if (it == orphanChunks.end()) {
+      continue;
+    }
+
+    // Чанк снова в файлах (повторная загрузка того же содержимого):
+    // его текущие реплики не трогаем
+    uint64_t size;
+    std::vector<std::string> nodeIds;
+    GetChunkReplicasLocked(chunkId, size, nodeIds);
+    int64_t ageSec = std::chrono::duration_cast<std::chrono::seconds>(
+                         now - it->second.orphanedAt)
+                         .count();
+    for (const auto &nodeId : it->second.nodeIds) {
+      if (std::find(nodeIds.begin(), nodeIds.end(), nodeId) !=
+          nodeIds.end()) {
+        continue;
+      }
+      replicas[nodeId].push_back({chunkId, ageSec});
+    }
+    orphanChunks.erase(it);
+  }
+
+  return replicas;
+}
+
+// Возврат копий, которые не удалось удалить
+void MetadataManager::DeferOrphanReplicas(
+    const std::string &nodeId, const std::vector<OrphanReplica> &replicas,
+    int delaySec) {
+  auto now = TimingWheel::Clock::now();
+
+  std::lock_guard<std::mutex> lock(indexMutex);
+  for (const auto &replica : replicas) {
+    AddOrphanLocked(replica.chunkId, {nodeId},
+                    now - std::chrono::seconds(replica.ageSec),
+                    now + std::chrono::seconds(delaySec));
+  }
+}
+
+void MetadataManager::SetOrphanTracking(bool enabled) {
+  std::lock_guard<std::mutex> lock(indexMutex);
+  trackOrphans = enabled;
+}
+
+// Чанки (с репликами) и файлы в снимок
+void MetadataManager::ExportSnapshot(SnapshotImageWriter &writer) {
+  // Снимки метаданных файлов неизменяемы: под короткими разделяемыми
+  // блокировками сегментов копируются только указатели, запись снимка
+  // идёт без блокировок. Снимок "размытый": изменения во время обхода
+  // уже в журнале после границы снимка и повторяются при загрузке.
+  // Неизменённые файлы загруженного снимка переписываются из него без
+  // разбора в память
+  std::vector<std::shared_ptr<const FileMetadata>> files;
+  std::vector<size_t> imageFiles;
+  std::shared_ptr<const SnapshotImage> source;
+  files.reserve(totalFiles);
+  for (const auto &shard : fileShards) {
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    for (const auto &pair : shard.files) {
+      if (pair.second.metadata != nullptr) {
+        files.push_back(pair.second.metadata);
+      } else {
+        imageFiles.push_back(pair.second.imageFile);
+        source = image;
+      }
+    }
+  }
+
+  // Реплики чанка - объединение по всем файлам, как в индексе реплик.
+  // Ключи ссылаются на строки снимков files
+  std::unordered_map<std::string_view, std::pair<uint64_t,
+                                                 std::vector<std::string>>>
+      chunks;
+  std::vector<std::string_view> chunkOrder;
+  auto mergeReplicas = [](std::vector<std::string> &nodeIds,
+                          const std::vector<std::string> &add) {
+    for (const auto &nodeId : add) {
+      if (std::find(nodeIds.begin(), nodeIds.end(), nodeId) ==
+          nodeIds.end()) {
+        nodeIds.push_back(nodeId);
+      }
+    }
+  };
+  for (const auto &metadata : files) {
+    for (const auto &chunk : metadata->chunks) {
+      auto inserted = chunks.emplace(chunk.chunkId,
+                                     std::make_pair(chunk.size,
+                                                    std::vector<std::string>()));
+      if (inserted.second) {
+        chunkOrder.push_back(chunk.chunkId);
+      }
+      mergeReplicas(inserted.first->second.second, chunk.nodeIds);
+    }
+  }
+
+  // Чанки файлов из снимка: у всех таких файлов реплики чанка - из его
+  // записи; с файлами в памяти они объединяются
+  std::vector<bool> imageChunkAdded(source != nullptr
+                                        ? source->GetChunkCount()
+                                        : 0);
+  std::vector<std::string> nodeIds;
+  for (size_t index : imageFiles) {
+    const SnapshotFileRecord &record = source->GetFile(index);
+    const uint32_t *chunkIndexes = source->GetFileChunks(record);
+    for (uint64_t c = 0; c < record.chunkCount; ++c) {
+      if (imageChunkAdded[chunkIndexes[c]]) {
+        continue;
+      }
+      imageChunkAdded[chunkIndexes[c]] = true;
+
+      const SnapshotChunkRecord &chunk = source->GetChunk(chunkIndexes[c]);
+      const uint32_t *handles = source->GetReplicas(chunk);
+      nodeIds.clear();
+      for (uint32_t r = 0; r < chunk.replicaCount; ++r) {
+        nodeIds.push_back(source->GetNodeName(handles[r]));
+      }
+      std::string chunkId = source->GetChunkId(chunk);
+      auto it = chunks.find(chunkId);
+      if (it != chunks.end()) {
+        mergeReplicas(it->second.second, nodeIds);
+      } else {
+        writer.AddChunk(chunkId, chunk.size, nodeIds);
+      }
+    }
+  }
+  imageChunkAdded = std::vector<bool>();
+
+  for (const auto &chunkId : chunkOrder) {
+    const auto &chunk = chunks[chunkId];
+    writer.AddChunk(std::string(chunkId), chunk.first, chunk.second);
+  }
+  chunks.clear();
+
+  std::vector<std::string> chunkIds;
+  for (const auto &metadata : files) {
+    chunkIds.clear();
+    for (const auto &chunk : metadata->chunks) {
+      chunkIds.push_back(chunk.chunkId);
+    }
+    if (!writer.AddFile(metadata->filename, metadata->totalSize, chunkIds)) {
+      std::cerr << "Warning: File " << metadata->filename
+                << " references unindexed chunks, skipped in snapshot"
+                << std::endl;
+    }
+  }
+  for (size_t index : imageFiles) {
+    const SnapshotFileRecord &record = source->GetFile(index);
+    const uint32_t *chunkIndexes = source->GetFileChunks(record);
+    chunkIds.clear();
+    for (uint64_t c = 0; c < record.chunkCount; ++c) {
+      chunkIds.push_back(source->GetChunkId(source->GetChunk(chunkIndexes[c])));
+    }
+    writer.AddFile(source->GetString(record.nameString), record.totalSize,
+                   chunkIds);
+  }
+}
+
+// Очистка файлов и индексов реплик
+void MetadataManager::Clear() {
+  std::lock_guard<std::mutex> lock(indexMutex);
+  for (auto &shard : fileShards) {
+    std::unique_lock<std::shared_mutex> shardLock(shard.mutex);
+    shard.files.clear();
+  }
+  {
+    std::unique_lock<std::shared_mutex> indexLock(fileIndexMutex);
+    fileIndex.clear();
+  }
+  chunkLocations.clear();
+  nodeChunks.clear();
+  nodeUsage.clear();
+  image.reset();
+  imageChunkMoved.clear();
+  imageNodeHandles.clear();
+  for (const auto &pair : orphanChunks) {
+    orphanTimers.Cancel(pair.first);
+  }
+  orphanChunks.clear();
+  totalFiles = 0;
+  totalBytes = 0;
+}
 
-  std::lock_guard<std::mutex> lock(filesMutex);
-  for (const auto &pair : files) {
-    total += pair.second.totalSize;
+// Загрузка снимка при запуске (менеджер ещё пуст). Снимок остаётся
+// отображённым: в память читаются только имена файлов (для сегментов и
+// списка) и учёт узлов, чанки и содержимое файлов читаются из
+// отображения, пока не изменятся
+void MetadataManager::LoadSnapshotImage(
+    std::shared_ptr<const SnapshotImage> snapshot) {
+  std::lock_guard<std::mutex> lock(indexMutex);
+  image = std::move(snapshot);
+  imageChunkMoved.assign(image->GetChunkCount(), false);
+
+  for (size_t i = 0; i < image->GetNodeNameCount(); ++i) {
+    uint32_t handle = static_cast<uint32_t>(i);
+    std::string nodeId = image->GetNodeName(handle);
+    const SnapshotNodeUsage &usage = image->GetNodeUsage(handle);
+    if (usage.chunks > 0) {
+      nodeUsage[nodeId] = NodeUsage{static_cast<size_t>(usage.chunks),
+                                    usage.bytes, usage.fingerprint};
+    }
+    imageNodeHandles[std::move(nodeId)] = handle;
   }
 
-  return total;
+  int64_t now = NowMs();
+  for (auto &shard : fileShards) {
+    shard.files.reserve(image->GetFileCount() / FILE_SHARD_COUNT + 1);
+  }
+  for (size_t i = 0; i < image->GetFileCount(); ++i) {
+    const SnapshotFileRecord &record = image->GetFile(i);
+    std::string filename = image->GetString(record.nameString);
+
+    // Менеджер ещё не доступен другим потокам: сегменты без блокировок
+    totalFiles++;
+    totalBytes += record.totalSize;
+    fileIndex[filename] = record.totalSize;
+    FileEntry &entry = GetShard(filename).files[filename];
+    entry.imageFile = i;
+    entry.imageVersion = ++lastVersion;
+    entry.lastAccessedMs.store(now, std::memory_order_relaxed);
+  }
 }
 
+// Генерация идентификатора сессии загрузки
+std::string MetadataManager::GenerateSessionId() {
+  std::random_device rd;
+  std::mt19937_64 gen(rd());
+
+  std::stringstream ss;
+  ss << std::hex << gen() << gen();
+  return ss.str();
+}
+
+// Создание сессии загрузки
+std::string MetadataManager::CreateUploadSession(const std::string &filename,
+                                                 uint64_t fileSize) {
+  ExpireUploadSessions();
+
+  UploadSession session;
+  session.filename = SanitizeFilename(filename);
+  session.fileSize = fileSize;
+  session.createdAt = std::chrono::steady_clock::now();
+  session.lastActivity = session.createdAt;
+
+  std::lock_guard<std::mutex> lock(sessionsMutex);
+  do {
+    session.sessionId = GenerateSessionId();
+  } while (uploadSessions.find(session.sessionId) != uploadSessions.end());
+
+  uploadSessions[session.sessionId] = session;
+  return session.sessionId;
+}
+
+// Продолжение сессии загрузки (продлевает её)
+bool MetadataManager::ResumeUploadSession(const std::string &sessionId,
+                                          UploadSession &session) {
+  ExpireUploadSessions();
+
+  std::lock_guard<std::mutex> lock(sessionsMutex);
+  auto it = uploadSessions.find(sessionId);
+  if (it == uploadSessions.end()) {
+    return false;
+  }
+
+  it->second.lastActivity = std::chrono::steady_clock::now();
+  session = it->second;
+  return true;
+}
+
+// Завершение сессии загрузки
+bool MetadataManager::CompleteUploadSession(const std::string &sessionId) {
+  std::lock_guard<std::mutex> lock(sessionsMutex);
+  return uploadSessions.erase(sessionId) > 0;
+}
+
+// Удаление заброшенных сессий
+size_t MetadataManager::ExpireUploadSessions() {
+  auto now = std::chrono::steady_clock::now();
+  size_t expired = 0;
+
+  std::lock_guard<std::mutex> lock(sessionsMutex);
+  auto it = uploadSessions.begin();
+  while (it != uploadSessions.end()) {
+    auto idle = std::chrono::duration_cast<std::chrono::seconds>(
+                    now - it->second.lastActivity)
+                    .count();
+    if (idle > UPLOAD_SESSION_TTL_SEC) {
+      it = uploadSessions.erase(it);
+      expired++;
+    } else {
+      ++it;
+    }
+  }
+
+  return expired;
+}
+
+// Количество файлов
+size_t MetadataManager::GetFileCount() const { return totalFiles; }
+
+// Общий объём данных
+uint64_t MetadataManager::GetTotalBytes() const { return totalBytes; }
+
 
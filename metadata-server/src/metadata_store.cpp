@@ -0,0 +1,417 @@
+#include "metadata_store.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char *SNAPSHOT_PREFIX = "snapshot-";
+const char *SNAPSHOT_SUFFIX = ".dat";
+
+// Номер из имени snapshot-<seq>.dat
+bool ParseSnapshotName(const std::string &name, uint64_t &seq) {
+  std::string prefix = SNAPSHOT_PREFIX;
+  std::string suffix = SNAPSHOT_SUFFIX;
+  if (name.size() <= prefix.size() + suffix.size() ||
+      name.compare(0, prefix.size(), prefix) != 0 ||
+      name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0) {
+    return false;
+  }
+  try {
+    seq = std::stoull(name.substr(prefix.size(), name.size() - prefix.size() -
+                                                     suffix.size()));
+  } catch (const std::exception &) {
+    return false;
+  }
+  return true;
+}
+
+} // namespace
+
+MetadataStore::MetadataStore(const std::string &directory,
+                             MetadataManager *metadataManager,
+                             NodeManager *nodeManager)
+    : directory(directory), metadataManager(metadataManager),
+      nodeManager(nodeManager), log(directory), lastSnapshotSeq(0),
+      running(false) {}
+
+MetadataStore::~MetadataStore() { Stop(); }
+
+std::string MetadataStore::SnapshotPath(uint64_t seq) const {
+  std::stringstream name;
+  name << SNAPSHOT_PREFIX << std::setw(20) << std::setfill('0') << seq
+       << SNAPSHOT_SUFFIX;
+  return (fs::path(directory) / name.str()).string();
+}
+
+// Запись журнала или снимка - менеджеру, которому она принадлежит
+bool MetadataStore::ApplyRecord(const MetadataLog::Record &record) {
+  const std::string &type = record[0];
+  if (type.compare(0, 5, "NODE_") == 0) {
+    return nodeManager->ApplyLogRecord(record);
+  }
+  return metadataManager->ApplyLogRecord(record);
+}
+
+// Восстановление состояния при запуске
+bool MetadataStore::Recover() {
+  std::error_code ec;
+  fs::create_directories(directory, ec);
+  if (ec) {
+    std::cerr << "Error: Cannot create metadata directory " << directory
+              << ": " << ec.message() << std::endl;
+    return false;
+  }
+
+  uint64_t snapshotSeq = 0;
+  std::string snapshotPath = FindLatestSnapshot(snapshotSeq);
+  if (!snapshotPath.empty() && !LoadSnapshot(snapshotPath, snapshotSeq)) {
+    std::cerr << "Error: Corrupted metadata snapshot " << snapshotPath
+              << std::endl;
+    return false;
+  }
+
+  size_t replayed = 0;
+  uint64_t nextSeq = snapshotSeq;
+  bool replayOk = log.Replay(
+      snapshotSeq,
+      [&](const MetadataLog::Record &record) {
+        if (!ApplyRecord(record)) {
+          std::cerr << "Error: Invalid metadata log record " << record[0]
+                    << std::endl;
+          return false;
+        }
+        replayed++;
+        return true;
+      },
+      nextSeq);
+  if (!replayOk) {
+    return false;
+  }
+
+  if (!log.Open(nextSeq)) {
+    return false;
+  }
+  lastSnapshotSeq = snapshotSeq;
+
+  std::cout << "Metadata recovered from " << directory << ": "
+            << metadataManager->GetFileCount() << " files, "
+            << nodeManager->GetTotalNodes() << " nodes (" << replayed
+            << " log records replayed)" << std::endl;
+  return true;
+}
+
+void MetadataStore::AttachLog() {
+  metadataManager->SetLog(&log);
+  nodeManager->SetLog(&log);
+}
+
+void MetadataStore::Start() {
+  if (running) {
+    return;
+  }
+
+  running = true;
+  snapshotThread = std::thread(&MetadataStore::SnapshotLoop, this);
+}
+
+// Остановка: журнал дописывается, менеджеры дальше работают без него
+void MetadataStore::Stop() {
+  if (running) {
+    {
+      std::lock_guard<std::mutex> lock(stopMutex);
+      running = false;
+    }
+    stopCondition.notify_all();
+
+    if (snapshotThread.joinable()) {
+      snapshotThread.join();
+    }
+  }
+
+  metadataManager->SetLog(nullptr);
+  nodeManager->SetLog(nullptr);
+  log.Close();
+}
+
+// Поток снимков: снимок, когда журнал вырос на SNAPSHOT_EVERY_RECORDS
+void MetadataStore::SnapshotLoop() {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(stopMutex);
+      stopCondition.wait_for(lock, std::chrono::seconds(SNAPSHOT_CHECK_SEC),
+                             [this] { return !running; });
+      if (!running) {
+        return;
+      }
+    }
+
+    if (log.GetNextSeq() - lastSnapshotSeq >= SNAPSHOT_EVERY_RECORDS) {
+      TakeSnapshot();
+    }
+  }
+}
+
+// Снимок состояния и усечение журнала
+bool MetadataStore::TakeSnapshot() {
+  std::lock_guard<std::mutex> lock(snapshotMutex);
+
+  // Граница снимка: всё до seq войдёт в снимок, всё после - в новый сегмент
+  uint64_t seq = 0;
+  if (!log.Rotate(seq)) {
+    return false;
+  }
+
+  SnapshotImageWriter writer;
+  nodeManager->ExportSnapshot(writer);
+  metadataManager->ExportSnapshot(writer);
+
+  if (!writer.Write(SnapshotPath(seq), seq)) {
+    return false;
+  }
+
+  // Снимок на диске: более ранние журнал и снимки не нужны
+  log.RemoveSegmentsBefore(seq);
+  RemoveSnapshotsBefore(seq);
+  lastSnapshotSeq = seq;
+
+  std::cout << "Metadata snapshot written: " << writer.GetRecordCount()
+            << " records at log position " << seq << std::endl;
+  return true;
+}
+
+// Поток журнала резервному серверу
+void MetadataStore::ServeStandby(SOCKET socket, uint64_t fromSeq) {
+  uint64_t nextSeq = log.GetNextSeq();
+  if (fromSeq > nextSeq) {
+    // Резервный впереди основного: истории журналов разошлись
+    NetworkUtils::SendMessage(socket,
+                              "ERROR LOG_AHEAD " + std::to_string(nextSeq));
+    return;
+  }
+  // Читать можно только зафиксированные записи
+  if (fromSeq > 0 &&
+      !log.WaitDurableFor(fromSeq - 1, std::chrono::seconds(5))) {
+    NetworkUtils::SendMessage(socket, "ERROR LOG_UNAVAILABLE");
+    return;
+  }
+
+  MetadataLog::Reader reader(log);
+  if (!reader.Seek(fromSeq)) {
+    // Сегменты с fromSeq удалены после снимка: сначала передаётся снимок
+    uint64_t snapshotSeq = 0;
+    std::string data;
+    {
+      std::lock_guard<std::mutex> lock(snapshotMutex);
+      std::string path = FindLatestSnapshot(snapshotSeq);
+      std::ifstream in(path, std::ios::binary);
+      if (!path.empty() && in) {
+        data.assign(std::istreambuf_iterator<char>(in),
+                    std::istreambuf_iterator<char>());
+      }
+      // Под блокировкой: иначе следующий снимок может удалить сегмент
+      if (data.empty() || !reader.Seek(snapshotSeq)) {
+        data.clear();
+      }
+    }
+    if (data.empty()) {
+      NetworkUtils::SendMessage(socket, "ERROR LOG_UNAVAILABLE");
+      return;
+    }
+
+    if (!NetworkUtils::SendMessage(socket, "SNAPSHOT " +
+                                               std::to_string(snapshotSeq) +
+                                               " " +
+                                               std::to_string(data.size())) ||
+        !NetworkUtils::SendBinaryData(socket, data.data(), data.size())) {
+      return;
+    }
+    std::cout << "Sent metadata snapshot at log position " << snapshotSeq
+              << " to standby" << std::endl;
+  }
+
+  std::cout << "Standby subscribed from log position " << reader.GetSeq()
+            << std::endl;
+
+  std::string batch;
+  std::string line;
+  while (running) {
+    uint64_t seq = reader.GetSeq();
+    if (!log.WaitDurableFor(
+            seq, std::chrono::milliseconds(STANDBY_HEARTBEAT_MS))) {
+      // Простой: heartbeat подтверждает резервному, что основной жив
+      if (!running ||
+          !NetworkUtils::SendMessage(socket, "H " + std::to_string(seq))) {
+        break;
+      }
+      continue;
+    }
+
+    uint64_t durableSeq = log.GetDurableSeq();
+    batch.clear();
+    while (reader.GetSeq() < durableSeq &&
+           batch.size() < STANDBY_BATCH_BYTES) {
+      if (!reader.Next(line)) {
+        std::cerr << "Error: Cannot read metadata log at position "
+                  << reader.GetSeq() << " for standby" << std::endl;
+        return;
+      }
+      batch += "R ";
+      batch += line;
+      batch += "\r\n";
+    }
+    if (!NetworkUtils::SendBinaryData(socket, batch.data(), batch.size())) {
+      break;
+    }
+  }
+
+  std::cout << "Standby disconnected at log position " << reader.GetSeq()
+            << std::endl;
+}
+
+// Запись основного: сначала применяется, затем пишется в журнал. Снимок,
+// начатый между этими шагами, получит запись в новом сегменте и повторит
+// её при восстановлении (записи идемпотентны)
+bool MetadataStore::ApplyReplicated(const std::string &line) {
+  MetadataLog::Record record;
+  if (!MetadataLog::DecodeRecord(line, record) || !ApplyRecord(record)) {
+    return false;
+  }
+  log.Append(record);
+  return true;
+}
+
+// Установка снимка основного на резервном сервере
+bool MetadataStore::InstallSnapshot(uint64_t snapshotSeq,
+                                    const std::string &data) {
+  std::lock_guard<std::mutex> lock(snapshotMutex);
+
+  std::string path = SnapshotPath(snapshotSeq);
+  std::string tempPath = path + ".tmp";
+  std::FILE *file = std::fopen(tempPath.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Error: Cannot write metadata snapshot " << tempPath
+              << std::endl;
+    return false;
+  }
+  bool written =
+      std::fwrite(data.data(), 1, data.size(), file) == data.size() &&
+      MetadataLog::SyncFile(file);
+  std::fclose(file);
+  std::error_code ec;
+  if (written) {
+    fs::rename(tempPath, path, ec);
+  }
+  if (!written || ec) {
+    std::cerr << "Error: Cannot write metadata snapshot " << path
+              << std::endl;
+    fs::remove(tempPath, ec);
+    return false;
+  }
+  MetadataLog::SyncDirectory(directory);
+
+  nodeManager->Clear();
+  metadataManager->Clear();
+  if (!LoadSnapshot(path, snapshotSeq)) {
+    std::cerr << "Error: Corrupted metadata snapshot from primary"
+              << std::endl;
+    return false;
+  }
+
+  // Локальный журнал до снимка больше не нужен
+  if (!log.Reset(snapshotSeq)) {
+    return false;
+  }
+  RemoveSnapshotsBefore(snapshotSeq);
+  lastSnapshotSeq = snapshotSeq;
+
+  std::cout << "Installed metadata snapshot from primary at log position "
+            << snapshotSeq << std::endl;
+  return true;
+}
+
+// Самый новый снимок каталога
+std::string MetadataStore::FindLatestSnapshot(uint64_t &snapshotSeq) {
+  std::string latest;
+  std::error_code ec;
+  for (const auto &entry : fs::directory_iterator(directory, ec)) {
+    uint64_t seq = 0;
+    if (ParseSnapshotName(entry.path().filename().string(), seq) &&
+        (latest.empty() || seq > snapshotSeq)) {
+      latest = entry.path().string();
+      snapshotSeq = seq;
+    }
+  }
+  return latest;
+}
+
+// Загрузка снимка любого поддерживаемого формата
+bool MetadataStore::LoadSnapshot(const std::string &path,
+                                 uint64_t snapshotSeq) {
+  if (!SnapshotImage::HasImageMagic(path)) {
+    return LoadTextSnapshot(path, snapshotSeq);
+  }
+
+  // Отображение остаётся у менеджера метаданных
+  auto image = std::make_shared<SnapshotImage>();
+  if (!image->Open(path) || image->GetLogSeq() != snapshotSeq) {
+    return false;
+  }
+  nodeManager->LoadSnapshotImage(*image);
+  metadataManager->LoadSnapshotImage(std::move(image));
+  return true;
+}
+
+// Текстовый снимок: заголовок, записи, число записей в конце
+bool MetadataStore::LoadTextSnapshot(const std::string &path,
+                                     uint64_t snapshotSeq) {
+  std::ifstream in(path, std::ios::binary);
+  std::string line;
+  MetadataLog::Record record;
+
+  if (!std::getline(in, line) || !MetadataLog::DecodeRecord(line, record) ||
+      record.size() != 3 || record[0] != "SNAPSHOT" ||
+      record[1] != std::to_string(TEXT_SNAPSHOT_VERSION) ||
+      record[2] != std::to_string(snapshotSeq)) {
+    return false;
+  }
+
+  size_t count = 0;
+  while (std::getline(in, line)) {
+    if (!MetadataLog::DecodeRecord(line, record)) {
+      return false;
+    }
+    if (record[0] == "END") {
+      return record.size() == 2 && record[1] == std::to_string(count);
+    }
+    if (!ApplyRecord(record)) {
+      return false;
+    }
+    count++;
+  }
+
+  return false; // Нет завершающей строки
+}
+
+void MetadataStore::RemoveSnapshotsBefore(uint64_t seq) {
+  std::vector<fs::path> obsolete;
+  std::error_code ec;
+  for (const auto &entry : fs::directory_iterator(directory, ec)) {
+    uint64_t snapshotSeq = 0;
+    if (ParseSnapshotName(entry.path().filename().string(), snapshotSeq) &&
+        snapshotSeq < seq) {
+      obsolete.push_back(entry.path());
+    }
+  }
+
+  for (const auto &path : obsolete) {
+    fs::remove(path, ec);
+  }
+}
@@ -1,7 +1,11 @@
 #include "node_manager.h"
 
+#include "placement.h"
 #include <algorithm>
+#include <cctype>
+#include <cmath>
 #include <iomanip>
+#include <limits>
 #include <iostream>
 #include <random>
 #include <sstream>
@@ -15,8 +19,18 @@ bool StorageNode::IsActive() const {
   return isActive;
 }
 
+uint64_t StorageNode::GetEffectiveFreeSpace() const {
+  return freeSpace > reservedSpace ? freeSpace - reservedSpace : 0;
+}
+
 // Конструктор
-NodeManager::NodeManager() : running(false) {}
+NodeManager::NodeManager()
+    : running(false),
+      nodeExpiry(std::chrono::milliseconds(EXPIRY_TICK_MS)),
+      reservationExpiry(std::chrono::milliseconds(EXPIRY_TICK_MS)),
+      log(nullptr), activeNodeCount(0), totalFreeSpace(0),
+      nodesRemoved(0), directory(std::make_shared<NodeDirectory>()),
+      directoryStale(true), directoryEpoch(0) {}
 
 // Деструктор
 NodeManager::~NodeManager() { StopKeepAliveChecker(); }
@@ -62,198 +76,903 @@ bool NodeManager::ValidateNodeInfo(const std::string &ip, int port,
   return true;
 }
 
-// Регистрация узла
+// Проверка идентификатора, присланного узлом
+bool NodeManager::ValidateNodeId(const std::string &nodeId) {
+  if (nodeId.empty() || nodeId.length() > 64) {
+    return false;
+  }
+  return std::all_of(nodeId.begin(), nodeId.end(), [](unsigned char c) {
+    return std::isalnum(c) || c == '-' || c == '_';
+  });
+}
+
+// Регистрация узла. Узел, сохранивший свой nodeId, возвращается под ним:
+// реплики в метаданных снова указывают на живой узел без перестроения
 bool NodeManager::RegisterNode(const std::string &ip, int port,
-                               uint64_t freeSpace, std::string &nodeId) {
+                               uint64_t freeSpace,
+                               const std::string &failureDomain,
+                               const std::string &requestedNodeId,
+                               std::string &nodeId) {
   // Валидация параметров
   if (!ValidateNodeInfo(ip, port, freeSpace)) {
     return false;
   }
+  if (!requestedNodeId.empty() && !ValidateNodeId(requestedNodeId)) {
+    return false;
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  bool reactivated = false;
+  uint64_t seq = 0;
 
-  // Проверка максимального количества узлов
   {
     std::lock_guard<std::mutex> lock(nodesMutex);
-    if (nodes.size() >= MAX_NODES) {
-      return false;
+
+    auto existing = requestedNodeId.empty() ? nodes.end()
+                                            : nodes.find(requestedNodeId);
+    if (existing != nodes.end()) {
+      StorageNode &node = existing->second;
+
+      // Тот же идентификатор у другого живого узла - скорее всего,
+      // скопированный каталог данных
+      if (node.isActive && (node.ipAddress != ip || node.port != port)) {
+        std::cerr << "Warning: Node id " << requestedNodeId
+                  << " is already used by " << node.ipAddress << ":"
+                  << node.port << std::endl;
+        return false;
+      }
+
+      reactivated = !node.isActive;
+      node.ipAddress = ip;
+      node.port = port;
+      node.failureDomain = failureDomain.empty() ? ip : failureDomain;
+      node.totalSpace = freeSpace + node.bytesStored;
+      node.telemetry = NodeTelemetry(); // Счётчики узла начались заново
+      node.loadScore = 0;
+      node.lastSeen = now;
+      directoryStale = true; // Адрес и нагрузка могли измениться
+      SetNodeActiveLocked(node, true);
+      SetNodeFreeSpaceLocked(node, freeSpace);
+      nodeExpiry.Schedule(requestedNodeId,
+                          now + std::chrono::seconds(NODE_TIMEOUT_SEC));
+      seq = AppendLogLocked(MakeNodeRecord(node));
+
+      nodeId = requestedNodeId;
+    } else {
+      // Проверка максимального количества узлов
+      if (nodes.size() >= MAX_NODES) {
+        return false;
+      }
+
+      // Новый узел или узел, о котором сервер не знает (перезапуск
+      // сервера): сохранённый идентификатор принимается как есть
+      std::string newNodeId = requestedNodeId;
+      if (newNodeId.empty()) {
+        do {
+          newNodeId = GenerateNodeId();
+        } while (nodes.find(newNodeId) != nodes.end());
+      }
+
+      // Создание записи узла
+      StorageNode &node = nodes[newNodeId];
+      node.nodeId = newNodeId;
+      node.ipAddress = ip;
+      node.port = port;
+      node.freeSpace = 0; // Учитывается в агрегатах ниже
+      node.reservedSpace = 0;
+      node.totalSpace = freeSpace; // Уточняется по объёму хранимых данных
+      node.failureDomain = failureDomain.empty() ? ip : failureDomain;
+      node.lastSeen = now;
+      node.registeredAt = now;
+      node.isActive = false;
+      node.chunksStored = 0;
+      node.bytesStored = 0;
+      node.loadScore = 0;
+
+      SetNodeActiveLocked(node, true);
+      SetNodeFreeSpaceLocked(node, freeSpace);
+      nodeExpiry.Schedule(newNodeId,
+                          now + std::chrono::seconds(NODE_TIMEOUT_SEC));
+      seq = AppendLogLocked(MakeNodeRecord(node));
+
+      nodeId = newNodeId;
     }
   }
 
-  // Генерация уникального nodeId
-  std::string newNodeId = GenerateNodeId();
+  if (reactivated) {
+    NotifyNodeState(nodeId, true);
+  }
+  // Идентификатор выдаётся узлу, только когда он сохранён
+  return WaitLogDurable(seq);
+}
 
-  // Проверка уникальности (маловероятно, но на всякий случай)
+// Удаление узла
+bool NodeManager::UnregisterNode(const std::string &nodeId) {
+  uint64_t seq = 0;
   {
     std::lock_guard<std::mutex> lock(nodesMutex);
-    while (nodes.find(newNodeId) != nodes.end()) {
-      newNodeId = GenerateNodeId();
+    auto it = nodes.find(nodeId);
+    if (it == nodes.end()) {
+      return false;
     }
+    SetNodeActiveLocked(it->second, false);
+    nodeExpiry.Cancel(nodeId);
+    nodes.erase(it);
+    nodesRemoved++;
+    directoryStale = true;
+    seq = AppendLogLocked({"NODE_DEL", nodeId});
   }
 
-  // Создание записи узла
-  StorageNode node;
-  node.nodeId = newNodeId;
-  node.ipAddress = ip;
-  node.port = port;
-  node.freeSpace = freeSpace;
-  node.totalSpace = freeSpace; // Пока используем freeSpace как totalSpace
-  node.lastSeen = std::chrono::steady_clock::now();
-  node.registeredAt = std::chrono::steady_clock::now();
-  node.isActive = true;
-  node.chunksStored = 0;
-  node.bytesStored = 0;
-
-  // Сохранение в map с мьютексом
+  NotifyNodeState(nodeId, false);
+  return WaitLogDurable(seq);
+}
+
+void NodeManager::SetLog(MetadataLog *metadataLog) {
+  std::lock_guard<std::mutex> lock(nodesMutex);
+  log = metadataLog;
+}
+
+// Запись в журнал (nodesMutex уже захвачен)
+uint64_t NodeManager::AppendLogLocked(const MetadataLog::Record &record) {
+  return log != nullptr ? log->Append(record) : 0;
+}
+
+// Ожидание фиксации записи seq (без nodesMutex)
+bool NodeManager::WaitLogDurable(uint64_t seq) {
+  MetadataLog *metadataLog;
   {
     std::lock_guard<std::mutex> lock(nodesMutex);
-    nodes[newNodeId] = node;
+    metadataLog = log;
+  }
+  if (metadataLog == nullptr) {
+    return true;
+  }
+  if (!metadataLog->WaitDurable(seq)) {
+    std::cerr << "Error: Node change was not persisted" << std::endl;
+    return false;
   }
-
-  nodeId = newNodeId;
   return true;
 }
 
-// Удаление узла
-bool NodeManager::UnregisterNode(const std::string &nodeId) {
-  std::lock_guard<std::mutex> lock(nodesMutex);
-  auto it = nodes.find(nodeId);
-  if (it != nodes.end()) {
-    nodes.erase(it);
+// NODE_PUT <nodeId> <ip> <port> <failureDomain> <totalSpace>
+MetadataLog::Record NodeManager::MakeNodeRecord(const StorageNode &node) {
+  return {"NODE_PUT", node.nodeId, node.ipAddress, std::to_string(node.port),
+          node.failureDomain, std::to_string(node.totalSpace)};
+}
+
+// Повтор записи журнала (NODE_PUT, NODE_DEL)
+bool NodeManager::ApplyLogRecord(const MetadataLog::Record &record) {
+  const std::string &type = record[0];
+
+  if (type == "NODE_PUT" && record.size() == 6) {
+    int port;
+    uint64_t totalSpace;
+    try {
+      port = std::stoi(record[3]);
+      totalSpace = std::stoull(record[5]);
+    } catch (const std::exception &) {
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(nodesMutex);
+    auto it = nodes.find(record[1]);
+    if (it == nodes.end()) {
+      // Узел неактивен и не в индексе записи, пока не зарегистрируется
+      auto now = std::chrono::steady_clock::now();
+      StorageNode &node = nodes[record[1]];
+      node.nodeId = record[1];
+      node.freeSpace = 0;
+      node.reservedSpace = 0;
+      node.lastSeen = now;
+      node.registeredAt = now;
+      node.isActive = false;
+      node.chunksStored = 0;
+      node.bytesStored = 0;
+      node.loadScore = 0;
+      it = nodes.find(record[1]);
+    }
+    it->second.ipAddress = record[2];
+    it->second.port = port;
+    it->second.failureDomain = record[4];
+    it->second.totalSpace = totalSpace;
+    directoryStale = true;
+    return true;
+  }
+
+  if (type == "NODE_DEL" && record.size() == 2) {
+    std::lock_guard<std::mutex> lock(nodesMutex);
+    auto it = nodes.find(record[1]);
+    if (it != nodes.end()) {
+      SetNodeActiveLocked(it->second, false);
+      nodeExpiry.Cancel(record[1]);
+      nodes.erase(it);
+      nodesRemoved++;
+      directoryStale = true;
+    }
     return true;
   }
+
   return false;
 }
 
+// Все известные узлы в снимок
+void NodeManager::ExportSnapshot(SnapshotImageWriter &writer) {
+  std::lock_guard<std::mutex> lock(nodesMutex);
+  for (const auto &pair : nodes) {
+    const StorageNode &node = pair.second;
+    writer.AddNode(node.nodeId, node.ipAddress, node.port,
+                   node.failureDomain, node.totalSpace);
+  }
+}
+
+// Удаление всех узлов перед загрузкой снимка основного сервера
+void NodeManager::Clear() {
+  std::lock_guard<std::mutex> lock(nodesMutex);
+  for (auto &pair : nodes) {
+    SetNodeActiveLocked(pair.second, false);
+    nodeExpiry.Cancel(pair.first);
+  }
+  nodes.clear();
+  nodesRemoved++;
+  directoryStale = true;
+}
+
+// Узлы из снимка (их немного - через ту же запись, что и журнал)
+void NodeManager::LoadSnapshotImage(const SnapshotImage &image) {
+  for (size_t i = 0; i < image.GetNodeCount(); ++i) {
+    const SnapshotNodeRecord &record = image.GetNode(i);
+    ApplyLogRecord({"NODE_PUT", image.GetNodeName(record.handle),
+                    image.GetString(record.ipString),
+                    std::to_string(record.port),
+                    image.GetString(record.domainString),
+                    std::to_string(record.totalSpace)});
+  }
+}
+
 // Обновление свободного места
 bool NodeManager::UpdateNodeSpace(const std::string &nodeId,
                                   uint64_t freeSpace) {
   std::lock_guard<std::mutex> lock(nodesMutex);
   auto it = nodes.find(nodeId);
   if (it != nodes.end()) {
-    it->second.freeSpace = freeSpace;
+    SetNodeFreeSpaceLocked(it->second, freeSpace);
     return true;
   }
   return false;
 }
 
-// Обновление времени последнего контакта
-void NodeManager::UpdateNodeLastSeen(const std::string &nodeId) {
+// Поправка свободного места
+void NodeManager::AdjustNodeSpace(const std::string &nodeId, int64_t delta) {
   std::lock_guard<std::mutex> lock(nodesMutex);
   auto it = nodes.find(nodeId);
-  if (it != nodes.end()) {
-    it->second.lastSeen = std::chrono::steady_clock::now();
-    it->second.isActive = true;
+  if (it == nodes.end()) {
+    return;
+  }
+
+  StorageNode &node = it->second;
+  uint64_t freeSpace = node.freeSpace;
+  if (delta >= 0) {
+    freeSpace += static_cast<uint64_t>(delta);
+  } else {
+    uint64_t used = static_cast<uint64_t>(-delta);
+    freeSpace = freeSpace > used ? freeSpace - used : 0;
   }
+  SetNodeFreeSpaceLocked(node, freeSpace);
 }
 
-// Получение узла по ID
-StorageNode *NodeManager::GetNode(const std::string &nodeId) {
+// Обновление статистики хранения узла
+void NodeManager::UpdateNodeUsage(const std::string &nodeId,
+                                  size_t chunksStored, uint64_t bytesStored) {
   std::lock_guard<std::mutex> lock(nodesMutex);
   auto it = nodes.find(nodeId);
   if (it != nodes.end()) {
-    return &(it->second);
+    StorageNode &node = it->second;
+    node.chunksStored = chunksStored;
+    node.bytesStored = bytesStored;
+    // Ёмкость узла не меньше занятого нашими данными плюс свободное
+    node.totalSpace =
+        std::max(node.totalSpace, node.freeSpace + node.bytesStored);
   }
-  return nullptr;
 }
 
-// Фильтрация и сортировка узлов
-std::vector<StorageNode> NodeManager::FilterAndSortNodes(uint64_t requiredSpace) {
-  std::vector<StorageNode> availableNodes;
-  auto now = std::chrono::steady_clock::now();
+// Телеметрия узла
+bool NodeManager::UpdateNodeTelemetry(const std::string &nodeId,
+                                      const NodeTelemetry &telemetry) {
+  std::lock_guard<std::mutex> lock(nodesMutex);
+  auto it = nodes.find(nodeId);
+  if (it == nodes.end()) {
+    return false;
+  }
 
-  size_t totalNodes = 0;
-  size_t inactiveNodes = 0;
-  size_t timeoutNodes = 0;
-  size_t insufficientSpaceNodes = 0;
+  StorageNode &node = it->second;
 
-  {
-    std::lock_guard<std::mutex> lock(nodesMutex);
-    totalNodes = nodes.size();
-    
-    for (const auto &pair : nodes) {
-      const StorageNode &node = pair.second;
-
-      // Фильтрация активных узлов
-      if (!node.isActive) {
-        inactiveNodes++;
-        continue;
-      }
+  // Счётчик ошибок накопительный; уменьшение - перезапуск узла
+  uint64_t newErrors = telemetry.errorCount >= node.telemetry.errorCount
+                           ? telemetry.errorCount - node.telemetry.errorCount
+                           : telemetry.errorCount;
 
-      // Проверка таймаута
-      auto timeSinceLastSeen =
-          std::chrono::duration_cast<std::chrono::seconds>(now - node.lastSeen)
-              .count();
-      if (timeSinceLastSeen > NODE_TIMEOUT_SEC) {
-        timeoutNodes++;
-        continue;
-      }
+  int readRank = GetReadRank(node);
+  node.loadScore = LOAD_EWMA_ALPHA * ComputeLoad(telemetry, newErrors) +
+                   (1.0 - LOAD_EWMA_ALPHA) * node.loadScore;
+  node.telemetry = telemetry;
+  ReindexNodeLocked(node); // Вес размещения зависит от нагрузки
+  if (GetReadRank(node) != readRank) {
+    directoryStale = true;
+  }
+  return true;
+}
+
+// Ранг узла в порядке чтения реплик, неактивные в конце. Нагрузка
+// сравнивается с шагом 0.1: при близкой нагрузке сохраняется исходный
+// порядок (HRW), иначе все клиенты сошлись бы на одном чуть менее
+// нагруженном узле
+int NodeManager::GetReadRank(const StorageNode &node) {
+  return node.isActive ? static_cast<int>(node.loadScore * 10)
+                       : std::numeric_limits<int>::max();
+}
 
-      // Фильтрация по свободному месту
-      if (node.freeSpace < requiredSpace) {
-        insufficientSpaceNodes++;
-        continue;
+// Снимок адресов узлов: пересобирается под nodesMutex, только если узлы
+// менялись с прошлого запроса
+std::shared_ptr<const NodeDirectory> NodeManager::GetNodeDirectory() {
+  if (directoryStale) {
+    std::lock_guard<std::mutex> lock(nodesMutex);
+    if (directoryStale) {
+      auto rebuilt = std::make_shared<NodeDirectory>();
+      rebuilt->nodes.reserve(nodes.size());
+      for (const auto &pair : nodes) {
+        rebuilt->nodes[pair.first] = {pair.second.ipAddress, pair.second.port,
+                                      GetReadRank(pair.second)};
       }
+      // Смена одной лишь нагрузки не меняет эпоху: по ней кэшируются
+      // ответы с адресами узлов
+      rebuilt->epoch = IsSameAddresses(*directory, *rebuilt)
+                           ? directoryEpoch
+                           : ++directoryEpoch;
+      std::atomic_store(&directory,
+                        std::shared_ptr<const NodeDirectory>(rebuilt));
+      directoryStale = false;
+    }
+  }
+  return std::atomic_load(&directory);
+}
 
-      availableNodes.push_back(node);
+// Обновление времени последнего контакта
+void NodeManager::UpdateNodeLastSeen(const std::string &nodeId) {
+  bool reactivated = false;
+  {
+    std::lock_guard<std::mutex> lock(nodesMutex);
+    auto it = nodes.find(nodeId);
+    if (it == nodes.end()) {
+      return;
     }
+    it->second.lastSeen = std::chrono::steady_clock::now();
+    reactivated = !it->second.isActive;
+    SetNodeActiveLocked(it->second, true);
+    nodeExpiry.Schedule(nodeId, it->second.lastSeen +
+                                    std::chrono::seconds(NODE_TIMEOUT_SEC));
   }
 
-  std::cout << "FilterAndSortNodes: total=" << totalNodes 
-            << ", inactive=" << inactiveNodes 
-            << ", timeout=" << timeoutNodes 
-            << ", insufficientSpace=" << insufficientSpaceNodes 
-            << ", available=" << availableNodes.size() << std::endl;
+  if (reactivated) {
+    NotifyNodeState(nodeId, true);
+  }
+}
 
-  // Сортировка по свободному месту (по убыванию)
-  std::sort(availableNodes.begin(), availableNodes.end(),
-            [](const StorageNode &a, const StorageNode &b) {
-              return a.freeSpace > b.freeSpace;
-            });
+// Копия узла по ID
+bool NodeManager::GetNode(const std::string &nodeId, StorageNode &node) const {
+  std::lock_guard<std::mutex> lock(nodesMutex);
+  auto it = nodes.find(nodeId);
+  if (it == nodes.end()) {
+    return false;
+  }
+  node = it->second;
+  return true;
+}
 
-  return availableNodes;
+// Копия активного узла
+bool NodeManager::GetActiveNode(const std::string &nodeId,
+                                StorageNode &node) const {
+  std::lock_guard<std::mutex> lock(nodesMutex);
+  auto it = nodes.find(nodeId);
+  if (it == nodes.end() || !it->second.isActive) {
+    return false;
+  }
+  node = it->second;
+  return true;
+}
+
+// Смена активности узла с обновлением индекса и агрегатов
+// (nodesMutex уже захвачен)
+void NodeManager::SetNodeActiveLocked(StorageNode &node, bool active) {
+  if (node.isActive == active) {
+    return;
+  }
+
+  node.isActive = active;
+  directoryStale = true;
+  if (active) {
+    activeNodeCount++;
+    totalFreeSpace += node.freeSpace;
+  } else {
+    activeNodeCount--;
+    totalFreeSpace -= node.freeSpace;
+  }
+  ReindexNodeLocked(node);
+}
+
+// Смена свободного места узла (nodesMutex уже захвачен)
+void NodeManager::SetNodeFreeSpaceLocked(StorageNode &node,
+                                         uint64_t freeSpace) {
+  if (node.isActive) {
+    totalFreeSpace += freeSpace;
+    totalFreeSpace -= node.freeSpace;
+  }
+  node.freeSpace = freeSpace;
+  ReindexNodeLocked(node);
+}
+
+// Обновление позиции, веса и домена узла в индексе (nodesMutex уже
+// захвачен)
+void NodeManager::ReindexNodeLocked(const StorageNode &node) {
+  UnindexNodeLocked(node.nodeId);
+  if (node.isActive) {
+    eligiblePositions[node.nodeId] = eligibleIndex.emplace(
+        node.GetEffectiveFreeSpace(),
+        EligibleEntry{&node, Placement::Hash64(node.nodeId),
+                      GetPlacementWeight(node),
+                      GetDomainIdLocked(node.failureDomain)});
+  }
+}
+
+// Номер метки домена отказа (nodesMutex уже захвачен)
+uint32_t NodeManager::GetDomainIdLocked(const std::string &failureDomain) {
+  auto it = domainIds.find(failureDomain);
+  if (it != domainIds.end()) {
+    return it->second;
+  }
+  uint32_t domain = static_cast<uint32_t>(domainNames.size());
+  domainNames.push_back(failureDomain);
+  domainIds.emplace(failureDomain, domain);
+  return domain;
+}
+
+// Удаление узла из индекса (nodesMutex уже захвачен)
+void NodeManager::UnindexNodeLocked(const std::string &nodeId) {
+  auto it = eligiblePositions.find(nodeId);
+  if (it != eligiblePositions.end()) {
+    eligibleIndex.erase(it->second);
+    eligiblePositions.erase(it);
+  }
+}
+
+// Обход узлов, доступных для записи
+void NodeManager::ForEachEligibleNode(
+    uint64_t requiredSpace,
+    const std::function<bool(const StorageNode &)> &visitor) const {
+  std::lock_guard<std::mutex> lock(nodesMutex);
+  ForEachEligibleNodeLocked(requiredSpace, visitor);
+}
+
+void NodeManager::ForEachEligibleNodeLocked(
+    uint64_t requiredSpace,
+    const std::function<bool(const StorageNode &)> &visitor) const {
+  ForEachEligibleEntryLocked(
+      requiredSpace, [&](const EligibleIndex::value_type &entry) {
+        return visitor(*entry.second.node);
+      });
+}
+
+// Обход записей индекса (nodesMutex уже захвачен)
+void NodeManager::ForEachEligibleEntryLocked(
+    uint64_t requiredSpace,
+    const std::function<bool(const EligibleIndex::value_type &)> &visitor)
+    const {
+  // В индексе только активные узлы: замолчавшие снимает колесо таймеров
+  for (const auto &entry : eligibleIndex) {
+    // Индекс упорядочен по убыванию места: дальше узлы только меньше
+    if (entry.first < requiredSpace) {
+      break;
+    }
+
+    if (!visitor(entry)) {
+      break;
+    }
+  }
 }
 
 // Получение доступных узлов для загрузки
 std::vector<StorageNode> NodeManager::GetAvailableNodes(size_t count,
                                                         uint64_t requiredSpace) {
-  std::vector<StorageNode> availableNodes = FilterAndSortNodes(requiredSpace);
+  std::vector<StorageNode> availableNodes;
 
-  std::cout << "GetAvailableNodes: requested " << count 
-            << " nodes with " << requiredSpace << " bytes free space" << std::endl;
-  std::cout << "GetAvailableNodes: found " << availableNodes.size() 
-            << " available nodes" << std::endl;
+  // Первые count узлов с наибольшим свободным местом
+  ForEachEligibleNode(requiredSpace, [&](const StorageNode &node) {
+    availableNodes.push_back(node);
+    return availableNodes.size() < count;
+  });
 
-  // Выбор первых N узлов
-  if (availableNodes.size() > count) {
-    availableNodes.resize(count);
+  return availableNodes;
+}
+
+// Вес узла при размещении
+double NodeManager::GetPlacementWeight(const StorageNode &node) {
+  // В гигабайтах, чтобы не терять точность на больших значениях;
+  // нагруженный узел получает пропорционально меньше новых чанков
+  return static_cast<double>(node.GetEffectiveFreeSpace()) /
+         (1024.0 * 1024.0 * 1024.0) * (1.0 - node.loadScore);
+}
+
+// Мгновенная нагрузка узла по телеметрии, в [0, 1)
+double NodeManager::ComputeLoad(const NodeTelemetry &telemetry,
+                                uint64_t newErrors) {
+  double raw =
+      telemetry.inflightTransfers / INFLIGHT_SATURATION +
+      static_cast<double>(telemetry.readBytesPerSec +
+                          telemetry.writeBytesPerSec) /
+          BANDWIDTH_SATURATION +
+      telemetry.diskQueueDepth / QUEUE_SATURATION +
+      static_cast<double>(newErrors) / ERRORS_SATURATION;
+  return raw / (1.0 + raw);
+}
+
+// Число общих первых уровней двух меток домена ("zone/rack/host");
+// для одинаковых меток - SIZE_MAX
+size_t NodeManager::GetSharedDomainDepth(const std::string &a,
+                                         const std::string &b) {
+  if (a == b) {
+    return SIZE_MAX;
   }
 
-  return availableNodes;
+  size_t depth = 0;
+  size_t start = 0;
+  while (true) {
+    size_t endA = a.find('/', start);
+    size_t endB = b.find('/', start);
+    if (endA != endB || endA == std::string::npos ||
+        a.compare(start, endA - start, b, start, endB - start) != 0) {
+      return depth;
+    }
+    depth++;
+    start = endA + 1;
+  }
 }
 
-// Получение всех активных узлов
-std::vector<StorageNode> NodeManager::GetAllActiveNodes() {
-  std::vector<StorageNode> activeNodes;
-  auto now = std::chrono::steady_clock::now();
+// Планирование размещения реплик чанков
+bool NodeManager::PlanPlacement(const std::string &placementKey,
+                                size_t chunkCount, size_t replicationFactor,
+                                uint64_t chunkSize, size_t spareNodes,
+                                PlacementPlan &plan) {
+  plan.nodes.clear();
+  plan.chunkReplicas.clear();
+
+  // Под блокировкой копируются только записи индекса без строк; оценка и
+  // выбор узлов идут без nodesMutex, полные записи копируются лишь для
+  // выбранных узлов. Если за это время узел удалили, выбор повторяется
+  std::vector<PlacementCandidate> candidates;
+  std::vector<size_t> chosen;
+  while (true) {
+    uint64_t removed;
+    candidates.clear();
+    {
+      std::lock_guard<std::mutex> lock(nodesMutex);
+      removed = nodesRemoved;
+      candidates.reserve(activeNodeCount);
+      ForEachEligibleEntryLocked(
+          chunkSize, [&](const EligibleIndex::value_type &entry) {
+            const EligibleEntry &eligible = entry.second;
+            candidates.push_back(PlacementCandidate{
+                eligible.nodeHash, eligible.weight, entry.first,
+                eligible.domain, &domainNames[eligible.domain],
+                eligible.node});
+            return true;
+          });
+    }
+
+    if (!ChoosePlacement(candidates, placementKey, chunkCount,
+                         replicationFactor, chunkSize, spareNodes, chosen,
+                         plan.chunkReplicas)) {
+      plan.chunkReplicas.clear();
+      return false;
+    }
 
-  {
     std::lock_guard<std::mutex> lock(nodesMutex);
-    for (const auto &pair : nodes) {
-      const StorageNode &node = pair.second;
+    if (nodesRemoved != removed) {
+      continue;
+    }
+    plan.nodes.reserve(chosen.size());
+    for (size_t candidate : chosen) {
+      plan.nodes.push_back(*candidates[candidate].node);
+    }
+    return true;
+  }
+}
+
+// Выбор узлов для реплик каждого чанка
+bool NodeManager::ChoosePlacement(
+    const std::vector<PlacementCandidate> &candidates,
+    const std::string &placementKey, size_t chunkCount,
+    size_t replicationFactor, uint64_t chunkSize, size_t spareNodes,
+    std::vector<size_t> &chosen,
+    std::vector<std::vector<size_t>> &chunkReplicas) {
+  chosen.clear();
+  chunkReplicas.clear();
+  if (candidates.size() < replicationFactor) {
+    return false;
+  }
+
+  // Индекс кандидата -> индекс в таблице плана
+  std::vector<size_t> planIndex(candidates.size(), SIZE_MAX);
+  std::vector<std::pair<double, size_t>> scores(candidates.size());
+  bool domainWarningShown = false;
+
+  // Место, остающееся на кандидатах с учётом уже распределённых чанков
+  std::vector<uint64_t> remaining;
+  remaining.reserve(candidates.size());
+  for (const PlacementCandidate &candidate : candidates) {
+    remaining.push_back(candidate.freeSpace);
+  }
+
+  chunkReplicas.resize(chunkCount);
+  for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+    uint64_t keyHash =
+        Placement::Hash64(placementKey + "#" + std::to_string(chunk));
+
+    // Узел, на котором больше не помещается чанк, получает минимум
+    for (size_t i = 0; i < candidates.size(); ++i) {
+      double score = remaining[i] >= chunkSize
+                         ? Placement::Score(keyHash, candidates[i].nodeHash,
+                                            candidates[i].weight)
+                         : -std::numeric_limits<double>::infinity();
+      scores[i] = {score, i};
+    }
+
+    auto byScore = [](const std::pair<double, size_t> &a,
+                      const std::pair<double, size_t> &b) {
+      return a.first > b.first;
+    };
+
+    // Реплики - узлы с наибольшими оценками
+    std::partial_sort(scores.begin(), scores.begin() + replicationFactor,
+                      scores.end(), byScore);
+
+    if (std::isinf(scores[replicationFactor - 1].first)) {
+      return false; // Не хватает места
+    }
+
+    std::vector<size_t> selected;
+    for (size_t r = 0; r < replicationFactor; ++r) {
+      selected.push_back(scores[r].second);
+    }
 
-      // Проверка активности
-      if (!node.isActive) {
-        continue;
+    // Реплики в одном домене: выбираем заново с учётом доменов
+    bool sameDomain = false;
+    for (size_t i = 0; i < selected.size() && !sameDomain; ++i) {
+      for (size_t j = i + 1; j < selected.size(); ++j) {
+        if (candidates[selected[i]].domain ==
+            candidates[selected[j]].domain) {
+          sameDomain = true;
+          break;
+        }
       }
+    }
+
+    if (sameDomain) {
+      std::sort(scores.begin(), scores.end(), byScore);
+      selected.clear();
+      std::vector<bool> taken(candidates.size(), false);
+
+      // Каждая следующая реплика - узел, наименее близкий по иерархии
+      // доменов к уже выбранным; среди равных - с наибольшей оценкой
+      for (size_t r = 0; r < replicationFactor; ++r) {
+        size_t best = SIZE_MAX;
+        size_t bestDepth = SIZE_MAX;
+        for (const auto &scored : scores) {
+          size_t candidate = scored.second;
+          if (taken[candidate] || std::isinf(scored.first)) {
+            continue;
+          }
+          size_t depth = 0;
+          for (size_t previous : selected) {
+            depth = std::max(depth, GetSharedDomainDepth(
+                                        *candidates[candidate].domainName,
+                                        *candidates[previous].domainName));
+          }
+          if (best == SIZE_MAX || depth < bestDepth) {
+            best = candidate;
+            bestDepth = depth;
+            if (depth == 0) {
+              break; // Лучше не бывает
+            }
+          }
+        }
+
+        if (bestDepth == SIZE_MAX && !selected.empty() &&
+            !domainWarningShown) {
+          std::cerr << "Warning: Not enough failure domains for "
+                    << replicationFactor
+                    << " replicas, some replicas share a domain" << std::endl;
+          domainWarningShown = true;
+        }
+
+        taken[best] = true;
+        selected.push_back(best);
+      }
+    }
 
-      // Проверка таймаута
-      auto timeSinceLastSeen =
-          std::chrono::duration_cast<std::chrono::seconds>(now - node.lastSeen)
-              .count();
-      if (timeSinceLastSeen > NODE_TIMEOUT_SEC) {
-        continue;
+    for (size_t candidate : selected) {
+      remaining[candidate] -= chunkSize;
+      if (planIndex[candidate] == SIZE_MAX) {
+        planIndex[candidate] = chosen.size();
+        chosen.push_back(candidate);
       }
+      chunkReplicas[chunk].push_back(planIndex[candidate]);
+    }
+  }
+
+  // Запасные узлы (индекс упорядочен по свободному месту)
+  for (size_t i = 0; i < candidates.size() && spareNodes > 0; ++i) {
+    if (planIndex[i] == SIZE_MAX) {
+      planIndex[i] = chosen.size();
+      chosen.push_back(i);
+      spareNodes--;
+    }
+  }
+
+  return true;
+}
+
+// Выбор узла для новой реплики чанка
+bool NodeManager::SelectReplicaTarget(
+    const std::string &chunkId, uint64_t chunkSize,
+    const std::vector<std::string> &excludeNodeIds, StorageNode &target) {
+  std::lock_guard<std::mutex> lock(nodesMutex);
+
+  // Домены живых реплик
+  std::vector<std::string> liveDomains;
+  for (const auto &nodeId : excludeNodeIds) {
+    auto it = nodes.find(nodeId);
+    if (it != nodes.end() && it->second.isActive) {
+      liveDomains.push_back(it->second.failureDomain);
+    }
+  }
+
+  uint64_t keyHash = Placement::Hash64(chunkId);
+  const StorageNode *best = nullptr;
+  const StorageNode *bestOtherDomain = nullptr;
+  double bestScore = 0;
+  double bestOtherDomainScore = 0;
+
+  ForEachEligibleEntryLocked(
+      chunkSize, [&](const EligibleIndex::value_type &entry) {
+        const StorageNode &node = *entry.second.node;
+        if (std::find(excludeNodeIds.begin(), excludeNodeIds.end(),
+                      node.nodeId) != excludeNodeIds.end()) {
+          return true;
+        }
+
+        double score = Placement::Score(keyHash, entry.second.nodeHash,
+                                        entry.second.weight);
+        if (best == nullptr || score > bestScore) {
+          best = &node;
+          bestScore = score;
+        }
+        if (std::find(liveDomains.begin(), liveDomains.end(),
+                      node.failureDomain) == liveDomains.end() &&
+            (bestOtherDomain == nullptr || score > bestOtherDomainScore)) {
+          bestOtherDomain = &node;
+          bestOtherDomainScore = score;
+        }
+        return true;
+      });
+
+  if (bestOtherDomain != nullptr) {
+    target = *bestOtherDomain;
+    return true;
+  }
+  if (best != nullptr) {
+    target = *best;
+    return true;
+  }
+  return false;
+}
+
+// Резервирование места под загрузку
+bool NodeManager::ReserveSpace(
+    const std::string &sessionId,
+    const std::unordered_map<std::string, uint64_t> &bytes) {
+  std::lock_guard<std::mutex> lock(nodesMutex);
+
+  // Прежний резерв сессии учитывается как свободное место и снимается
+  // только после проверки нового
+  auto previous = reservations.find(sessionId);
+  for (const auto &pair : bytes) {
+    auto it = nodes.find(pair.first);
+    if (it == nodes.end()) {
+      return false;
+    }
+    uint64_t available = it->second.GetEffectiveFreeSpace();
+    if (previous != reservations.end()) {
+      auto held = previous->second.bytesPerNode.find(pair.first);
+      if (held != previous->second.bytesPerNode.end()) {
+        available += held->second;
+      }
+    }
+    if (available < pair.second) {
+      return false;
+    }
+  }
+
+  ReleaseReservationLocked(sessionId);
+
+  SpaceReservation reservation;
+  reservation.bytesPerNode = bytes;
+  reservation.expiresAt = std::chrono::steady_clock::now() +
+                          std::chrono::seconds(RESERVATION_TTL_SEC);
+  for (const auto &pair : bytes) {
+    StorageNode &node = nodes[pair.first];
+    node.reservedSpace += pair.second;
+    ReindexNodeLocked(node);
+  }
+  reservations[sessionId] = reservation;
+  reservationExpiry.Schedule(sessionId, reservation.expiresAt);
+
+  return true;
+}
+
+// Перевод резерва в занятое место
+void NodeManager::CommitReservation(
+    const std::string &sessionId,
+    const std::unordered_map<std::string, uint64_t> &storedBytes) {
+  std::lock_guard<std::mutex> lock(nodesMutex);
+
+  ReleaseReservationLocked(sessionId);
 
-      activeNodes.push_back(node);
+  for (const auto &pair : storedBytes) {
+    auto it = nodes.find(pair.first);
+    if (it != nodes.end()) {
+      StorageNode &node = it->second;
+      SetNodeFreeSpaceLocked(node, node.freeSpace > pair.second
+                                       ? node.freeSpace - pair.second
+                                       : 0);
+    }
+  }
+}
+
+// Снятие резерва
+void NodeManager::ReleaseReservation(const std::string &sessionId) {
+  std::lock_guard<std::mutex> lock(nodesMutex);
+  ReleaseReservationLocked(sessionId);
+}
+
+// Снятие резерва (nodesMutex уже захвачен)
+void NodeManager::ReleaseReservationLocked(const std::string &sessionId) {
+  auto it = reservations.find(sessionId);
+  if (it == reservations.end()) {
+    return;
+  }
+
+  for (const auto &pair : it->second.bytesPerNode) {
+    auto nodeIt = nodes.find(pair.first);
+    if (nodeIt != nodes.end()) {
+      StorageNode &node = nodeIt->second;
+      node.reservedSpace =
+          node.reservedSpace > pair.second ? node.reservedSpace - pair.second
+                                           : 0;
+      ReindexNodeLocked(node);
+    }
+  }
+  reservations.erase(it);
+  reservationExpiry.Cancel(sessionId);
+}
+
+// Получение всех активных узлов
+std::vector<StorageNode> NodeManager::GetAllActiveNodes() {
+  std::vector<StorageNode> activeNodes;
+
+  std::lock_guard<std::mutex> lock(nodesMutex);
+  activeNodes.reserve(activeNodeCount);
+  for (const auto &pair : nodes) {
+    if (pair.second.isActive) {
+      activeNodes.push_back(pair.second);
     }
   }
 
@@ -261,9 +980,7 @@ std::vector<StorageNode> NodeManager::GetAllActiveNodes() {
 }
 
 // Количество активных узлов
-size_t NodeManager::GetActiveNodeCount() {
-  return GetAllActiveNodes().size();
-}
+size_t NodeManager::GetActiveNodeCount() { return activeNodeCount; }
 
 // Запуск keep-alive проверки
 void NodeManager::StartKeepAliveChecker() {
@@ -275,7 +992,7 @@ void NodeManager::StartKeepAliveChecker() {
   keepAliveThread = std::thread([this]() {
     while (running) {
       std::this_thread::sleep_for(
-          std::chrono::seconds(KEEP_ALIVE_INTERVAL_SEC));
+          std::chrono::milliseconds(EXPIRY_TICK_MS));
 
       if (running) {
         CheckNodeHealth();
@@ -297,38 +1014,86 @@ void NodeManager::StopKeepAliveChecker() {
   }
 }
 
-// Проверка здоровья узлов
+// Проверка здоровья узлов: срабатывание таймаутов и истёкших резервов
 void NodeManager::CheckNodeHealth() {
   auto now = std::chrono::steady_clock::now();
+  std::vector<std::string> expiredNodes;
+  std::vector<std::string> expiredSessions;
+  std::vector<std::string> deactivated;
 
   {
     std::lock_guard<std::mutex> lock(nodesMutex);
-    for (auto &pair : nodes) {
-      StorageNode &node = pair.second;
 
-      // Проверка таймаута
-      auto timeSinceLastSeen =
-          std::chrono::duration_cast<std::chrono::seconds>(now - node.lastSeen)
-              .count();
-
-      if (timeSinceLastSeen > NODE_TIMEOUT_SEC) {
+    nodeExpiry.Advance(now, expiredNodes);
+    for (const auto &nodeId : expiredNodes) {
+      auto it = nodes.find(nodeId);
+      if (it != nodes.end() && it->second.isActive) {
         // Помечаем узел как неактивный
-        node.isActive = false;
+        SetNodeActiveLocked(it->second, false);
+        deactivated.push_back(nodeId);
+        std::cout << "Node " << nodeId << " timed out" << std::endl;
       }
     }
+
+    // Резервы брошенных загрузок
+    reservationExpiry.Advance(now, expiredSessions);
+    for (const auto &sessionId : expiredSessions) {
+      ReleaseReservationLocked(sessionId);
+    }
+  }
+
+  for (const auto &nodeId : deactivated) {
+    NotifyNodeState(nodeId, false);
   }
 
   // Удаление неактивных узлов (опционально)
   // RemoveInactiveNodes();
 }
 
+// Подписка на смену активности узлов
+void NodeManager::SetNodeStateCallback(NodeStateCallback callback) {
+  std::lock_guard<std::mutex> lock(callbackMutex);
+  nodeStateCallback = std::move(callback);
+}
+
+// Вызов подписчика (не под nodesMutex: он может обращаться к NodeManager)
+void NodeManager::NotifyNodeState(const std::string &nodeId, bool active) {
+  std::lock_guard<std::mutex> lock(callbackMutex);
+  if (nodeStateCallback) {
+    nodeStateCallback(nodeId, active);
+  }
+}
+
+// Совпадают ли в снимках адреса и набор активных узлов
+bool NodeManager::IsSameAddresses(const NodeDirectory &a,
+                                  const NodeDirectory &b) {
+  if (a.nodes.size() != b.nodes.size()) {
+    return false;
+  }
+  const int inactive = std::numeric_limits<int>::max();
+  for (const auto &pair : a.nodes) {
+    auto it = b.nodes.find(pair.first);
+    if (it == b.nodes.end() ||
+        it->second.ipAddress != pair.second.ipAddress ||
+        it->second.port != pair.second.port ||
+        (it->second.readRank == inactive) !=
+            (pair.second.readRank == inactive)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 // Удаление неактивных узлов
 void NodeManager::RemoveInactiveNodes() {
   std::lock_guard<std::mutex> lock(nodesMutex);
   auto it = nodes.begin();
   while (it != nodes.end()) {
     if (!it->second.isActive) {
+      nodeExpiry.Cancel(it->first);
       it = nodes.erase(it);
+      nodesRemoved++;
+      directoryStale = true;
     } else {
       ++it;
     }
@@ -342,55 +1107,8 @@ size_t NodeManager::GetTotalNodes() const {
 }
 
 // Количество активных узлов
-size_t NodeManager::GetActiveNodes() const {
-  size_t count = 0;
-  auto now = std::chrono::steady_clock::now();
+size_t NodeManager::GetActiveNodes() const { return activeNodeCount; }
 
-  std::lock_guard<std::mutex> lock(nodesMutex);
-
-  for (const auto &pair : nodes) {
-    const StorageNode &node = pair.second;
-
-    if (!node.isActive) {
-      continue;
-    }
-
-    // Проверка таймаута
-    auto timeSinceLastSeen =
-        std::chrono::duration_cast<std::chrono::seconds>(now - node.lastSeen)
-            .count();
-    if (timeSinceLastSeen <= NODE_TIMEOUT_SEC) {
-      count++;
-    }
-  }
-
-  return count;
-}
-
-// Общее свободное место
-uint64_t NodeManager::GetTotalFreeSpace() const {
-  uint64_t total = 0;
-  auto now = std::chrono::steady_clock::now();
-
-  std::lock_guard<std::mutex> lock(nodesMutex);
-
-  for (const auto &pair : nodes) {
-    const StorageNode &node = pair.second;
-
-    // Учитываем только активные узлы
-    if (!node.isActive) {
-      continue;
-    }
-
-    // Проверка таймаута
-    auto timeSinceLastSeen =
-        std::chrono::duration_cast<std::chrono::seconds>(now - node.lastSeen)
-            .count();
-    if (timeSinceLastSeen <= NODE_TIMEOUT_SEC) {
-      total += node.freeSpace;
-    }
-  }
-
-  return total;
-}
+// Общее свободное место активных узлов
+uint64_t NodeManager::GetTotalFreeSpace() const { return totalFreeSpace; }
 
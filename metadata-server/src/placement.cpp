@@ -0,0 +1,27 @@
+#include "placement.h"
+
+#include "hash_utils.h"
+#include <cmath>
+#include <limits>
+
+namespace Placement {
+
+uint64_t Hash64(const std::string &data) { return HashUtils::Hash64(data); }
+
+uint64_t Combine(uint64_t keyHash, uint64_t nodeHash) {
+  return HashUtils::Mix64(keyHash ^ HashUtils::Mix64(nodeHash));
+}
+
+double Score(uint64_t keyHash, uint64_t nodeHash, double weight) {
+  if (weight <= 0) {
+    return -std::numeric_limits<double>::infinity();
+  }
+
+  // Старшие 53 бита -> u в открытом интервале (0, 1)
+  uint64_t bits = Combine(keyHash, nodeHash) >> 11;
+  double u = (static_cast<double>(bits) + 0.5) / 9007199254740992.0;
+
+  return -weight / std::log(u);
+}
+
+} // namespace Placement
@@ -1,18 +1,32 @@
 #include "protocol_handler.h"
 
+#include "hash_utils.h"
 #include "network_utils.h"
 #include <algorithm>
+#include <iomanip>
 #include <iostream>
+#include <limits>
 #include <sstream>
+#include <unordered_map>
 
 // Конструктор
 ProtocolHandler::ProtocolHandler(NodeManager *nodeManager,
-                                 MetadataManager *metadataManager)
-    : nodeManager(nodeManager), metadataManager(metadataManager) {}
+                                 MetadataManager *metadataManager,
+                                 RepairScheduler *repairScheduler)
+    : nodeManager(nodeManager), metadataManager(metadataManager),
+      repairScheduler(repairScheduler), shardMap(nullptr), localShard(0),
+      shardRelay(nullptr), manifestCache(MANIFEST_CACHE_BYTES) {}
+
+void ProtocolHandler::SetSharding(const ShardMap *shardMap, size_t localShard,
+                                  ShardRelay *shardRelay) {
+  this->shardMap = shardMap;
+  this->localShard = localShard;
+  this->shardRelay = shardRelay;
+}
 
 // Главный метод обработки запроса
 std::string ProtocolHandler::ProcessRequest(const std::string &request,
-                                            SOCKET socket) {
+                                            SOCKET socket, bool relayed) {
   if (request.empty()) {
     return CreateErrorResponse("INVALID_COMMAND", "Empty request");
   }
@@ -28,26 +42,103 @@ std::string ProtocolHandler::ProcessRequest(const std::string &request,
 
   // Маршрутизация к обработчику
   // UPLOAD_COMPLETE обрабатывается отдельно через ProcessMultilineRequest
-  if (command == "REGISTER_NODE") {
-    return HandleRegisterNode(args);
-  } else if (command == "KEEP_ALIVE") {
-    return HandleKeepAlive(args);
-  } else if (command == "UPDATE_SPACE") {
-    return HandleUpdateSpace(args);
+  // Запросы узлов хранения повторяются на остальных шардах
+  if (command == "REGISTER_NODE" || command == "KEEP_ALIVE" ||
+      command == "UPDATE_SPACE") {
+    std::string response;
+    if (command == "REGISTER_NODE") {
+      response = HandleRegisterNode(args);
+    } else if (command == "KEEP_ALIVE") {
+      response = HandleKeepAlive(args);
+    } else {
+      response = HandleUpdateSpace(args);
+    }
+    if (!relayed) {
+      RelayNodeRequest(args, request, response);
+    }
+    return response;
   } else if (command == "REQUEST_UPLOAD") {
     return HandleRequestUpload(args);
+  } else if (command == "RESUME_UPLOAD") {
+    return HandleResumeUpload(args);
   } else if (command == "REQUEST_DOWNLOAD") {
     return HandleRequestDownload(args);
+  } else if (command == "DELETE_FILE") {
+    return HandleDeleteFile(args);
   } else if (command == "LIST_FILES") {
-    return HandleListFiles();
+    return HandleListFiles(args);
   } else if (command == "LIST_NODES") {
     return HandleListNodes();
+  } else if (command == "GET_SHARD_MAP") {
+    return HandleGetShardMap();
   } else {
     return CreateErrorResponse("INVALID_COMMAND",
                                "Unknown command: " + command);
   }
 }
 
+// Проверка принадлежности имени файла этому шарду
+bool ProtocolHandler::IsLocalFilename(const std::string &filename,
+                                      const std::string &responsePrefix,
+                                      std::string &wrongShard) {
+  if (shardMap == nullptr || !shardMap->IsSharded()) {
+    return true;
+  }
+
+  size_t owner = shardMap->Locate(filename);
+  if (owner == localShard) {
+    return true;
+  }
+  wrongShard = responsePrefix + " ERROR WRONG_SHARD " +
+               std::to_string(owner) + "\r\n";
+  return false;
+}
+
+// REGISTER_NODE пересылается с выданным идентификатором, чтобы узел
+// получил один и тот же node_id на всех шардах
+void ProtocolHandler::RelayNodeRequest(const std::vector<std::string> &args,
+                                       const std::string &request,
+                                       const std::string &response) {
+  std::vector<std::string> responseArgs = ParseCommand(response);
+  if (shardRelay == nullptr || responseArgs.size() < 2 ||
+      responseArgs[1] != "OK") {
+    return;
+  }
+
+  if (args[0] != "REGISTER_NODE") {
+    shardRelay->Forward(request + "\r\n");
+    return;
+  }
+  if (responseArgs.size() < 3) {
+    return;
+  }
+
+  std::string relayed;
+  for (const auto &arg : args) {
+    if (arg.compare(0, 8, "node_id=") != 0) {
+      relayed += arg + " ";
+    }
+  }
+  shardRelay->Forward(relayed + "node_id=" + responseArgs[2] + "\r\n");
+}
+
+// Обработка GET_SHARD_MAP: карта шардов для маршрутизации клиентов.
+// Формат: SHARD_MAP_RESPONSE OK <shard_count> <local_shard>, затем строки
+// "<shard> <адреса>" и END_SHARD_MAP; 0 шардов - без шардирования
+std::string ProtocolHandler::HandleGetShardMap() {
+  std::stringstream response;
+  size_t count =
+      shardMap != nullptr && shardMap->IsSharded() ? shardMap->GetShardCount()
+                                                   : 0;
+  response << "SHARD_MAP_RESPONSE OK " << count << " " << localShard
+           << "\r\n";
+  for (size_t shard = 0; shard < count; ++shard) {
+    response << shard << " " << shardMap->GetShardAddresses(shard) << "\r\n";
+  }
+  response << "END_SHARD_MAP\r\n";
+  return response.str();
+}
+
 // Парсинг команды
 std::vector<std::string> ProtocolHandler::ParseCommand(
     const std::string &command) {
@@ -92,18 +183,20 @@ std::vector<std::string> ProtocolHandler::SplitLines(const std::string &text) {
   return lines;
 }
 
-// Чтение многострочного запроса
+// Чтение многострочного запроса до строки endMarker
 bool ProtocolHandler::ReadMultilineRequest(SOCKET socket,
                                           std::string &request,
-                                          const std::string &firstLine) {
+                                          const std::string &firstLine,
+                                          const std::string &endMarker,
+                                          size_t maxLines) {
   request.clear();
   
   // Добавляем первую строку (уже прочитанную)
   request += firstLine + "\r\n";
 
-  // Чтение остальных строк до END_CHUNKS или END_FILES
+  // Чтение остальных строк до завершающей
   std::string line;
-  int lineCount = 0;
+  size_t lineCount = 0;
   while (true) {
     if (!NetworkUtils::ReceiveMessage(socket, line, 4096, 30)) {
       std::cerr << "Error: Failed to read line " << (lineCount + 1) << " in multiline request" << std::endl;
@@ -114,12 +207,12 @@ bool ProtocolHandler::ReadMultilineRequest(SOCKET socket,
     lineCount++;
 
     // Проверка на завершение
-    if (line == "END_CHUNKS" || line == "END_FILES") {
+    if (line == endMarker) {
       break;
     }
     
     // Защита от бесконечного цикла
-    if (lineCount > 10000) {
+    if (lineCount > maxLines) {
       std::cerr << "Error: Too many lines in multiline request" << std::endl;
       return false;
     }
@@ -131,8 +224,9 @@ bool ProtocolHandler::ReadMultilineRequest(SOCKET socket,
 // Обработка REGISTER_NODE
 std::string ProtocolHandler::HandleRegisterNode(
     const std::vector<std::string> &args) {
-  // Валидация аргументов
-  if (args.size() != 4) {
+  // Валидация аргументов:
+  // REGISTER_NODE <ip> <port> <free> [domain=<label>] [node_id=<id>]
+  if (args.size() < 4 || args.size() > 6) {
     return "REGISTER_RESPONSE ERROR INVALID_PARAMETERS\r\n";
   }
 
@@ -148,28 +242,109 @@ std::string ProtocolHandler::HandleRegisterNode(
     return "REGISTER_RESPONSE ERROR INVALID_PARAMETERS\r\n";
   }
 
+  // Необязательные параметры key=value:
+  // domain - домен отказа, иерархическая метка "zone/rack/host";
+  // node_id - идентификатор, сохранённый узлом с прошлой регистрации
+  std::string failureDomain;
+  std::string requestedNodeId;
+  for (size_t i = 4; i < args.size(); ++i) {
+    size_t separator = args[i].find('=');
+    if (separator == std::string::npos || separator + 1 == args[i].length()) {
+      return "REGISTER_RESPONSE ERROR INVALID_PARAMETERS\r\n";
+    }
+
+    std::string key = args[i].substr(0, separator);
+    std::string value = args[i].substr(separator + 1);
+    if (key == "domain" && failureDomain.empty()) {
+      failureDomain = value;
+    } else if (key == "node_id" && requestedNodeId.empty()) {
+      requestedNodeId = value;
+    } else {
+      return "REGISTER_RESPONSE ERROR INVALID_PARAMETERS\r\n";
+    }
+  }
+
   // Регистрация узла
   std::string nodeId;
-  if (nodeManager->RegisterNode(ip, port, freeSpace, nodeId)) {
-    return "REGISTER_RESPONSE OK " + nodeId + "\r\n";
-  } else {
+  if (!nodeManager->RegisterNode(ip, port, freeSpace, failureDomain,
+                                 requestedNodeId, nodeId)) {
     return "REGISTER_RESPONSE ERROR REGISTRATION_FAILED\r\n";
   }
+
+  // Ожидаемое содержимое узла: если число чанков и отпечаток совпадают с
+  // локальными, узел не отправляет инвентарь (CHUNK_INVENTORY)
+  size_t expectedChunks = 0;
+  uint64_t fingerprint = 0;
+  metadataManager->GetNodeInventory(nodeId, expectedChunks, fingerprint);
+
+  std::stringstream response;
+  response << "REGISTER_RESPONSE OK " << nodeId << " " << expectedChunks
+           << " " << std::hex << std::setw(16) << std::setfill('0')
+           << fingerprint << "\r\n";
+  return response.str();
 }
 
 // Обработка KEEP_ALIVE
 std::string ProtocolHandler::HandleKeepAlive(
     const std::vector<std::string> &args) {
-  // Валидация аргументов
-  if (args.size() != 2) {
+  // Валидация аргументов: KEEP_ALIVE <node_id> [key=value ...]
+  // Ключи телеметрии: inflight, read_bps, write_bps, queue, errors, free;
+  // незнакомые ключи пропускаются (совместимость с новыми узлами)
+  if (args.size() < 2) {
     return "KEEP_ALIVE_RESPONSE ERROR INVALID_PARAMETERS\r\n";
   }
 
   std::string nodeId = args[1];
 
+  NodeTelemetry telemetry;
+  bool hasTelemetry = false;
+  bool hasFreeSpace = false;
+  uint64_t freeSpace = 0;
+
+  for (size_t i = 2; i < args.size(); ++i) {
+    size_t separator = args[i].find('=');
+    if (separator == std::string::npos) {
+      return "KEEP_ALIVE_RESPONSE ERROR INVALID_PARAMETERS\r\n";
+    }
+
+    std::string key = args[i].substr(0, separator);
+    uint64_t value;
+    try {
+      value = std::stoull(args[i].substr(separator + 1));
+    } catch (const std::exception &) {
+      return "KEEP_ALIVE_RESPONSE ERROR INVALID_PARAMETERS\r\n";
+    }
+
+    if (key == "inflight") {
+      telemetry.inflightTransfers = static_cast<uint32_t>(value);
+    } else if (key == "read_bps") {
+      telemetry.readBytesPerSec = value;
+    } else if (key == "write_bps") {
+      telemetry.writeBytesPerSec = value;
+    } else if (key == "queue") {
+      telemetry.diskQueueDepth = static_cast<uint32_t>(value);
+    } else if (key == "errors") {
+      telemetry.errorCount = value;
+    } else if (key == "free") {
+      freeSpace = value;
+      hasFreeSpace = true;
+      continue;
+    } else {
+      continue;
+    }
+    hasTelemetry = true;
+  }
+
   // Обновление времени последнего контакта
   nodeManager->UpdateNodeLastSeen(nodeId);
 
+  if (hasFreeSpace) {
+    nodeManager->UpdateNodeSpace(nodeId, freeSpace);
+  }
+  if (hasTelemetry) {
+    nodeManager->UpdateNodeTelemetry(nodeId, telemetry);
+  }
+
   return "KEEP_ALIVE_RESPONSE OK\r\n";
 }
 
@@ -198,6 +373,78 @@ std::string ProtocolHandler::HandleUpdateSpace(
   }
 }
 
+// Обработка CHUNK_INVENTORY: фактический набор чанков узла после
+// перезапуска. Формат: CHUNK_INVENTORY <node_id> <count>, затем count строк
+// с идентификаторами чанков и END_INVENTORY
+std::string ProtocolHandler::HandleChunkInventory(const std::string &firstLine,
+                                                  SOCKET socket,
+                                                  bool relayed) {
+  std::vector<std::string> args = ParseCommand(firstLine);
+  if (args.size() != 3) {
+    return "INVENTORY_RESPONSE ERROR INVALID_PARAMETERS\r\n";
+  }
+
+  std::string nodeId = args[1];
+  size_t count;
+  try {
+    count = std::stoull(args[2]);
+  } catch (const std::exception &) {
+    return "INVENTORY_RESPONSE ERROR INVALID_PARAMETERS\r\n";
+  }
+  if (count > MAX_INVENTORY_CHUNKS) {
+    return "INVENTORY_RESPONSE ERROR TOO_MANY_CHUNKS\r\n";
+  }
+
+  std::string request;
+  if (!ReadMultilineRequest(socket, request, firstLine, "END_INVENTORY",
+                            count + 1)) {
+    return "INVENTORY_RESPONSE ERROR READ_ERROR\r\n";
+  }
+
+  std::vector<std::string> lines = SplitLines(request);
+  std::vector<std::string> chunkIds;
+  chunkIds.reserve(count);
+  for (size_t i = 1; i < lines.size() && lines[i] != "END_INVENTORY"; ++i) {
+    if (lines[i].length() != 64) {
+      return "INVENTORY_RESPONSE ERROR INVALID_FORMAT\r\n";
+    }
+    chunkIds.push_back(lines[i]);
+  }
+  if (chunkIds.size() != count) {
+    return "INVENTORY_RESPONSE ERROR INVALID_FORMAT\r\n";
+  }
+
+  // Инвентарь принимается только от зарегистрированного активного узла
+  StorageNode node;
+  if (!nodeManager->GetActiveNode(nodeId, node)) {
+    return "INVENTORY_RESPONSE ERROR NODE_NOT_FOUND\r\n";
+  }
+
+  // Остальные шарды сверяют инвентарь со своими файлами
+  if (!relayed && shardRelay != nullptr) {
+    shardRelay->Forward(request);
+  }
+
+  InventoryReconciliation result = metadataManager->ReconcileNodeInventory(
+      nodeId, chunkIds, REPLICATION_FACTOR);
+
+  // Потерянные узлом реплики восстанавливаются сразу, не дожидаясь обхода
+  for (const auto &chunkId : result.missing) {
+    repairScheduler->EnqueueChunk(chunkId);
+  }
+
+  std::cout << "Node " << nodeId << " inventory: " << chunkIds.size()
+            << " chunks, " << result.restored << " restored, "
+            << result.missing.size() << " missing, " << result.surplus
+            << " surplus, " << result.unknown << " unknown" << std::endl;
+
+  std::stringstream response;
+  response << "INVENTORY_RESPONSE OK " << result.restored << " "
+           << result.missing.size() << " " << result.surplus << " "
+           << result.unknown << "\r\n";
+  return response.str();
+}
+
 // Обработка REQUEST_UPLOAD
 std::string ProtocolHandler::HandleRequestUpload(
     const std::vector<std::string> &args) {
@@ -219,58 +466,139 @@ std::string ProtocolHandler::HandleRequestUpload(
     return "UPLOAD_RESPONSE ERROR INVALID_PARAMETERS\r\n";
   }
 
-  // Вычисление необходимого количества узлов
-  // Для каждого чанка нужно REPLICATION_FACTOR узлов
+  std::string wrongShard;
+  if (!IsLocalFilename(filename, "UPLOAD_RESPONSE", wrongShard)) {
+    return wrongShard;
+  }
+
+  // Новая сессия загрузки (клиент может продолжить её через RESUME_UPLOAD)
+  std::string sessionId =
+      metadataManager->CreateUploadSession(filename, fileSize);
+
+  return BuildUploadResponse(filename, fileSize, sessionId);
+}
+
+// Обработка RESUME_UPLOAD <session_id>
+std::string ProtocolHandler::HandleResumeUpload(
+    const std::vector<std::string> &args) {
+  if (args.size() != 2) {
+    return "UPLOAD_RESPONSE ERROR INVALID_PARAMETERS\r\n";
+  }
+
+  UploadSession session;
+  if (!metadataManager->ResumeUploadSession(args[1], session)) {
+    return "UPLOAD_RESPONSE ERROR SESSION_NOT_FOUND\r\n";
+  }
+
+  std::cout << "RESUME_UPLOAD: session=" << session.sessionId
+            << ", filename=" << session.filename << std::endl;
+
+  return BuildUploadResponse(session.filename, session.fileSize,
+                             session.sessionId);
+}
+
+// Формирование UPLOAD_RESPONSE с планом размещения чанков
+std::string ProtocolHandler::BuildUploadResponse(const std::string &filename,
+                                                 uint64_t fileSize,
+                                                 const std::string &sessionId) {
   // Предполагаем размер чанка 1MB (1048576 байт)
   const size_t CHUNK_SIZE = 1048576;
   size_t chunkCount = (fileSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
-  size_t requiredNodes = chunkCount * REPLICATION_FACTOR;
 
-  std::cout << "REQUEST_UPLOAD: filename=" << filename 
-            << ", fileSize=" << fileSize 
-            << ", chunkCount=" << chunkCount 
-            << ", requiredNodes=" << requiredNodes << std::endl;
+  std::cout << "REQUEST_UPLOAD: filename=" << filename
+            << ", fileSize=" << fileSize << ", chunkCount=" << chunkCount
+            << std::endl;
+
+  // Ключ размещения - имя файла: повторный запрос (возобновление)
+  // получает тот же план, пока набор узлов не изменился.
+  // План строится без резерва: если место успела занять параллельная
+  // загрузка, план перестраивается по обновлённому свободному месту
+  PlacementPlan plan;
+  bool reserved = false;
+  for (size_t attempt = 0; attempt < PLACEMENT_ATTEMPTS && !reserved;
+       ++attempt) {
+    if (!nodeManager->PlanPlacement(filename, chunkCount, REPLICATION_FACTOR,
+                                    CHUNK_SIZE, SPARE_NODES, plan)) {
+      std::cerr << "Error: Not enough nodes, need at least "
+                << REPLICATION_FACTOR << std::endl;
+      return "UPLOAD_RESPONSE ERROR INSUFFICIENT_NODES\r\n";
+    }
 
-  // Получение доступных узлов
-  std::vector<StorageNode> nodes =
-      nodeManager->GetAvailableNodes(requiredNodes, CHUNK_SIZE);
+    // Резерв места на узлах плана (запасные узлы не резервируются)
+    std::unordered_map<std::string, uint64_t> reservedBytes;
+    for (size_t chunk = 0; chunk < plan.chunkReplicas.size(); ++chunk) {
+      uint64_t size =
+          std::min<uint64_t>(CHUNK_SIZE, fileSize - chunk * CHUNK_SIZE);
+      for (size_t nodeIndex : plan.chunkReplicas[chunk]) {
+        reservedBytes[plan.nodes[nodeIndex].nodeId] += size;
+      }
+    }
 
-  std::cout << "REQUEST_UPLOAD: found " << nodes.size() 
-            << " available nodes (need at least " << REPLICATION_FACTOR << ")" << std::endl;
+    reserved = nodeManager->ReserveSpace(sessionId, reservedBytes);
+  }
 
-  if (nodes.size() < REPLICATION_FACTOR) {
-    std::cerr << "Error: Not enough nodes. Found " << nodes.size() 
-              << ", need at least " << REPLICATION_FACTOR << std::endl;
-    return "UPLOAD_RESPONSE ERROR INSUFFICIENT_NODES\r\n";
+  if (!reserved) {
+    std::cerr << "Error: Failed to reserve space for " << filename
+              << std::endl;
+    return "UPLOAD_RESPONSE ERROR INSUFFICIENT_SPACE\r\n";
   }
 
-  // Формирование ответа
+  std::cout << "REQUEST_UPLOAD: planned " << chunkCount << " chunks on "
+            << plan.nodes.size() << " nodes" << std::endl;
+
+  // Формат ответа:
+  //   UPLOAD_RESPONSE OK <node_count> <session_id>
+  //   <node_id> <ip> <port> <free_space> <domain> (node_count строк)
+  //   PLACEMENT <chunk_count> <replication_factor>
+  //   <node_index> ...                             (chunk_count строк)
+  //   END_PLACEMENT
   std::stringstream response;
-  response << "UPLOAD_RESPONSE OK " << nodes.size() << "\r\n";
+  response << "UPLOAD_RESPONSE OK " << plan.nodes.size() << " " << sessionId
+           << "\r\n";
 
-  for (const auto &node : nodes) {
+  for (const auto &node : plan.nodes) {
     response << node.nodeId << " " << node.ipAddress << " " << node.port << " "
-             << node.freeSpace << "\r\n";
+             << node.freeSpace << " " << node.failureDomain << "\r\n";
   }
 
+  response << "PLACEMENT " << chunkCount << " " << REPLICATION_FACTOR
+           << "\r\n";
+  for (const auto &replicas : plan.chunkReplicas) {
+    for (size_t i = 0; i < replicas.size(); ++i) {
+      response << (i > 0 ? " " : "") << replicas[i];
+    }
+    response << "\r\n";
+  }
+  response << "END_PLACEMENT\r\n";
+
   return response.str();
 }
 
 // Обработка многострочного запроса
-std::string ProtocolHandler::ProcessMultilineRequest(const std::string &firstLine, SOCKET socket) {
-  // Проверяем, что это UPLOAD_COMPLETE
+bool ProtocolHandler::IsMultilineRequest(const std::string &firstLine) {
+  return firstLine.find("UPLOAD_COMPLETE") == 0 ||
+         firstLine.find("CHUNK_INVENTORY") == 0;
+}
+
+std::string ProtocolHandler::ProcessMultilineRequest(const std::string &firstLine,
+                                                     SOCKET socket,
+                                                     bool relayed) {
   std::vector<std::string> args = ParseCommand(firstLine);
-  if (args.empty() || args[0] != "UPLOAD_COMPLETE") {
-    return CreateErrorResponse("INVALID_COMMAND", "Expected UPLOAD_COMPLETE");
+  if (!args.empty() && args[0] == "UPLOAD_COMPLETE") {
+    return HandleUploadComplete(firstLine, socket);
   }
-  
-  return HandleUploadComplete(firstLine, socket);
+  if (!args.empty() && args[0] == "CHUNK_INVENTORY") {
+    return HandleChunkInventory(firstLine, socket, relayed);
+  }
+
+  return CreateErrorResponse("INVALID_COMMAND", "Expected multiline command");
 }
 
 // Обработка UPLOAD_COMPLETE
 std::string ProtocolHandler::HandleUploadComplete(const std::string &firstLine, SOCKET socket) {
   std::string request;
-  if (!ReadMultilineRequest(socket, request, firstLine)) {
+  if (!ReadMultilineRequest(socket, request, firstLine, "END_CHUNKS",
+                            MAX_UPLOAD_LINES)) {
     return "UPLOAD_COMPLETE_RESPONSE ERROR READ_ERROR\r\n";
   }
 
@@ -291,9 +619,15 @@ std::string ProtocolHandler::HandleUploadComplete(const std::string &firstLine,
     filename += " " + firstLineArgs[i];
   }
 
+  std::string wrongShard;
+  if (!IsLocalFilename(filename, "UPLOAD_COMPLETE_RESPONSE", wrongShard)) {
+    return wrongShard;
+  }
+
   // Парсинг чанков
   std::vector<ChunkInfo> chunks;
   uint64_t totalSize = 0;
+  std::string sessionId;
 
   for (size_t i = 1; i < lines.size(); ++i) {
     if (lines[i] == "END_CHUNKS") {
@@ -301,6 +635,13 @@ std::string ProtocolHandler::HandleUploadComplete(const std::string &firstLine,
     }
 
     std::vector<std::string> chunkArgs = ParseCommand(lines[i]);
+
+    // Необязательная строка SESSION <session_id>
+    if (chunkArgs.size() == 2 && chunkArgs[0] == "SESSION") {
+      sessionId = chunkArgs[1];
+      continue;
+    }
+
     if (chunkArgs.size() < 5) {
       continue; // Пропускаем некорректные строки
     }
@@ -328,12 +669,57 @@ std::string ProtocolHandler::HandleUploadComplete(const std::string &firstLine,
 
   // Регистрация файла
   if (metadataManager->RegisterFile(filename, totalSize, chunks)) {
+    // Резерв сессии переходит в фактически записанные байты
+    std::unordered_map<std::string, uint64_t> storedBytes;
+    for (const auto &chunk : chunks) {
+      for (const auto &nodeId : chunk.nodeIds) {
+        storedBytes[nodeId] += chunk.size;
+      }
+    }
+    nodeManager->CommitReservation(sessionId, storedBytes);
+
+    if (!sessionId.empty()) {
+      metadataManager->CompleteUploadSession(sessionId);
+    }
     return "UPLOAD_COMPLETE_RESPONSE OK\r\n";
   } else {
     return "UPLOAD_COMPLETE_RESPONSE ERROR REGISTRATION_FAILED\r\n";
   }
 }
 
+// Обработка DELETE_FILE. Чанки, на которые больше не ссылается ни один
+// файл, удаляет с узлов сборщик мусора по истечении срока ожидания
+std::string
+ProtocolHandler::HandleDeleteFile(const std::vector<std::string> &args) {
+  // Валидация аргументов
+  if (args.size() < 2) {
+    return "DELETE_RESPONSE ERROR INVALID_PARAMETERS\r\n";
+  }
+
+  // Парсинг имени файла (может содержать пробелы)
+  std::string filename = args[1];
+  for (size_t i = 2; i < args.size(); ++i) {
+    filename += " " + args[i];
+  }
+
+  std::string wrongShard;
+  if (!IsLocalFilename(filename, "DELETE_RESPONSE", wrongShard)) {
+    return wrongShard;
+  }
+
+  std::shared_ptr<const FileMetadata> metadata =
+      metadataManager->GetFileMetadata(filename);
+  if (metadata == nullptr) {
+    return "DELETE_RESPONSE ERROR FILE_NOT_FOUND\r\n";
+  }
+  if (!metadataManager->DeleteFile(filename)) {
+    return "DELETE_RESPONSE ERROR DELETE_FAILED\r\n";
+  }
+
+  manifestCache.Invalidate(metadata->filename);
+  return "DELETE_RESPONSE OK\r\n";
+}
+
 // Обработка REQUEST_DOWNLOAD
 std::string ProtocolHandler::HandleRequestDownload(
     const std::vector<std::string> &args) {
@@ -348,37 +734,86 @@ std::string ProtocolHandler::HandleRequestDownload(
     filename += " " + args[i];
   }
 
-  // Получение метаданных файла
-  FileMetadata *metadata = metadataManager->GetFileMetadata(filename);
+  std::string wrongShard;
+  if (!IsLocalFilename(filename, "DOWNLOAD_RESPONSE", wrongShard)) {
+    return wrongShard;
+  }
+
+  // Снимок метаданных файла: не меняется, пока формируется ответ
+  std::shared_ptr<const FileMetadata> metadata =
+      metadataManager->GetFileMetadata(filename);
   if (metadata == nullptr) {
     return "DOWNLOAD_RESPONSE ERROR FILE_NOT_FOUND\r\n";
   }
 
-  // Формирование ответа
-  std::stringstream response;
-  response << "DOWNLOAD_RESPONSE OK " << metadata->totalSize << " "
-           << metadata->chunks.size() << "\r\n";
+  // Адреса узлов - из снимка таблицы узлов, без nodesMutex
+  std::shared_ptr<const NodeDirectory> directory =
+      nodeManager->GetNodeDirectory();
+
+  // Ответ зависит только от версии метаданных и эпохи таблицы узлов;
+  // порядок реплик по текущей нагрузке узлов - при выдаче
+  std::shared_ptr<const DownloadManifest> manifest = manifestCache.Get(
+      metadata->filename, metadata->version, directory->epoch,
+      [&] { return BuildDownloadManifest(*metadata, *directory); });
+
+  std::vector<int> ranks(manifest->nodeIds.size(),
+                         std::numeric_limits<int>::max());
+  for (size_t i = 0; i < manifest->nodeIds.size(); ++i) {
+    auto it = directory->nodes.find(manifest->nodeIds[i]);
+    if (it != directory->nodes.end()) {
+      ranks[i] = it->second.readRank;
+    }
+  }
+  return *manifest->Render(ranks);
+}
 
-  for (const auto &chunk : metadata->chunks) {
-    response << chunk.chunkId << " " << chunk.index << " " << chunk.size;
+// Ответ REQUEST_DOWNLOAD по снимкам файла и таблицы узлов (без порядка
+// реплик)
+std::shared_ptr<const DownloadManifest>
+ProtocolHandler::BuildDownloadManifest(const FileMetadata &metadata,
+                                       const NodeDirectory &directory) {
+  auto manifest = std::make_shared<DownloadManifest>();
+
+  // Таблица узлов ответа: каждый узел файла один раз; реплики чанков -
+  // индексы в ней (подряд, в порядке чанков)
+  std::unordered_map<std::string, size_t> nodeIndexes;
+  manifest->chunks.reserve(metadata.chunks.size());
+  manifest->replicaOffsets.reserve(metadata.chunks.size() + 1);
+  for (const auto &chunk : metadata.chunks) {
+    manifest->replicaOffsets.push_back(manifest->replicaIndexes.size());
     for (const auto &nodeId : chunk.nodeIds) {
-      // Получение информации об узле для включения IP и порта
-      StorageNode *node = nodeManager->GetNode(nodeId);
-      if (node != nullptr) {
-        // Формат: nodeId ip port (для каждого узла)
-        response << " " << nodeId << " " << node->ipAddress << " "
-                 << node->port;
-      } else {
-        // Если узел не найден, возвращаем только nodeId
-        response << " " << nodeId;
+      auto inserted = nodeIndexes.emplace(nodeId, manifest->nodeIds.size());
+      if (inserted.second) {
+        manifest->nodeIds.push_back(nodeId);
       }
+      manifest->replicaIndexes.push_back(inserted.first->second);
     }
-    response << "\r\n";
+    manifest->chunks.push_back(chunk.chunkId + " " +
+                               std::to_string(chunk.index) + " " +
+                               std::to_string(chunk.size));
+  }
+  manifest->replicaOffsets.push_back(manifest->replicaIndexes.size());
+
+  // Формат: DOWNLOAD_RESPONSE OK <file_size> <chunk_count> <node_count>,
+  // строки узлов "nodeId ip port" (только nodeId, если адрес неизвестен),
+  // строки чанков "chunkId index size <индекс узла>..." и END_CHUNKS
+  std::string &head = manifest->head;
+  head.reserve(64 + manifest->nodeIds.size() * 48);
+  head += "DOWNLOAD_RESPONSE OK " + std::to_string(metadata.totalSize) + " " +
+          std::to_string(metadata.chunks.size()) + " " +
+          std::to_string(manifest->nodeIds.size()) + "\r\n";
+
+  for (const auto &nodeId : manifest->nodeIds) {
+    head += nodeId;
+    auto it = directory.nodes.find(nodeId);
+    if (it != directory.nodes.end()) {
+      head += " " + it->second.ipAddress + " " +
+              std::to_string(it->second.port);
+    }
+    head += "\r\n";
   }
 
-  response << "END_CHUNKS\r\n";
-
-  return response.str();
+  return manifest;
 }
 
 // Обработка LIST_NODES
@@ -392,7 +827,9 @@ std::string ProtocolHandler::HandleListNodes() {
 
   for (const auto &node : activeNodes) {
     response << node.nodeId << " " << node.ipAddress << " " << node.port << " "
-             << node.freeSpace << " " << (node.isActive ? "1" : "0") << "\r\n";
+             << node.freeSpace << " " << (node.isActive ? "1" : "0") << " "
+             << node.failureDomain << " " << std::fixed
+             << std::setprecision(2) << node.loadScore << "\r\n";
   }
 
   response << "END_NODES\r\n";
@@ -401,23 +838,64 @@ std::string ProtocolHandler::HandleListNodes() {
 }
 
 // Обработка LIST_FILES
-std::string ProtocolHandler::HandleListFiles() {
-  // Получение списка файлов
-  std::vector<std::string> fileList = metadataManager->ListFiles();
-
-  // Формирование ответа
-  std::stringstream response;
-  response << "LIST_FILES_RESPONSE OK " << fileList.size() << "\r\n";
+std::string
+ProtocolHandler::HandleListFiles(const std::vector<std::string> &args) {
+  // LIST_FILES [prefix=<prefix>] [after=<cursor>] [limit=<count>];
+  // prefix и after экранированы %XX (имена файлов могут содержать пробелы)
+  std::string prefix;
+  std::string after;
+  size_t limit = LIST_FILES_DEFAULT_LIMIT;
+  for (size_t i = 1; i < args.size(); ++i) {
+    size_t separator = args[i].find('=');
+    if (separator == std::string::npos || separator + 1 == args[i].length()) {
+      return "LIST_FILES_RESPONSE ERROR INVALID_PARAMETERS\r\n";
+    }
 
-  for (const auto &filename : fileList) {
-    FileMetadata *metadata = metadataManager->GetFileMetadata(filename);
-    if (metadata != nullptr) {
-      response << filename << " " << metadata->totalSize << "\r\n";
+    std::string key = args[i].substr(0, separator);
+    std::string value = args[i].substr(separator + 1);
+    if (key == "prefix" || key == "after") {
+      if (!NetworkUtils::UnescapeToken(value, key == "prefix" ? prefix
+                                                              : after)) {
+        return "LIST_FILES_RESPONSE ERROR INVALID_PARAMETERS\r\n";
+      }
+    } else if (key == "limit") {
+      try {
+        limit = std::stoull(value);
+      } catch (const std::exception &) {
+        return "LIST_FILES_RESPONSE ERROR INVALID_PARAMETERS\r\n";
+      }
+      if (limit == 0) {
+        return "LIST_FILES_RESPONSE ERROR INVALID_PARAMETERS\r\n";
+      }
+      limit = std::min(limit, LIST_FILES_MAX_LIMIT);
+    } else {
+      return "LIST_FILES_RESPONSE ERROR INVALID_PARAMETERS\r\n";
     }
   }
 
-  response << "END_FILES\r\n";
+  // Страница из упорядоченного индекса: имена вместе с размерами
+  std::string nextCursor;
+  std::vector<std::pair<std::string, uint64_t>> fileList =
+      metadataManager->ListFiles(prefix, after, limit, nextCursor);
+
+  // Формирование ответа: LIST_FILES_RESPONSE OK <count> [next=<cursor>]
+  // (курсор экранирован), затем строки "<имя> <размер>"
+  std::string response = "LIST_FILES_RESPONSE OK " +
+                         std::to_string(fileList.size());
+  if (!nextCursor.empty()) {
+    response += " next=" + NetworkUtils::EscapeToken(nextCursor);
+  }
+  response += "\r\n";
 
-  return response.str();
+  for (const auto &file : fileList) {
+    response += file.first;
+    response += ' ';
+    response += std::to_string(file.second);
+    response += "\r\n";
+  }
+
+  response += "END_FILES\r\n";
+
+  return response;
 }
 
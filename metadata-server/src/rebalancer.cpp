@@ -0,0 +1,352 @@
+#include "rebalancer.h"
+
+#include "storage_node_client.h"
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+
+Rebalancer::Rebalancer(NodeManager *nodeManager,
+                       MetadataManager *metadataManager,
+                       RepairScheduler *repairScheduler)
+    : nodeManager(nodeManager), metadataManager(metadataManager),
+      repairScheduler(repairScheduler),
+      limiter(DEFAULT_BANDWIDTH, BURST_BYTES), running(false),
+      movedChunks(0) {}
+
+Rebalancer::~Rebalancer() { Stop(); }
+
+void Rebalancer::Start() {
+  if (running) {
+    return;
+  }
+
+  running = true;
+  rebalanceThread = std::thread(&Rebalancer::RebalanceLoop, this);
+}
+
+// Остановка. Отложенные удаления старых копий теряются: такие копии
+// остаются на узлах лишними
+void Rebalancer::Stop() {
+  if (!running) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(stopMutex);
+    running = false;
+  }
+  limiter.Cancel();
+  stopCondition.notify_all();
+
+  if (rebalanceThread.joinable()) {
+    rebalanceThread.join();
+  }
+}
+
+void Rebalancer::SetBandwidthLimit(uint64_t bytesPerSecond) {
+  limiter.SetRate(bytesPerSecond);
+}
+
+// Поток ребалансировки: отложенные удаления и периодические проходы
+void Rebalancer::RebalanceLoop() {
+  auto lastPass = std::chrono::steady_clock::now();
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(stopMutex);
+      stopCondition.wait_for(lock, std::chrono::seconds(1),
+                             [this] { return !running; });
+      if (!running) {
+        return;
+      }
+    }
+
+    ProcessPendingDeletes();
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastPass >= std::chrono::seconds(REBALANCE_INTERVAL_SEC)) {
+      RunPass();
+      lastPass = std::chrono::steady_clock::now();
+    }
+  }
+}
+
+// Один проход: статистика узлов, план и выполнение переносов
+void Rebalancer::RunPass() {
+  std::unordered_map<std::string, NodeUsage> usage =
+      metadataManager->GetNodeUsage();
+  std::vector<StorageNode> activeNodes = nodeManager->GetAllActiveNodes();
+
+  // Статистика хранения узлов (chunksStored / bytesStored)
+  for (const auto &node : activeNodes) {
+    auto it = usage.find(node.nodeId);
+    if (it != usage.end()) {
+      nodeManager->UpdateNodeUsage(node.nodeId, it->second.chunks,
+                                   it->second.bytes);
+    } else {
+      nodeManager->UpdateNodeUsage(node.nodeId, 0, 0);
+    }
+  }
+
+  // Сначала восстанавливаются недостающие реплики
+  if (activeNodes.size() < 2 || repairScheduler->GetQueueLength() > 0) {
+    return;
+  }
+
+  std::vector<ChunkMove> moves = PlanMoves(activeNodes, usage);
+  if (moves.empty()) {
+    return;
+  }
+
+  std::cout << "Rebalancer: planned " << moves.size() << " chunk moves"
+            << std::endl;
+
+  size_t moved = 0;
+  std::vector<ChunkMove> copied;
+  for (const auto &move : moves) {
+    if (!running) {
+      break;
+    }
+    if (CopyChunk(move)) {
+      copied.push_back(move);
+    }
+    if (copied.size() >= MOVE_COMMIT_BATCH) {
+      moved += CommitMoves(copied);
+      copied.clear();
+    }
+  }
+  moved += CommitMoves(copied);
+
+  std::cout << "Rebalancer: moved " << moved << " of " << moves.size()
+            << " chunks" << std::endl;
+}
+
+// План переносов: с самого заполненного узла на наименее заполненные,
+// пока разброс долей больше порога
+std::vector<Rebalancer::ChunkMove> Rebalancer::PlanMoves(
+    const std::vector<StorageNode> &activeNodes,
+    const std::unordered_map<std::string, NodeUsage> &usage) {
+  std::vector<ChunkMove> moves;
+
+  size_t count = activeNodes.size();
+  std::vector<double> used(count);
+  std::vector<double> capacity(count);
+  std::vector<uint64_t> freeSpace(count);
+  std::unordered_map<std::string, size_t> indexById;
+
+  for (size_t i = 0; i < count; ++i) {
+    const StorageNode &node = activeNodes[i];
+    auto it = usage.find(node.nodeId);
+    uint64_t bytes = it != usage.end() ? it->second.bytes : 0;
+
+    used[i] = static_cast<double>(bytes);
+    capacity[i] = static_cast<double>(std::max<uint64_t>(
+        std::max(node.totalSpace, bytes), 1));
+    freeSpace[i] = node.GetEffectiveFreeSpace();
+    indexById[node.nodeId] = i;
+  }
+
+  auto fraction = [&](size_t i) { return used[i] / capacity[i]; };
+
+  std::vector<bool> exhausted(count, false); // Переносить больше нечего
+  std::vector<std::vector<std::string>> nodeChunks(count);
+  std::vector<bool> chunksLoaded(count, false);
+  std::vector<size_t> cursor(count, 0);
+  std::unordered_set<std::string> plannedChunks;
+
+  while (moves.size() < MAX_MOVES_PER_PASS) {
+    size_t source = count;
+    size_t emptiest = count;
+    for (size_t i = 0; i < count; ++i) {
+      if (!exhausted[i] && (source == count || fraction(i) > fraction(source))) {
+        source = i;
+      }
+      if (emptiest == count || fraction(i) < fraction(emptiest)) {
+        emptiest = i;
+      }
+    }
+    if (source == count || source == emptiest ||
+        fraction(source) - fraction(emptiest) <= IMBALANCE_THRESHOLD) {
+      break;
+    }
+
+    // Получатели: заметно менее заполненные узлы, самые пустые первыми
+    std::vector<size_t> targets;
+    for (size_t i = 0; i < count; ++i) {
+      if (fraction(source) - fraction(i) > IMBALANCE_THRESHOLD) {
+        targets.push_back(i);
+      }
+    }
+    std::sort(targets.begin(), targets.end(),
+              [&](size_t a, size_t b) { return fraction(a) < fraction(b); });
+
+    if (!chunksLoaded[source]) {
+      nodeChunks[source] =
+          metadataManager->GetNodeChunks(activeNodes[source].nodeId);
+      chunksLoaded[source] = true;
+    }
+
+    const StorageNode &sourceNode = activeNodes[source];
+    bool planned = false;
+
+    while (!planned && cursor[source] < nodeChunks[source].size()) {
+      const std::string &chunkId = nodeChunks[source][cursor[source]++];
+      if (plannedChunks.count(chunkId) != 0) {
+        continue;
+      }
+
+      uint64_t size = 0;
+      std::vector<std::string> nodeIds;
+      if (!metadataManager->GetChunkLocation(chunkId, size, nodeIds)) {
+        continue;
+      }
+
+      // Чанки с репликами на неактивных узлах - забота ремонта
+      bool healthy = true;
+      std::vector<std::string> otherDomains;
+      for (const auto &nodeId : nodeIds) {
+        if (nodeId == sourceNode.nodeId) {
+          continue;
+        }
+        auto it = indexById.find(nodeId);
+        if (it == indexById.end()) {
+          healthy = false;
+          break;
+        }
+        otherDomains.push_back(activeNodes[it->second].failureDomain);
+      }
+      if (!healthy) {
+        continue;
+      }
+
+      // Перенос не должен сводить реплики в один домен отказа
+      bool sourceSharesDomain =
+          std::find(otherDomains.begin(), otherDomains.end(),
+                    sourceNode.failureDomain) != otherDomains.end();
+
+      for (size_t target : targets) {
+        const StorageNode &targetNode = activeNodes[target];
+        if (std::find(nodeIds.begin(), nodeIds.end(), targetNode.nodeId) !=
+                nodeIds.end() ||
+            freeSpace[target] < size) {
+          continue;
+        }
+        if (!sourceSharesDomain &&
+            std::find(otherDomains.begin(), otherDomains.end(),
+                      targetNode.failureDomain) != otherDomains.end()) {
+          continue;
+        }
+        // Перенос не должен менять узлы местами
+        double chunkBytes = static_cast<double>(size);
+        if ((used[target] + chunkBytes) / capacity[target] >
+            (used[source] - chunkBytes) / capacity[source]) {
+          continue;
+        }
+
+        moves.push_back(ChunkMove{chunkId, size, sourceNode, targetNode});
+        plannedChunks.insert(chunkId);
+        used[source] -= chunkBytes;
+        used[target] += chunkBytes;
+        freeSpace[target] -= size;
+        planned = true;
+        break;
+      }
+    }
+
+    if (!planned) {
+      exhausted[source] = true;
+    }
+  }
+
+  return moves;
+}
+
+// Копия переносимого чанка и её проверка
+bool Rebalancer::CopyChunk(const ChunkMove &move) {
+  if (!limiter.Acquire(move.size)) {
+    return false; // Остановка сервера
+  }
+
+  if (!StorageNodeClient::ReplicateChunk(move.source, move.chunkId,
+                                         move.target)) {
+    return false;
+  }
+
+  if (!StorageNodeClient::CheckChunk(move.target, move.chunkId)) {
+    std::cerr << "Warning: Copy of chunk " << move.chunkId << " on node "
+              << move.target.nodeId << " not confirmed, move cancelled"
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// Замена реплик скопированных чанков в метаданных: файл со многими
+// перенесёнными чанками копируется раз на пакет
+size_t Rebalancer::CommitMoves(const std::vector<ChunkMove> &copied) {
+  if (copied.empty()) {
+    return 0;
+  }
+
+  std::vector<ReplicaChange> changes;
+  changes.reserve(copied.size());
+  for (const auto &move : copied) {
+    changes.push_back(ReplicaChange{move.chunkId, {move.source.nodeId},
+                                    move.target.nodeId, true});
+  }
+  std::vector<bool> applied;
+  if (!metadataManager->ApplyReplicaChanges(changes, applied)) {
+    return 0; // Изменения не сохранены: старые копии не удаляются
+  }
+
+  size_t moved = 0;
+  auto dueAt = std::chrono::steady_clock::now() +
+               std::chrono::seconds(DELETE_DELAY_SEC);
+  for (size_t i = 0; i < copied.size(); ++i) {
+    const ChunkMove &move = copied[i];
+    // Пока шла передача, реплики чанка могли измениться (ремонт,
+    // удаление файла) - тогда новая копия остаётся лишней
+    if (!applied[i]) {
+      std::cerr << "Warning: Replicas of chunk " << move.chunkId
+                << " changed during move, keeping existing placement"
+                << std::endl;
+      continue;
+    }
+
+    nodeManager->AdjustNodeSpace(move.target.nodeId,
+                                 -static_cast<int64_t>(move.size));
+    movedChunks++;
+    moved++;
+    pendingDeletes.push_back(
+        PendingDelete{dueAt, move.source, move.chunkId, move.size});
+  }
+  return moved;
+}
+
+// Удаление старых копий перенесённых чанков
+void Rebalancer::ProcessPendingDeletes() {
+  auto now = std::chrono::steady_clock::now();
+  auto it = std::partition(pendingDeletes.begin(), pendingDeletes.end(),
+                           [&](const PendingDelete &pending) {
+                             return pending.dueAt > now;
+                           });
+  std::vector<PendingDelete> due(it, pendingDeletes.end());
+  pendingDeletes.erase(it, pendingDeletes.end());
+
+  for (const auto &pending : due) {
+    // Реплика могла вернуться на узел (ремонт выбрал его снова)
+    uint64_t size = 0;
+    std::vector<std::string> nodeIds;
+    if (metadataManager->GetChunkLocation(pending.chunkId, size, nodeIds) &&
+        std::find(nodeIds.begin(), nodeIds.end(), pending.node.nodeId) !=
+            nodeIds.end()) {
+      continue;
+    }
+
+    if (StorageNodeClient::DeleteChunk(pending.node, pending.chunkId)) {
+      nodeManager->AdjustNodeSpace(pending.node.nodeId,
+                                   static_cast<int64_t>(pending.size));
+    }
+  }
+}
@@ -0,0 +1,456 @@
+#include "repair_scheduler.h"
+
+#include "storage_node_client.h"
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+RepairScheduler::RepairScheduler(NodeManager *nodeManager,
+                                 MetadataManager *metadataManager,
+                                 size_t replicationFactor)
+    : nodeManager(nodeManager), metadataManager(metadataManager),
+      replicationFactor(replicationFactor),
+      limiter(DEFAULT_BANDWIDTH, BURST_BYTES),
+      downGraceSec(DEFAULT_DOWN_GRACE_SEC), nextSequence(0),
+      scanning(false), running(false), repairedChunks(0) {}
+
+RepairScheduler::~RepairScheduler() { Stop(); }
+
+// Запуск рабочих потоков и подписка на отказы узлов
+void RepairScheduler::Start() {
+  if (running) {
+    return;
+  }
+
+  running = true;
+  nodeManager->SetNodeStateCallback(
+      [this](const std::string &nodeId, bool active) {
+        OnNodeStateChanged(nodeId, active);
+      });
+
+  for (size_t i = 0; i < WORKER_COUNT; ++i) {
+    workers.emplace_back(&RepairScheduler::WorkerLoop, this);
+  }
+  scanThread = std::thread(&RepairScheduler::ScanLoop, this);
+}
+
+// Остановка: текущие передачи дорабатывают, ожидание полосы прерывается
+void RepairScheduler::Stop() {
+  if (!running) {
+    return;
+  }
+
+  nodeManager->SetNodeStateCallback(nullptr);
+
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    running = false;
+  }
+  limiter.Cancel();
+  queueCondition.notify_all();
+  scanCondition.notify_all();
+
+  for (auto &worker : workers) {
+    if (worker.joinable()) {
+      worker.join();
+    }
+  }
+  workers.clear();
+  CommitRepairs(true);
+
+  if (scanThread.joinable()) {
+    scanThread.join();
+  }
+}
+
+void RepairScheduler::SetBandwidthLimit(uint64_t bytesPerSecond) {
+  limiter.SetRate(bytesPerSecond);
+}
+
+void RepairScheduler::SetDownGrace(int seconds) {
+  std::lock_guard<std::mutex> lock(queueMutex);
+  downGraceSec = seconds;
+}
+
+// Реакция на смену активности узла. Вызывается из потока keep-alive,
+// поэтому здесь только запоминаем узел: разбор его чанков - в ScanLoop
+// по истечении отсрочки
+void RepairScheduler::OnNodeStateChanged(const std::string &nodeId,
+                                         bool active) {
+  std::lock_guard<std::mutex> lock(queueMutex);
+  if (active) {
+    if (downNodes.erase(nodeId) > 0) {
+      std::cout << "Node " << nodeId
+                << " is back: pending repair cancelled" << std::endl;
+    }
+    return;
+  }
+
+  downNodes[nodeId] = std::chrono::steady_clock::now() +
+                      std::chrono::seconds(downGraceSec);
+  if (downGraceSec == 0) {
+    scanCondition.notify_one();
+  }
+}
+
+// Реплики на узлах в отсрочке (queueMutex уже захвачен)
+size_t RepairScheduler::CountDownGraceLocked(
+    const std::vector<std::string> &nodeIds) const {
+  size_t count = 0;
+  for (const auto &nodeId : nodeIds) {
+    if (downNodes.find(nodeId) != downNodes.end()) {
+      count++;
+    }
+  }
+  return count;
+}
+
+// Живые реплики из списка узлов
+std::vector<StorageNode> RepairScheduler::GetLiveReplicas(
+    const std::vector<std::string> &nodeIds) const {
+  std::vector<StorageNode> live;
+  for (const auto &nodeId : nodeIds) {
+    StorageNode node;
+    if (nodeManager->GetActiveNode(nodeId, node)) {
+      live.push_back(node);
+    }
+  }
+  return live;
+}
+
+// Постановка чанка в очередь с приоритетом по числу живых реплик
+void RepairScheduler::EnqueueChunk(const std::string &chunkId) {
+  uint64_t size = 0;
+  std::vector<std::string> nodeIds;
+  if (!metadataManager->GetChunkLocation(chunkId, size, nodeIds)) {
+    return;
+  }
+
+  size_t liveReplicas = GetLiveReplicas(nodeIds).size();
+
+  std::lock_guard<std::mutex> lock(queueMutex);
+  EnqueueLocked(chunkId, nodeIds, liveReplicas);
+}
+
+// Постановка чанка по его репликам (queueMutex уже захвачен)
+void RepairScheduler::EnqueueLocked(const std::string &chunkId,
+                                    const std::vector<std::string> &nodeIds,
+                                    size_t liveReplicas) {
+  // Реплики на узлах в отсрочке ещё могут вернуться: чанк встанет в
+  // очередь, когда отсрочка истечёт
+  size_t graceReplicas = CountDownGraceLocked(nodeIds);
+  if (liveReplicas == 0 && graceReplicas == 0) {
+    ReportLost(chunkId, true);
+    return;
+  }
+  ReportLost(chunkId, false);
+
+  if (liveReplicas + graceReplicas >= replicationFactor ||
+      scheduled.find(chunkId) != scheduled.end()) {
+    return;
+  }
+
+  scheduled.insert(chunkId);
+  PushLocked(chunkId, liveReplicas, 0);
+}
+
+// Добавление задачи в очередь (queueMutex уже захвачен)
+void RepairScheduler::PushLocked(const std::string &chunkId,
+                                 size_t liveReplicas, size_t attempts) {
+  queue.push(RepairTask{liveReplicas, nextSequence++, chunkId, attempts});
+  queueCondition.notify_one();
+}
+
+// Учёт чанков без живых реплик (queueMutex уже захвачен). Ремонтировать
+// их не из чего: чанк вернётся, только если вернётся один из его узлов
+void RepairScheduler::ReportLost(const std::string &chunkId, bool lost) {
+  if (!lost) {
+    lostChunks.erase(chunkId);
+    return;
+  }
+
+  if (lostChunks.insert(chunkId).second) {
+    std::cerr << "Error: Chunk " << chunkId
+              << " has no live replicas and cannot be repaired" << std::endl;
+  }
+}
+
+// Рабочий поток: чанки с наименьшим числом живых реплик - первыми
+void RepairScheduler::WorkerLoop() {
+  while (true) {
+    RepairTask task;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      queueCondition.wait(lock, [this] { return !running || !queue.empty(); });
+      if (!running) {
+        return;
+      }
+      task = queue.top();
+      queue.pop();
+    }
+
+    bool copied = false;
+    if (!RepairChunk(task.chunkId, task.attempts, copied)) {
+      ScheduleRetry(task.chunkId, task.attempts + 1);
+    } else if (!copied) {
+      FinishChunk(task.chunkId);
+      if (running) {
+        EnqueueChunk(task.chunkId);
+      }
+    }
+    CommitRepairs(false);
+  }
+}
+
+// Одна попытка ремонта чанка
+bool RepairScheduler::RepairChunk(const std::string &chunkId,
+                                  size_t attempts, bool &copied) {
+  uint64_t size = 0;
+  std::vector<std::string> nodeIds;
+  if (!metadataManager->GetChunkLocation(chunkId, size, nodeIds)) {
+    return true; // Файл удалён
+  }
+
+  std::vector<StorageNode> live = GetLiveReplicas(nodeIds);
+  if (live.size() >= replicationFactor) {
+    return true; // Узел вернулся, пока задача ждала
+  }
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    size_t graceReplicas = CountDownGraceLocked(nodeIds);
+    if (live.size() + graceReplicas >= replicationFactor) {
+      return true; // Отказал ещё один узел: ждём его отсрочку
+    }
+    if (live.empty()) {
+      ReportLost(chunkId, graceReplicas == 0);
+      return true;
+    }
+  }
+
+  StorageNode target;
+  if (!nodeManager->SelectReplicaTarget(chunkId, size, nodeIds, target)) {
+    std::cerr << "Warning: No node available for a new replica of chunk "
+              << chunkId << std::endl;
+    return false;
+  }
+
+  // Источник меняется от попытки к попытке
+  const StorageNode &source = live[attempts % live.size()];
+
+  if (!limiter.Acquire(size)) {
+    return true; // Остановка сервера
+  }
+
+  if (!StorageNodeClient::ReplicateChunk(source, chunkId, target)) {
+    std::cerr << "Warning: Failed to replicate chunk " << chunkId << " from "
+              << source.nodeId << " to " << target.nodeId << std::endl;
+    return false;
+  }
+
+  // Реплики на неактивных узлах заменяются новой; узлы в отсрочке
+  // остаются в метаданных до её истечения
+  std::vector<std::string> deadNodeIds;
+  {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    for (const auto &nodeId : nodeIds) {
+      bool isLive = std::any_of(live.begin(), live.end(),
+                                [&](const StorageNode &node) {
+                                  return node.nodeId == nodeId;
+                                });
+      if (!isLive && downNodes.find(nodeId) == downNodes.end()) {
+        deadNodeIds.push_back(nodeId);
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(commitMutex);
+  pendingCommits.push_back(RepairCommit{
+      ReplicaChange{chunkId, deadNodeIds, target.nodeId, false}, size,
+      source.nodeId, live.size() + 1});
+  copied = true;
+  return true;
+}
+
+// Запись скопированных реплик в метаданные. Пока очередь не пуста,
+// реплики копятся до COMMIT_BATCH; чанки пакета остаются в scheduled до
+// записи и после неё проверяются заново (RF > 2 или отказало несколько
+// узлов)
+void RepairScheduler::CommitRepairs(bool force) {
+  std::vector<RepairCommit> commits;
+  {
+    std::lock_guard<std::mutex> lock(commitMutex);
+    if (pendingCommits.empty()) {
+      return;
+    }
+    if (!force && pendingCommits.size() < COMMIT_BATCH) {
+      std::lock_guard<std::mutex> queueLock(queueMutex);
+      if (!queue.empty()) {
+        return;
+      }
+    }
+    commits.swap(pendingCommits);
+  }
+
+  std::vector<ReplicaChange> changes;
+  changes.reserve(commits.size());
+  for (const auto &commit : commits) {
+    changes.push_back(commit.change);
+  }
+  // Невыполненное изменение - файл удалён во время передачи
+  std::vector<bool> applied;
+  bool durable = metadataManager->ApplyReplicaChanges(changes, applied);
+
+  for (size_t i = 0; i < commits.size(); ++i) {
+    const RepairCommit &commit = commits[i];
+    const std::string &chunkId = commit.change.chunkId;
+    if (applied[i] && durable) {
+      nodeManager->AdjustNodeSpace(commit.change.addNodeId,
+                                   -static_cast<int64_t>(commit.size));
+      repairedChunks++;
+      std::cout << "Chunk " << chunkId << " repaired: " << commit.sourceNodeId
+                << " -> " << commit.change.addNodeId << " ("
+                << commit.replicas << "/" << replicationFactor
+                << " replicas)" << std::endl;
+    }
+
+    FinishChunk(chunkId);
+    if (running) {
+      EnqueueChunk(chunkId);
+    }
+  }
+}
+
+// Отложенный повтор неудачной попытки
+void RepairScheduler::ScheduleRetry(const std::string &chunkId,
+                                    size_t attempts) {
+  if (attempts >= MAX_ATTEMPTS) {
+    std::cerr << "Error: Giving up on chunk " << chunkId << " after "
+              << attempts << " attempts (next full scan will retry)"
+              << std::endl;
+    FinishChunk(chunkId);
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(queueMutex);
+  retries.push_back(RetryTask{std::chrono::steady_clock::now() +
+                                  std::chrono::seconds(RETRY_DELAY_SEC),
+                              chunkId, attempts});
+}
+
+void RepairScheduler::FinishChunk(const std::string &chunkId) {
+  std::lock_guard<std::mutex> lock(queueMutex);
+  scheduled.erase(chunkId);
+}
+
+// Поток обхода: разбор отказавших узлов с истёкшей отсрочкой, повторы и
+// периодический обход
+void RepairScheduler::ScanLoop() {
+  auto lastScan = std::chrono::steady_clock::now();
+
+  while (true) {
+    std::vector<std::string> nodeIds;
+    std::vector<RetryTask> due;
+    {
+      std::unique_lock<std::mutex> lock(queueMutex);
+      scanCondition.wait_for(lock, std::chrono::seconds(1));
+      if (!running) {
+        return;
+      }
+
+      auto now = std::chrono::steady_clock::now();
+      for (auto it = downNodes.begin(); it != downNodes.end();) {
+        if (it->second <= now) {
+          nodeIds.push_back(it->first);
+          it = downNodes.erase(it);
+        } else {
+          ++it;
+        }
+      }
+
+      auto it = std::partition(retries.begin(), retries.end(),
+                               [&](const RetryTask &retry) {
+                                 return retry.dueAt > now;
+                               });
+      due.assign(it, retries.end());
+      retries.erase(it, retries.end());
+    }
+
+    for (const auto &nodeId : nodeIds) {
+      StorageNode node;
+      if (nodeManager->GetActiveNode(nodeId, node)) {
+        continue; // Вернулся в последний момент
+      }
+      std::vector<std::string> chunkIds =
+          metadataManager->GetNodeChunks(nodeId);
+      if (!chunkIds.empty()) {
+        std::cout << "Node " << nodeId << " lost: checking "
+                  << chunkIds.size() << " chunks for repair" << std::endl;
+      }
+      for (const auto &chunkId : chunkIds) {
+        EnqueueChunk(chunkId);
+      }
+    }
+
+    // Повторы идут в общую очередь с пересчитанным приоритетом
+    for (const auto &retry : due) {
+      uint64_t size = 0;
+      std::vector<std::string> replicaIds;
+      size_t liveReplicas = 0;
+      if (metadataManager->GetChunkLocation(retry.chunkId, size,
+                                            replicaIds)) {
+        liveReplicas = GetLiveReplicas(replicaIds).size();
+      }
+
+      std::lock_guard<std::mutex> lock(queueMutex);
+      PushLocked(retry.chunkId, liveReplicas, retry.attempts);
+    }
+
+    // Следующий обход начинается не раньше чем через SCAN_INTERVAL_SEC
+    // после начала предыдущего
+    auto now = std::chrono::steady_clock::now();
+    if (!scanning &&
+        now - lastScan >= std::chrono::seconds(SCAN_INTERVAL_SEC)) {
+      lastScan = now;
+      scanCursor = ChunkScanCursor();
+      scanning = true;
+    }
+    if (scanning) {
+      scanning = ScanChunkBatch();
+    }
+  }
+}
+
+// Порция полного обхода: чанки, для которых событие отказа было
+// пропущено. Реплики порции читаются одним запросом, активность узлов -
+// по снимку адресов, очередь пополняется под одной блокировкой
+bool RepairScheduler::ScanChunkBatch() {
+  std::vector<ChunkReplicas> chunks;
+  bool more = metadataManager->ScanChunks(scanCursor, SCAN_BATCH, chunks);
+  std::shared_ptr<const NodeDirectory> directory =
+      nodeManager->GetNodeDirectory();
+
+  std::lock_guard<std::mutex> lock(queueMutex);
+  for (const auto &chunk : chunks) {
+    // У неактивного узла ранг чтения - максимальный
+    size_t liveReplicas = 0;
+    for (const auto &nodeId : chunk.nodeIds) {
+      auto it = directory->nodes.find(nodeId);
+      if (it != directory->nodes.end() &&
+          it->second.readRank != std::numeric_limits<int>::max()) {
+        liveReplicas++;
+      }
+    }
+    EnqueueLocked(chunk.chunkId, chunk.nodeIds, liveReplicas);
+  }
+  return more;
+}
+
+size_t RepairScheduler::GetQueueLength() {
+  std::lock_guard<std::mutex> lock(queueMutex);
+  return queue.size() + retries.size();
+}
+
+size_t RepairScheduler::GetLostChunks() {
+  std::lock_guard<std::mutex> lock(queueMutex);
+  return lostChunks.size();
+}
@@ -5,9 +5,15 @@
 #include <iostream>
 #include <thread>
 
-MetadataServer::MetadataServer(int port)
+MetadataServer::MetadataServer(int port, const std::string &dataDir)
     : port(port), listenSocket(INVALID_SOCKET), running(false),
-      protocolHandler(&nodeManager, &metadataManager) {}
+      metadataStore(dataDir, &metadataManager, &nodeManager),
+      repairScheduler(&nodeManager, &metadataManager,
+                      ProtocolHandler::REPLICATION_FACTOR),
+      protocolHandler(&nodeManager, &metadataManager, &repairScheduler),
+      rebalancer(&nodeManager, &metadataManager, &repairScheduler),
+      chunkCollector(&nodeManager, &metadataManager), standby(false),
+      shardIndex(0) {}
 
 MetadataServer::~MetadataServer() { Shutdown(); }
 
@@ -18,8 +24,19 @@ bool MetadataServer::Initialize() {
     return false;
   }
 
-  // Запуск keep-alive проверки для NodeManager
-  nodeManager.StartKeepAliveChecker();
+  // Восстановление метаданных до запуска фоновых потоков
+  if (!metadataStore.Recover()) {
+    return false;
+  }
+  if (standby) {
+    // Резервный: только следование за журналом основного
+    replicator->Start();
+  } else {
+    metadataStore.AttachLog();
+    StartPrimaryServices();
+  }
+  metadataStore.Start();
+  shardRelay.Start();
 
   // Инициализация ProtocolHandler (уже создан в конструкторе)
   // protocolHandler инициализирован через список инициализации
@@ -32,6 +49,87 @@ bool MetadataServer::Initialize() {
   return true;
 }
 
+// Фоновые задачи основного сервера
+void MetadataServer::StartPrimaryServices() {
+  // Запуск keep-alive проверки для NodeManager
+  nodeManager.StartKeepAliveChecker();
+
+  // Запуск восстановления реплик (подписывается на отказы узлов)
+  repairScheduler.Start();
+
+  // Ребалансировка и сборка чанков без ссылок - только без шардирования:
+  // id чанка - SHA-256 содержимого, и одна копия на узле может
+  // принадлежать файлам разных шардов, поэтому шард не вправе удалять её
+  // (ни исходную реплику после переноса, ни "осиротевшую")
+  if (!shardMap.IsSharded()) {
+    rebalancer.Start();
+    chunkCollector.Start();
+  }
+}
+
+// Настройка резервного режима
+void MetadataServer::SetStandby(const std::string &primaryIp, int primaryPort,
+                                int leaseSec) {
+  replicator = std::make_unique<StandbyReplicator>(
+      &metadataStore, primaryIp, primaryPort, leaseSec);
+  replicator->SetLeaseExpiredCallback([this] { Promote(); });
+  standby = true;
+}
+
+// Настройка шардирования
+bool MetadataServer::SetSharding(const ShardMap &map, size_t index) {
+  if (index >= map.GetShardCount() || !shardRelay.Configure(map, index)) {
+    return false;
+  }
+  shardMap = map;
+  shardIndex = index;
+  protocolHandler.SetSharding(&shardMap, shardIndex, &shardRelay);
+  metadataManager.SetOrphanTracking(false);
+  std::cout << "Namespace shard " << shardIndex << " of "
+            << shardMap.GetShardCount()
+            << " (orphan chunk collection disabled)" << std::endl;
+  return true;
+}
+
+// Повышение до основного: журнал основного больше не применяется, журнал
+// подключается к менеджерам, запускаются фоновые задачи. Узлы хранения
+// неактивны до повторной регистрации (с node_id) на этом сервере
+bool MetadataServer::Promote() {
+  std::lock_guard<std::mutex> lock(roleMutex);
+  if (!standby) {
+    return false;
+  }
+
+  auto started = std::chrono::steady_clock::now();
+  replicator->Stop();
+  metadataStore.AttachLog();
+  StartPrimaryServices();
+  standby = false;
+
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - started);
+  std::cout << "Promoted to primary at log position "
+            << metadataStore.GetNextSeq() << " ("
+            << replicator->GetAppliedRecords()
+            << " records received from previous primary, switch took "
+            << elapsed.count() << " ms)" << std::endl;
+  return true;
+}
+
+// ROLE - текущая роль и позиция журнала; PROMOTE - повышение
+std::string MetadataServer::HandleRoleCommand(const std::string &command) {
+  if (command == "PROMOTE") {
+    if (!Promote()) {
+      return "ERROR ALREADY_PRIMARY Server is already primary\r\n";
+    }
+    return "PROMOTE_RESPONSE OK " +
+           std::to_string(metadataStore.GetNextSeq()) + "\r\n";
+  }
+  return std::string("ROLE_RESPONSE OK ") +
+         (standby ? "STANDBY " : "PRIMARY ") +
+         std::to_string(metadataStore.GetNextSeq()) + "\r\n";
+}
+
 // Инициализация сетевого слоя
 bool MetadataServer::InitializeNetwork() {
   return NetworkUtils::InitializeWinsock();
@@ -156,18 +254,52 @@ void MetadataServer::HandleClient(SOCKET clientSocket) {
 
   std::cout << "Received command: " << firstLine << std::endl;
 
+  // Запрос узла хранения, пересланный другим шардом
+  bool relayed = false;
+  if (firstLine.compare(0, 6, "RELAY ") == 0) {
+    relayed = true;
+    firstLine.erase(0, 6);
+  }
+
+  // Подписка резервного сервера: соединение остаётся открытым под поток
+  // журнала
+  std::string command = firstLine.substr(0, firstLine.find(' '));
+  if (command == "SUBSCRIBE_LOG") {
+    bool validSeq = true;
+    uint64_t fromSeq = 0;
+    try {
+      fromSeq = std::stoull(firstLine.substr(command.size()));
+    } catch (const std::exception &) {
+      validSeq = false;
+    }
+    if (validSeq) {
+      metadataStore.ServeStandby(clientSocket, fromSeq);
+    } else {
+      NetworkUtils::SendMessage(clientSocket,
+                                "ERROR INVALID_ARGUMENTS Invalid log position");
+    }
+    NetworkUtils::CloseSocket(clientSocket);
+    std::cout << "Client disconnected: " << clientIP << std::endl;
+    return;
+  }
+
   // Обработка через ProtocolHandler
-  // Для UPLOAD_COMPLETE передаем пустую строку, так как команда будет прочитана внутри
   std::string response;
-  if (firstLine.find("UPLOAD_COMPLETE") == 0) {
-    // Для UPLOAD_COMPLETE нужно прочитать многострочное сообщение
-    // Передаем первую строку и сокет для чтения остальных строк
-    std::cout << "Processing UPLOAD_COMPLETE multiline request" << std::endl;
-    response = protocolHandler.ProcessMultilineRequest(firstLine, clientSocket);
-    std::cout << "UPLOAD_COMPLETE response: " << response.substr(0, 50) << std::endl;
+  if (command == "ROLE" || command == "PROMOTE") {
+    response = HandleRoleCommand(command);
+  } else if (standby) {
+    // Резервный сервер не обслуживает клиентов и узлы до повышения
+    response = "ERROR NOT_PRIMARY Standby metadata server\r\n";
+  } else if (ProtocolHandler::IsMultilineRequest(firstLine)) {
+    // Многострочный запрос (UPLOAD_COMPLETE, CHUNK_INVENTORY): передаем
+    // первую строку и сокет для чтения остальных строк
+    std::cout << "Processing multiline request" << std::endl;
+    response = protocolHandler.ProcessMultilineRequest(firstLine, clientSocket,
+                                                       relayed);
+    std::cout << "Multiline response: " << response.substr(0, 50) << std::endl;
   } else {
     // Для остальных команд используем обычную обработку
-    response = protocolHandler.ProcessRequest(firstLine, clientSocket);
+    response = protocolHandler.ProcessRequest(firstLine, clientSocket, relayed);
   }
 
   // Отправка ответа
@@ -229,7 +361,21 @@ void MetadataServer::Shutdown() {
 
 // Очистка ресурсов
 void MetadataServer::Cleanup() {
+  // Резервный: прекращение приёма журнала основного
+  if (replicator) {
+    replicator->Stop();
+  }
+  shardRelay.Stop();
+
+  // Остановка сборки мусора, ребалансировки и восстановления реплик
+  chunkCollector.Stop();
+  rebalancer.Stop();
+  repairScheduler.Stop();
+
   // Остановка keep-alive проверки
   nodeManager.StopKeepAliveChecker();
+
+  // Журнал закрывается последним: выше могли идти изменения
+  metadataStore.Stop();
 }
 
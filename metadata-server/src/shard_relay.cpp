@@ -0,0 +1,137 @@
+#include "shard_relay.h"
+
+#include "network_utils.h"
+#include <chrono>
+#include <iostream>
+
+ShardRelay::ShardRelay() : running(false), droppedRequests(0) {}
+
+ShardRelay::~ShardRelay() { Stop(); }
+
+bool ShardRelay::Configure(const ShardMap &shardMap, size_t localShard) {
+  peers.clear();
+  for (size_t shard = 0; shard < shardMap.GetShardCount(); ++shard) {
+    if (shard == localShard) {
+      continue;
+    }
+    auto peer = std::make_unique<Peer>();
+    peer->shard = shard;
+    peer->activeEndpoint = 0;
+    if (!ShardMap::ParseAddresses(shardMap.GetShardAddresses(shard),
+                                  peer->endpoints)) {
+      return false;
+    }
+    peers.push_back(std::move(peer));
+  }
+  return true;
+}
+
+void ShardRelay::Start() {
+  if (running || peers.empty()) {
+    return;
+  }
+
+  running = true;
+  for (auto &peer : peers) {
+    peer->thread = std::thread(&ShardRelay::PeerLoop, this, peer.get());
+  }
+}
+
+void ShardRelay::Stop() {
+  if (!running) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    running = false;
+  }
+  queueCondition.notify_all();
+
+  for (auto &peer : peers) {
+    if (peer->thread.joinable()) {
+      peer->thread.join();
+    }
+  }
+}
+
+void ShardRelay::Forward(const std::string &request) {
+  if (peers.empty()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &peer : peers) {
+      if (peer->queue.size() >= MAX_QUEUE) {
+        peer->queue.pop_front();
+        if (droppedRequests++ % 1000 == 0) {
+          std::cerr << "Warning: Shard " << peer->shard
+                    << " unreachable, dropping relayed node requests"
+                    << std::endl;
+        }
+      }
+      peer->queue.push_back(request);
+    }
+  }
+  queueCondition.notify_all();
+}
+
+// Поток шарда: доставка очереди по порядку, при ошибке - повтор
+void ShardRelay::PeerLoop(Peer *peer) {
+  while (true) {
+    std::string request;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      queueCondition.wait(
+          lock, [&] { return !running || !peer->queue.empty(); });
+      if (!running) {
+        return;
+      }
+      request = peer->queue.front();
+    }
+
+    if (Deliver(*peer, request)) {
+      std::lock_guard<std::mutex> lock(mutex);
+      // Запрос мог быть вытеснен из переполненной очереди
+      if (!peer->queue.empty() && peer->queue.front() == request) {
+        peer->queue.pop_front();
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    queueCondition.wait_for(lock, std::chrono::milliseconds(RETRY_DELAY_MS),
+                            [this] { return !running; });
+  }
+}
+
+// Доставка основному серверу шарда (резервные отвечают NOT_PRIMARY)
+bool ShardRelay::Deliver(Peer &peer, const std::string &request) {
+  std::string relayed = "RELAY " + request;
+
+  for (size_t attempt = 0; attempt < peer.endpoints.size(); ++attempt) {
+    size_t index = (peer.activeEndpoint + attempt) % peer.endpoints.size();
+    const auto &endpoint = peer.endpoints[index];
+
+    SOCKET socket = NetworkUtils::ConnectToHost(
+        endpoint.first, endpoint.second, SEND_TIMEOUT_SEC);
+    if (socket == INVALID_SOCKET) {
+      continue;
+    }
+
+    std::string response;
+    bool delivered =
+        NetworkUtils::SendBinaryData(socket, relayed.data(), relayed.size()) &&
+        NetworkUtils::ReceiveMessage(socket, response, 4096,
+                                     SEND_TIMEOUT_SEC);
+    NetworkUtils::CloseSocket(socket);
+
+    if (delivered && response.find("ERROR NOT_PRIMARY") != 0) {
+      // Ошибка обработки на шарде не повторяется: запрос доставлен
+      peer.activeEndpoint = index;
+      return true;
+    }
+  }
+  return false;
+}
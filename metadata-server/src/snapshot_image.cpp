@@ -0,0 +1,652 @@
+#include "snapshot_image.h"
+
+#include "hash_utils.h"
+#include "metadata_log.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = {'P', '2', 'P', 'M', 'E', 'T', 'A', '\0'};
+const size_t SECTION_ALIGNMENT = 8;
+
+uint64_t AlignUp(uint64_t value) {
+  return (value + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT *
+         SECTION_ALIGNMENT;
+}
+
+// Проверка границ секции и указатель на её начало
+template <typename T>
+bool MapSection(const unsigned char *data, size_t size,
+                const SnapshotSection &section, const T *&out) {
+  if (section.offset % SECTION_ALIGNMENT != 0 ||
+      section.offset < sizeof(SnapshotHeader) || section.offset > size ||
+      section.count > (size - section.offset) / sizeof(T)) {
+    return false;
+  }
+  out = reinterpret_cast<const T *>(data + section.offset);
+  return true;
+}
+
+int HexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+// 64 строчных hex-символа -> 32 байта
+bool ParseChunkId(const std::string &chunkId, uint8_t (&id)[32]) {
+  if (chunkId.length() != 64) {
+    return false;
+  }
+  for (size_t i = 0; i < 32; ++i) {
+    int high = HexValue(chunkId[2 * i]);
+    int low = HexValue(chunkId[2 * i + 1]);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    id[i] = static_cast<uint8_t>((high << 4) | low);
+  }
+  return true;
+}
+
+} // namespace
+
+SnapshotImage::SnapshotImage()
+    : data(nullptr), size(0),
+#ifdef _WIN32
+      fileHandle(nullptr), mappingHandle(nullptr),
+#endif
+      header(nullptr), stringOffsets(nullptr), stringData(nullptr),
+      nodeNames(nullptr), nodes(nullptr), chunks(nullptr), replicas(nullptr),
+      files(nullptr), fileChunks(nullptr), chunkFiles(nullptr),
+      nodeChunkOffsets(nullptr), nodeChunks(nullptr), nodeUsage(nullptr),
+      hexChunkCount(0) {
+}
+
+SnapshotImage::~SnapshotImage() { Close(); }
+
+bool SnapshotImage::HasImageMagic(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  char magic[sizeof(SNAPSHOT_MAGIC)];
+  return in.read(magic, sizeof(magic)) &&
+         std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0;
+}
+
+// Отображение файла в память и проверка
+bool SnapshotImage::Open(const std::string &path) {
+  Close();
+
+#ifdef _WIN32
+  // Отображение живёт до следующего снимка: файл можно удалять
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER fileSize;
+  if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+    CloseHandle(file);
+    return false;
+  }
+  HANDLE mapping =
+      CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping == nullptr) {
+    CloseHandle(file);
+    return false;
+  }
+  void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (view == nullptr) {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+  fileHandle = file;
+  mappingHandle = mapping;
+  data = static_cast<const unsigned char *>(view);
+  size = static_cast<size_t>(fileSize.QuadPart);
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  void *view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                    MAP_PRIVATE, fd, 0);
+  close(fd); // Отображение держит файл само
+  if (view == MAP_FAILED) {
+    return false;
+  }
+  madvise(view, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+  data = static_cast<const unsigned char *>(view);
+  size = static_cast<size_t>(st.st_size);
+#endif
+
+  if (!Validate()) {
+    Close();
+    return false;
+  }
+#ifndef _WIN32
+  // Дальше записи читаются вразброс (поиск чанков), а не подряд
+  madvise(const_cast<unsigned char *>(data), size, MADV_RANDOM);
+#endif
+  return true;
+}
+
+void SnapshotImage::Close() {
+  if (data != nullptr) {
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(static_cast<HANDLE>(mappingHandle));
+    CloseHandle(static_cast<HANDLE>(fileHandle));
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    munmap(const_cast<unsigned char *>(data), size);
+#endif
+  }
+  data = nullptr;
+  size = 0;
+  header = nullptr;
+}
+
+// Заголовок, CRC и ссылки между секциями: после проверки записи можно
+// читать без проверок границ
+bool SnapshotImage::Validate() {
+  if (size < sizeof(SnapshotHeader)) {
+    return false;
+  }
+  header = reinterpret_cast<const SnapshotHeader *>(data);
+
+  if (std::memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) !=
+          0 ||
+      header->version != FORMAT_VERSION) {
+    std::cerr << "Error: Unsupported metadata snapshot format" << std::endl;
+    return false;
+  }
+  if (header->byteOrder != BYTE_ORDER_MARK) {
+    std::cerr << "Error: Metadata snapshot written with another byte order"
+              << std::endl;
+    return false;
+  }
+  if (HashUtils::Crc32(header, offsetof(SnapshotHeader, headerCrc)) !=
+          header->headerCrc ||
+      header->fileSize != size) {
+    return false;
+  }
+  if (HashUtils::Crc32(data + sizeof(SnapshotHeader),
+                       size - sizeof(SnapshotHeader)) != header->bodyCrc) {
+    return false;
+  }
+
+  const unsigned char *bytes = nullptr;
+  if (!MapSection(data, size, header->stringOffsets, stringOffsets) ||
+      !MapSection(data, size, header->stringData, bytes) ||
+      !MapSection(data, size, header->nodeNames, nodeNames) ||
+      !MapSection(data, size, header->nodes, nodes) ||
+      !MapSection(data, size, header->chunks, chunks) ||
+      !MapSection(data, size, header->replicas, replicas) ||
+      !MapSection(data, size, header->files, files) ||
+      !MapSection(data, size, header->fileChunks, fileChunks) ||
+      !MapSection(data, size, header->chunkFiles, chunkFiles) ||
+      !MapSection(data, size, header->nodeChunkOffsets, nodeChunkOffsets) ||
+      !MapSection(data, size, header->nodeChunks, nodeChunks) ||
+      !MapSection(data, size, header->nodeUsage, nodeUsage)) {
+    return false;
+  }
+  stringData = reinterpret_cast<const char *>(bytes);
+
+  // Строки
+  uint64_t stringCount = header->stringOffsets.count;
+  if (stringCount == 0 || stringOffsets[0] != 0 ||
+      stringOffsets[stringCount - 1] != header->stringData.count) {
+    return false;
+  }
+  for (uint64_t i = 1; i < stringCount; ++i) {
+    if (stringOffsets[i] < stringOffsets[i - 1]) {
+      return false;
+    }
+  }
+  stringCount--; // Последнее смещение - конец данных
+
+  // Узлы
+  uint64_t handleCount = header->nodeNames.count;
+  for (uint64_t i = 0; i < handleCount; ++i) {
+    if (nodeNames[i] >= stringCount) {
+      return false;
+    }
+  }
+  for (uint64_t i = 0; i < header->nodes.count; ++i) {
+    if (nodes[i].handle >= handleCount || nodes[i].ipString >= stringCount ||
+        nodes[i].domainString >= stringCount) {
+      return false;
+    }
+  }
+
+  // Чанки и реплики. Двоичные идентификаторы строго по возрастанию и
+  // раньше строковых: на этом держится FindChunk
+  for (uint64_t i = 0; i < header->replicas.count; ++i) {
+    if (replicas[i] >= handleCount) {
+      return false;
+    }
+  }
+  hexChunkCount = 0;
+  for (uint64_t i = 0; i < header->chunks.count; ++i) {
+    const SnapshotChunkRecord &chunk = chunks[i];
+    if (chunk.firstReplica > header->replicas.count ||
+        chunk.replicaCount > header->replicas.count - chunk.firstReplica ||
+        chunk.firstFile > header->chunkFiles.count ||
+        chunk.fileCount > header->chunkFiles.count - chunk.firstFile) {
+      return false;
+    }
+    if (chunk.flags & CHUNK_ID_IN_STRING_TABLE) {
+      uint64_t index;
+      std::memcpy(&index, chunk.id, sizeof(index));
+      if (index >= stringCount) {
+        return false;
+      }
+      continue;
+    }
+    if (hexChunkCount != i ||
+        (i > 0 &&
+         std::memcmp(chunks[i - 1].id, chunk.id, sizeof(chunk.id)) >= 0)) {
+      return false;
+    }
+    hexChunkCount++;
+  }
+
+  // Файлы
+  for (uint64_t i = 0; i < header->fileChunks.count; ++i) {
+    if (fileChunks[i] >= header->chunks.count) {
+      return false;
+    }
+  }
+  for (uint64_t i = 0; i < header->files.count; ++i) {
+    const SnapshotFileRecord &file = files[i];
+    if (file.nameString >= stringCount ||
+        file.firstChunk > header->fileChunks.count ||
+        file.chunkCount > header->fileChunks.count - file.firstChunk) {
+      return false;
+    }
+  }
+  for (uint64_t i = 0; i < header->chunkFiles.count; ++i) {
+    if (chunkFiles[i] >= header->files.count) {
+      return false;
+    }
+  }
+
+  // Чанки узлов
+  if (header->nodeChunkOffsets.count != handleCount + 1 ||
+      nodeChunkOffsets[0] != 0 ||
+      nodeChunkOffsets[handleCount] != header->nodeChunks.count ||
+      header->nodeUsage.count != handleCount) {
+    return false;
+  }
+  for (uint64_t i = 1; i <= handleCount; ++i) {
+    if (nodeChunkOffsets[i] < nodeChunkOffsets[i - 1]) {
+      return false;
+    }
+  }
+  for (uint64_t i = 0; i < header->nodeChunks.count; ++i) {
+    if (nodeChunks[i] >= header->chunks.count) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+std::string SnapshotImage::GetString(uint64_t index) const {
+  return std::string(stringData + stringOffsets[index],
+                     stringOffsets[index + 1] - stringOffsets[index]);
+}
+
+std::string SnapshotImage::GetNodeName(uint32_t handle) const {
+  return GetString(nodeNames[handle]);
+}
+
+std::string SnapshotImage::GetChunkId(const SnapshotChunkRecord &chunk) const {
+  if (chunk.flags & CHUNK_ID_IN_STRING_TABLE) {
+    uint64_t index;
+    std::memcpy(&index, chunk.id, sizeof(index));
+    return GetString(index);
+  }
+
+  static const char *hex = "0123456789abcdef";
+  std::string chunkId(64, '0');
+  for (size_t i = 0; i < 32; ++i) {
+    chunkId[2 * i] = hex[chunk.id[i] >> 4];
+    chunkId[2 * i + 1] = hex[chunk.id[i] & 0x0F];
+  }
+  return chunkId;
+}
+
+bool SnapshotImage::FindChunk(const std::string &chunkId,
+                              size_t &index) const {
+  uint8_t id[32];
+  if (ParseChunkId(chunkId, id)) {
+    const SnapshotChunkRecord *end = chunks + hexChunkCount;
+    const SnapshotChunkRecord *it = std::lower_bound(
+        chunks, end, id,
+        [](const SnapshotChunkRecord &chunk, const uint8_t *key) {
+          return std::memcmp(chunk.id, key, sizeof(chunk.id)) < 0;
+        });
+    if (it == end || std::memcmp(it->id, id, sizeof(id)) != 0) {
+      return false;
+    }
+    index = static_cast<size_t>(it - chunks);
+    return true;
+  }
+
+  // Нестандартные идентификаторы редки: перебор
+  for (size_t i = hexChunkCount; i < GetChunkCount(); ++i) {
+    if (GetChunkId(chunks[i]) == chunkId) {
+      index = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+SnapshotImageWriter::SnapshotImageWriter() { stringOffsets.push_back(0); }
+
+uint64_t SnapshotImageWriter::AddString(const std::string &value) {
+  stringData += value;
+  stringOffsets.push_back(stringData.size());
+  return stringOffsets.size() - 2;
+}
+
+uint64_t SnapshotImageWriter::AddSharedString(const std::string &value) {
+  auto it = sharedStrings.find(value);
+  if (it != sharedStrings.end()) {
+    return it->second;
+  }
+  uint64_t index = AddString(value);
+  sharedStrings[value] = index;
+  return index;
+}
+
+uint32_t SnapshotImageWriter::GetNodeHandle(const std::string &nodeId) {
+  auto it = nodeHandles.find(nodeId);
+  if (it != nodeHandles.end()) {
+    return it->second;
+  }
+  uint32_t handle = static_cast<uint32_t>(nodeNames.size());
+  nodeNames.push_back(AddSharedString(nodeId));
+  nodeUsage.push_back(SnapshotNodeUsage{0, 0, 0});
+  nodeHandles[nodeId] = handle;
+  return handle;
+}
+
+void SnapshotImageWriter::AddNode(const std::string &nodeId,
+                                  const std::string &ip, int port,
+                                  const std::string &failureDomain,
+                                  uint64_t totalSpace) {
+  SnapshotNodeRecord node{};
+  node.handle = GetNodeHandle(nodeId);
+  node.port = static_cast<uint32_t>(port);
+  node.ipString = AddSharedString(ip);
+  node.domainString = AddSharedString(failureDomain);
+  node.totalSpace = totalSpace;
+  nodes.push_back(node);
+}
+
+void SnapshotImageWriter::AddChunk(const std::string &chunkId, uint64_t size,
+                                   const std::vector<std::string> &nodeIds) {
+  if (chunkIndexes.find(chunkId) != chunkIndexes.end()) {
+    return; // Идентификаторы в снимке уникальны
+  }
+
+  SnapshotChunkRecord chunk{};
+  if (!ParseChunkId(chunkId, chunk.id)) {
+    uint64_t index = AddString(chunkId);
+    std::memset(chunk.id, 0, sizeof(chunk.id));
+    std::memcpy(chunk.id, &index, sizeof(index));
+    chunk.flags = SnapshotImage::CHUNK_ID_IN_STRING_TABLE;
+  }
+  chunk.size = size;
+  chunk.firstReplica = replicas.size();
+  chunk.replicaCount = static_cast<uint32_t>(nodeIds.size());
+  uint64_t fingerprint = HashUtils::ChunkFingerprint(chunkId);
+  for (const auto &nodeId : nodeIds) {
+    uint32_t handle = GetNodeHandle(nodeId);
+    replicas.push_back(handle);
+    SnapshotNodeUsage &usage = nodeUsage[handle];
+    usage.chunks++;
+    usage.bytes += size;
+    usage.fingerprint ^= fingerprint;
+  }
+
+  chunkIndexes[chunkId] = static_cast<uint32_t>(chunks.size());
+  chunks.push_back(chunk);
+}
+
+bool SnapshotImageWriter::AddFile(const std::string &filename,
+                                  uint64_t totalSize,
+                                  const std::vector<std::string> &chunkIds) {
+  SnapshotFileRecord file{};
+  file.nameString = AddString(filename);
+  file.totalSize = totalSize;
+  file.firstChunk = fileChunks.size();
+  file.chunkCount = chunkIds.size();
+
+  for (const auto &chunkId : chunkIds) {
+    auto it = chunkIndexes.find(chunkId);
+    if (it == chunkIndexes.end()) {
+      fileChunks.resize(file.firstChunk);
+      return false;
+    }
+    fileChunks.push_back(it->second);
+  }
+
+  files.push_back(file);
+  return true;
+}
+
+void SnapshotImageWriter::BuildIndexes() {
+  // Двоичные идентификаторы по возрастанию, строковые - в конце
+  std::vector<uint32_t> order(chunks.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+    const SnapshotChunkRecord &left = chunks[a];
+    const SnapshotChunkRecord &right = chunks[b];
+    if (left.flags != right.flags) {
+      return left.flags < right.flags;
+    }
+    return left.flags == 0 &&
+           std::memcmp(left.id, right.id, sizeof(left.id)) < 0;
+  });
+
+  std::vector<uint32_t> position(chunks.size());
+  std::vector<SnapshotChunkRecord> sorted;
+  sorted.reserve(chunks.size());
+  for (uint32_t i = 0; i < order.size(); ++i) {
+    position[order[i]] = i;
+    sorted.push_back(chunks[order[i]]);
+  }
+  chunks.swap(sorted);
+  sorted = std::vector<SnapshotChunkRecord>();
+  chunkIndexes.clear();
+  for (auto &index : fileChunks) {
+    index = position[index];
+  }
+
+  // Чанк -> файлы (файл с повторяющимся чанком учитывается один раз):
+  // первый проход считает, второй заполняет
+  std::vector<uint64_t> lastFile(chunks.size());
+  for (int pass = 0; pass < 2; ++pass) {
+    std::fill(lastFile.begin(), lastFile.end(), files.size());
+    for (auto &chunk : chunks) {
+      chunk.fileCount = 0;
+    }
+    for (size_t f = 0; f < files.size(); ++f) {
+      const SnapshotFileRecord &file = files[f];
+      for (uint64_t c = 0; c < file.chunkCount; ++c) {
+        uint32_t index = fileChunks[file.firstChunk + c];
+        if (lastFile[index] == f) {
+          continue;
+        }
+        lastFile[index] = f;
+        SnapshotChunkRecord &chunk = chunks[index];
+        if (pass == 1) {
+          chunkFiles[chunk.firstFile + chunk.fileCount] =
+              static_cast<uint32_t>(f);
+        }
+        chunk.fileCount++;
+      }
+    }
+    if (pass == 0) {
+      uint64_t offset = 0;
+      for (auto &chunk : chunks) {
+        chunk.firstFile = offset;
+        offset += chunk.fileCount;
+      }
+      chunkFiles.assign(offset, 0);
+    }
+  }
+
+  // Узел -> чанки
+  nodeChunkOffsets.assign(nodeNames.size() + 1, 0);
+  for (const auto &chunk : chunks) {
+    for (uint32_t r = 0; r < chunk.replicaCount; ++r) {
+      nodeChunkOffsets[replicas[chunk.firstReplica + r] + 1]++;
+    }
+  }
+  for (size_t i = 1; i < nodeChunkOffsets.size(); ++i) {
+    nodeChunkOffsets[i] += nodeChunkOffsets[i - 1];
+  }
+  nodeChunks.assign(nodeChunkOffsets.back(), 0);
+  std::vector<uint64_t> next(nodeChunkOffsets.begin(),
+                             nodeChunkOffsets.end() - 1);
+  for (uint32_t i = 0; i < chunks.size(); ++i) {
+    const SnapshotChunkRecord &chunk = chunks[i];
+    for (uint32_t r = 0; r < chunk.replicaCount; ++r) {
+      nodeChunks[next[replicas[chunk.firstReplica + r]]++] = i;
+    }
+  }
+}
+
+// Запись снимка: секции по порядку, затем заголовок с CRC
+bool SnapshotImageWriter::Write(const std::string &path, uint64_t logSeq) {
+  BuildIndexes();
+
+  SnapshotHeader header{};
+  std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  header.version = SnapshotImage::FORMAT_VERSION;
+  header.byteOrder = SnapshotImage::BYTE_ORDER_MARK;
+  header.logSeq = logSeq;
+
+  struct Section {
+    SnapshotSection *ref;
+    const void *data;
+    uint64_t count;
+    size_t elementSize;
+  };
+  Section sections[] = {
+      {&header.stringOffsets, stringOffsets.data(), stringOffsets.size(),
+       sizeof(uint64_t)},
+      {&header.stringData, stringData.data(), stringData.size(), 1},
+      {&header.nodeNames, nodeNames.data(), nodeNames.size(),
+       sizeof(uint64_t)},
+      {&header.nodes, nodes.data(), nodes.size(), sizeof(SnapshotNodeRecord)},
+      {&header.chunks, chunks.data(), chunks.size(),
+       sizeof(SnapshotChunkRecord)},
+      {&header.replicas, replicas.data(), replicas.size(), sizeof(uint32_t)},
+      {&header.files, files.data(), files.size(), sizeof(SnapshotFileRecord)},
+      {&header.fileChunks, fileChunks.data(), fileChunks.size(),
+       sizeof(uint32_t)},
+      {&header.chunkFiles, chunkFiles.data(), chunkFiles.size(),
+       sizeof(uint32_t)},
+      {&header.nodeChunkOffsets, nodeChunkOffsets.data(),
+       nodeChunkOffsets.size(), sizeof(uint64_t)},
+      {&header.nodeChunks, nodeChunks.data(), nodeChunks.size(),
+       sizeof(uint32_t)},
+      {&header.nodeUsage, nodeUsage.data(), nodeUsage.size(),
+       sizeof(SnapshotNodeUsage)},
+  };
+
+  std::string tmpPath = path + ".tmp";
+  std::FILE *file = std::fopen(tmpPath.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Error: Cannot create metadata snapshot " << tmpPath
+              << std::endl;
+    return false;
+  }
+  std::vector<char> buffer(1 << 20);
+  std::setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+
+  bool success =
+      std::fwrite(&header, sizeof(header), 1, file) == 1; // Заполняется ниже
+  uint64_t offset = sizeof(header);
+  uint32_t crc = 0;
+  static const char padding[SECTION_ALIGNMENT] = {0};
+
+  for (Section &section : sections) {
+    uint64_t aligned = AlignUp(offset);
+    size_t padSize = static_cast<size_t>(aligned - offset);
+    if (padSize > 0) {
+      success = success && std::fwrite(padding, 1, padSize, file) == padSize;
+      crc = HashUtils::Crc32(padding, padSize, crc);
+    }
+
+    size_t bytes = static_cast<size_t>(section.count * section.elementSize);
+    if (bytes > 0) {
+      success = success && std::fwrite(section.data, 1, bytes, file) == bytes;
+      crc = HashUtils::Crc32(section.data, bytes, crc);
+    }
+
+    section.ref->offset = aligned;
+    section.ref->count = section.count;
+    offset = aligned + bytes;
+  }
+
+  header.fileSize = offset;
+  header.bodyCrc = crc;
+  header.headerCrc =
+      HashUtils::Crc32(&header, offsetof(SnapshotHeader, headerCrc));
+
+  success = success && std::fseek(file, 0, SEEK_SET) == 0 &&
+            std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+            MetadataLog::SyncFile(file);
+  std::fclose(file);
+
+  std::error_code ec;
+  if (success) {
+    fs::rename(tmpPath, path, ec);
+  }
+  if (!success || ec) {
+    std::cerr << "Error: Failed to write metadata snapshot " << path
+              << std::endl;
+    fs::remove(tmpPath, ec);
+    return false;
+  }
+
+  MetadataLog::SyncDirectory(fs::path(path).parent_path().string());
+  return true;
+}
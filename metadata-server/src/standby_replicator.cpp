@@ -0,0 +1,208 @@
+#include "standby_replicator.h"
+
+#include <iostream>
+#include <sstream>
+
+StandbyReplicator::StandbyReplicator(MetadataStore *store,
+                                     const std::string &primaryIp,
+                                     int primaryPort, int leaseSec)
+    : store(store), primaryIp(primaryIp), primaryPort(primaryPort),
+      leaseSec(leaseSec), running(false), streamSocket(INVALID_SOCKET),
+      streamOffset(0), everConnected(false), appliedRecords(0) {}
+
+StandbyReplicator::~StandbyReplicator() { Stop(); }
+
+void StandbyReplicator::SetLeaseExpiredCallback(
+    LeaseExpiredCallback callback) {
+  leaseExpiredCallback = std::move(callback);
+}
+
+void StandbyReplicator::Start() {
+  if (running) {
+    return;
+  }
+
+  running = true;
+  replicationThread = std::thread(&StandbyReplicator::ReplicationLoop, this);
+  std::cout << "Standby mode: following primary " << primaryIp << ":"
+            << primaryPort;
+  if (leaseSec > 0) {
+    std::cout << ", lease " << leaseSec << " s";
+  }
+  std::cout << std::endl;
+}
+
+void StandbyReplicator::Stop() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    running = false;
+    // Прерывание чтения потока, чтобы не ждать таймаута
+    if (streamSocket != INVALID_SOCKET) {
+#ifdef _WIN32
+      shutdown(streamSocket, SD_BOTH);
+#else
+      shutdown(streamSocket, SHUT_RDWR);
+#endif
+    }
+  }
+  stopCondition.notify_all();
+
+  if (replicationThread.joinable()) {
+    if (replicationThread.get_id() == std::this_thread::get_id()) {
+      replicationThread.detach(); // Stop из обработчика аренды
+    } else {
+      replicationThread.join();
+    }
+  }
+}
+
+bool StandbyReplicator::IsLeaseExpired() const {
+  return leaseSec > 0 && everConnected &&
+         std::chrono::steady_clock::now() - lastContact >=
+             std::chrono::seconds(leaseSec);
+}
+
+// Подписка на журнал основного с переподключением
+void StandbyReplicator::ReplicationLoop() {
+  while (running) {
+    SOCKET socket = NetworkUtils::ConnectToHost(primaryIp, primaryPort,
+                                                CONNECT_TIMEOUT_SEC);
+    if (socket != INVALID_SOCKET) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        streamSocket = running ? socket : INVALID_SOCKET;
+      }
+      if (running) {
+        FollowPrimary(socket);
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        streamSocket = INVALID_SOCKET;
+      }
+      NetworkUtils::CloseSocket(socket);
+    }
+
+    if (!running) {
+      return;
+    }
+
+    if (IsLeaseExpired()) {
+      std::cout << "Primary " << primaryIp << ":" << primaryPort
+                << " silent for " << leaseSec
+                << " s, lease expired: taking over" << std::endl;
+      running = false;
+      if (leaseExpiredCallback) {
+        leaseExpiredCallback();
+      }
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    stopCondition.wait_for(lock,
+                           std::chrono::milliseconds(RECONNECT_DELAY_MS),
+                           [this] { return !running; });
+  }
+}
+
+// Сеанс подписки: записи, снимок и heartbeat основного
+void StandbyReplicator::FollowPrimary(SOCKET socket) {
+  uint64_t fromSeq = store->GetNextSeq();
+  if (!NetworkUtils::SendMessage(socket,
+                                 "SUBSCRIBE_LOG " + std::to_string(fromSeq))) {
+    return;
+  }
+  NetworkUtils::SetSocketTimeout(socket, STREAM_TIMEOUT_SEC);
+  streamBuffer.clear();
+  streamOffset = 0;
+
+  bool announced = false;
+  std::string line;
+  while (running && ReadLine(socket, line)) {
+    if (line.compare(0, 6, "ERROR ") == 0) {
+      std::cerr << "Error: Primary refused log subscription from position "
+                << fromSeq << ": " << line << std::endl;
+      return;
+    }
+
+    lastContact = std::chrono::steady_clock::now();
+    everConnected = true;
+    if (!announced) {
+      std::cout << "Following primary log from position " << fromSeq
+                << std::endl;
+      announced = true;
+    }
+
+    if (line.compare(0, 2, "R ") == 0) {
+      if (!store->ApplyReplicated(line.substr(2))) {
+        std::cerr << "Error: Invalid metadata log record from primary"
+                  << std::endl;
+        return;
+      }
+      appliedRecords++;
+    } else if (line.compare(0, 2, "H ") == 0) {
+      // Heartbeat несёт позицию основного: она должна совпасть с нашей
+      if (line.substr(2) != std::to_string(store->GetNextSeq())) {
+        std::cerr << "Error: Standby log diverged from primary (primary at "
+                  << line.substr(2) << ", standby at " << store->GetNextSeq()
+                  << ")" << std::endl;
+        return;
+      }
+    } else if (line.compare(0, 9, "SNAPSHOT ") == 0) {
+      std::stringstream ss(line.substr(9));
+      uint64_t snapshotSeq = 0;
+      size_t size = 0;
+      std::string data;
+      if (!(ss >> snapshotSeq >> size) || !ReadBytes(socket, size, data) ||
+          !store->InstallSnapshot(snapshotSeq, data)) {
+        return;
+      }
+      lastContact = std::chrono::steady_clock::now();
+    } else {
+      std::cerr << "Error: Unexpected line in primary log stream: " << line
+                << std::endl;
+      return;
+    }
+  }
+}
+
+bool StandbyReplicator::FillBuffer(SOCKET socket) {
+  // Прочитанное начало буфера отбрасывается
+  if (streamOffset > 0) {
+    streamBuffer.erase(0, streamOffset);
+    streamOffset = 0;
+  }
+
+  char chunk[16384];
+  int bytesReceived = recv(socket, chunk, sizeof(chunk), 0);
+  if (bytesReceived <= 0) {
+    return false; // Таймаут, ошибка или соединение закрыто
+  }
+  streamBuffer.append(chunk, static_cast<size_t>(bytesReceived));
+  return true;
+}
+
+bool StandbyReplicator::ReadLine(SOCKET socket, std::string &line) {
+  while (true) {
+    size_t end = streamBuffer.find("\r\n", streamOffset);
+    if (end != std::string::npos) {
+      line.assign(streamBuffer, streamOffset, end - streamOffset);
+      streamOffset = end + 2;
+      return true;
+    }
+    if (!FillBuffer(socket)) {
+      return false;
+    }
+  }
+}
+
+bool StandbyReplicator::ReadBytes(SOCKET socket, size_t size,
+                                  std::string &data) {
+  while (streamBuffer.size() - streamOffset < size) {
+    if (!FillBuffer(socket)) {
+      return false;
+    }
+  }
+  data.assign(streamBuffer, streamOffset, size);
+  streamOffset += size;
+  return true;
+}
@@ -0,0 +1,98 @@
+#include "storage_node_client.h"
+
+#include "network_utils.h"
+#include <iostream>
+#include <sstream>
+
+namespace StorageNodeClient {
+
+namespace {
+
+// Передача чанка между узлами: 1 МБ по медленной сети
+const int REPLICATE_TIMEOUT_SEC = 120;
+const int COMMAND_TIMEOUT_SEC = 30;
+
+// Отправка команды узлу и чтение однострочного ответа
+bool SendCommand(const StorageNode &node, const std::string &command,
+                 int timeoutSec, std::string &response) {
+  SOCKET socket =
+      NetworkUtils::ConnectToHost(node.ipAddress, node.port, timeoutSec);
+  if (socket == INVALID_SOCKET) {
+    return false;
+  }
+
+  bool success = NetworkUtils::SendMessage(socket, command) &&
+                 NetworkUtils::ReceiveMessage(socket, response, 4096,
+                                              timeoutSec);
+  NetworkUtils::CloseSocket(socket);
+  return success;
+}
+
+} // namespace
+
+bool ReplicateChunk(const StorageNode &source, const std::string &chunkId,
+                    const StorageNode &target) {
+  std::stringstream command;
+  command << "REPLICATE_CHUNK " << chunkId << " " << target.ipAddress << " "
+          << target.port;
+
+  std::string response;
+  if (!SendCommand(source, command.str(), REPLICATE_TIMEOUT_SEC, response)) {
+    return false;
+  }
+
+  if (response.rfind("REPLICATE_RESPONSE OK", 0) != 0) {
+    std::cerr << "Warning: Node " << source.nodeId
+              << " failed to replicate chunk " << chunkId << ": " << response
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool CheckChunk(const StorageNode &node, const std::string &chunkId) {
+  std::string response;
+  return SendCommand(node, "CHECK_CHUNK " + chunkId, COMMAND_TIMEOUT_SEC,
+                     response) &&
+         response.rfind("CHECK_RESPONSE EXISTS", 0) == 0;
+}
+
+bool DeleteChunk(const StorageNode &node, const std::string &chunkId) {
+  std::string response;
+  if (!SendCommand(node, "DELETE_CHUNK " + chunkId, COMMAND_TIMEOUT_SEC,
+                   response)) {
+    return false;
+  }
+
+  if (response.rfind("DELETE_RESPONSE OK", 0) != 0) {
+    std::cerr << "Warning: Node " << node.nodeId << " failed to delete chunk "
+              << chunkId << ": " << response << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool DeleteChunks(const StorageNode &node,
+                  const std::vector<OrphanReplica> &replicas) {
+  std::string command = "DELETE_CHUNKS " + std::to_string(replicas.size());
+  for (const auto &replica : replicas) {
+    command += "\r\n" + replica.chunkId + " " +
+               std::to_string(replica.ageSec);
+  }
+  command += "\r\nEND_CHUNKS";
+
+  std::string response;
+  if (!SendCommand(node, command, COMMAND_TIMEOUT_SEC, response)) {
+    return false;
+  }
+
+  if (response.rfind("DELETE_RESPONSE OK", 0) != 0) {
+    std::cerr << "Warning: Node " << node.nodeId << " failed to delete "
+              << replicas.size() << " orphan chunks: " << response
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+} // namespace StorageNodeClient
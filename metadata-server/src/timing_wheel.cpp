@@ -0,0 +1,114 @@
+#include "timing_wheel.h"
+
+#include <utility>
+
+TimingWheel::TimingWheel(std::chrono::milliseconds tick)
+    : tick(tick), start(Clock::now()), currentTick(0), nextGeneration(0) {}
+
+// Номер шага для момента времени (с округлением вниз)
+uint64_t TimingWheel::ToTick(Clock::time_point time) const {
+  if (time <= start) {
+    return 0;
+  }
+  auto elapsed =
+      std::chrono::duration_cast<std::chrono::milliseconds>(time - start);
+  return static_cast<uint64_t>(elapsed.count() / tick.count());
+}
+
+// Постановка таймера
+void TimingWheel::Schedule(const std::string &key,
+                           Clock::time_point deadline) {
+  // Округление вверх: таймер не срабатывает раньше срока
+  uint64_t deadlineTick = ToTick(deadline);
+  if (deadline > start + deadlineTick * tick) {
+    deadlineTick++;
+  }
+
+  Timer &timer = timers[key];
+  timer.generation = nextGeneration++;
+  timer.deadlineTick = deadlineTick;
+
+  Insert(Entry{key, timer.generation, deadlineTick});
+}
+
+void TimingWheel::Cancel(const std::string &key) { timers.erase(key); }
+
+bool TimingWheel::IsScheduled(const std::string &key) const {
+  return timers.find(key) != timers.end();
+}
+
+// Размещение записи на уровне, соответствующем оставшемуся времени
+void TimingWheel::Insert(Entry entry) {
+  if (entry.deadlineTick <= currentTick) {
+    // Срок уже прошёл - сработает на следующем шаге
+    wheel[0][(currentTick + 1) & (SLOTS - 1)].push_back(std::move(entry));
+    return;
+  }
+
+  uint64_t delta = entry.deadlineTick - currentTick;
+  for (size_t level = 0; level < LEVELS; ++level) {
+    if (delta < (uint64_t(1) << (SLOT_BITS * (level + 1)))) {
+      size_t slot =
+          (entry.deadlineTick >> (SLOT_BITS * level)) & (SLOTS - 1);
+      wheel[level][slot].push_back(std::move(entry));
+      return;
+    }
+  }
+
+  // Дальше диапазона колеса: последний слот верхнего уровня, оттуда
+  // запись будет переразмещена при очередном обороте
+  size_t top = LEVELS - 1;
+  size_t slot =
+      ((currentTick >> (SLOT_BITS * top)) + SLOTS - 1) & (SLOTS - 1);
+  wheel[top][slot].push_back(std::move(entry));
+}
+
+// Перенос текущего слота уровня на нижние уровни
+void TimingWheel::Cascade(size_t level) {
+  size_t slot = (currentTick >> (SLOT_BITS * level)) & (SLOTS - 1);
+  std::vector<Entry> entries;
+  entries.swap(wheel[level][slot]);
+
+  for (auto &entry : entries) {
+    auto it = timers.find(entry.key);
+    if (it != timers.end() && it->second.generation == entry.generation) {
+      Insert(std::move(entry));
+    }
+  }
+}
+
+// Продвижение колеса
+void TimingWheel::Advance(Clock::time_point now,
+                          std::vector<std::string> &expired) {
+  uint64_t target = ToTick(now);
+
+  while (currentTick < target) {
+    currentTick++;
+
+    // Сначала верхние уровни: их записи могут попасть в слоты нижних,
+    // которые переносятся на этом же шаге
+    for (size_t level = LEVELS - 1; level > 0; --level) {
+      uint64_t mask = (uint64_t(1) << (SLOT_BITS * level)) - 1;
+      if ((currentTick & mask) == 0) {
+        Cascade(level);
+      }
+    }
+
+    std::vector<Entry> entries;
+    entries.swap(wheel[0][currentTick & (SLOTS - 1)]);
+
+    for (auto &entry : entries) {
+      auto it = timers.find(entry.key);
+      if (it == timers.end() || it->second.generation != entry.generation) {
+        continue; // Таймер перенесён или отменён
+      }
+
+      if (entry.deadlineTick <= currentTick) {
+        timers.erase(it);
+        expired.push_back(std::move(entry.key));
+      } else {
+        Insert(std::move(entry));
+      }
+    }
+  }
+}
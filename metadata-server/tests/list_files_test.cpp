@@ -0,0 +1,120 @@
+// Постраничный LIST_FILES по именам с пробелами и '%': курсор и префикс
+// передаются экранированными и не разрываются на токены
+#include "metadata_manager.h"
+#include "network_utils.h"
+#include "node_manager.h"
+#include "protocol_handler.h"
+#include "repair_scheduler.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void Check(bool condition, const std::string &message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+// Регистрация файла из одного чанка
+void AddFile(MetadataManager &metadataManager, const std::string &filename) {
+  ChunkInfo chunk;
+  chunk.chunkId = std::string(64, 'a');
+  chunk.index = 0;
+  chunk.size = 100;
+  chunk.nodeIds = {"node-1"};
+  Check(metadataManager.RegisterFile(filename, chunk.size, {chunk}),
+        "RegisterFile " + filename);
+}
+
+// Все страницы LIST_FILES по одному файлу; имена - в порядке выдачи
+std::vector<std::string> ListAllPages(ProtocolHandler &handler,
+                                      const std::string &prefix) {
+  std::vector<std::string> names;
+  std::string after;
+  for (size_t page = 0; page < 100; ++page) {
+    std::string request = "LIST_FILES limit=1";
+    if (!prefix.empty()) {
+      request += " prefix=" + NetworkUtils::EscapeToken(prefix);
+    }
+    if (!after.empty()) {
+      request += " after=" + NetworkUtils::EscapeToken(after);
+    }
+
+    std::string response = handler.ProcessRequest(request, INVALID_SOCKET);
+    std::istringstream lines(response);
+    std::string line;
+    std::getline(lines, line);
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    std::istringstream header(line);
+    std::string command, status, count, next;
+    header >> command >> status >> count >> next;
+    if (command != "LIST_FILES_RESPONSE" || status != "OK") {
+      Check(false, "LIST_FILES failed: " + line);
+      return names;
+    }
+
+    while (std::getline(lines, line)) {
+      if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+      }
+      if (line == "END_FILES") {
+        break;
+      }
+      names.push_back(line.substr(0, line.rfind(' ')));
+    }
+
+    if (next.compare(0, 5, "next=") != 0) {
+      return names;
+    }
+    Check(NetworkUtils::UnescapeToken(next.substr(5), after),
+          "cursor unescape: " + next);
+  }
+  Check(false, "LIST_FILES did not finish");
+  return names;
+}
+
+} // namespace
+
+int main() {
+  NodeManager nodeManager;
+  MetadataManager metadataManager;
+  RepairScheduler repairScheduler(&nodeManager, &metadataManager,
+                                  ProtocolHandler::REPLICATION_FACTOR);
+  ProtocolHandler handler(&nodeManager, &metadataManager, &repairScheduler);
+
+  // "my file.txt" < "my%file.txt" < "my-file.txt" < "myfile.txt"
+  AddFile(metadataManager, "myfile.txt");
+  AddFile(metadataManager, "my file.txt");
+  AddFile(metadataManager, "my%file.txt");
+  AddFile(metadataManager, "my-file.txt");
+  AddFile(metadataManager, "other.txt");
+
+  std::vector<std::string> all = ListAllPages(handler, "");
+  std::vector<std::string> expected = {"my file.txt", "my%file.txt",
+                                       "my-file.txt", "myfile.txt",
+                                       "other.txt"};
+  Check(all == expected, "all pages");
+
+  std::vector<std::string> spaced = ListAllPages(handler, "my ");
+  Check(spaced == std::vector<std::string>{"my file.txt"}, "prefix 'my '");
+
+  std::vector<std::string> prefixed = ListAllPages(handler, "my");
+  expected.pop_back();
+  Check(prefixed == expected, "prefix 'my'");
+
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "list_files_test: OK" << std::endl;
+  return 0;
+}
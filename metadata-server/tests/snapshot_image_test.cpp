@@ -0,0 +1,267 @@
+// Загрузка двоичного снимка: файлы, реплики и учёт узлов, читаемые из
+// отображения, совпадают с исходным менеджером - сразу после загрузки и
+// после изменений, переносящих данные из снимка в память
+#include "metadata_manager.h"
+#include "snapshot_image.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+int failures = 0;
+
+void Check(bool condition, const std::string &message) {
+  if (!condition) {
+    std::cerr << "FAIL: " << message << std::endl;
+    failures++;
+  }
+}
+
+// Идентификатор чанка из 64 hex-символов
+std::string ChunkId(int number) {
+  char buffer[65];
+  std::snprintf(buffer, sizeof(buffer), "%064x", number * 7919 + 17);
+  return buffer;
+}
+
+// Идентификатор не из строчных hex-символов хранится в таблице строк
+const std::string UPPER_CHUNK_ID(64, 'A');
+
+ChunkInfo MakeChunk(const std::string &chunkId, size_t index, size_t size,
+                    const std::vector<std::string> &nodeIds) {
+  ChunkInfo chunk;
+  chunk.chunkId = chunkId;
+  chunk.index = index;
+  chunk.size = size;
+  chunk.nodeIds = nodeIds;
+  return chunk;
+}
+
+bool Register(MetadataManager &metadataManager, const std::string &filename,
+              const std::vector<ChunkInfo> &chunks) {
+  uint64_t size = 0;
+  for (const auto &chunk : chunks) {
+    size += chunk.size;
+  }
+  return metadataManager.RegisterFile(filename, size, chunks);
+}
+
+std::vector<std::string> Sorted(std::vector<std::string> values) {
+  std::sort(values.begin(), values.end());
+  return values;
+}
+
+// Сравнение всего, что менеджер отдаёт наружу
+void ExpectSame(MetadataManager &expected, MetadataManager &actual,
+                const std::string &stage) {
+  Check(expected.GetFileCount() == actual.GetFileCount(),
+        stage + ": file count");
+  Check(expected.GetTotalBytes() == actual.GetTotalBytes(),
+        stage + ": total bytes");
+
+  for (const auto &file : expected.GetAllFiles()) {
+    std::shared_ptr<const FileMetadata> metadata =
+        actual.GetFileMetadata(file.filename);
+    if (metadata == nullptr) {
+      Check(false, stage + ": missing file " + file.filename);
+      continue;
+    }
+    bool same = metadata->totalSize == file.totalSize &&
+                metadata->chunks.size() == file.chunks.size();
+    for (size_t i = 0; same && i < file.chunks.size(); ++i) {
+      const ChunkInfo &left = file.chunks[i];
+      const ChunkInfo &right = metadata->chunks[i];
+      same = left.chunkId == right.chunkId && left.index == right.index &&
+             left.size == right.size && left.nodeIds == right.nodeIds;
+    }
+    Check(same, stage + ": metadata of " + file.filename);
+  }
+
+  std::vector<std::string> chunkIds = Sorted(expected.GetAllChunkIds());
+  Check(chunkIds == Sorted(actual.GetAllChunkIds()), stage + ": chunk ids");
+  for (const auto &chunkId : chunkIds) {
+    uint64_t expectedSize = 0, actualSize = 0;
+    std::vector<std::string> expectedNodes, actualNodes;
+    Check(expected.GetChunkLocation(chunkId, expectedSize, expectedNodes) &&
+              actual.GetChunkLocation(chunkId, actualSize, actualNodes) &&
+              expectedSize == actualSize &&
+              Sorted(expectedNodes) == Sorted(actualNodes),
+          stage + ": location of " + chunkId);
+  }
+
+  // Обход порциями видит каждый чанк один раз и с теми же репликами
+  std::vector<std::string> scanned;
+  ChunkScanCursor cursor;
+  std::vector<ChunkReplicas> batch;
+  bool more = true;
+  while (more) {
+    more = actual.ScanChunks(cursor, 3, batch);
+    for (const auto &chunk : batch) {
+      uint64_t size = 0;
+      std::vector<std::string> nodeIds;
+      Check(actual.GetChunkLocation(chunk.chunkId, size, nodeIds) &&
+                Sorted(nodeIds) == Sorted(chunk.nodeIds),
+            stage + ": scanned replicas of " + chunk.chunkId);
+      scanned.push_back(chunk.chunkId);
+    }
+  }
+  Check(Sorted(scanned) == chunkIds, stage + ": scanned chunk ids");
+
+  auto expectedUsage = expected.GetNodeUsage();
+  auto actualUsage = actual.GetNodeUsage();
+  Check(expectedUsage.size() == actualUsage.size(), stage + ": usage nodes");
+  for (const auto &pair : expectedUsage) {
+    auto it = actualUsage.find(pair.first);
+    Check(it != actualUsage.end() &&
+              it->second.chunks == pair.second.chunks &&
+              it->second.bytes == pair.second.bytes &&
+              it->second.fingerprint == pair.second.fingerprint,
+          stage + ": usage of " + pair.first);
+    Check(Sorted(expected.GetNodeChunks(pair.first)) ==
+              Sorted(actual.GetNodeChunks(pair.first)),
+          stage + ": chunks of " + pair.first);
+  }
+}
+
+// Снимок менеджера в файл и загрузка в новый менеджер
+bool SaveAndLoad(MetadataManager &source, const std::string &path,
+                 MetadataManager &target) {
+  SnapshotImageWriter writer;
+  source.ExportSnapshot(writer);
+  if (!writer.Write(path, 1)) {
+    return false;
+  }
+  auto image = std::make_shared<SnapshotImage>();
+  if (!image->Open(path)) {
+    return false;
+  }
+  target.LoadSnapshotImage(std::move(image));
+  return true;
+}
+
+} // namespace
+
+int main() {
+  fs::path directory = fs::temp_directory_path() / "snapshot_image_test";
+  std::error_code ec;
+  fs::remove_all(directory, ec);
+  fs::create_directories(directory);
+
+  MetadataManager original;
+  std::vector<std::string> nodes12 = {"node-1", "node-2"};
+  std::vector<std::string> nodes23 = {"node-2", "node-3"};
+  Check(Register(original, "a.bin",
+                 {MakeChunk(ChunkId(1), 0, 100, nodes12),
+                  MakeChunk(ChunkId(2), 1, 200, nodes23),
+                  MakeChunk(ChunkId(3), 2, 50, nodes12)}),
+        "register a.bin");
+  // Общий чанк с a.bin и повтор чанка внутри файла
+  Check(Register(original, "b.bin",
+                 {MakeChunk(ChunkId(2), 0, 200, nodes23),
+                  MakeChunk(ChunkId(4), 1, 10, {"node-3"}),
+                  MakeChunk(ChunkId(2), 2, 200, nodes23)}),
+        "register b.bin");
+  Check(Register(original, "c bin",
+                 {MakeChunk(UPPER_CHUNK_ID, 0, 30, nodes12),
+                  MakeChunk(ChunkId(3), 1, 50, nodes12)}),
+        "register c bin");
+  for (int i = 10; i < 40; ++i) {
+    Check(Register(original, "many-" + std::to_string(i),
+                   {MakeChunk(ChunkId(i), 0, 1000, {"node-4"})}),
+          "register many");
+  }
+
+  MetadataManager loaded;
+  Check(SaveAndLoad(original, (directory / "first.dat").string(), loaded),
+        "first snapshot");
+  ExpectSame(original, loaded, "loaded");
+
+  // Изменения переносят чанки и файлы из снимка в память
+  for (MetadataManager *manager : {&original, &loaded}) {
+    Check(manager->ReplaceChunkReplicas(ChunkId(2), {"node-2"}, "node-4"),
+          "replace replicas");
+  }
+  ExpectSame(original, loaded, "replaced");
+
+  for (MetadataManager *manager : {&original, &loaded}) {
+    Check(manager->MoveChunkReplica(UPPER_CHUNK_ID, "node-1", "node-3"),
+          "move replica");
+    Check(manager->DeleteFile("b.bin"), "delete b.bin");
+    Check(Register(*manager, "a.bin",
+                   {MakeChunk(ChunkId(3), 0, 50, nodes12),
+                    MakeChunk(ChunkId(5), 1, 70, nodes23)}),
+          "overwrite a.bin");
+  }
+  ExpectSame(original, loaded, "rewritten");
+
+  // Сверка инвентаря: часть чанков узла пропала, один лишний найден
+  InventoryReconciliation expectedResult = original.ReconcileNodeInventory(
+      "node-4", {ChunkId(10), ChunkId(11), ChunkId(2), ChunkId(3)}, 3);
+  InventoryReconciliation actualResult = loaded.ReconcileNodeInventory(
+      "node-4", {ChunkId(10), ChunkId(11), ChunkId(2), ChunkId(3)}, 3);
+  Check(expectedResult.missing.size() == actualResult.missing.size() &&
+            expectedResult.restored == actualResult.restored &&
+            expectedResult.surplus == actualResult.surplus &&
+            expectedResult.unknown == actualResult.unknown,
+        "reconcile result");
+  ExpectSame(original, loaded, "reconciled");
+
+  // Пакет: несколько изменений одного файла, два - одного чанка, перенос
+  // с узла, где реплики нет, не выполняется
+  std::vector<ReplicaChange> changes = {
+      {ChunkId(3), {"node-1"}, "node-5", false},
+      {ChunkId(5), {}, "node-1", false},
+      {ChunkId(3), {"node-5"}, "node-6", true},
+      {ChunkId(5), {"node-4"}, "node-6", true}};
+  for (MetadataManager *manager : {&original, &loaded}) {
+    std::vector<bool> applied;
+    Check(manager->ApplyReplicaChanges(changes, applied) &&
+              applied == std::vector<bool>({true, true, true, false}),
+          "replica batch");
+    std::shared_ptr<const FileMetadata> metadata =
+        manager->GetFileMetadata("a.bin");
+    Check(metadata != nullptr && metadata->chunks.size() == 2 &&
+              Sorted(metadata->chunks[0].nodeIds) ==
+                  std::vector<std::string>({"node-2", "node-4", "node-6"}) &&
+              Sorted(metadata->chunks[1].nodeIds) ==
+                  std::vector<std::string>({"node-1", "node-2", "node-3"}),
+          "replica batch in file");
+  }
+  ExpectSame(original, loaded, "batch");
+
+  // Снимок частично загруженного менеджера
+  MetadataManager reloaded;
+  Check(SaveAndLoad(loaded, (directory / "second.dat").string(), reloaded),
+        "second snapshot");
+  ExpectSame(original, reloaded, "reloaded");
+
+  // Испорченный снимок не открывается
+  std::string path = (directory / "second.dat").string();
+  std::FILE *file = std::fopen(path.c_str(), "r+b");
+  Check(file != nullptr, "open snapshot for corruption");
+  if (file != nullptr) {
+    std::fseek(file, -1, SEEK_END);
+    int last = std::fgetc(file);
+    std::fseek(file, -1, SEEK_END);
+    std::fputc(last ^ 0xFF, file);
+    std::fclose(file);
+    SnapshotImage image;
+    Check(!image.Open(path), "corrupted snapshot rejected");
+  }
+
+  fs::remove_all(directory, ec);
+  if (failures > 0) {
+    std::cerr << failures << " check(s) failed" << std::endl;
+    return 1;
+  }
+  std::cout << "snapshot_image_test: OK" << std::endl;
+  return 0;
+}